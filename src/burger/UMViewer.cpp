@@ -60,6 +60,13 @@ namespace burger
 	
 static bool is_raytracing_camp_ = true;
 
+// seconds of interactive render per frame
+static const double interactive_time_slice = 1.0 / 30.0;
+
+// adaptive subdivision by S key
+static const unsigned int adaptive_subdivision_level = 3;
+static const size_t adaptive_triangle_budget = 4000000;
+
 int UMViewer::width_(0);
 int UMViewer::height_(0);
 bool UMViewer::is_disable_update_(false);
@@ -451,6 +458,15 @@ bool UMViewer::on_paint()
 		return false;
 	}
 
+	// interactive render continues in every frame
+	if (rays_->is_interactive_rendering())
+	{
+		if (rays_->interactive_render(interactive_time_slice))
+		{
+			scene_->set_foreground_image(rays_->interactive_image());
+		}
+	}
+
 	if (drawer_->clear())
 	{
 		if (drawer_->update())
@@ -510,7 +526,12 @@ void UMViewer::on_keyboard(GLFWwindow * window,int key, int action)
 	{
 		if (action == GLFW_PRESS)
 		{
-			if (scene_->foreground_image())
+			if (rays_->is_interactive_rendering())
+			{
+				rays_->stop_interactive_render();
+				scene_->set_foreground_image(UMImagePtr());
+			}
+			else if (scene_->foreground_image())
 			{
 				scene_->set_foreground_image(UMImagePtr());
 			}
@@ -521,6 +542,22 @@ void UMViewer::on_keyboard(GLFWwindow * window,int key, int action)
 			}
 		}
 	}
+	else if (key == GLFW_KEY_I)
+	{
+		if (action == GLFW_PRESS)
+		{
+			// toggle interactive render
+			if (rays_->is_interactive_rendering())
+			{
+				rays_->stop_interactive_render();
+				scene_->set_foreground_image(UMImagePtr());
+			}
+			else
+			{
+				rays_->start_interactive_render(scene_->width(), scene_->height());
+			}
+		}
+	}
 	else if (key == GLFW_KEY_LEFT_ALT)
 	{
 		if (action == GLFW_PRESS)
@@ -625,6 +662,17 @@ void UMViewer::on_keyboard(GLFWwindow * window,int key, int action)
 			}
 		}
 	}
+	else if (key == GLFW_KEY_S)
+	{
+		if (action == GLFW_RELEASE)
+		{
+			// subdivide meshes by their size on screen for current camera
+			if (rays_->subdivide_adaptive(adaptive_subdivision_level, adaptive_triangle_budget))
+			{
+				rays_->restart_interactive_render(false);
+			}
+		}
+	}
 	else if (key == GLFW_KEY_LEFT && action == GLFW_PRESS)
 	{
 		set_current_frame(current_frame_ - 1);
@@ -677,6 +725,8 @@ void UMViewer::set_current_frame(int frame)
 	{
 		if (gui_) gui_->update();
 	}
+	// deformed geometry is not found by transforms
+	rays_->restart_interactive_render(true);
 }
 
 /**
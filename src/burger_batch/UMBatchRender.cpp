@@ -0,0 +1,705 @@
+/**
+ * @file UMBatchRender.cpp
+ * headless batch rendering
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMBatchRender.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#ifdef _OPENMP
+	#include <omp.h>
+#endif
+
+#include "UMStringUtil.h"
+#include "UMTime.h"
+#include "UMPath.h"
+#include "UMImage.h"
+#include "UMScene.h"
+#include "UMCamera.h"
+#include "UMResource.h"
+#include "UMSceneAccess.h"
+#include "UMTextureCache.h"
+#include "UMRenderParameter.h"
+#include "UMRenderStatistics.h"
+#include "UMRenderFarm.h"
+
+#ifdef WITH_ALEMBIC
+	#include "UMAbcIO.h"
+	#include "UMAbcScene.h"
+	#include "UMAbcSetting.h"
+#endif
+
+namespace
+{
+	using namespace umbase;
+
+	/**
+	 * lower case file extension with dot
+	 */
+	std::string extension(const std::string& path)
+	{
+		const std::string::size_type pos = path.rfind('.');
+		if (pos == std::string::npos) return std::string();
+		std::string ext = path.substr(pos);
+		std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+		return ext;
+	}
+
+	/**
+	 * image type from file extension
+	 */
+	umimage::UMImage::ImageType image_type(const std::string& path)
+	{
+		const std::string ext = extension(path);
+		if (ext == ".bmp") return umimage::UMImage::eImageTypeBMP_RGB;
+		if (ext == ".tga") return umimage::UMImage::eImageTypeTGA_RGBA;
+		return umimage::UMImage::eImageTypePNG_RGBA;
+	}
+
+	const char* renderer_name(umrt::UMRenderer::RendererType type)
+	{
+		switch (type)
+		{
+		case umrt::UMRenderer::eSimpleRayTracer: return "raytracer";
+		case umrt::UMRenderer::ePathTracer: return "pathtracer";
+		case umrt::UMRenderer::eToonRender: return "toon";
+		}
+		return "unknown";
+	}
+
+	/**
+	 * load a texture file, or an unpacked file of same name when it is not on disk
+	 */
+	umimage::UMImagePtr load_texture_image(const umstring& path)
+	{
+		if (umimage::UMImagePtr image = umimage::UMImage::load(path)) return image;
+		const umstring file_name = UMPath::get_file_name(path);
+		umresource::UMResource& resource = umresource::UMResource::instance();
+		for (size_t i = 0, size = resource.unpacked_name_list().size(); i < size; ++i)
+		{
+			if (UMPath::get_file_name(resource.unpacked_name_list().at(i)) == file_name)
+			{
+				return umimage::UMImage::load_from_memory(resource.unpacked_data_list().at(i));
+			}
+		}
+		return umimage::UMImagePtr();
+	}
+
+	int thread_count()
+	{
+#ifdef _OPENMP
+		return omp_get_max_threads();
+#else
+		return 1;
+#endif
+	}
+
+} // anonymouse namespace
+
+namespace burger
+{
+	using namespace umbase;
+
+/**
+ * a copy of scenes for a frame in flight
+ */
+class UMBatchRender::FrameSlot
+{
+	DISALLOW_COPY_AND_ASSIGN(FrameSlot);
+public:
+	enum State {
+		eSlotFree, ///< waiting for prefetch
+		eSlotReady, ///< prefetched. waiting for render.
+		eSlotFailed, ///< prefetch failed
+	};
+
+	FrameSlot()
+		: scene_access(std::make_shared<umrt::UMSceneAccess>())
+		, frame(0)
+		, bvh_time(0.0)
+		, is_built(false)
+		, state(eSlotFree)
+	{}
+
+	umdraw::UMScenePtr scene;
+	std::vector<umabc::UMAbcScenePtr> abc_scene_list;
+	umrt::UMSceneAccessPtr scene_access;
+	int frame;
+	double bvh_time;
+	bool is_built;
+	State state;
+};
+
+/**
+ * constructor
+ */
+UMBatchRender::UMBatchRender(const UMBatchSetting& setting)
+	: setting_(setting)
+	, is_cancelled_(false)
+	, load_time_(0.0)
+{
+#ifdef _OPENMP
+	if (setting_.thread_count > 0)
+	{
+		omp_set_num_threads(setting_.thread_count);
+	}
+#endif
+	if (setting_.texture_cache_size > 0)
+	{
+		umrt::UMTextureCache::instance().set_capacity(
+			static_cast<size_t>(setting_.texture_cache_size) * 1024 * 1024);
+	}
+}
+
+/**
+ * destructor
+ */
+UMBatchRender::~UMBatchRender()
+{
+	if (prefetch_thread_.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			is_cancelled_ = true;
+			condition_.notify_all();
+		}
+		prefetch_thread_.join();
+	}
+}
+
+/**
+ * load scenes
+ */
+bool UMBatchRender::load()
+{
+	const double start_time = UMTime::current_seconds();
+
+	slot_list_.clear();
+	const int slot_count = std::max(setting_.frames_in_flight, 1);
+	for (int i = 0; i < slot_count; ++i)
+	{
+		FrameSlotPtr slot(std::make_shared<FrameSlot>());
+		if (!load_slot(slot)) return false;
+		slot_list_.push_back(slot);
+		// static scenes are same for all frames
+		if (slot->abc_scene_list.empty()) break;
+	}
+	load_time_ = UMTime::current_seconds() - start_time;
+	return true;
+}
+
+/**
+ * load scenes to a slot
+ */
+bool UMBatchRender::load_slot(FrameSlotPtr slot)
+{
+	slot->scene = std::make_shared<umdraw::UMScene>(setting_.width, setting_.height);
+	for (size_t i = 0, size = setting_.scene_path_list.size(); i < size; ++i)
+	{
+		const std::string& path = setting_.scene_path_list[i];
+		const umstring utf16path = UMStringUtil::utf8_to_utf16(path);
+		const std::string ext = extension(path);
+		std::cerr << "load: " << path << std::endl;
+
+		if (ext == ".abc")
+		{
+#ifdef WITH_ALEMBIC
+			umabc::UMAbcIO abcio;
+			umabc::UMAbcSetting setting;
+			setting.set_reference_scene(slot->scene);
+			umabc::UMAbcScenePtr abc_scene = abcio.load(utf16path, setting);
+			if (!abc_scene) return false;
+			slot->abc_scene_list.push_back(abc_scene);
+#else
+			std::cerr << "alembic is not supported: " << path << std::endl;
+			return false;
+#endif
+		}
+		else if (ext == ".pack")
+		{
+			umresource::UMResource& resource = umresource::UMResource::instance();
+			const size_t first = resource.unpacked_data_list().size();
+			if (!resource.unpack_to_memory(utf16path)) return false;
+			for (size_t k = first, count = resource.unpacked_data_list().size(); k < count; ++k)
+			{
+				const std::string name = UMStringUtil::utf16_to_utf8(resource.unpacked_name_list().at(k));
+				if (extension(name) != ".bos") continue;
+				if (!slot->scene->load_from_memory(resource.unpacked_data_list().at(k))) return false;
+			}
+		}
+		else if (!slot->scene->load(utf16path))
+		{
+			return false;
+		}
+	}
+
+	// textures are loaded at first sampling
+	slot->scene_access->set_texture_loader(load_texture_image);
+	slot->scene_access->add_scene(slot->scene);
+#ifdef WITH_ALEMBIC
+	for (size_t i = 0, size = slot->abc_scene_list.size(); i < size; ++i)
+	{
+		slot->scene_access->add_abc_scene(slot->abc_scene_list[i]);
+	}
+	// use abc camera if exists
+	if (!slot->abc_scene_list.empty())
+	{
+		if (umdraw::UMCameraPtr camera = slot->abc_scene_list[0]->umdraw_camera(umstring()))
+		{
+			slot->scene->mutable_camera_list().at(0) = camera;
+		}
+	}
+#endif
+	// patches are tessellated by their size on screen when a ray reaches them
+	if (setting_.subdivision_level > 0)
+	{
+		slot->scene_access->subdivide_on_demand(setting_.subdivision_level);
+	}
+	slot->scene_access->geometry_cache()->set_capacity(
+		static_cast<size_t>(std::max(setting_.geometry_cache_size, 0)) * 1024 * 1024);
+	// textures are read from tiles only
+	if (setting_.texture_cache_size > 0)
+	{
+		slot->scene_access->release_texture_images();
+	}
+	return true;
+}
+
+/**
+ * move scenes of a slot to a frame
+ */
+bool UMBatchRender::update_frame(FrameSlotPtr slot, int frame)
+{
+	// static scenes need no rebuild
+	if (slot->is_built && slot->abc_scene_list.empty()) return true;
+#ifdef WITH_ALEMBIC
+	const double time = frame * 1000.0 / std::max(setting_.fps, 1);
+	for (size_t i = 0, size = slot->abc_scene_list.size(); i < size; ++i)
+	{
+		// out of range frames use the nearest sample
+		umabc::UMAbcScenePtr abc_scene = slot->abc_scene_list[i];
+		const double clamped = std::min(std::max(time, abc_scene->min_time()), abc_scene->max_time());
+		abc_scene->update(static_cast<unsigned long>(clamped));
+	}
+#endif
+	// levels follow the camera of this frame
+	if (setting_.adaptive_subdivision_level > 0)
+	{
+		slot->scene_access->subdivide_adaptive(
+			setting_.adaptive_subdivision_level,
+			static_cast<size_t>(std::max(setting_.triangle_budget, 0)));
+	}
+	slot->is_built = slot->scene_access->update_bvh();
+	return slot->is_built;
+}
+
+/**
+ * decode and build frames ahead of rendering
+ * @note alembic is decoded by this thread only
+ */
+void UMBatchRender::prefetch()
+{
+	const int slot_count = static_cast<int>(slot_list_.size());
+	for (int frame = setting_.start_frame; frame <= setting_.end_frame; ++frame)
+	{
+		FrameSlotPtr slot = slot_list_[(frame - setting_.start_frame) % slot_count];
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			while (slot->state != FrameSlot::eSlotFree && !is_cancelled_)
+			{
+				condition_.wait(lock);
+			}
+			if (is_cancelled_) return;
+		}
+
+		const double start_time = UMTime::current_seconds();
+		const bool result = update_frame(slot, frame);
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		slot->frame = frame;
+		slot->bvh_time = UMTime::current_seconds() - start_time;
+		slot->state = result ? FrameSlot::eSlotReady : FrameSlot::eSlotFailed;
+		condition_.notify_all();
+		if (!result) return;
+	}
+}
+
+/**
+ * render a frame progressively with checkpoints
+ */
+bool UMBatchRender::render_progressive(umrt::UMSceneAccessPtr scene_access, umrt::UMRenderParameter& parameter, int frame)
+{
+	// progressive state is kept in renderer, so each frame starts with a new one
+	umrt::UMRendererPtr renderer = umrt::UMRenderer::create(setting_.renderer_type);
+	if (!renderer) return false;
+	renderer->set_width(setting_.width);
+	renderer->set_height(setting_.height);
+	renderer->init();
+
+	const bool is_sequence = setting_.start_frame != setting_.end_frame;
+	const std::string path = frame_path(setting_.checkpoint_path, frame, is_sequence);
+	const umstring utf16path = UMStringUtil::utf8_to_utf16(path);
+	parameter.set_checkpoint_path(utf16path);
+	parameter.set_checkpoint_interval(std::max(setting_.checkpoint_interval, 1));
+	if (UMPath::exists(utf16path))
+	{
+		// never overwrite progress saved with other settings
+		if (!renderer->resume(utf16path, parameter))
+		{
+			std::cerr << "failed to resume, remove checkpoint to restart: " << path << std::endl;
+			return false;
+		}
+		std::cerr << "resume: " << path << std::endl;
+	}
+	while (renderer->progress_render(scene_access, parameter)) {}
+
+	// last passes are not mapped to the output image
+	if (!parameter.frame_buffer().resolve(
+		umrt::UMFrameBuffer::eLayerBeauty,
+		parameter.output_image(),
+		parameter.render_rect(setting_.width, setting_.height)))
+	{
+		return false;
+	}
+	if (parameter.is_denoise_enabled())
+	{
+		parameter.denoise(parameter.render_rect(setting_.width, setting_.height));
+	}
+	return true;
+}
+
+/**
+ * copy renderer statistics of a frame
+ */
+void UMBatchRender::set_statistics(const umrt::UMRenderStatistics& statistics, FrameTime& time)
+{
+	time.ray_count = statistics.ray_count();
+	time.rays_per_second = statistics.rays_per_second();
+	time.setup = statistics.setup_seconds();
+	time.shading = statistics.shading_seconds();
+	time.resolve = statistics.resolve_seconds();
+}
+
+/**
+ * write image of a frame
+ */
+bool UMBatchRender::write_image(umimage::UMImagePtr image, FrameTime& time) const
+{
+	const double start_time = UMTime::current_seconds();
+	const bool is_sequence = setting_.start_frame != setting_.end_frame;
+	const std::string path = frame_path(setting_.output_path, time.frame, is_sequence);
+	const bool result = umimage::UMImage::save(
+		UMStringUtil::utf8_to_utf16(path), image, image_type(path));
+	time.write = UMTime::current_seconds() - start_time;
+	if (!result)
+	{
+		std::cerr << "failed to write: " << path << std::endl;
+	}
+	return result;
+}
+
+/**
+ * render all frames
+ */
+bool UMBatchRender::render()
+{
+	if (slot_list_.empty()) return false;
+	frame_time_list_.clear();
+
+	umrt::UMRendererPtr renderer = umrt::UMRenderer::create(setting_.renderer_type);
+	if (!renderer) return false;
+	renderer->set_width(setting_.width);
+	renderer->set_height(setting_.height);
+	renderer->init();
+	// only path tracer saves and resumes progressive state
+	const bool is_checkpoint_enabled =
+		!setting_.checkpoint_path.empty() && setting_.renderer_type == umrt::UMRenderer::ePathTracer;
+	if (!setting_.checkpoint_path.empty() && !is_checkpoint_enabled)
+	{
+		std::cerr << "checkpoint needs pathtracer, rendered without checkpoints" << std::endl;
+	}
+
+	for (size_t i = 0, size = slot_list_.size(); i < size; ++i)
+	{
+		slot_list_[i]->state = FrameSlot::eSlotFree;
+	}
+	is_cancelled_ = false;
+	prefetch_thread_ = std::thread([this] { prefetch(); });
+
+	const int slot_count = static_cast<int>(slot_list_.size());
+	bool result = true;
+	for (int frame = setting_.start_frame; frame <= setting_.end_frame && result; ++frame)
+	{
+		FrameSlotPtr slot = slot_list_[(frame - setting_.start_frame) % slot_count];
+		FrameTime time;
+		time.frame = frame;
+		time.write = 0.0;
+
+		double start_time = UMTime::current_seconds();
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			while (slot->state == FrameSlot::eSlotFree)
+			{
+				condition_.wait(lock);
+			}
+			if (slot->state == FrameSlot::eSlotFailed) break;
+		}
+		time.wait = UMTime::current_seconds() - start_time;
+		time.bvh = slot->bvh_time;
+
+		start_time = UMTime::current_seconds();
+		umrt::UMRenderParameter parameter(setting_.width, setting_.height);
+		parameter.set_sample_count(setting_.sample_count);
+		parameter.set_light_sample_count(setting_.light_sample_count);
+		parameter.set_denoise_enabled(setting_.is_denoise_enabled);
+		parameter.set_irradiance_cache_enabled(setting_.is_irradiance_cache_enabled);
+		if (is_checkpoint_enabled)
+		{
+			result = render_progressive(slot->scene_access, parameter, frame);
+		}
+		else
+		{
+			result = renderer->render(slot->scene_access, parameter);
+		}
+		time.render = UMTime::current_seconds() - start_time;
+		set_statistics(parameter.statistics(), time);
+
+		// hand the slot back to prefetch
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			slot->state = FrameSlot::eSlotFree;
+			condition_.notify_all();
+		}
+		if (!result) break;
+
+		result = write_image(parameter.output_image(), time);
+		frame_time_list_.push_back(time);
+		std::cerr << "frame " << frame << " done" << std::endl;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		is_cancelled_ = true;
+		condition_.notify_all();
+	}
+	prefetch_thread_.join();
+	// a failed prefetch stops rendering
+	const size_t frame_count = static_cast<size_t>(setting_.end_frame - setting_.start_frame + 1);
+	return result && frame_time_list_.size() == frame_count;
+}
+
+/**
+ * render tiles for a coordinator
+ */
+bool UMBatchRender::run_worker(const std::string& address)
+{
+	if (slot_list_.empty()) return false;
+	frame_time_list_.clear();
+
+	// frames follow the coordinator, which may have finished frames before this worker joined
+	int frame = setting_.start_frame;
+	while (frame <= setting_.end_frame)
+	{
+		FrameTime time;
+		time.frame = frame;
+		time.wait = 0.0;
+		time.write = 0.0;
+
+		double start_time = UMTime::current_seconds();
+		if (!update_frame(slot_list_[0], frame)) return false;
+		time.bvh = UMTime::current_seconds() - start_time;
+
+		start_time = UMTime::current_seconds();
+		umrt::UMRenderWorker worker(slot_list_[0]->scene_access);
+		worker.set_frame(frame);
+		if (!worker.run(address)) return false;
+		time.render = UMTime::current_seconds() - start_time;
+
+		const int coordinator_frame = worker.coordinator_frame();
+		if (coordinator_frame < frame)
+		{
+			std::cerr << "coordinator is at frame " << coordinator_frame << ", behind frame " << frame << std::endl;
+			return false;
+		}
+		if (coordinator_frame > frame)
+		{
+			std::cerr << "frame " << frame << " skipped, coordinator is at frame " << coordinator_frame << std::endl;
+			frame = coordinator_frame;
+			continue;
+		}
+		frame_time_list_.push_back(time);
+		std::cerr << "frame " << frame << " rendered tiles: " << worker.rendered_tile_count() << std::endl;
+		++frame;
+	}
+	return true;
+}
+
+/**
+ * render by workers
+ */
+bool UMBatchRender::run_coordinator(const std::string& address)
+{
+	frame_time_list_.clear();
+
+	umrt::UMRenderCoordinator coordinator;
+	if (!coordinator.listen(address))
+	{
+		std::cerr << "failed to listen: " << address << std::endl;
+		return false;
+	}
+
+	// workers are kept connected across frames
+	for (int frame = setting_.start_frame; frame <= setting_.end_frame; ++frame)
+	{
+		FrameTime time;
+		time.frame = frame;
+		time.wait = 0.0;
+		time.bvh = 0.0;
+		time.write = 0.0;
+
+		const double start_time = UMTime::current_seconds();
+		umrt::UMRenderParameter parameter(setting_.width, setting_.height);
+		parameter.set_sample_count(setting_.sample_count);
+		parameter.set_light_sample_count(setting_.light_sample_count);
+		parameter.set_denoise_enabled(setting_.is_denoise_enabled);
+		parameter.set_irradiance_cache_enabled(setting_.is_irradiance_cache_enabled);
+		coordinator.set_frame(frame);
+		if (!coordinator.render(setting_.renderer_type, setting_.width, setting_.height, parameter))
+		{
+			std::cerr << "failed to render frame " << frame << std::endl;
+			return false;
+		}
+		time.render = UMTime::current_seconds() - start_time;
+		set_statistics(parameter.statistics(), time);
+		std::cerr << "frame " << frame << " workers: " << coordinator.worker_count()
+			<< ", reassigned tiles: " << coordinator.reassigned_tile_count() << std::endl;
+
+		const bool result = write_image(parameter.output_image(), time);
+		frame_time_list_.push_back(time);
+		if (!result) return false;
+	}
+	return true;
+}
+
+/**
+ * get image path of a frame
+ */
+std::string UMBatchRender::frame_path(const std::string& path, int frame, bool is_sequence)
+{
+	const std::string::size_type first = path.find('#');
+	if (first == std::string::npos)
+	{
+		if (!is_sequence) return path;
+		// insert frame number before extension
+		char number[32];
+		std::sprintf(number, "_%04d", frame);
+		const std::string::size_type dot = path.rfind('.');
+		const std::string::size_type slash = path.find_last_of("/\\");
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		{
+			return path + number;
+		}
+		return path.substr(0, dot) + number + path.substr(dot);
+	}
+	std::string::size_type last = path.find_first_not_of('#', first);
+	if (last == std::string::npos) last = path.size();
+	std::ostringstream stream;
+	stream << path.substr(0, first)
+		<< std::setw(static_cast<int>(last - first)) << std::setfill('0') << frame
+		<< path.substr(last);
+	return stream.str();
+}
+
+/**
+ * get timing report as json
+ */
+std::string UMBatchRender::report() const
+{
+	double total_wait = 0.0;
+	double total_bvh = 0.0;
+	double total_render = 0.0;
+	double total_write = 0.0;
+	double total_setup = 0.0;
+	double total_shading = 0.0;
+	double total_resolve = 0.0;
+	unsigned long long total_ray_count = 0;
+
+	std::ostringstream stream;
+	stream << std::fixed << std::setprecision(6);
+	stream << "{\"renderer\":\"" << renderer_name(setting_.renderer_type) << "\""
+		<< ",\"width\":" << setting_.width
+		<< ",\"height\":" << setting_.height
+		<< ",\"samples\":" << setting_.sample_count
+		<< ",\"threads\":" << thread_count()
+		<< ",\"frames_in_flight\":" << slot_list_.size()
+		<< ",\"texture_cache\":" << setting_.texture_cache_size
+		<< ",\"geometry_cache\":" << setting_.geometry_cache_size
+		<< ",\"subdivision\":" << setting_.subdivision_level
+		<< ",\"adaptive_subdivision\":" << setting_.adaptive_subdivision_level
+		<< ",\"triangle_budget\":" << setting_.triangle_budget
+		<< ",\"load\":" << load_time_
+		<< ",\"frames\":[";
+	for (size_t i = 0, size = frame_time_list_.size(); i < size; ++i)
+	{
+		const FrameTime& time = frame_time_list_[i];
+		if (i > 0) stream << ",";
+		stream << "{\"frame\":" << time.frame
+			<< ",\"wait\":" << time.wait
+			<< ",\"bvh\":" << time.bvh
+			<< ",\"render\":" << time.render
+			<< ",\"write\":" << time.write
+			<< ",\"setup\":" << time.setup
+			<< ",\"shading\":" << time.shading
+			<< ",\"resolve\":" << time.resolve
+			<< ",\"rays\":" << time.ray_count
+			<< ",\"rays_per_second\":" << time.rays_per_second << "}";
+		total_wait += time.wait;
+		total_bvh += time.bvh;
+		total_render += time.render;
+		total_write += time.write;
+		total_setup += time.setup;
+		total_shading += time.shading;
+		total_resolve += time.resolve;
+		total_ray_count += time.ray_count;
+	}
+	stream << "],\"total\":{\"load\":" << load_time_
+		<< ",\"wait\":" << total_wait
+		<< ",\"bvh\":" << total_bvh
+		<< ",\"render\":" << total_render
+		<< ",\"write\":" << total_write
+		<< ",\"setup\":" << total_setup
+		<< ",\"shading\":" << total_shading
+		<< ",\"resolve\":" << total_resolve
+		<< ",\"rays\":" << total_ray_count
+		<< ",\"rays_per_second\":" << (total_shading > 0.0 ? total_ray_count / total_shading : 0.0) << "}"
+		<< ",\"texture_misses\":" << umrt::UMTextureCache::instance().miss_count() << "}";
+	return stream.str();
+}
+
+/**
+ * write timing report
+ */
+bool UMBatchRender::write_report() const
+{
+	const std::string json = report();
+	std::cout << json << std::endl;
+	if (setting_.report_path.empty()) return true;
+
+	std::ofstream file(setting_.report_path.c_str());
+	if (!file) return false;
+	file << json << std::endl;
+	return file.good();
+}
+
+} // burger
@@ -0,0 +1,209 @@
+/**
+ * @file UMBatchRender.h
+ * headless batch rendering
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "UMMacro.h"
+#include "UMRenderer.h"
+
+namespace umimage
+{
+	class UMImage;
+	typedef std::shared_ptr<UMImage> UMImagePtr;
+} // umimage
+
+namespace umrt
+{
+	class UMRenderStatistics;
+} // umrt
+
+namespace burger
+{
+
+/**
+ * batch render setting
+ */
+class UMBatchSetting
+{
+public:
+	UMBatchSetting()
+		: renderer_type(umrt::UMRenderer::ePathTracer)
+		, width(800)
+		, height(600)
+		, sample_count(20)
+		, light_sample_count(1)
+		, thread_count(0)
+		, start_frame(0)
+		, end_frame(0)
+		, fps(30)
+		, frames_in_flight(2)
+		, texture_cache_size(0)
+		, geometry_cache_size(256)
+		, subdivision_level(0)
+		, adaptive_subdivision_level(0)
+		, triangle_budget(0)
+		, is_denoise_enabled(false)
+		, is_irradiance_cache_enabled(false)
+		, checkpoint_interval(8)
+		, output_path("out_####.png")
+	{}
+
+	~UMBatchSetting() {}
+
+	/// scene files (.bos, .abc, .pack)
+	std::vector<std::string> scene_path_list;
+	umrt::UMRenderer::RendererType renderer_type;
+	int width;
+	int height;
+	int sample_count;
+	int light_sample_count;
+	/// 0 uses all processors
+	int thread_count;
+	int start_frame;
+	int end_frame;
+	int fps;
+	/// frames prepared or rendered at once. each frame has its own copy of scenes.
+	int frames_in_flight;
+	/// megabytes of resident texture tiles. 0 keeps all tiles in memory.
+	int texture_cache_size;
+	/// megabytes of resident tessellated patches. 0 keeps all patches in memory.
+	int geometry_cache_size;
+	/// max level of meshes subdivided on demand. 0 renders base meshes.
+	int subdivision_level;
+	/// max level of meshes subdivided by their size on screen for each frame. 0 renders base meshes.
+	int adaptive_subdivision_level;
+	/// max triangles of the scene subdivided adaptively. 0 is unbounded.
+	int triangle_budget;
+	bool is_denoise_enabled;
+	bool is_irradiance_cache_enabled;
+	/// progressive passes between checkpoints
+	int checkpoint_interval;
+	/// '#' is replaced by zero padded frame number
+	std::string output_path;
+	/// timing report file. empty prints to stdout only.
+	std::string report_path;
+	/// checkpoint file of progressive rendering. '#' is replaced by frame number.
+	/// an existing checkpoint is resumed. empty renders without checkpoints.
+	std::string checkpoint_path;
+};
+
+/**
+ * headless batch renderer.
+ * loads scenes without any GL context, renders a frame range and writes images.
+ * alembic decoding and bvh building of next frames run on a background thread
+ * while current frame is rendered.
+ */
+class UMBatchRender
+{
+	DISALLOW_COPY_AND_ASSIGN(UMBatchRender);
+public:
+	explicit UMBatchRender(const UMBatchSetting& setting);
+
+	~UMBatchRender();
+
+	/**
+	 * load scenes
+	 * @retval success or failed
+	 */
+	bool load();
+
+	/**
+	 * render all frames and write images
+	 * @retval success or failed
+	 */
+	bool render();
+
+	/**
+	 * render tiles for a coordinator from start frame to end frame.
+	 * frames already finished by the coordinator are skipped.
+	 * @param [in] address coordinator address
+	 * @retval success or failed
+	 */
+	bool run_worker(const std::string& address);
+
+	/**
+	 * render all frames by workers and write images
+	 * @param [in] address listening address
+	 * @retval success or failed
+	 */
+	bool run_coordinator(const std::string& address);
+
+	/**
+	 * get timing report as json
+	 */
+	std::string report() const;
+
+	/**
+	 * write timing report to stdout and report file
+	 * @retval success or failed
+	 */
+	bool write_report() const;
+
+	/**
+	 * get image path of a frame
+	 */
+	static std::string frame_path(const std::string& path, int frame, bool is_sequence);
+
+private:
+	/**
+	 * time of a frame in seconds
+	 */
+	struct FrameTime
+	{
+		FrameTime()
+			: frame(0), wait(0), bvh(0), render(0), write(0)
+			, ray_count(0), rays_per_second(0), setup(0), shading(0), resolve(0)
+		{}
+
+		int frame;
+		/// time waited for prefetch
+		double wait;
+		double bvh;
+		double render;
+		double write;
+		/// statistics of the renderer
+		unsigned long long ray_count;
+		double rays_per_second;
+		double setup;
+		double shading;
+		double resolve;
+	};
+	typedef std::vector<FrameTime> FrameTimeList;
+
+	class FrameSlot;
+	typedef std::shared_ptr<FrameSlot> FrameSlotPtr;
+	typedef std::vector<FrameSlotPtr> FrameSlotList;
+
+	bool load_slot(FrameSlotPtr slot);
+	bool update_frame(FrameSlotPtr slot, int frame);
+	void prefetch();
+	bool render_progressive(umrt::UMSceneAccessPtr scene_access, umrt::UMRenderParameter& parameter, int frame);
+	static void set_statistics(const umrt::UMRenderStatistics& statistics, FrameTime& time);
+	bool write_image(umimage::UMImagePtr image, FrameTime& time) const;
+
+	UMBatchSetting setting_;
+	FrameSlotList slot_list_;
+
+	std::thread prefetch_thread_;
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	bool is_cancelled_;
+
+	double load_time_;
+	FrameTimeList frame_time_list_;
+};
+
+} // burger
@@ -0,0 +1,154 @@
+/**
+ * @file UMMain.cpp
+ * headless batch renderer
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <iostream>
+#include "UMBatchRender.h"
+
+namespace
+{
+	void print_usage()
+	{
+		std::cerr
+			<< "usage: burger_batch [options] scene...\n"
+			<< "  scene                  .bos, .abc or .pack\n"
+			<< "  --renderer <type>      raytracer, pathtracer or toon (pathtracer)\n"
+			<< "  --size <w> <h>         resolution (800 600)\n"
+			<< "  --samples <n>          samples per pixel (20)\n"
+			<< "  --light-samples <n>    light samples (1)\n"
+			<< "  --threads <n>          render threads, 0 uses all (0)\n"
+			<< "  --frames <start> <end> alembic frame range (0 0)\n"
+			<< "  --fps <n>              frames per second of alembic time (30)\n"
+			<< "  --frames-in-flight <n> frames prefetched while rendering, 1 disables (2)\n"
+			<< "  --texture-cache <mb>   resident texture tiles, 0 keeps all in memory (0)\n"
+			<< "  --geometry-cache <mb>  resident tessellated patches, 0 keeps all in memory (256)\n"
+			<< "  --subdivide <level>    subdivide meshes on demand up to the level (0)\n"
+			<< "  --subdivide-adaptive <level> <budget> subdivide meshes by size on screen, budget 0 is unbounded\n"
+			<< "  --denoise              denoise output\n"
+			<< "  --irradiance-cache     interpolate diffuse interreflection (pathtracer)\n"
+			<< "  --output <path>        '#' is replaced by frame number (out_####.png)\n"
+			<< "  --report <path>        write timing report json to file\n"
+			<< "  --checkpoint <path>    save progressive state, resume if exists (pathtracer)\n"
+			<< "  --checkpoint-interval <n> passes between checkpoints (8)\n"
+			<< "  --coordinator <addr>   render frames by workers (host:port or unix:/path)\n"
+			<< "  --worker <addr>        render tiles for a coordinator\n";
+	}
+
+	bool parse_renderer(const std::string& name, umrt::UMRenderer::RendererType& type)
+	{
+		if (name == "raytracer") { type = umrt::UMRenderer::eSimpleRayTracer; return true; }
+		if (name == "pathtracer") { type = umrt::UMRenderer::ePathTracer; return true; }
+		if (name == "toon") { type = umrt::UMRenderer::eToonRender; return true; }
+		return false;
+	}
+
+} // anonymouse namespace
+
+// main
+int main(int argc, char** argv)
+{
+	burger::UMBatchSetting setting;
+	std::string coordinator_address;
+	std::string worker_address;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg(argv[i]);
+		const int rest = argc - i - 1;
+		if (arg == "--renderer" && rest >= 1)
+		{
+			if (!parse_renderer(argv[++i], setting.renderer_type))
+			{
+				print_usage();
+				return 1;
+			}
+		}
+		else if (arg == "--size" && rest >= 2)
+		{
+			setting.width = std::atoi(argv[++i]);
+			setting.height = std::atoi(argv[++i]);
+		}
+		else if (arg == "--samples" && rest >= 1) { setting.sample_count = std::atoi(argv[++i]); }
+		else if (arg == "--light-samples" && rest >= 1) { setting.light_sample_count = std::atoi(argv[++i]); }
+		else if (arg == "--threads" && rest >= 1) { setting.thread_count = std::atoi(argv[++i]); }
+		else if (arg == "--frames" && rest >= 2)
+		{
+			setting.start_frame = std::atoi(argv[++i]);
+			setting.end_frame = std::atoi(argv[++i]);
+		}
+		else if (arg == "--fps" && rest >= 1) { setting.fps = std::atoi(argv[++i]); }
+		else if (arg == "--frames-in-flight" && rest >= 1) { setting.frames_in_flight = std::atoi(argv[++i]); }
+		else if (arg == "--texture-cache" && rest >= 1) { setting.texture_cache_size = std::atoi(argv[++i]); }
+		else if (arg == "--geometry-cache" && rest >= 1) { setting.geometry_cache_size = std::atoi(argv[++i]); }
+		else if (arg == "--subdivide" && rest >= 1) { setting.subdivision_level = std::atoi(argv[++i]); }
+		else if (arg == "--subdivide-adaptive" && rest >= 2)
+		{
+			setting.adaptive_subdivision_level = std::atoi(argv[++i]);
+			setting.triangle_budget = std::atoi(argv[++i]);
+		}
+		else if (arg == "--denoise") { setting.is_denoise_enabled = true; }
+		else if (arg == "--irradiance-cache") { setting.is_irradiance_cache_enabled = true; }
+		else if (arg == "--output" && rest >= 1) { setting.output_path = argv[++i]; }
+		else if (arg == "--report" && rest >= 1) { setting.report_path = argv[++i]; }
+		else if (arg == "--checkpoint" && rest >= 1) { setting.checkpoint_path = argv[++i]; }
+		else if (arg == "--checkpoint-interval" && rest >= 1) { setting.checkpoint_interval = std::atoi(argv[++i]); }
+		else if (arg == "--coordinator" && rest >= 1) { coordinator_address = argv[++i]; }
+		else if (arg == "--worker" && rest >= 1) { worker_address = argv[++i]; }
+		else if (arg.compare(0, 2, "--") == 0)
+		{
+			print_usage();
+			return 1;
+		}
+		else
+		{
+			setting.scene_path_list.push_back(arg);
+		}
+	}
+
+	if (setting.width <= 0 || setting.height <= 0 || setting.end_frame < setting.start_frame)
+	{
+		print_usage();
+		return 1;
+	}
+
+	burger::UMBatchRender batch(setting);
+	bool result = false;
+	if (!coordinator_address.empty())
+	{
+		// the coordinator needs no scene
+		result = batch.run_coordinator(coordinator_address);
+	}
+	else
+	{
+		if (setting.scene_path_list.empty())
+		{
+			print_usage();
+			return 1;
+		}
+		if (!batch.load())
+		{
+			std::cerr << "failed to load scene" << std::endl;
+			return 1;
+		}
+		if (!worker_address.empty())
+		{
+			result = batch.run_worker(worker_address);
+		}
+		else
+		{
+			result = batch.render();
+		}
+	}
+
+	batch.write_report();
+	return result ? 0 : 1;
+}
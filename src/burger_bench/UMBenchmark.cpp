@@ -0,0 +1,622 @@
+/**
+ * @file UMBenchmark.cpp
+ * benchmark suite of rays
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMBenchmark.h"
+
+#include <cstdio>
+#include <cmath>
+#include <cfloat>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <random>
+
+#ifdef _OPENMP
+	#include <omp.h>
+#endif
+
+#include "UMStringUtil.h"
+#include "UMPath.h"
+#include "UMTime.h"
+#include "UMImage.h"
+#include "UMScene.h"
+#include "UMCamera.h"
+#include "UMLight.h"
+#include "UMMesh.h"
+#include "UMMeshGroup.h"
+#include "UMMaterial.h"
+#include "UMRay.h"
+#include "UMShaderParameter.h"
+#include "UMTriangle.h"
+#include "UMBvh.h"
+#include "UMSceneAccess.h"
+#include "UMRenderer.h"
+#include "UMRenderParameter.h"
+
+namespace
+{
+	using namespace umbase;
+
+	typedef std::vector<umrt::UMRay> RayList;
+
+	// offset of secondary ray origins from surfaces
+	const double ray_offset = 1.0e-4;
+
+	int thread_count()
+	{
+#ifdef _OPENMP
+		return omp_get_max_threads();
+#else
+		return 1;
+#endif
+	}
+
+	/**
+	 * json string with escapes
+	 */
+	std::string json_string(const std::string& src)
+	{
+		std::string dst("\"");
+		for (size_t i = 0, size = src.size(); i < size; ++i)
+		{
+			const char c = src[i];
+			if (c == '"' || c == '\\') dst += '\\';
+			dst += c;
+		}
+		return dst + "\"";
+	}
+
+	/**
+	 * create a height field scene facing the default camera
+	 * @param [in] triangle_count number of triangles
+	 * @param [in] width scene width
+	 * @param [in] height scene height
+	 */
+	umdraw::UMScenePtr create_height_field_scene(size_t triangle_count, int width, int height)
+	{
+		const int division = std::max(1, static_cast<int>(sqrt(triangle_count / 2.0)));
+		const double size = 40.0;
+
+		umdraw::UMMeshPtr mesh(std::make_shared<umdraw::UMMesh>());
+		umdraw::UMMesh::Vec3dList& vertex_list = mesh->mutable_vertex_list();
+		vertex_list.reserve((division + 1) * (division + 1));
+		for (int j = 0; j <= division; ++j)
+		{
+			for (int i = 0; i <= division; ++i)
+			{
+				const double x = size * i / division - size * 0.5;
+				const double y = size * j / division - size * 0.25;
+				const double z =
+					1.5 * sin(x * 0.7) * cos(y * 0.5) +
+					0.5 * sin(x * 3.1 + y * 2.3) - 5.0;
+				vertex_list.push_back(UMVec3d(x, y, z));
+			}
+		}
+		umdraw::UMMesh::Vec3iList& face_list = mesh->mutable_face_list();
+		face_list.reserve(division * division * 2);
+		for (int j = 0; j < division; ++j)
+		{
+			for (int i = 0; i < division; ++i)
+			{
+				const int a = j * (division + 1) + i;
+				const int b = a + 1;
+				const int c = a + (division + 1);
+				const int d = c + 1;
+				face_list.push_back(UMVec3i(a, b, c));
+				face_list.push_back(UMVec3i(b, d, c));
+			}
+		}
+		umdraw::UMMaterialPtr material = umdraw::UMMaterial::default_material();
+		material->set_polygon_count(static_cast<int>(face_list.size()));
+		mesh->mutable_material_list().push_back(material);
+		mesh->create_normals(true);
+		mesh->update_box();
+
+		umdraw::UMMeshGroupPtr group(std::make_shared<umdraw::UMMeshGroup>());
+		group->mutable_mesh_list().push_back(mesh);
+		umdraw::UMScenePtr scene(std::make_shared<umdraw::UMScene>(width, height));
+		scene->mutable_mesh_group_list().push_back(group);
+		scene->mutable_light_list().push_back(std::make_shared<umdraw::UMLight>(UMVec3d(0, 40, 30)));
+		return scene;
+	}
+
+	/**
+	 * cosine weighted direction around normal
+	 */
+	UMVec3d cosine_direction(const UMVec3d& normal, double r1, double r2)
+	{
+		UMVec3d u;
+		if (fabs(normal.x) > 0.1) {
+			u = UMVec3d(0, 1, 0).cross(normal).normalized();
+		} else {
+			u = UMVec3d(1, 0, 0).cross(normal).normalized();
+		}
+		const UMVec3d v = normal.cross(u);
+		const double phi = 2.0 * M_PI * r1;
+		const double r = sqrt(r2);
+		return (u * (cos(phi) * r) + v * (sin(phi) * r) + normal * sqrt(1.0 - r2)).normalized();
+	}
+
+	/**
+	 * intersect a ray set with bvh
+	 * @param [in] bvh bvh
+	 * @param [in] ray_list rays
+	 * @param [in] is_closest find closest hits, or any hits
+	 * @retval number of hits
+	 */
+	unsigned long long intersect_ray_set(umrt::UMBvhPtr bvh, const RayList& ray_list, bool is_closest)
+	{
+		const int ray_count = static_cast<int>(ray_list.size());
+		long long hit_count = 0;
+#pragma omp parallel for schedule(dynamic, 256) reduction(+:hit_count)
+		for (int i = 0; i < ray_count; ++i)
+		{
+			if (is_closest)
+			{
+				umrt::UMShaderParameter parameter;
+				if (bvh->intersects(ray_list[i], parameter)) ++hit_count;
+			}
+			else
+			{
+				if (bvh->intersects(ray_list[i])) ++hit_count;
+			}
+		}
+		return static_cast<unsigned long long>(hit_count);
+	}
+
+	/**
+	 * intersect all rays with all triangles
+	 * @retval number of hits
+	 */
+	unsigned long long intersect_triangles(
+		const std::vector<UMVec3d>& vertex_list,
+		const RayList& ray_list,
+		bool is_closest)
+	{
+		const int ray_count = static_cast<int>(ray_list.size());
+		const int triangle_count = static_cast<int>(vertex_list.size() / 3);
+		long long hit_count = 0;
+#pragma omp parallel for schedule(static) reduction(+:hit_count)
+		for (int i = 0; i < ray_count; ++i)
+		{
+			const umrt::UMRay& ray = ray_list[i];
+			for (int k = 0; k < triangle_count; ++k)
+			{
+				const UMVec3d& v1 = vertex_list[k * 3 + 0];
+				const UMVec3d& v2 = vertex_list[k * 3 + 1];
+				const UMVec3d& v3 = vertex_list[k * 3 + 2];
+				if (is_closest)
+				{
+					umrt::UMShaderParameter parameter;
+					if (umrt::UMTriangle::intersects(v1, v2, v3, ray, parameter)) ++hit_count;
+				}
+				else
+				{
+					if (umrt::UMTriangle::intersects(v1, v2, v3, ray)) ++hit_count;
+				}
+			}
+		}
+		return static_cast<unsigned long long>(hit_count);
+	}
+
+} // anonymouse namespace
+
+namespace burger
+{
+	using namespace umbase;
+
+/**
+ * constructor
+ */
+UMBenchmark::UMBenchmark(const UMBenchmarkSetting& setting)
+	: setting_(setting)
+{
+#ifdef _OPENMP
+	if (setting_.thread_count > 0)
+	{
+		omp_set_num_threads(setting_.thread_count);
+	}
+#endif
+	setting_.repeat_count = std::max(setting_.repeat_count, 1);
+}
+
+/**
+ * add a run to timing
+ */
+void UMBenchmark::add_run(Timing& timing, double seconds, int run) const
+{
+	if (run == 0 || seconds < timing.best)
+	{
+		timing.best = seconds;
+	}
+	timing.mean += seconds / setting_.repeat_count;
+}
+
+/**
+ * run all benchmarks
+ */
+bool UMBenchmark::run()
+{
+	scene_result_list_.clear();
+	kernel_result_list_.clear();
+	image_result_list_.clear();
+	bool result = true;
+
+	if (setting_.is_standard_scene_enabled)
+	{
+		// bundled assets. exported next to the .blend files.
+		const char* asset_list[] = { "cornellbox.bos", "monkey2.bos" };
+		for (int i = 0; i < 2; ++i)
+		{
+			SceneResult scene_result;
+			scene_result.name = asset_list[i];
+			const umstring path = UMPath::resource_absolute_path(UMStringUtil::utf8_to_utf16(asset_list[i]));
+			if (UMPath::exists(path))
+			{
+				const double start_time = UMTime::current_seconds();
+				umdraw::UMScenePtr scene(std::make_shared<umdraw::UMScene>(setting_.width, setting_.height));
+				if (scene->load(path))
+				{
+					scene_result.load_time = UMTime::current_seconds() - start_time;
+					run_scene(scene, scene_result);
+				}
+			}
+			if (!scene_result.is_loaded)
+			{
+				std::cerr << "skip: " << asset_list[i] << std::endl;
+			}
+			scene_result_list_.push_back(scene_result);
+		}
+
+		// procedural meshes
+		const size_t triangle_count_list[] = { 10000, 100000, 1000000, 10000000 };
+		for (int i = 0; i < 4; ++i)
+		{
+			const size_t triangle_count = triangle_count_list[i];
+			if (triangle_count > setting_.max_triangle_count) break;
+			SceneResult scene_result;
+			std::ostringstream name;
+			name << "height_field_" << triangle_count;
+			scene_result.name = name.str();
+			const double start_time = UMTime::current_seconds();
+			umdraw::UMScenePtr scene = create_height_field_scene(triangle_count, setting_.width, setting_.height);
+			scene_result.load_time = UMTime::current_seconds() - start_time;
+			run_scene(scene, scene_result);
+			scene_result_list_.push_back(scene_result);
+		}
+	}
+
+	for (size_t i = 0, size = setting_.scene_path_list.size(); i < size; ++i)
+	{
+		const std::string& path = setting_.scene_path_list[i];
+		SceneResult scene_result;
+		scene_result.name = path;
+		const double start_time = UMTime::current_seconds();
+		umdraw::UMScenePtr scene(std::make_shared<umdraw::UMScene>(setting_.width, setting_.height));
+		if (scene->load(UMStringUtil::utf8_to_utf16(path)))
+		{
+			scene_result.load_time = UMTime::current_seconds() - start_time;
+			run_scene(scene, scene_result);
+		}
+		if (!scene_result.is_loaded)
+		{
+			std::cerr << "failed to load scene: " << path << std::endl;
+			result = false;
+		}
+		scene_result_list_.push_back(scene_result);
+	}
+
+	run_triangle_kernel();
+	run_image_conversion();
+	return result;
+}
+
+/**
+ * run benchmarks of a scene
+ */
+bool UMBenchmark::run_scene(umdraw::UMScenePtr scene, SceneResult& result)
+{
+	std::cerr << "scene: " << result.name << std::endl;
+	umrt::UMSceneAccessPtr scene_access(std::make_shared<umrt::UMSceneAccess>());
+	scene_access->add_scene(scene);
+	result.triangle_count = scene_access->primitive_list().size();
+
+	for (int run = 0; run < setting_.repeat_count; ++run)
+	{
+		const double start_time = UMTime::current_seconds();
+		if (!scene_access->update_bvh()) return false;
+		add_run(result.bvh_time, UMTime::current_seconds() - start_time, run);
+	}
+	result.is_loaded = true;
+
+	run_ray_sets(scene_access, result);
+	if (setting_.is_render_enabled)
+	{
+		run_render(scene_access, result);
+	}
+	return true;
+}
+
+/**
+ * measure traversal of primary, shadow and diffuse ray sets
+ */
+void UMBenchmark::run_ray_sets(umrt::UMSceneAccessPtr scene_access, SceneResult& result)
+{
+	umdraw::UMScenePtr scene = scene_access->scene();
+	umrt::UMBvhPtr bvh = scene_access->bvh();
+	if (!scene || !scene->camera() || !bvh) return;
+	if (!scene_access->update_camera_sampler()) return;
+
+	// primary rays through pixel centers
+	const int width = setting_.width;
+	const int height = setting_.height;
+	RayList primary_list(width * height);
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			scene_access->camera_sampler().generate_ray(primary_list[y * width + x], UMVec2d(x + 0.5, y + 0.5));
+		}
+	}
+
+	// shadow and diffuse rays from primary hits
+	const UMVec3d light_position = scene->light_list().empty() ?
+		scene->camera()->position() : scene->light_list().front()->position();
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	RayList shadow_list;
+	RayList diffuse_list;
+	for (size_t i = 0, size = primary_list.size(); i < size; ++i)
+	{
+		const umrt::UMRay& ray = primary_list[i];
+		umrt::UMShaderParameter parameter;
+		if (!bvh->intersects(ray, parameter)) continue;
+		UMVec3d normal = parameter.normal;
+		if (normal.dot(ray.direction()) > 0.0) normal = -normal;
+		const UMVec3d origin = parameter.intersect_point + normal * ray_offset;
+
+		const UMVec3d to_light = light_position - origin;
+		const double distance = to_light.length();
+		if (distance > ray_offset)
+		{
+			umrt::UMRay shadow_ray(origin, to_light / distance);
+			shadow_ray.set_tmax(distance * (1.0 - FLT_EPSILON));
+			shadow_list.push_back(shadow_ray);
+		}
+		const double r1 = uniform(random);
+		const double r2 = uniform(random);
+		diffuse_list.push_back(umrt::UMRay(origin, cosine_direction(normal, r1, r2)));
+	}
+
+	const char* name_list[] = { "primary", "shadow", "diffuse" };
+	const RayList* ray_set_list[] = { &primary_list, &shadow_list, &diffuse_list };
+	for (int i = 0; i < 3; ++i)
+	{
+		ThroughputResult ray_set;
+		ray_set.name = name_list[i];
+		ray_set.count = ray_set_list[i]->size();
+		// shadow rays need any hit only
+		const bool is_closest = (ray_set_list[i] != &shadow_list);
+		for (int run = 0; run < setting_.repeat_count; ++run)
+		{
+			const double start_time = UMTime::current_seconds();
+			ray_set.hit_count = intersect_ray_set(bvh, *ray_set_list[i], is_closest);
+			add_run(ray_set.time, UMTime::current_seconds() - start_time, run);
+		}
+		result.ray_set_list.push_back(ray_set);
+	}
+}
+
+/**
+ * measure a full render by the path tracer
+ */
+void UMBenchmark::run_render(umrt::UMSceneAccessPtr scene_access, SceneResult& result)
+{
+	umrt::UMRendererPtr renderer = umrt::UMRenderer::create(umrt::UMRenderer::ePathTracer);
+	if (!renderer) return;
+	renderer->set_width(setting_.width);
+	renderer->set_height(setting_.height);
+	renderer->init();
+
+	umrt::UMRenderParameter parameter(setting_.width, setting_.height);
+	parameter.set_sample_count(setting_.sample_count);
+	const double start_time = UMTime::current_seconds();
+	if (!renderer->render(scene_access, parameter)) return;
+	result.render_time = UMTime::current_seconds() - start_time;
+
+	const umrt::UMRenderStatistics& statistics = parameter.statistics();
+	result.primary_ray_count = statistics.primary_ray_count();
+	result.shadow_ray_count = statistics.shadow_ray_count();
+	result.indirect_ray_count = statistics.indirect_ray_count();
+	result.rays_per_second = statistics.rays_per_second();
+	result.shading_time = statistics.shading_seconds();
+	result.resolve_time = statistics.resolve_seconds();
+}
+
+/**
+ * measure ray triangle intersection without bvh
+ */
+void UMBenchmark::run_triangle_kernel()
+{
+	const int triangle_count = 1024;
+	const int ray_count = 4096;
+	std::mt19937 random(5678);
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+	// small triangles in a unit cube
+	std::vector<UMVec3d> vertex_list;
+	vertex_list.reserve(triangle_count * 3);
+	for (int i = 0; i < triangle_count; ++i)
+	{
+		const UMVec3d center(uniform(random), uniform(random), uniform(random));
+		for (int k = 0; k < 3; ++k)
+		{
+			const UMVec3d offset(uniform(random) - 0.5, uniform(random) - 0.5, uniform(random) - 0.5);
+			vertex_list.push_back(center + offset * 0.2);
+		}
+	}
+	// rays from around the cube to points in it
+	RayList ray_list;
+	ray_list.reserve(ray_count);
+	for (int i = 0; i < ray_count; ++i)
+	{
+		const UMVec3d origin(uniform(random) * 3.0 - 1.0, uniform(random) * 3.0 - 1.0, -1.0);
+		const UMVec3d target(uniform(random), uniform(random), uniform(random));
+		ray_list.push_back(umrt::UMRay(origin, (target - origin).normalized()));
+	}
+
+	const char* name_list[] = { "closest", "any" };
+	for (int i = 0; i < 2; ++i)
+	{
+		ThroughputResult kernel;
+		kernel.name = name_list[i];
+		kernel.count = static_cast<unsigned long long>(triangle_count) * ray_count;
+		for (int run = 0; run < setting_.repeat_count; ++run)
+		{
+			const double start_time = UMTime::current_seconds();
+			kernel.hit_count = intersect_triangles(vertex_list, ray_list, i == 0);
+			add_run(kernel.time, UMTime::current_seconds() - start_time, run);
+		}
+		kernel_result_list_.push_back(kernel);
+	}
+}
+
+/**
+ * measure image conversion
+ */
+void UMBenchmark::run_image_conversion()
+{
+	const int width = setting_.width;
+	const int height = setting_.height;
+	umimage::UMImagePtr image(std::make_shared<umimage::UMImage>());
+	image->init(width, height);
+	umimage::UMImage::ImageBuffer& buffer = image->mutable_list();
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			buffer[y * width + x] = UMVec4d(x / (double)width, y / (double)height, 0.5, 1.0);
+		}
+	}
+
+	const char* name_list[] = { "r8g8b8a8", "b8g8r8", "flip" };
+	for (int i = 0; i < 3; ++i)
+	{
+		ThroughputResult conversion;
+		conversion.name = name_list[i];
+		conversion.count = static_cast<unsigned long long>(width) * height;
+		for (int run = 0; run < setting_.repeat_count; ++run)
+		{
+			const double start_time = UMTime::current_seconds();
+			if (i == 0)
+			{
+				umimage::UMImage::R8G8B8A8Buffer dst;
+				image->create_r8g8b8a8_buffer(dst);
+			}
+			else if (i == 1)
+			{
+				umimage::UMImage::B8G8R8Buffer dst;
+				image->create_b8g8r8_buffer(dst);
+			}
+			else
+			{
+				umimage::UMImagePtr dst = image->create_flip_image(false, true);
+			}
+			add_run(conversion.time, UMTime::current_seconds() - start_time, run);
+		}
+		image_result_list_.push_back(conversion);
+	}
+}
+
+/**
+ * get report as json
+ */
+std::string UMBenchmark::report() const
+{
+	std::ostringstream stream;
+	stream << std::fixed << std::setprecision(6);
+	stream << "{\"threads\":" << thread_count()
+		<< ",\"width\":" << setting_.width
+		<< ",\"height\":" << setting_.height
+		<< ",\"samples\":" << setting_.sample_count
+		<< ",\"repeat\":" << setting_.repeat_count
+		<< ",\"scenes\":[";
+	for (size_t i = 0, size = scene_result_list_.size(); i < size; ++i)
+	{
+		const SceneResult& scene = scene_result_list_[i];
+		if (i > 0) stream << ",";
+		stream << "{\"name\":" << json_string(scene.name)
+			<< ",\"loaded\":" << (scene.is_loaded ? "true" : "false");
+		if (scene.is_loaded)
+		{
+			stream << ",\"triangles\":" << scene.triangle_count
+				<< ",\"load\":" << scene.load_time
+				<< ",\"bvh\":{\"best\":" << scene.bvh_time.best << ",\"mean\":" << scene.bvh_time.mean << "}"
+				<< ",\"rays\":" << throughput_report(scene.ray_set_list);
+			if (setting_.is_render_enabled)
+			{
+				stream << ",\"render\":{\"time\":" << scene.render_time
+					<< ",\"primary\":" << scene.primary_ray_count
+					<< ",\"shadow\":" << scene.shadow_ray_count
+					<< ",\"indirect\":" << scene.indirect_ray_count
+					<< ",\"rays_per_second\":" << scene.rays_per_second
+					<< ",\"shading\":" << scene.shading_time
+					<< ",\"resolve\":" << scene.resolve_time << "}";
+			}
+		}
+		stream << "}";
+	}
+	stream << "],\"triangle_kernel\":" << throughput_report(kernel_result_list_)
+		<< ",\"image\":" << throughput_report(image_result_list_) << "}";
+	return stream.str();
+}
+
+/**
+ * get json array of throughput results
+ */
+std::string UMBenchmark::throughput_report(const ThroughputResultList& result_list)
+{
+	std::ostringstream stream;
+	stream << std::fixed << std::setprecision(6);
+	stream << "[";
+	for (size_t i = 0, size = result_list.size(); i < size; ++i)
+	{
+		const ThroughputResult& result = result_list[i];
+		const double per_second = result.time.best > 0.0 ? result.count / result.time.best : 0.0;
+		if (i > 0) stream << ",";
+		stream << "{\"name\":" << json_string(result.name)
+			<< ",\"count\":" << result.count
+			<< ",\"hits\":" << result.hit_count
+			<< ",\"best\":" << result.time.best
+			<< ",\"mean\":" << result.time.mean
+			<< ",\"per_second\":" << per_second << "}";
+	}
+	stream << "]";
+	return stream.str();
+}
+
+/**
+ * write report
+ */
+bool UMBenchmark::write_report() const
+{
+	const std::string json = report();
+	std::cout << json << std::endl;
+	if (setting_.report_path.empty()) return true;
+
+	std::ofstream file(setting_.report_path.c_str());
+	if (!file) return false;
+	file << json << std::endl;
+	return file.good();
+}
+
+} // burger
@@ -0,0 +1,177 @@
+/**
+ * @file UMBenchmark.h
+ * benchmark suite of rays
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "UMMacro.h"
+
+namespace umdraw
+{
+	class UMScene;
+	typedef std::shared_ptr<UMScene> UMScenePtr;
+} // umdraw
+
+namespace umrt
+{
+	class UMSceneAccess;
+	typedef std::shared_ptr<UMSceneAccess> UMSceneAccessPtr;
+} // umrt
+
+namespace burger
+{
+
+/**
+ * benchmark setting
+ */
+class UMBenchmarkSetting
+{
+public:
+	UMBenchmarkSetting()
+		: width(640)
+		, height(480)
+		, sample_count(4)
+		, repeat_count(3)
+		, thread_count(0)
+		, max_triangle_count(10000000)
+		, is_standard_scene_enabled(true)
+		, is_render_enabled(true)
+	{}
+
+	~UMBenchmarkSetting() {}
+
+	/// additional scene files
+	std::vector<std::string> scene_path_list;
+	/// resolution of ray sets and renders
+	int width;
+	int height;
+	/// samples per pixel of full renders
+	int sample_count;
+	/// runs of each measurement. best and mean are reported.
+	int repeat_count;
+	/// 0 uses all processors
+	int thread_count;
+	/// procedural meshes over this are skipped
+	size_t max_triangle_count;
+	/// bundled and procedural scenes
+	bool is_standard_scene_enabled;
+	bool is_render_enabled;
+	/// report file. empty prints to stdout only.
+	std::string report_path;
+};
+
+/**
+ * benchmark suite.
+ * measures bvh build, traversal of primary, shadow and diffuse ray sets,
+ * triangle intersection kernels, image conversion and full renders,
+ * then reports them as json for regression tracking.
+ */
+class UMBenchmark
+{
+	DISALLOW_COPY_AND_ASSIGN(UMBenchmark);
+public:
+	explicit UMBenchmark(const UMBenchmarkSetting& setting);
+
+	~UMBenchmark() {}
+
+	/**
+	 * run all benchmarks
+	 * @retval success or failed
+	 */
+	bool run();
+
+	/**
+	 * get report as json
+	 */
+	std::string report() const;
+
+	/**
+	 * write report to stdout and report file
+	 * @retval success or failed
+	 */
+	bool write_report() const;
+
+private:
+	/**
+	 * seconds of repeated runs
+	 */
+	struct Timing
+	{
+		Timing() : best(0.0), mean(0.0) {}
+		double best;
+		double mean;
+	};
+
+	/**
+	 * result of a ray set or a kernel
+	 */
+	struct ThroughputResult
+	{
+		ThroughputResult() : count(0), hit_count(0) {}
+		std::string name;
+		/// rays, tests or pixels
+		unsigned long long count;
+		unsigned long long hit_count;
+		Timing time;
+	};
+	typedef std::vector<ThroughputResult> ThroughputResultList;
+
+	/**
+	 * result of a scene
+	 */
+	struct SceneResult
+	{
+		SceneResult()
+			: is_loaded(false)
+			, triangle_count(0)
+			, load_time(0.0)
+			, render_time(0.0)
+			, primary_ray_count(0)
+			, shadow_ray_count(0)
+			, indirect_ray_count(0)
+			, rays_per_second(0.0)
+			, shading_time(0.0)
+			, resolve_time(0.0)
+		{}
+		std::string name;
+		bool is_loaded;
+		size_t triangle_count;
+		double load_time;
+		Timing bvh_time;
+		ThroughputResultList ray_set_list;
+		// full render
+		double render_time;
+		unsigned long long primary_ray_count;
+		unsigned long long shadow_ray_count;
+		unsigned long long indirect_ray_count;
+		double rays_per_second;
+		double shading_time;
+		double resolve_time;
+	};
+	typedef std::vector<SceneResult> SceneResultList;
+
+	void add_run(Timing& timing, double seconds, int run) const;
+	static std::string throughput_report(const ThroughputResultList& result_list);
+
+	bool run_scene(umdraw::UMScenePtr scene, SceneResult& result);
+	void run_ray_sets(umrt::UMSceneAccessPtr scene_access, SceneResult& result);
+	void run_render(umrt::UMSceneAccessPtr scene_access, SceneResult& result);
+	void run_triangle_kernel();
+	void run_image_conversion();
+
+	UMBenchmarkSetting setting_;
+	SceneResultList scene_result_list_;
+	ThroughputResultList kernel_result_list_;
+	ThroughputResultList image_result_list_;
+};
+
+} // burger
@@ -0,0 +1,77 @@
+/**
+ * @file UMMain.cpp
+ * benchmark suite of rays
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include <cstdlib>
+#include <string>
+#include <iostream>
+#include "UMBenchmark.h"
+
+namespace
+{
+	void print_usage()
+	{
+		std::cerr
+			<< "usage: burger_bench [options] [scene...]\n"
+			<< "  scene                  additional scene files\n"
+			<< "  --size <w> <h>         resolution of ray sets and renders (640 480)\n"
+			<< "  --samples <n>          samples per pixel of full renders (4)\n"
+			<< "  --repeat <n>           runs of each measurement (3)\n"
+			<< "  --threads <n>          threads, 0 uses all (0)\n"
+			<< "  --max-triangles <n>    largest procedural mesh (10000000)\n"
+			<< "  --no-standard          skip bundled and procedural scenes\n"
+			<< "  --no-render            skip full renders\n"
+			<< "  --report <path>        write json report to file\n";
+	}
+
+} // anonymouse namespace
+
+// main
+int main(int argc, char** argv)
+{
+	burger::UMBenchmarkSetting setting;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg(argv[i]);
+		const int rest = argc - i - 1;
+		if (arg == "--size" && rest >= 2)
+		{
+			setting.width = std::atoi(argv[++i]);
+			setting.height = std::atoi(argv[++i]);
+		}
+		else if (arg == "--samples" && rest >= 1) { setting.sample_count = std::atoi(argv[++i]); }
+		else if (arg == "--repeat" && rest >= 1) { setting.repeat_count = std::atoi(argv[++i]); }
+		else if (arg == "--threads" && rest >= 1) { setting.thread_count = std::atoi(argv[++i]); }
+		else if (arg == "--max-triangles" && rest >= 1) { setting.max_triangle_count = std::strtoul(argv[++i], NULL, 10); }
+		else if (arg == "--no-standard") { setting.is_standard_scene_enabled = false; }
+		else if (arg == "--no-render") { setting.is_render_enabled = false; }
+		else if (arg == "--report" && rest >= 1) { setting.report_path = argv[++i]; }
+		else if (arg.compare(0, 2, "--") == 0)
+		{
+			print_usage();
+			return 1;
+		}
+		else
+		{
+			setting.scene_path_list.push_back(arg);
+		}
+	}
+
+	if (setting.width <= 0 || setting.height <= 0 || setting.repeat_count <= 0)
+	{
+		print_usage();
+		return 1;
+	}
+
+	burger::UMBenchmark benchmark(setting);
+	const bool result = benchmark.run();
+	if (!benchmark.write_report()) return 1;
+	return result ? 0 : 1;
+}
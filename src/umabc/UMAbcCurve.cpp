@@ -52,6 +52,11 @@ bool UMAbcCurve::init(bool recursive)
 			max_time_ = static_cast<unsigned long>(time->getSampleTime(num_samples-1)*1000);
 		}
 	}
+	// widths are optional
+	if (curves_.getSchema().getWidthsParam().valid())
+	{
+		widths_param_ = curves_.getSchema().getWidthsParam();
+	}
 
 	return UMAbcObject::init(recursive);
 }
@@ -83,7 +88,12 @@ void UMAbcCurve::update_curve_all()
 	positions_ = sample.getPositions();
 	curve_count_ = sample.getNumCurves();
 	vertex_count_ = sample.getCurvesNumVertices();
-
+	curve_type_ = sample.getType();
+	basis_type_ = sample.getBasis();
+	if (widths_param_.valid())
+	{
+		widths_ = widths_param_.getExpandedValue(selector).getVals();
+	}
 }
 
 /**
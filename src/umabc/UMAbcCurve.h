@@ -68,10 +68,43 @@ public:
 	 */
 	void update_curve_all();
 
+	/**
+	 * get positions of current time
+	 */
+	Alembic::AbcGeom::P3fArraySamplePtr positions() const { return positions_; }
+
+	/**
+	 * get number of vertices of each curve
+	 */
+	Alembic::AbcGeom::Int32ArraySamplePtr vertex_count() const { return vertex_count_; }
+
+	/**
+	 * get widths of current time. may be none.
+	 */
+	Alembic::AbcGeom::FloatArraySamplePtr widths() const { return widths_; }
+
+	/**
+	 * get curve type (linear or cubic)
+	 */
+	Alembic::AbcGeom::CurveType curve_type() const { return curve_type_; }
+
+	/**
+	 * get basis of cubic curves
+	 */
+	Alembic::AbcGeom::BasisType basis_type() const { return basis_type_; }
+
+	/**
+	 * get number of curves
+	 */
+	size_t curve_count() const { return curve_count_; }
+
 protected:
 	UMAbcCurve(Alembic::AbcGeom::ICurves curves)
 		: UMAbcObject(curves)
 		, curves_(curves)
+		, curve_count_(0)
+		, curve_type_(Alembic::AbcGeom::kLinear)
+		, basis_type_(Alembic::AbcGeom::kNoBasis)
 	{}
 	
 	virtual UMAbcObjectPtr self_reference()
@@ -83,7 +116,11 @@ private:
 	Alembic::AbcGeom::ICurves curves_;
 	Alembic::AbcGeom::P3fArraySamplePtr positions_;
 	Alembic::AbcGeom::Int32ArraySamplePtr vertex_count_;
+	Alembic::AbcGeom::IFloatGeomParam widths_param_;
+	Alembic::AbcGeom::FloatArraySamplePtr widths_;
 	size_t curve_count_;
+	Alembic::AbcGeom::CurveType curve_type_;
+	Alembic::AbcGeom::BasisType basis_type_;
 
 	Alembic::AbcGeom::ICurvesSchema::Sample initial_sample_;
 
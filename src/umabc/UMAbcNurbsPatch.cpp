@@ -60,7 +60,7 @@ bool UMAbcNurbsPatch::init(bool recursive)
 		}
 	}
 
-	return false;
+	return UMAbcObject::init(recursive);
 }
 
 /**
@@ -86,6 +86,7 @@ void UMAbcNurbsPatch::update_patch_all()
 	patch_.getSchema().get(sample, selector);
 
 	positions_ = sample.getPositions();
+	position_weights_ = sample.getPositionWeights();
 	u_knot_ = sample.getUKnot();
 	v_knot_ = sample.getVKnot();
 	u_size_ = sample.getNumU();
@@ -68,6 +68,46 @@ public:
 	 */
 	void update_patch_all();
 
+	/**
+	 * get control points of current time. u varies fastest.
+	 */
+	Alembic::AbcGeom::P3fArraySamplePtr positions() const { return positions_; }
+
+	/**
+	 * get weights of control points of current time. may be none.
+	 */
+	Alembic::AbcGeom::FloatArraySamplePtr position_weights() const { return position_weights_; }
+
+	/**
+	 * get u knots of current time
+	 */
+	Alembic::AbcGeom::FloatArraySamplePtr u_knot() const { return u_knot_; }
+
+	/**
+	 * get v knots of current time
+	 */
+	Alembic::AbcGeom::FloatArraySamplePtr v_knot() const { return v_knot_; }
+
+	/**
+	 * get number of control points in u
+	 */
+	size_t u_size() const { return u_size_; }
+
+	/**
+	 * get number of control points in v
+	 */
+	size_t v_size() const { return v_size_; }
+
+	/**
+	 * get order in u
+	 */
+	int u_order() const { return u_order_; }
+
+	/**
+	 * get order in v
+	 */
+	int v_order() const { return v_order_; }
+
 protected:
 	UMAbcNurbsPatch(Alembic::AbcGeom::INuPatch patch)
 		: UMAbcObject(patch)
@@ -88,6 +128,7 @@ private:
 	Alembic::AbcGeom::INuPatchSchema::Sample initial_sample_;
 
 	Alembic::AbcGeom::P3fArraySamplePtr positions_;
+	Alembic::AbcGeom::FloatArraySamplePtr position_weights_;
 	Alembic::AbcGeom::FloatArraySamplePtr u_knot_;
 	Alembic::AbcGeom::FloatArraySamplePtr v_knot_;
 	size_t u_size_;
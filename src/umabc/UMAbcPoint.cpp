@@ -50,6 +50,11 @@ bool UMAbcPoint::init(bool recursive)
 			color_prop_ = IC3fArrayProperty(schema, "Cs");
 		}
 	}
+	// widths are optional
+	if (schema.getWidthsParam().valid())
+	{
+		widths_param_ = schema.getWidthsParam();
+	}
 	// try to create normals.
 	if (const PropertyHeader *head = schema.getPropertyHeader("N"))
 	{
@@ -151,6 +156,10 @@ void UMAbcPoint::update_point()
 	IPointsSchema::Sample sample;
 	points_.getSchema().get(sample, selector);
 	positions_ = sample.getPositions();
+	if (widths_param_.valid())
+	{
+		widths_ = widths_param_.getExpandedValue(selector).getVals();
+	}
 	
 #ifdef WITH_OPENGL
 	if (opengl_point_ && !umdraw::UMDirectX11::current_device_pointer())
@@ -71,6 +71,21 @@ public:
 	 */
 	void update_point_all();
 	
+	/**
+	 * get positions of current time
+	 */
+	Alembic::AbcGeom::P3fArraySamplePtr positions() const { return positions_; }
+
+	/**
+	 * get widths of current time. may be none.
+	 */
+	Alembic::AbcGeom::FloatArraySamplePtr widths() const { return widths_; }
+
+	/**
+	 * get colors of current time. may be none.
+	 */
+	Alembic::AbcGeom::C3fArraySamplePtr colors() const { return colors_; }
+
 	/**
 	 * get opengl point
 	 */
@@ -115,7 +130,10 @@ private:
 	Alembic::AbcGeom::IC3fArrayProperty color_prop_;
 	Alembic::AbcGeom::IN3fArrayProperty normal_prop_;
 
+	Alembic::AbcGeom::IFloatGeomParam widths_param_;
+
 	Alembic::AbcGeom::P3fArraySamplePtr positions_;
+	Alembic::AbcGeom::FloatArraySamplePtr widths_;
 	Alembic::AbcGeom::C3fArraySamplePtr colors_;
 	Alembic::AbcGeom::N3fArraySamplePtr normals_;
 	
@@ -10,8 +10,14 @@
  */
 #pragma once
 
+#include <cstddef>
 #include "UMVector.h"
 
+#ifndef WITH_EMSCRIPTEN
+	#include <emmintrin.h>
+	#define UM_MATRIX_SSE
+#endif
+
 namespace umbase
 {
 	
@@ -250,8 +256,162 @@ public:
 		return dst;
 	}
 
+	/**
+	 * get inverted affine transform.
+	 * faster than inverted(). the matrix must not have projection.
+	 */
+	UMMatrix44 affine_inverted() const
+	{
+		// cofactors of 3x3 part
+		const T c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+		const T c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+		const T c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+		const T det = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+		if ( !det ) { return UMMatrix44(); }
+
+		const T rev_det = static_cast<T>(1.0 / det);
+		UMMatrix44 dst;
+		dst.m[0][0] = c00 * rev_det;
+		dst.m[1][0] = c01 * rev_det;
+		dst.m[2][0] = c02 * rev_det;
+		dst.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * rev_det;
+		dst.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * rev_det;
+		dst.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * rev_det;
+		dst.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * rev_det;
+		dst.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * rev_det;
+		dst.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * rev_det;
+		// translation
+		for (int i = 0; i < 3; ++i) {
+			dst.m[3][i] = -(m[3][0] * dst.m[0][i] + m[3][1] * dst.m[1][i] + m[3][2] * dst.m[2][i]);
+		}
+		return dst;
+	}
+
+	/**
+	 * transform points. same as operator * for each point.
+	 * @param [out] dst transformed points. can be same as src.
+	 * @param [in] src points
+	 * @param [in] count number of points
+	 */
+	void transform_points(UMVector3<T>* dst, const UMVector3<T>* src, size_t count) const
+	{
+		const int size = static_cast<int>(count);
+#pragma omp parallel for schedule(static) if (size >= parallel_transform_count)
+		for (int i = 0; i < size; ++i) {
+			transform_point(dst[i], src[i]);
+		}
+	}
+
+	/**
+	 * transform vectors. translation is ignored.
+	 * @param [out] dst transformed vectors. can be same as src.
+	 * @param [in] src vectors
+	 * @param [in] count number of vectors
+	 */
+	void transform_vectors(UMVector3<T>* dst, const UMVector3<T>* src, size_t count) const
+	{
+		const int size = static_cast<int>(count);
+#pragma omp parallel for schedule(static) if (size >= parallel_transform_count)
+		for (int i = 0; i < size; ++i) {
+			transform_vector(dst[i], src[i]);
+		}
+	}
+
+private:
+	/// batch transforms over this count run in parallel
+	static const int parallel_transform_count = 65536;
+
+	/**
+	 * transform a point
+	 */
+	void transform_point(UMVector3<T>& dst, const UMVector3<T>& v) const
+	{
+		dst = (*this) * v;
+	}
+
+	/**
+	 * transform a vector
+	 */
+	void transform_vector(UMVector3<T>& dst, const UMVector3<T>& v) const
+	{
+		const T tmp[] = {
+			v[0]*m[0][0] + v[1]*m[1][0] + v[2]*m[2][0],
+			v[0]*m[0][1] + v[1]*m[1][1] + v[2]*m[2][1],
+			v[0]*m[0][2] + v[1]*m[1][2] + v[2]*m[2][2]
+		};
+		dst = UMVector3<T>(tmp[0], tmp[1], tmp[2]);
+	}
 };
 
+#ifdef UM_MATRIX_SSE
+
+// transform kernels by SSE. rows of the matrix are added in the same order
+// as operator *, so results are same as the scalar code.
+
+/**
+ * transform a point (double)
+ */
+template <>
+inline void UMMatrix44<double>::transform_point(UMVector3<double>& dst, const UMVector3<double>& v) const
+{
+	const __m128d x = _mm_set1_pd(v.x);
+	const __m128d y = _mm_set1_pd(v.y);
+	const __m128d z = _mm_set1_pd(v.z);
+	__m128d xy = _mm_add_pd(_mm_mul_pd(x, _mm_loadu_pd(m[0])), _mm_mul_pd(y, _mm_loadu_pd(m[1])));
+	xy = _mm_add_pd(_mm_add_pd(xy, _mm_mul_pd(z, _mm_loadu_pd(m[2]))), _mm_loadu_pd(m[3]));
+	__m128d zz = _mm_add_sd(_mm_mul_sd(x, _mm_load_sd(&m[0][2])), _mm_mul_sd(y, _mm_load_sd(&m[1][2])));
+	zz = _mm_add_sd(_mm_add_sd(zz, _mm_mul_sd(z, _mm_load_sd(&m[2][2]))), _mm_load_sd(&m[3][2]));
+	_mm_storeu_pd(&dst.x, xy);
+	_mm_store_sd(&dst.z, zz);
+}
+
+/**
+ * transform a vector (double)
+ */
+template <>
+inline void UMMatrix44<double>::transform_vector(UMVector3<double>& dst, const UMVector3<double>& v) const
+{
+	const __m128d x = _mm_set1_pd(v.x);
+	const __m128d y = _mm_set1_pd(v.y);
+	const __m128d z = _mm_set1_pd(v.z);
+	__m128d xy = _mm_add_pd(_mm_mul_pd(x, _mm_loadu_pd(m[0])), _mm_mul_pd(y, _mm_loadu_pd(m[1])));
+	xy = _mm_add_pd(xy, _mm_mul_pd(z, _mm_loadu_pd(m[2])));
+	__m128d zz = _mm_add_sd(_mm_mul_sd(x, _mm_load_sd(&m[0][2])), _mm_mul_sd(y, _mm_load_sd(&m[1][2])));
+	zz = _mm_add_sd(zz, _mm_mul_sd(z, _mm_load_sd(&m[2][2])));
+	_mm_storeu_pd(&dst.x, xy);
+	_mm_store_sd(&dst.z, zz);
+}
+
+/**
+ * transform a point (float)
+ */
+template <>
+inline void UMMatrix44<float>::transform_point(UMVector3<float>& dst, const UMVector3<float>& v) const
+{
+	__m128 r = _mm_add_ps(
+		_mm_mul_ps(_mm_set1_ps(v.x), _mm_loadu_ps(m[0])),
+		_mm_mul_ps(_mm_set1_ps(v.y), _mm_loadu_ps(m[1])));
+	r = _mm_add_ps(_mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(v.z), _mm_loadu_ps(m[2]))), _mm_loadu_ps(m[3]));
+	_mm_storel_pi(reinterpret_cast<__m64*>(&dst.x), r);
+	_mm_store_ss(&dst.z, _mm_movehl_ps(r, r));
+}
+
+/**
+ * transform a vector (float)
+ */
+template <>
+inline void UMMatrix44<float>::transform_vector(UMVector3<float>& dst, const UMVector3<float>& v) const
+{
+	__m128 r = _mm_add_ps(
+		_mm_mul_ps(_mm_set1_ps(v.x), _mm_loadu_ps(m[0])),
+		_mm_mul_ps(_mm_set1_ps(v.y), _mm_loadu_ps(m[1])));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(v.z), _mm_loadu_ps(m[2])));
+	_mm_storel_pi(reinterpret_cast<__m64*>(&dst.x), r);
+	_mm_store_ss(&dst.z, _mm_movehl_ps(r, r));
+}
+
+#endif // UM_MATRIX_SSE
+
 
 
 /**
@@ -10,12 +10,14 @@
 
 #ifdef WITH_EMSCRIPTEN
 	#include <GL/glfw3.h>
-#else
+#elif defined(_WIN32)
 	#include <windows.h>
 	#include <Mmsystem.h>
 #endif
 
 #include <string>
+#include <iostream>
+#include <chrono>
 
 #include "UMTime.h"
 #include "UMStringUtil.h"
@@ -56,7 +58,7 @@ UMTime::~UMTime()
 		+ "ms\n"
 		);
 	
-#ifdef WITH_EMSCRIPTEN
+#if defined(WITH_EMSCRIPTEN) || !defined(_WIN32)
 	printf("%s\n", message.c_str());
 #else
 	::OutputDebugStringA(message.c_str());
@@ -75,8 +77,24 @@ unsigned int UMTime::current_time()
 #else
 	#ifdef _WIN32
 		return static_cast<unsigned int>(::timeGetTime());
+	#else
+		return static_cast<unsigned int>(current_seconds() * 1000.0);
 	#endif
 #endif
 }
 
+double UMTime::current_seconds()
+{
+#if defined(_WIN32) && !defined(WITH_EMSCRIPTEN)
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	::QueryPerformanceFrequency(&frequency);
+	::QueryPerformanceCounter(&counter);
+	return static_cast<double>(counter.QuadPart) / static_cast<double>(frequency.QuadPart);
+#else
+	return std::chrono::duration<double>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
 } // umbase
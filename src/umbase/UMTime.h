@@ -45,6 +45,12 @@ public:
 	 */
 	static unsigned int current_time();
 
+	/**
+	 * get high resolution time in seconds
+	 * @note only differences between two calls are meaningful
+	 */
+	static double current_seconds();
+
 	~UMTime();
 
 private:
@@ -14,6 +14,11 @@
 #include <cfloat>
 #include <limits>
 
+#ifndef WITH_EMSCRIPTEN
+	#include <xmmintrin.h>
+	#define UM_VECTOR_SSE
+#endif
+
 namespace umbase
 {
 
@@ -635,4 +640,124 @@ public:
 	}
 };
 
+#ifdef UM_VECTOR_SSE
+
+// UMVector4<float> by SSE.
+// components stay x, y, z, w without alignment, so arrays keep same layout and
+// values are loaded unaligned.
+
+/**
+ * plus
+ */
+template <>
+inline UMVector4<float> UMVector4<float>::operator + (const UMVector4<float> &v) const {
+	UMVector4<float> dst;
+	_mm_storeu_ps(&dst.x, _mm_add_ps(_mm_loadu_ps(&x), _mm_loadu_ps(&v.x)));
+	return dst;
+}
+
+/**
+ * plus equal
+ */
+template <>
+inline UMVector4<float> UMVector4<float>::operator += (const UMVector4<float> &v) {
+	_mm_storeu_ps(&x, _mm_add_ps(_mm_loadu_ps(&x), _mm_loadu_ps(&v.x)));
+	return *this;
+}
+
+/**
+ * minus
+ */
+template <>
+inline UMVector4<float> UMVector4<float>::operator - () const {
+	UMVector4<float> dst;
+	_mm_storeu_ps(&dst.x, _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&x)));
+	return dst;
+}
+
+/**
+ * minus
+ */
+template <>
+inline UMVector4<float> UMVector4<float>::operator - (const UMVector4<float> &v) const {
+	UMVector4<float> dst;
+	_mm_storeu_ps(&dst.x, _mm_sub_ps(_mm_loadu_ps(&x), _mm_loadu_ps(&v.x)));
+	return dst;
+}
+
+/**
+ * minus equal
+ */
+template <>
+inline UMVector4<float> UMVector4<float>::operator -= (const UMVector4<float> &v) {
+	_mm_storeu_ps(&x, _mm_sub_ps(_mm_loadu_ps(&x), _mm_loadu_ps(&v.x)));
+	return *this;
+}
+
+/**
+ * multiply scolor
+ */
+template <>
+template <>
+inline UMVector4<float> UMVector4<float>::operator * (const float &s) const {
+	UMVector4<float> dst;
+	_mm_storeu_ps(&dst.x, _mm_mul_ps(_mm_loadu_ps(&x), _mm_set1_ps(s)));
+	return dst;
+}
+
+/**
+ * multiply equal
+ */
+template <>
+template <>
+inline UMVector4<float> UMVector4<float>::operator *= (const float &s) {
+	_mm_storeu_ps(&x, _mm_mul_ps(_mm_loadu_ps(&x), _mm_set1_ps(s)));
+	return *this;
+}
+
+/**
+ * multiply
+ */
+template <>
+inline UMVector4<float> UMVector4<float>::multiply(const UMVector4<float> &v) const {
+	UMVector4<float> dst;
+	_mm_storeu_ps(&dst.x, _mm_mul_ps(_mm_loadu_ps(&x), _mm_loadu_ps(&v.x)));
+	return dst;
+}
+
+/**
+ * dot
+ */
+template <>
+inline float UMVector4<float>::dot(const UMVector4<float> &v) const {
+	__m128 m = _mm_mul_ps(_mm_loadu_ps(&x), _mm_loadu_ps(&v.x));
+	m = _mm_add_ps(m, _mm_movehl_ps(m, m));
+	m = _mm_add_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1)));
+	return _mm_cvtss_f32(m);
+}
+
+/**
+ * square of length
+ */
+template <>
+inline float UMVector4<float>::length_sq() const {
+	return dot(*this);
+}
+
+/**
+ * get normalized
+ */
+template <>
+inline UMVector4<float> UMVector4<float>::normalized() const {
+	UMVector4<float> dst;
+	const float a = length_sq();
+	if (a > std::numeric_limits<float>::epsilon()) {
+		const float b = static_cast<float>(1.0 / sqrt(a));
+		_mm_storeu_ps(&dst.x, _mm_mul_ps(_mm_loadu_ps(&x), _mm_set1_ps(b)));
+	}
+	return dst;
+}
+
+#endif // UM_VECTOR_SSE
+
 } // umbase
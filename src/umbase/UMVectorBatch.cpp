@@ -0,0 +1,357 @@
+/**
+ * @file UMVectorBatch.cpp
+ * batch operations over vector arrays
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMVectorBatch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	using namespace umbase;
+
+#ifdef UM_VECTOR_SSE
+	/**
+	 * load 4 UMVec3f as x, y, z of 4 vectors
+	 */
+	inline void load_soa(const UMVec3f* v, __m128& x, __m128& y, __m128& z)
+	{
+		const float* p = &v->x;
+		// m0 = x0 y0 z0 x1, m1 = y1 z1 x2 y2, m2 = z2 x3 y3 z3
+		const __m128 m0 = _mm_loadu_ps(p);
+		const __m128 m1 = _mm_loadu_ps(p + 4);
+		const __m128 m2 = _mm_loadu_ps(p + 8);
+		// t = x2 y2 x3 y3
+		const __m128 t = _mm_shuffle_ps(m1, m2, _MM_SHUFFLE(2, 1, 3, 2));
+		// u = y0 z0 y1 z1
+		const __m128 u = _mm_shuffle_ps(m0, m1, _MM_SHUFFLE(1, 0, 2, 1));
+		x = _mm_shuffle_ps(m0, t, _MM_SHUFFLE(2, 0, 3, 0));
+		y = _mm_shuffle_ps(u, t, _MM_SHUFFLE(3, 1, 2, 0));
+		z = _mm_shuffle_ps(u, m2, _MM_SHUFFLE(3, 0, 3, 1));
+	}
+
+	/**
+	 * store x, y, z of 4 vectors as 4 UMVec3f
+	 */
+	inline void store_soa(UMVec3f* v, const __m128& x, const __m128& y, const __m128& z)
+	{
+		float* p = &v->x;
+		// lo = x0 y0 x1 y1, hi = x2 y2 x3 y3
+		const __m128 lo = _mm_unpacklo_ps(x, y);
+		const __m128 hi = _mm_unpackhi_ps(x, y);
+		// z0 z0 x0 x0 -> x0 y0 z0 x1
+		const __m128 m0 = _mm_shuffle_ps(lo, _mm_shuffle_ps(z, lo, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0));
+		// y1 y1 z1 z1 -> y1 z1 x2 y2
+		const __m128 m1 = _mm_shuffle_ps(_mm_shuffle_ps(lo, z, _MM_SHUFFLE(1, 1, 3, 3)), hi, _MM_SHUFFLE(1, 0, 2, 0));
+		// z2 z3 x3 y3 -> z2 x3 y3 z3
+		const __m128 t = _mm_shuffle_ps(z, hi, _MM_SHUFFLE(3, 2, 3, 2));
+		const __m128 m2 = _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 3, 2, 0));
+		_mm_storeu_ps(p, m0);
+		_mm_storeu_ps(p + 4, m1);
+		_mm_storeu_ps(p + 8, m2);
+	}
+
+	/**
+	 * 1 / length, or 0 for zero length
+	 */
+	inline __m128 inverse_length(const __m128& length_sq)
+	{
+		const __m128 eps = _mm_set1_ps(std::numeric_limits<float>::epsilon());
+		const __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(length_sq));
+		return _mm_and_ps(inv, _mm_cmpgt_ps(length_sq, eps));
+	}
+#endif // UM_VECTOR_SSE
+
+	inline float inverse_length(float length_sq)
+	{
+		if (length_sq > std::numeric_limits<float>::epsilon()) {
+			return static_cast<float>(1.0 / sqrt(length_sq));
+		}
+		return 0.0f;
+	}
+
+} // anonymouse namespace
+
+namespace umbase
+{
+
+/**
+ * dot products of UMVec3f
+ */
+void um_dot_list(float* dst, const UMVec3f* a, const UMVec3f* b, size_t count)
+{
+	size_t i = 0;
+#ifdef UM_VECTOR_SSE
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 ax, ay, az, bx, by, bz;
+		load_soa(a + i, ax, ay, az);
+		load_soa(b + i, bx, by, bz);
+		const __m128 d = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+		_mm_storeu_ps(dst + i, d);
+	}
+#endif // UM_VECTOR_SSE
+	for (; i < count; ++i)
+	{
+		dst[i] = a[i].dot(b[i]);
+	}
+}
+
+/**
+ * dot products of UMVec4f
+ */
+void um_dot_list(float* dst, const UMVec4f* a, const UMVec4f* b, size_t count)
+{
+	size_t i = 0;
+#ifdef UM_VECTOR_SSE
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 m0 = _mm_mul_ps(_mm_loadu_ps(&a[i].x), _mm_loadu_ps(&b[i].x));
+		__m128 m1 = _mm_mul_ps(_mm_loadu_ps(&a[i + 1].x), _mm_loadu_ps(&b[i + 1].x));
+		__m128 m2 = _mm_mul_ps(_mm_loadu_ps(&a[i + 2].x), _mm_loadu_ps(&b[i + 2].x));
+		__m128 m3 = _mm_mul_ps(_mm_loadu_ps(&a[i + 3].x), _mm_loadu_ps(&b[i + 3].x));
+		_MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_add_ps(m0, m1), _mm_add_ps(m2, m3)));
+	}
+#endif // UM_VECTOR_SSE
+	for (; i < count; ++i)
+	{
+		dst[i] = a[i].dot(b[i]);
+	}
+}
+
+/**
+ * cross products of UMVec3f
+ */
+void um_cross_list(UMVec3f* dst, const UMVec3f* a, const UMVec3f* b, size_t count)
+{
+	size_t i = 0;
+#ifdef UM_VECTOR_SSE
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 ax, ay, az, bx, by, bz;
+		load_soa(a + i, ax, ay, az);
+		load_soa(b + i, bx, by, bz);
+		const __m128 x = _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by));
+		const __m128 y = _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz));
+		const __m128 z = _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx));
+		store_soa(dst + i, x, y, z);
+	}
+#endif // UM_VECTOR_SSE
+	for (; i < count; ++i)
+	{
+		dst[i] = a[i].cross(b[i]);
+	}
+}
+
+/**
+ * normalize UMVec3f
+ */
+void um_normalize_list(UMVec3f* dst, const UMVec3f* src, size_t count)
+{
+	size_t i = 0;
+#ifdef UM_VECTOR_SSE
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x, y, z;
+		load_soa(src + i, x, y, z);
+		const __m128 length_sq = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+		const __m128 inv = inverse_length(length_sq);
+		store_soa(dst + i, _mm_mul_ps(x, inv), _mm_mul_ps(y, inv), _mm_mul_ps(z, inv));
+	}
+#endif // UM_VECTOR_SSE
+	for (; i < count; ++i)
+	{
+		dst[i] = src[i] * inverse_length(src[i].length_sq());
+	}
+}
+
+/**
+ * normalize UMVec4f
+ */
+void um_normalize_list(UMVec4f* dst, const UMVec4f* src, size_t count)
+{
+	size_t i = 0;
+#ifdef UM_VECTOR_SSE
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 v0 = _mm_loadu_ps(&src[i].x);
+		const __m128 v1 = _mm_loadu_ps(&src[i + 1].x);
+		const __m128 v2 = _mm_loadu_ps(&src[i + 2].x);
+		const __m128 v3 = _mm_loadu_ps(&src[i + 3].x);
+		__m128 m0 = _mm_mul_ps(v0, v0);
+		__m128 m1 = _mm_mul_ps(v1, v1);
+		__m128 m2 = _mm_mul_ps(v2, v2);
+		__m128 m3 = _mm_mul_ps(v3, v3);
+		_MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+		const __m128 inv = inverse_length(_mm_add_ps(_mm_add_ps(m0, m1), _mm_add_ps(m2, m3)));
+		_mm_storeu_ps(&dst[i].x, _mm_mul_ps(v0, _mm_shuffle_ps(inv, inv, _MM_SHUFFLE(0, 0, 0, 0))));
+		_mm_storeu_ps(&dst[i + 1].x, _mm_mul_ps(v1, _mm_shuffle_ps(inv, inv, _MM_SHUFFLE(1, 1, 1, 1))));
+		_mm_storeu_ps(&dst[i + 2].x, _mm_mul_ps(v2, _mm_shuffle_ps(inv, inv, _MM_SHUFFLE(2, 2, 2, 2))));
+		_mm_storeu_ps(&dst[i + 3].x, _mm_mul_ps(v3, _mm_shuffle_ps(inv, inv, _MM_SHUFFLE(3, 3, 3, 3))));
+	}
+#endif // UM_VECTOR_SSE
+	for (; i < count; ++i)
+	{
+		dst[i] = src[i] * inverse_length(src[i].length_sq());
+	}
+}
+
+/**
+ * component wise minimum of UMVec3f
+ */
+void um_min_list(UMVec3f* dst, const UMVec3f* a, const UMVec3f* b, size_t count)
+{
+	size_t i = 0;
+#ifdef UM_VECTOR_SSE
+	// component wise, so 4 vectors are 3 registers without transpose
+	for (; i + 4 <= count; i += 4)
+	{
+		const float* pa = &a[i].x;
+		const float* pb = &b[i].x;
+		float* pd = &dst[i].x;
+		for (int k = 0; k < 12; k += 4)
+		{
+			_mm_storeu_ps(pd + k, _mm_min_ps(_mm_loadu_ps(pa + k), _mm_loadu_ps(pb + k)));
+		}
+	}
+#endif // UM_VECTOR_SSE
+	for (; i < count; ++i)
+	{
+		dst[i] = UMVec3f(
+			std::min(a[i].x, b[i].x),
+			std::min(a[i].y, b[i].y),
+			std::min(a[i].z, b[i].z));
+	}
+}
+
+/**
+ * component wise minimum of UMVec4f
+ */
+void um_min_list(UMVec4f* dst, const UMVec4f* a, const UMVec4f* b, size_t count)
+{
+	size_t i = 0;
+#ifdef UM_VECTOR_SSE
+	for (; i < count; ++i)
+	{
+		_mm_storeu_ps(&dst[i].x, _mm_min_ps(_mm_loadu_ps(&a[i].x), _mm_loadu_ps(&b[i].x)));
+	}
+#endif // UM_VECTOR_SSE
+	for (; i < count; ++i)
+	{
+		dst[i] = UMVec4f(
+			std::min(a[i].x, b[i].x),
+			std::min(a[i].y, b[i].y),
+			std::min(a[i].z, b[i].z),
+			std::min(a[i].w, b[i].w));
+	}
+}
+
+/**
+ * component wise maximum of UMVec3f
+ */
+void um_max_list(UMVec3f* dst, const UMVec3f* a, const UMVec3f* b, size_t count)
+{
+	size_t i = 0;
+#ifdef UM_VECTOR_SSE
+	for (; i + 4 <= count; i += 4)
+	{
+		const float* pa = &a[i].x;
+		const float* pb = &b[i].x;
+		float* pd = &dst[i].x;
+		for (int k = 0; k < 12; k += 4)
+		{
+			_mm_storeu_ps(pd + k, _mm_max_ps(_mm_loadu_ps(pa + k), _mm_loadu_ps(pb + k)));
+		}
+	}
+#endif // UM_VECTOR_SSE
+	for (; i < count; ++i)
+	{
+		dst[i] = UMVec3f(
+			std::max(a[i].x, b[i].x),
+			std::max(a[i].y, b[i].y),
+			std::max(a[i].z, b[i].z));
+	}
+}
+
+/**
+ * component wise maximum of UMVec4f
+ */
+void um_max_list(UMVec4f* dst, const UMVec4f* a, const UMVec4f* b, size_t count)
+{
+	size_t i = 0;
+#ifdef UM_VECTOR_SSE
+	for (; i < count; ++i)
+	{
+		_mm_storeu_ps(&dst[i].x, _mm_max_ps(_mm_loadu_ps(&a[i].x), _mm_loadu_ps(&b[i].x)));
+	}
+#endif // UM_VECTOR_SSE
+	for (; i < count; ++i)
+	{
+		dst[i] = UMVec4f(
+			std::max(a[i].x, b[i].x),
+			std::max(a[i].y, b[i].y),
+			std::max(a[i].z, b[i].z),
+			std::max(a[i].w, b[i].w));
+	}
+}
+
+/**
+ * lerp of UMVec3f
+ */
+void um_lerp_list(UMVec3f* dst, const UMVec3f* a, const UMVec3f* b, float s, size_t count)
+{
+	size_t i = 0;
+#ifdef UM_VECTOR_SSE
+	const __m128 ms = _mm_set1_ps(s);
+	for (; i + 4 <= count; i += 4)
+	{
+		const float* pa = &a[i].x;
+		const float* pb = &b[i].x;
+		float* pd = &dst[i].x;
+		for (int k = 0; k < 12; k += 4)
+		{
+			const __m128 ma = _mm_loadu_ps(pa + k);
+			const __m128 mb = _mm_loadu_ps(pb + k);
+			_mm_storeu_ps(pd + k, _mm_add_ps(ma, _mm_mul_ps(ms, _mm_sub_ps(mb, ma))));
+		}
+	}
+#endif // UM_VECTOR_SSE
+	for (; i < count; ++i)
+	{
+		dst[i] = a[i] + (b[i] - a[i]) * s;
+	}
+}
+
+/**
+ * lerp of UMVec4f
+ */
+void um_lerp_list(UMVec4f* dst, const UMVec4f* a, const UMVec4f* b, float s, size_t count)
+{
+	size_t i = 0;
+#ifdef UM_VECTOR_SSE
+	const __m128 ms = _mm_set1_ps(s);
+	for (; i < count; ++i)
+	{
+		const __m128 ma = _mm_loadu_ps(&a[i].x);
+		const __m128 mb = _mm_loadu_ps(&b[i].x);
+		_mm_storeu_ps(&dst[i].x, _mm_add_ps(ma, _mm_mul_ps(ms, _mm_sub_ps(mb, ma))));
+	}
+#endif // UM_VECTOR_SSE
+	for (; i < count; ++i)
+	{
+		dst[i] = a[i] + (b[i] - a[i]) * s;
+	}
+}
+
+} // umbase
@@ -0,0 +1,61 @@
+/**
+ * @file UMVectorBatch.h
+ * batch operations over vector arrays
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include "UMMacro.h"
+#include "UMMathTypes.h"
+#include "UMVector.h"
+
+namespace umbase
+{
+
+// each function runs over count elements of the arrays.
+// destination can be same as a source.
+// SSE processes 4 vectors at once, rest of them are processed by scalar code.
+
+/**
+ * dot products
+ * @param [out] dst count dot products
+ */
+void um_dot_list(float* dst, const UMVec3f* a, const UMVec3f* b, size_t count);
+void um_dot_list(float* dst, const UMVec4f* a, const UMVec4f* b, size_t count);
+
+/**
+ * cross products
+ */
+void um_cross_list(UMVec3f* dst, const UMVec3f* a, const UMVec3f* b, size_t count);
+
+/**
+ * normalize vectors. vectors of zero length become zero.
+ */
+void um_normalize_list(UMVec3f* dst, const UMVec3f* src, size_t count);
+void um_normalize_list(UMVec4f* dst, const UMVec4f* src, size_t count);
+
+/**
+ * component wise minimum
+ */
+void um_min_list(UMVec3f* dst, const UMVec3f* a, const UMVec3f* b, size_t count);
+void um_min_list(UMVec4f* dst, const UMVec4f* a, const UMVec4f* b, size_t count);
+
+/**
+ * component wise maximum
+ */
+void um_max_list(UMVec3f* dst, const UMVec3f* a, const UMVec3f* b, size_t count);
+void um_max_list(UMVec4f* dst, const UMVec4f* a, const UMVec4f* b, size_t count);
+
+/**
+ * lerp a + s * (b - a)
+ */
+void um_lerp_list(UMVec3f* dst, const UMVec3f* a, const UMVec3f* b, float s, size_t count);
+void um_lerp_list(UMVec4f* dst, const UMVec4f* a, const UMVec4f* b, float s, size_t count);
+
+} // umbase
@@ -40,6 +40,8 @@ void UMCamera::init(bool is_ortho, int width, int height)
 	position_ = UMVec3d(-10,  10, 25);
 	target_ = UMVec3d(0, 10, 0);
 	up_ = UMVec3d(0, 1, 0);
+	aperture_ = 0.0;
+	focus_distance_ = (target_ - position_).length();
 	theta_ = 0.0;
 	phi_ = 0.0;
 	inverted_width_ = 1.0 / static_cast<double>(width);
@@ -134,6 +134,26 @@ public:
 	 */
 	void set_position(const UMVec3d& position) { position_ = position; }
 
+	/**
+	 * get lens radius. 0 is pinhole.
+	 */
+	double aperture() const { return aperture_; }
+
+	/**
+	 * set lens radius
+	 */
+	void set_aperture(double aperture) { aperture_ = aperture; }
+
+	/**
+	 * get focus distance
+	 */
+	double focus_distance() const { return focus_distance_; }
+
+	/**
+	 * set focus distance
+	 */
+	void set_focus_distance(double distance) { focus_distance_ = distance; }
+
 	/**
 	 * get target
 	 */
@@ -181,6 +201,8 @@ private:
 	double fov_y_;
 	double near_;
 	double far_;
+	double aperture_;
+	double focus_distance_;
 	UMVec3d position_;
 	UMVec3d target_;
 	UMVec3d up_;
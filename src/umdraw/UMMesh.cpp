@@ -160,17 +160,18 @@ void UMMesh::update()
 		global_rot.m[3][0] = global_rot.m[3][1] = global_rot.m[3][2] = 0.0;
 		UMMat44d initial_global_rot = initial_global_transform;
 		initial_global_rot.m[3][0] = initial_global_rot.m[3][1] = initial_global_rot.m[3][2] = 0.0;
-		UMMat44d initial_global_rot_inv = initial_global_rot.inverted();
+		// initial inverse and current transform are applied as one matrix
+		const UMMat44d vertex_transform = initial_global_transform.affine_inverted() * global_transform;
+		const UMMat44d normal_transform = initial_global_rot.affine_inverted() * global_rot;
 
-		for (int i = 0, isize = static_cast<int>(original_vertex_list_.size()); i < isize; ++i)
+		// batch transforms write through raw pointers, so destination must have same size
+		if (!original_vertex_list_.empty() && vertex_list_.size() == original_vertex_list_.size())
 		{
-			const UMVec3d& v = initial_global_transform.inverted() * original_vertex_list_[i];
-			vertex_list_.at(i) = global_transform * v;
+			vertex_transform.transform_points(&vertex_list_[0], &original_vertex_list_[0], original_vertex_list_.size());
 		}
-		for (int i = 0, isize = static_cast<int>(original_normal_list_.size()); i < isize; ++i)
+		if (!original_normal_list_.empty() && normal_list_.size() == original_normal_list_.size())
 		{
-			const UMVec3d& n = initial_global_rot_inv * original_normal_list_[i];
- 			normal_list_[i] = global_rot * n;
+			normal_transform.transform_vectors(&normal_list_[0], &original_normal_list_[0], original_normal_list_.size());
 		}
 	}
 	else
@@ -190,15 +191,15 @@ void UMMesh::update()
 				global_rot.m[3][0] = global_rot.m[3][1] = global_rot.m[3][2] = 0.0;
 				UMMat44d initial_global_rot = initial_global_transform;
 				initial_global_rot.m[3][0] = initial_global_rot.m[3][1] = initial_global_rot.m[3][2] = 0.0;
-				UMMat44d initial_global_rot_inv = initial_global_rot.inverted();
+				const UMMat44d vertex_transform = initial_global_transform.affine_inverted() * global_transform;
+				const UMMat44d normal_transform = initial_global_rot.affine_inverted() * global_rot;
 
 				UMSkin::IndexList::const_iterator st = skin.index_list().begin();
 				for (int k = 0; st != skin.index_list().end(); ++st, ++k)
 				{
 					int index = *st;
 					double weight = skin.weight_list().at(k);
-					const UMVec3d& v = initial_global_transform.inverted() * original_vertex_list_[index];
-					vertex_list_.at(index) += global_transform * v * weight;
+					vertex_list_.at(index) += vertex_transform * original_vertex_list_[index] * weight;
 
 					if (original_normal_list_.size() > original_vertex_list_.size())
 					{
@@ -208,14 +209,12 @@ void UMMesh::update()
 						{
 							const IndexPair& pair = pair_list[p];
 							const int ni = pair.first * 3 + pair.second;
-							const UMVec3d& n = initial_global_rot_inv * original_normal_list_[ni];
- 							normal_list_[ni] += global_rot * n * weight;
+							normal_list_[ni] += normal_transform * original_normal_list_[ni] * weight;
 						}
 					}
 					else if (original_normal_list_.size() == original_vertex_list_.size())
 					{
-						const UMVec3d& n = initial_global_rot_inv * original_normal_list_[index];
-						normal_list_[index] += global_rot * n * weight;
+						normal_list_[index] += normal_transform * original_normal_list_[index] * weight;
 					}
 				}
 			}
@@ -84,6 +84,26 @@ public:
 		umdraw::UMLightPtr light,
 		const UMVec3d& point);
 
+	/**
+	 * get area
+	 */
+	double area() const { return area_; }
+
+	/**
+	 * get edge1
+	 */
+	const UMVec3d& edge1() const { return edge1_; }
+	
+	/**
+	 * get edge2
+	 */
+	const UMVec3d& edge2() const { return edge2_; }
+
+	/**
+	 * get normal
+	 */
+	const UMVec3d& normal() const { return normal_; }
+
 private:
 	double area_;
 	double constant_fall_off_;
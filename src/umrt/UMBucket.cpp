@@ -0,0 +1,160 @@
+/**
+ * @file UMBucket.cpp
+ * rendering buckets and bucket orders
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMBucket.h"
+#include "UMMath.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+	using namespace umrt;
+
+	/**
+	 * bucket with sort key
+	 */
+	struct KeyedBucket
+	{
+		double key;
+		UMBucket bucket;
+	};
+
+	struct keyed_bucket_less
+	{
+		bool operator()(const KeyedBucket& a, const KeyedBucket& b) const
+		{
+			return a.key < b.key;
+		}
+	};
+
+	/**
+	 * distance along hilbert curve
+	 * @param [in] n curve size (power of 2)
+	 */
+	unsigned int hilbert_index(unsigned int n, unsigned int x, unsigned int y)
+	{
+		unsigned int d = 0;
+		for (unsigned int s = n / 2; s > 0; s /= 2)
+		{
+			const unsigned int rx = (x & s) > 0 ? 1 : 0;
+			const unsigned int ry = (y & s) > 0 ? 1 : 0;
+			d += s * s * ((3 * rx) ^ ry);
+			// rotate
+			if (ry == 0)
+			{
+				if (rx == 1)
+				{
+					x = n - 1 - x;
+					y = n - 1 - y;
+				}
+				std::swap(x, y);
+			}
+		}
+		return d;
+	}
+
+	/**
+	 * spread lower 16 bits
+	 */
+	unsigned int part1by1(unsigned int x)
+	{
+		x &= 0x0000ffff;
+		x = (x | (x << 8)) & 0x00ff00ff;
+		x = (x | (x << 4)) & 0x0f0f0f0f;
+		x = (x | (x << 2)) & 0x33333333;
+		x = (x | (x << 1)) & 0x55555555;
+		return x;
+	}
+
+	/**
+	 * distance along z-order curve
+	 */
+	unsigned int morton_index(unsigned int x, unsigned int y)
+	{
+		return (part1by1(y) << 1) | part1by1(x);
+	}
+
+} // anonymouse namespace
+
+namespace umrt
+{
+
+/**
+ * create buckets covering a rectangle
+ */
+bool UMBucketOrder::create_buckets(
+	UMBucketList& buckets,
+	const UMVec4i& rect,
+	int bucket_size,
+	OrderType type)
+{
+	buckets.clear();
+	if (rect.z <= 0 || rect.w <= 0 || bucket_size <= 0) return false;
+
+	const int count_x = (rect.z + bucket_size - 1) / bucket_size;
+	const int count_y = (rect.w + bucket_size - 1) / bucket_size;
+
+	unsigned int curve_size = 1;
+	while (curve_size < static_cast<unsigned int>(std::max(count_x, count_y)))
+	{
+		curve_size <<= 1;
+	}
+	const double center_x = (count_x - 1) * 0.5;
+	const double center_y = (count_y - 1) * 0.5;
+
+	std::vector<KeyedBucket> keyed;
+	keyed.reserve(count_x * count_y);
+	for (int by = 0; by < count_y; ++by)
+	{
+		for (int bx = 0; bx < count_x; ++bx)
+		{
+			KeyedBucket kb;
+			kb.bucket.x = rect.x + bx * bucket_size;
+			kb.bucket.y = rect.y + by * bucket_size;
+			kb.bucket.width = std::min(bucket_size, rect.x + rect.z - kb.bucket.x);
+			kb.bucket.height = std::min(bucket_size, rect.y + rect.w - kb.bucket.y);
+			switch (type)
+			{
+			case eOrderHilbert:
+				kb.key = hilbert_index(curve_size, bx, by);
+				break;
+			case eOrderMorton:
+				kb.key = morton_index(bx, by);
+				break;
+			case eOrderSpiral:
+				{
+					// ring from the center, then angle in the ring
+					const double dx = bx - center_x;
+					const double dy = by - center_y;
+					const double ring = std::floor(std::max(std::fabs(dx), std::fabs(dy)) + 0.5);
+					const double angle = (std::atan2(dy, dx) + M_PI) / (2.0 * M_PI);
+					kb.key = ring + std::min(angle, 0.999999);
+				}
+				break;
+			case eOrderScanline:
+			default:
+				kb.key = by * count_x + bx;
+				break;
+			}
+			keyed.push_back(kb);
+		}
+	}
+	std::stable_sort(keyed.begin(), keyed.end(), keyed_bucket_less());
+
+	buckets.reserve(keyed.size());
+	for (size_t i = 0, size = keyed.size(); i < size; ++i)
+	{
+		buckets.push_back(keyed[i].bucket);
+	}
+	return true;
+}
+
+} // umrt
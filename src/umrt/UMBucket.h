@@ -0,0 +1,78 @@
+/**
+ * @file UMBucket.h
+ * rendering buckets and bucket orders
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <vector>
+#include "UMMacro.h"
+#include "UMMathTypes.h"
+#include "UMVector.h"
+
+namespace umrt
+{
+
+class UMBucket;
+typedef std::vector<UMBucket> UMBucketList;
+
+/**
+ * a rectangle region of image which is rendered at once
+ */
+class UMBucket
+{
+public:
+	UMBucket() : x(0), y(0), width(0), height(0) {}
+
+	UMBucket(int x, int y, int width, int height)
+		: x(x), y(y), width(width), height(height) {}
+
+	~UMBucket() {}
+
+	int x;
+	int y;
+	int width;
+	int height;
+};
+
+/**
+ * bucket order
+ */
+class UMBucketOrder
+{
+	DISALLOW_COPY_AND_ASSIGN(UMBucketOrder);
+public:
+	/**
+	 * order types
+	 */
+	enum OrderType {
+		eOrderScanline, ///< row by row
+		eOrderHilbert, ///< along hilbert curve
+		eOrderSpiral, ///< spiral from the center
+		eOrderMorton, ///< along z-order curve
+	};
+
+	/**
+	 * create buckets covering a rectangle
+	 * @param [out] buckets ordered buckets
+	 * @param [in] rect target rectangle (x, y, width, height)
+	 * @param [in] bucket_size bucket width and height
+	 * @param [in] type order type
+	 * @retval success or failed
+	 */
+	static bool create_buckets(
+		UMBucketList& buckets,
+		const UMVec4i& rect,
+		int bucket_size,
+		OrderType type);
+
+private:
+	UMBucketOrder() {}
+};
+
+} // umrt
@@ -0,0 +1,260 @@
+/**
+ * @file UMCameraSampler.cpp
+ * camera ray generator
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMCameraSampler.h"
+#include "UMCamera.h"
+#include "UMMath.h"
+#include "UMMatrix.h"
+
+#include <cmath>
+
+#ifndef WITH_EMSCRIPTEN
+	#include <emmintrin.h>
+	#define UM_CAMERA_SAMPLER_SSE
+#endif
+
+namespace
+{
+	using namespace umrt;
+
+	/**
+	 * transform a point in normalized device coordinate to world
+	 */
+	UMVec3d unproject(const UMMat44d& inverted_view_projection, double x, double y, double z)
+	{
+		const UMVec4d p = inverted_view_projection * UMVec4d(x, y, z, 1.0);
+		return p.xyz() * (1.0 / p.w);
+	}
+
+	/**
+	 * uniform [0, 1)^2 to unit disk by concentric mapping
+	 */
+	UMVec2d concentric_disk(const UMVec2d& sample)
+	{
+		const double x = sample.x * 2.0 - 1.0;
+		const double y = sample.y * 2.0 - 1.0;
+		if (x == 0.0 && y == 0.0) return UMVec2d(0);
+		double r;
+		double theta;
+		if (std::fabs(x) > std::fabs(y))
+		{
+			r = x;
+			theta = (M_PI / 4.0) * (y / x);
+		}
+		else
+		{
+			r = y;
+			theta = (M_PI / 2.0) - (M_PI / 4.0) * (x / y);
+		}
+		return UMVec2d(r * std::cos(theta), r * std::sin(theta));
+	}
+
+#ifdef UM_CAMERA_SAMPLER_SSE
+	inline __m128d madd(__m128d a, __m128d b, __m128d c)
+	{
+		return _mm_add_pd(_mm_mul_pd(a, b), c);
+	}
+
+	inline __m128d dot3(__m128d ax, __m128d ay, __m128d az, __m128d bx, __m128d by, __m128d bz)
+	{
+		return madd(ax, bx, madd(ay, by, _mm_mul_pd(az, bz)));
+	}
+#endif // UM_CAMERA_SAMPLER_SSE
+
+} // anonymouse namespace
+
+namespace umrt
+{
+
+/**
+ * constructor
+ */
+UMCameraSampler::UMCameraSampler()
+	: is_valid_(false)
+	, projection_type_(ePinhole)
+	, origin_(0)
+	, corner_(0)
+	, x_step_(0)
+	, y_step_(0)
+	, forward_(0)
+	, lens_u_(0)
+	, lens_v_(0)
+	, aperture_(0)
+	, focus_distance_(0)
+{
+}
+
+/**
+ * precompute camera basis
+ */
+bool UMCameraSampler::init(umdraw::UMCameraPtr camera, int width, int height)
+{
+	is_valid_ = false;
+	if (!camera) return false;
+	if (width <= 0 || height <= 0) return false;
+
+	const double inverted_width = 1.0 / static_cast<double>(width);
+	const double inverted_height = 1.0 / static_cast<double>(height);
+
+	if (camera->is_ortho())
+	{
+		// parallel rays from near plane
+		const UMMat44d inverted = camera->view_projection_matrix().inverted();
+		const UMVec3d center = unproject(inverted, 0, 0, 0);
+		const UMVec3d x_axis = unproject(inverted, 1, 0, 0) - center;
+		const UMVec3d y_axis = unproject(inverted, 0, 1, 0) - center;
+		projection_type_ = eOrthographic;
+		origin_ = center;
+		forward_ = (unproject(inverted, 0, 0, 1) - center).normalized();
+		x_step_ = x_axis * (inverted_width * 2);
+		y_step_ = y_axis * (inverted_height * 2);
+		corner_ = center - x_axis - y_axis;
+		aperture_ = 0.0;
+		focus_distance_ = 0.0;
+		is_valid_ = true;
+		return true;
+	}
+
+	const UMMat44d& view_projection = camera->view_projection_matrix();
+	UMVec3d right (view_projection.m[0][0], view_projection.m[1][0], view_projection.m[2][0]);
+	UMVec3d up (view_projection.m[0][1], view_projection.m[1][1], view_projection.m[2][1]);
+	UMVec3d direction (view_projection.m[0][2], view_projection.m[1][2], view_projection.m[2][2]);
+
+	const double inv_yscale = tan(umbase::um_to_radian(camera->fov_y() * 0.5));
+	const double inv_xscale = camera->aspect() * inv_yscale;
+	right *= inv_xscale;
+	up *= inv_yscale;
+	const UMVec3d x_scale = right * camera->aspect();
+	const UMVec3d y_scale = up;
+	const UMVec3d adder = direction * (1.0 / inv_yscale);
+
+	origin_ = camera->position();
+	// direction = corner + x_step * x + y_step * y
+	x_step_ = x_scale * (inverted_width * 2);
+	y_step_ = y_scale * (inverted_height * 2);
+	corner_ = adder - x_scale - y_scale;
+	forward_ = adder.normalized();
+	lens_u_ = x_scale.normalized();
+	lens_v_ = y_scale.normalized();
+	aperture_ = camera->aperture();
+	focus_distance_ = camera->focus_distance();
+	projection_type_ = (aperture_ > 0.0 && focus_distance_ > 0.0) ? eThinLens : ePinhole;
+	is_valid_ = true;
+	return true;
+}
+
+/**
+ * generate a camera ray through center of lens
+ */
+void UMCameraSampler::generate_ray(UMRay& ray, const UMVec2d& sample_point) const
+{
+	if (projection_type_ == eOrthographic)
+	{
+		ray.set_origin(corner_ + x_step_ * sample_point.x + y_step_ * sample_point.y);
+		ray.set_direction(forward_);
+		ray.set_differentials(x_step_, y_step_, UMVec3d(0), UMVec3d(0));
+		return;
+	}
+	const UMVec3d dir = corner_ + x_step_ * sample_point.x + y_step_ * sample_point.y;
+	const double inv_length = 1.0 / dir.length();
+	const UMVec3d normalized_dir = dir * inv_length;
+	ray.set_origin(origin_);
+	ray.set_direction(normalized_dir);
+	// derivatives of normalized direction
+	ray.set_differentials(
+		UMVec3d(0),
+		UMVec3d(0),
+		(x_step_ - normalized_dir * normalized_dir.dot(x_step_)) * inv_length,
+		(y_step_ - normalized_dir * normalized_dir.dot(y_step_)) * inv_length);
+}
+
+/**
+ * generate a camera ray
+ */
+void UMCameraSampler::generate_ray(UMRay& ray, const UMVec2d& sample_point, const UMVec2d& lens_sample) const
+{
+	generate_ray(ray, sample_point);
+	if (projection_type_ != eThinLens) return;
+
+	// rays through a lens point converge on focus plane.
+	// differentials of pinhole ray are kept as an approximation.
+	const UMVec3d& dir = ray.direction();
+	const UMVec3d focus_point = origin_ + dir * (focus_distance_ / dir.dot(forward_));
+	const UMVec2d disk = concentric_disk(lens_sample);
+	const UMVec3d lens_point = origin_ + (lens_u_ * disk.x + lens_v_ * disk.y) * aperture_;
+	ray.set_origin(lens_point);
+	ray.set_direction((focus_point - lens_point).normalized());
+}
+
+/**
+ * generate camera rays through center of lens at once
+ */
+void UMCameraSampler::generate_rays(UMRay* rays, const UMVec2d* sample_points, int count) const
+{
+	int i = 0;
+#ifdef UM_CAMERA_SAMPLER_SSE
+	if (projection_type_ != eOrthographic)
+	{
+		const __m128d one = _mm_set1_pd(1.0);
+		const __m128d cx = _mm_set1_pd(corner_.x);
+		const __m128d cy = _mm_set1_pd(corner_.y);
+		const __m128d cz = _mm_set1_pd(corner_.z);
+		const __m128d xsx = _mm_set1_pd(x_step_.x);
+		const __m128d xsy = _mm_set1_pd(x_step_.y);
+		const __m128d xsz = _mm_set1_pd(x_step_.z);
+		const __m128d ysx = _mm_set1_pd(y_step_.x);
+		const __m128d ysy = _mm_set1_pd(y_step_.y);
+		const __m128d ysz = _mm_set1_pd(y_step_.z);
+		// two rays at once
+		for (; i + 1 < count; i += 2)
+		{
+			const __m128d sx = _mm_set_pd(sample_points[i + 1].x, sample_points[i].x);
+			const __m128d sy = _mm_set_pd(sample_points[i + 1].y, sample_points[i].y);
+			const __m128d dx = madd(xsx, sx, madd(ysx, sy, cx));
+			const __m128d dy = madd(xsy, sx, madd(ysy, sy, cy));
+			const __m128d dz = madd(xsz, sx, madd(ysz, sy, cz));
+			const __m128d inv_length = _mm_div_pd(one, _mm_sqrt_pd(dot3(dx, dy, dz, dx, dy, dz)));
+			const __m128d nx = _mm_mul_pd(dx, inv_length);
+			const __m128d ny = _mm_mul_pd(dy, inv_length);
+			const __m128d nz = _mm_mul_pd(dz, inv_length);
+			const __m128d ndotx = dot3(nx, ny, nz, xsx, xsy, xsz);
+			const __m128d ndoty = dot3(nx, ny, nz, ysx, ysy, ysz);
+
+			double out[9][2];
+			_mm_storeu_pd(out[0], nx);
+			_mm_storeu_pd(out[1], ny);
+			_mm_storeu_pd(out[2], nz);
+			_mm_storeu_pd(out[3], _mm_mul_pd(_mm_sub_pd(xsx, _mm_mul_pd(nx, ndotx)), inv_length));
+			_mm_storeu_pd(out[4], _mm_mul_pd(_mm_sub_pd(xsy, _mm_mul_pd(ny, ndotx)), inv_length));
+			_mm_storeu_pd(out[5], _mm_mul_pd(_mm_sub_pd(xsz, _mm_mul_pd(nz, ndotx)), inv_length));
+			_mm_storeu_pd(out[6], _mm_mul_pd(_mm_sub_pd(ysx, _mm_mul_pd(nx, ndoty)), inv_length));
+			_mm_storeu_pd(out[7], _mm_mul_pd(_mm_sub_pd(ysy, _mm_mul_pd(ny, ndoty)), inv_length));
+			_mm_storeu_pd(out[8], _mm_mul_pd(_mm_sub_pd(ysz, _mm_mul_pd(nz, ndoty)), inv_length));
+			for (int k = 0; k < 2; ++k)
+			{
+				UMRay& ray = rays[i + k];
+				ray.set_origin(origin_);
+				ray.set_direction(UMVec3d(out[0][k], out[1][k], out[2][k]));
+				ray.set_differentials(
+					UMVec3d(0),
+					UMVec3d(0),
+					UMVec3d(out[3][k], out[4][k], out[5][k]),
+					UMVec3d(out[6][k], out[7][k], out[8][k]));
+			}
+		}
+	}
+#endif // UM_CAMERA_SAMPLER_SSE
+	for (; i < count; ++i)
+	{
+		generate_ray(rays[i], sample_points[i]);
+	}
+}
+
+} // umrt
@@ -0,0 +1,109 @@
+/**
+ * @file UMCameraSampler.h
+ * camera ray generator
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include "UMMacro.h"
+#include "UMMathTypes.h"
+#include "UMVector.h"
+#include "UMRay.h"
+
+namespace umdraw
+{
+	class UMCamera;
+	typedef std::shared_ptr<UMCamera> UMCameraPtr;
+} // umdraw
+
+namespace umrt
+{
+
+/**
+ * camera ray generator.
+ * camera basis is computed once by init, then a ray is a few multiply-adds.
+ */
+class UMCameraSampler
+{
+	DISALLOW_COPY_AND_ASSIGN(UMCameraSampler);
+public:
+	/**
+	 * projection types
+	 */
+	enum ProjectionType {
+		ePinhole,
+		eThinLens, ///< camera has aperture
+		eOrthographic, ///< camera is ortho
+	};
+
+	UMCameraSampler();
+
+	~UMCameraSampler() {}
+
+	/**
+	 * precompute camera basis
+	 * @param [in] camera camera
+	 * @param [in] width image width
+	 * @param [in] height image height
+	 * @retval success or failed
+	 */
+	bool init(umdraw::UMCameraPtr camera, int width, int height);
+
+	/**
+	 * is initialized or not
+	 */
+	bool is_valid() const { return is_valid_; }
+
+	/**
+	 * get projection type
+	 */
+	ProjectionType projection_type() const { return projection_type_; }
+
+	/**
+	 * generate a camera ray through center of lens
+	 * @param [out] ray generated ray
+	 * @param [in] sample_point a sample point on pixel in imageplane
+	 */
+	void generate_ray(UMRay& ray, const UMVec2d& sample_point) const;
+
+	/**
+	 * generate a camera ray
+	 * @param [out] ray generated ray
+	 * @param [in] sample_point a sample point on pixel in imageplane
+	 * @param [in] lens_sample a sample point on lens in [0, 1)
+	 */
+	void generate_ray(UMRay& ray, const UMVec2d& sample_point, const UMVec2d& lens_sample) const;
+
+	/**
+	 * generate camera rays through center of lens at once
+	 * @param [out] rays generated rays
+	 * @param [in] sample_points sample points on pixel in imageplane
+	 * @param [in] count number of rays
+	 */
+	void generate_rays(UMRay* rays, const UMVec2d* sample_points, int count) const;
+
+private:
+	bool is_valid_;
+	ProjectionType projection_type_;
+	UMVec3d origin_;
+	/// direction (or origin of ortho) at pixel (0, 0)
+	UMVec3d corner_;
+	/// difference per pixel in x
+	UMVec3d x_step_;
+	/// difference per pixel in y
+	UMVec3d y_step_;
+	/// ortho direction, or unit forward for thin lens
+	UMVec3d forward_;
+	UMVec3d lens_u_;
+	UMVec3d lens_v_;
+	double aperture_;
+	double focus_distance_;
+};
+
+} // umrt
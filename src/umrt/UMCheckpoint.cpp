@@ -0,0 +1,213 @@
+/**
+ * @file UMCheckpoint.cpp
+ * checkpoint of progressive rendering
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMCheckpoint.h"
+#include "UMFrameBuffer.h"
+#include "UMStringUtil.h"
+
+#include <cstdio>
+#include <fstream>
+
+#if defined(_WIN32) && !defined(WITH_EMSCRIPTEN)
+	#include <windows.h>
+#endif
+
+namespace
+{
+	using namespace umrt;
+
+	const unsigned int checkpoint_magic = 0x50434d55;
+	const unsigned int checkpoint_version = 1;
+
+	// written in host byte order
+	struct CheckpointHeader
+	{
+		unsigned int magic;
+		unsigned int version;
+		int width;
+		int height;
+		int sample_count;
+		int super_sampling_x;
+		int super_sampling_y;
+		int light_sample_count;
+		int light_sampling_type;
+		int bucket_order;
+		int bucket_size;
+		int crop_x;
+		int crop_y;
+		int crop_width;
+		int crop_height;
+		int current_sample_count;
+		int current_subpixel_x;
+		int current_subpixel_y;
+	};
+
+	/**
+	 * report a mismatched setting
+	 */
+	bool is_same(const char* name, int saved, int current)
+	{
+		if (saved == current) return true;
+		fprintf(stderr, "checkpoint %s mismatch: saved %d, current %d\n", name, saved, current);
+		return false;
+	}
+
+	/**
+	 * replace dst by src
+	 */
+	bool replace_file(const std::string& src, const std::string& dst)
+	{
+#if defined(_WIN32) && !defined(WITH_EMSCRIPTEN)
+		return ::MoveFileExA(src.c_str(), dst.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		return std::rename(src.c_str(), dst.c_str()) == 0;
+#endif
+	}
+
+} // anonymouse namespace
+
+namespace umrt
+{
+
+/**
+ * check this checkpoint can be resumed with current settings
+ */
+bool UMCheckpoint::is_compatible(const UMCheckpoint& current) const
+{
+	bool result = true;
+	result &= is_same("width", width, current.width);
+	result &= is_same("height", height, current.height);
+	result &= is_same("super sampling x", super_sampling_count.x, current.super_sampling_count.x);
+	result &= is_same("super sampling y", super_sampling_count.y, current.super_sampling_count.y);
+	result &= is_same("light sample count", light_sample_count, current.light_sample_count);
+	result &= is_same("light sampling type", light_sampling_type, current.light_sampling_type);
+	result &= is_same("bucket order", bucket_order, current.bucket_order);
+	result &= is_same("bucket size", bucket_size, current.bucket_size);
+	result &= is_same("crop x", crop_window.x, current.crop_window.x);
+	result &= is_same("crop y", crop_window.y, current.crop_window.y);
+	result &= is_same("crop width", crop_window.z, current.crop_window.z);
+	result &= is_same("crop height", crop_window.w, current.crop_window.w);
+	if (!result) return false;
+
+	// passes already done must not exceed the current sample count
+	const int pass_count = current.sample_count / (current.super_sampling_count.x * current.super_sampling_count.y);
+	if (pass_count < current_sample_count)
+	{
+		fprintf(stderr, "checkpoint sample count mismatch: %d passes done, current %d passes\n", 
+			current_sample_count, pass_count);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * save state and framebuffer
+ */
+bool UMCheckpoint::save(const umstring& path, const UMCheckpoint& checkpoint, const UMFrameBuffer& frame_buffer)
+{
+	CheckpointHeader header;
+	header.magic = checkpoint_magic;
+	header.version = checkpoint_version;
+	header.width = checkpoint.width;
+	header.height = checkpoint.height;
+	header.sample_count = checkpoint.sample_count;
+	header.super_sampling_x = checkpoint.super_sampling_count.x;
+	header.super_sampling_y = checkpoint.super_sampling_count.y;
+	header.light_sample_count = checkpoint.light_sample_count;
+	header.light_sampling_type = checkpoint.light_sampling_type;
+	header.bucket_order = checkpoint.bucket_order;
+	header.bucket_size = checkpoint.bucket_size;
+	header.crop_x = checkpoint.crop_window.x;
+	header.crop_y = checkpoint.crop_window.y;
+	header.crop_width = checkpoint.crop_window.z;
+	header.crop_height = checkpoint.crop_window.w;
+	header.current_sample_count = checkpoint.current_sample_count;
+	header.current_subpixel_x = checkpoint.current_subpixel_x;
+	header.current_subpixel_y = checkpoint.current_subpixel_y;
+
+	const std::string filepath = umbase::UMStringUtil::utf16_to_utf8(path);
+	const std::string temporary_path = filepath + ".tmp";
+	{
+		std::ofstream file(temporary_path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file) return false;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		if (!frame_buffer.write(file)) return false;
+		file.close();
+		if (file.fail()) return false;
+	}
+	return replace_file(temporary_path, filepath);
+}
+
+/**
+ * load state and framebuffer
+ */
+bool UMCheckpoint::load(
+	const umstring& path, 
+	const UMCheckpoint& current, 
+	UMCheckpoint& checkpoint, 
+	UMFrameBuffer& frame_buffer)
+{
+	const std::string filepath = umbase::UMStringUtil::utf16_to_utf8(path);
+	std::ifstream file(filepath.c_str(), std::ios::in | std::ios::binary);
+	if (!file) return false;
+
+	CheckpointHeader header;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file.good()) return false;
+	if (header.magic != checkpoint_magic || header.version != checkpoint_version) return false;
+	if (header.width <= 0 || header.height <= 0) return false;
+	if (header.super_sampling_x <= 0 || header.super_sampling_y <= 0) return false;
+
+	UMCheckpoint loaded;
+	loaded.width = header.width;
+	loaded.height = header.height;
+	loaded.sample_count = header.sample_count;
+	loaded.super_sampling_count = UMVec2i(header.super_sampling_x, header.super_sampling_y);
+	loaded.light_sample_count = header.light_sample_count;
+	loaded.light_sampling_type = header.light_sampling_type;
+	loaded.bucket_order = header.bucket_order;
+	loaded.bucket_size = header.bucket_size;
+	loaded.crop_window = UMVec4i(header.crop_x, header.crop_y, header.crop_width, header.crop_height);
+	loaded.current_sample_count = header.current_sample_count;
+	loaded.current_subpixel_x = header.current_subpixel_x;
+	loaded.current_subpixel_y = header.current_subpixel_y;
+	if (!loaded.is_compatible(current)) return false;
+
+	// reading replaces enabled layers. layers enabled now must be in the checkpoint.
+	bool is_enabled[UMFrameBuffer::eLayerTypeMax];
+	for (int i = 0; i < UMFrameBuffer::eLayerTypeMax; ++i)
+	{
+		is_enabled[i] = frame_buffer.is_layer_enabled(static_cast<UMFrameBuffer::LayerType>(i));
+	}
+	bool result = frame_buffer.read(file) &&
+		frame_buffer.width() == header.width && 
+		frame_buffer.height() == header.height;
+	for (int i = 0; result && i < UMFrameBuffer::eLayerTypeMax; ++i)
+	{
+		const UMFrameBuffer::LayerType type = static_cast<UMFrameBuffer::LayerType>(i);
+		if (is_enabled[i] && !frame_buffer.is_layer_enabled(type))
+		{
+			fprintf(stderr, "checkpoint has no %s layer\n", UMFrameBuffer::layer_name(type));
+			result = false;
+		}
+	}
+	if (!result)
+	{
+		for (int i = 0; i < UMFrameBuffer::eLayerTypeMax; ++i)
+		{
+			frame_buffer.set_layer_enabled(static_cast<UMFrameBuffer::LayerType>(i), is_enabled[i]);
+		}
+		return false;
+	}
+	checkpoint = loaded;
+	return true;
+}
+
+} // umrt
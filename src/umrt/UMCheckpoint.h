@@ -0,0 +1,91 @@
+/**
+ * @file UMCheckpoint.h
+ * checkpoint of progressive rendering
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include "UMMacro.h"
+#include "UMMathTypes.h"
+#include "UMVector.h"
+
+namespace umrt
+{
+
+class UMFrameBuffer;
+
+/**
+ * progressive rendering state.
+ * sampler state is not stored because seeds are derived from pass and bucket position.
+ */
+class UMCheckpoint
+{
+public:
+	UMCheckpoint()
+		: width(0)
+		, height(0)
+		, sample_count(0)
+		, super_sampling_count(1, 1)
+		, light_sample_count(0)
+		, light_sampling_type(0)
+		, bucket_order(0)
+		, bucket_size(0)
+		, crop_window(0, 0, 0, 0)
+		, current_sample_count(0)
+		, current_subpixel_x(0)
+		, current_subpixel_y(0)
+	{}
+
+	~UMCheckpoint() {}
+
+	int width;
+	int height;
+	int sample_count;
+	UMVec2i super_sampling_count;
+	int light_sample_count;
+	int light_sampling_type;
+	int bucket_order;
+	int bucket_size;
+	UMVec4i crop_window;
+	int current_sample_count;
+	int current_subpixel_x;
+	int current_subpixel_y;
+
+	/**
+	 * check this checkpoint can be resumed with current settings.
+	 * sample count may be raised. other changes make passes and buckets differ.
+	 * @param [in] current state of current settings. progress is ignored.
+	 * @retval compatible or not. mismatch is reported to stderr.
+	 */
+	bool is_compatible(const UMCheckpoint& current) const;
+
+	/**
+	 * save state and framebuffer to a binary file.
+	 * written to a temporary file and renamed, so a killed process keeps the previous checkpoint.
+	 * @retval success or failed
+	 */
+	static bool save(const umstring& path, const UMCheckpoint& checkpoint, const UMFrameBuffer& frame_buffer);
+
+	/**
+	 * load state and framebuffer from a binary file.
+	 * fails without reading pixels when settings are not compatible,
+	 * and keeps enabled layers of framebuffer when failed.
+	 * @param [in] path checkpoint file path
+	 * @param [in] current state of current settings
+	 * @param [out] checkpoint loaded state
+	 * @param [in,out] frame_buffer framebuffer with current enabled layers
+	 * @retval success or failed
+	 */
+	static bool load(
+		const umstring& path, 
+		const UMCheckpoint& current, 
+		UMCheckpoint& checkpoint, 
+		UMFrameBuffer& frame_buffer);
+};
+
+} // umrt
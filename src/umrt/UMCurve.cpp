@@ -0,0 +1,769 @@
+/**
+ * @file UMCurve.cpp
+ * ray traced curves
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMCurve.h"
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#ifdef WITH_ALEMBIC
+	#include "UMAbcCurve.h"
+#endif
+
+#ifndef WITH_EMSCRIPTEN
+	#include <xmmintrin.h>
+	#define UM_CURVE_SSE
+#endif
+
+namespace
+{
+	using namespace umrt;
+
+	const unsigned int max_leaf_count = 4;
+
+	/// number of linear pieces of a cubic segment at intersection
+	const int cubic_subdivision = 8;
+
+	/**
+	 * slab test of a node box
+	 */
+	bool intersect_node(
+		const float* box_min,
+		const float* box_max,
+		const UMVec3d& origin,
+		const UMVec3d& inv_dir,
+		double tmin,
+		double tmax)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			double t0 = (box_min[i] - origin[i]) * inv_dir[i];
+			double t1 = (box_max[i] - origin[i]) * inv_dir[i];
+			if (t0 > t1) std::swap(t0, t1);
+			tmin = t0 > tmin ? t0 : tmin;
+			tmax = t1 < tmax ? t1 : tmax;
+			if (tmin > tmax) return false;
+		}
+		return true;
+	}
+
+	/**
+	 * compare segment centers on an axis
+	 */
+	class SegmentAxisLess
+	{
+	public:
+		SegmentAxisLess(const std::vector<float>& bounds, int axis)
+			: bounds_(bounds), axis_(axis) {}
+
+		bool operator()(unsigned int a, unsigned int b) const
+		{
+			return bounds_[a * 9 + 6 + axis_] < bounds_[b * 9 + 6 + axis_];
+		}
+
+	private:
+		const std::vector<float>& bounds_;
+		int axis_;
+	};
+
+	/**
+	 * float which is not greater than value
+	 */
+	float float_floor(double value)
+	{
+		const float f = static_cast<float>(value);
+		return f > value ? std::nextafter(f, -FLT_MAX) : f;
+	}
+
+	/**
+	 * float which is not less than value
+	 */
+	float float_ceil(double value)
+	{
+		const float f = static_cast<float>(value);
+		return f < value ? std::nextafter(f, FLT_MAX) : f;
+	}
+
+	/**
+	 * coordinate system where the ray is +z axis from the origin
+	 */
+	struct RayFrame
+	{
+		explicit RayFrame(const UMRay& ray)
+			: origin(ray.origin())
+		{
+			length = ray.direction().length();
+			w = ray.direction() * (1.0 / length);
+			if (std::fabs(w.x) > std::fabs(w.y))
+			{
+				u = UMVec3d(-w.z, 0, w.x) * (1.0 / std::sqrt(w.x * w.x + w.z * w.z));
+			}
+			else
+			{
+				u = UMVec3d(0, w.z, -w.y) * (1.0 / std::sqrt(w.y * w.y + w.z * w.z));
+			}
+			v = w.cross(u);
+		}
+
+		/**
+		 * transform x, y, z, radius to ray space
+		 */
+		void transform(const float* p, float* out) const
+		{
+			const UMVec3d d(p[0] - origin.x, p[1] - origin.y, p[2] - origin.z);
+			out[0] = static_cast<float>(d.dot(u));
+			out[1] = static_cast<float>(d.dot(v));
+			out[2] = static_cast<float>(d.dot(w));
+			out[3] = p[3];
+		}
+
+		UMVec3d origin;
+		UMVec3d u;
+		UMVec3d v;
+		UMVec3d w;
+		double length;
+	};
+
+	/**
+	 * 4 linear segments in ray space (structure of arrays)
+	 */
+	struct Segments4
+	{
+		float ax[4];
+		float ay[4];
+		float az[4];
+		float ar[4];
+		float bx[4];
+		float by[4];
+		float bz[4];
+		float br[4];
+
+		void set(int lane, const float* a, const float* b)
+		{
+			ax[lane] = a[0]; ay[lane] = a[1]; az[lane] = a[2]; ar[lane] = a[3];
+			bx[lane] = b[0]; by[lane] = b[1]; bz[lane] = b[2]; br[lane] = b[3];
+		}
+
+		/**
+		 * make a lane never hit
+		 */
+		void disable(int lane)
+		{
+			ax[lane] = ay[lane] = bx[lane] = by[lane] = 0.0f;
+			ar[lane] = br[lane] = 0.0f;
+			az[lane] = bz[lane] = -1.0f;
+		}
+	};
+
+	/**
+	 * intersect 4 segments at once.
+	 * a hit is the nearest point on a segment to the ray axis, within the radius there.
+	 * for tubes the distance is moved to the front surface.
+	 * hits nearer than the strand width are ignored to avoid self intersection.
+	 * @retval lane of nearest hit, or -1
+	 */
+	int intersect_segments4(
+		const Segments4& seg,
+		bool is_tube,
+		float min_z,
+		float max_z,
+		float& hit_s,
+		float& hit_z)
+	{
+		float lane_s[4];
+		float lane_z[4];
+		int mask = 0;
+#ifdef UM_CURVE_SSE
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 ax = _mm_loadu_ps(seg.ax);
+		const __m128 ay = _mm_loadu_ps(seg.ay);
+		const __m128 az = _mm_loadu_ps(seg.az);
+		const __m128 ar = _mm_loadu_ps(seg.ar);
+		const __m128 dx = _mm_sub_ps(_mm_loadu_ps(seg.bx), ax);
+		const __m128 dy = _mm_sub_ps(_mm_loadu_ps(seg.by), ay);
+		const __m128 dz = _mm_sub_ps(_mm_loadu_ps(seg.bz), az);
+		const __m128 dr = _mm_sub_ps(_mm_loadu_ps(seg.br), ar);
+
+		// closest point to the ray axis in xy plane
+		const __m128 length_sq = _mm_max_ps(
+			_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_set1_ps(FLT_MIN));
+		const __m128 numerator = _mm_sub_ps(zero, _mm_add_ps(_mm_mul_ps(ax, dx), _mm_mul_ps(ay, dy)));
+		const __m128 s = _mm_min_ps(_mm_max_ps(_mm_div_ps(numerator, length_sq), zero), one);
+		const __m128 px = _mm_add_ps(ax, _mm_mul_ps(dx, s));
+		const __m128 py = _mm_add_ps(ay, _mm_mul_ps(dy, s));
+		const __m128 distance_sq = _mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py));
+		const __m128 r = _mm_add_ps(ar, _mm_mul_ps(dr, s));
+		const __m128 r_sq = _mm_mul_ps(r, r);
+		__m128 z = _mm_add_ps(az, _mm_mul_ps(dz, s));
+		if (is_tube)
+		{
+			z = _mm_sub_ps(z, _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(r_sq, distance_sq), zero)));
+		}
+		const __m128 lane_min_z = _mm_max_ps(_mm_set1_ps(min_z), _mm_add_ps(r, r));
+		const __m128 hit = _mm_and_ps(
+			_mm_cmple_ps(distance_sq, r_sq),
+			_mm_and_ps(_mm_cmpgt_ps(z, lane_min_z), _mm_cmplt_ps(z, _mm_set1_ps(max_z))));
+		mask = _mm_movemask_ps(hit);
+		if (mask == 0) return -1;
+		_mm_storeu_ps(lane_s, s);
+		_mm_storeu_ps(lane_z, z);
+#else
+		for (int i = 0; i < 4; ++i)
+		{
+			const float dx = seg.bx[i] - seg.ax[i];
+			const float dy = seg.by[i] - seg.ay[i];
+			const float length_sq = std::max(dx * dx + dy * dy, FLT_MIN);
+			const float s = std::min(std::max(-(seg.ax[i] * dx + seg.ay[i] * dy) / length_sq, 0.0f), 1.0f);
+			const float px = seg.ax[i] + dx * s;
+			const float py = seg.ay[i] + dy * s;
+			const float distance_sq = px * px + py * py;
+			const float r = seg.ar[i] + (seg.br[i] - seg.ar[i]) * s;
+			float z = seg.az[i] + (seg.bz[i] - seg.az[i]) * s;
+			if (is_tube)
+			{
+				z -= std::sqrt(std::max(r * r - distance_sq, 0.0f));
+			}
+			lane_s[i] = s;
+			lane_z[i] = z;
+			if (distance_sq <= r * r && z > std::max(min_z, r + r) && z < max_z)
+			{
+				mask |= (1 << i);
+			}
+		}
+		if (mask == 0) return -1;
+#endif // UM_CURVE_SSE
+		int lane = -1;
+		float nearest = max_z;
+		for (int i = 0; i < 4; ++i)
+		{
+			if ((mask & (1 << i)) && lane_z[i] < nearest)
+			{
+				lane = i;
+				nearest = lane_z[i];
+			}
+		}
+		hit_s = lane_s[lane];
+		hit_z = nearest;
+		return lane;
+	}
+
+	/**
+	 * evaluate cubic bezier of x, y, z, radius
+	 */
+	void bezier_point(const float control_points[4][4], float t, float* out)
+	{
+		const float mt = 1.0f - t;
+		const float b0 = mt * mt * mt;
+		const float b1 = 3.0f * t * mt * mt;
+		const float b2 = 3.0f * t * t * mt;
+		const float b3 = t * t * t;
+		for (int k = 0; k < 4; ++k)
+		{
+			out[k] = control_points[0][k] * b0
+				+ control_points[1][k] * b1
+				+ control_points[2][k] * b2
+				+ control_points[3][k] * b3;
+		}
+	}
+
+	/**
+	 * ray distance in float without overflow
+	 */
+	float to_ray_space(double distance, double length)
+	{
+		return static_cast<float>(std::min(distance * length, static_cast<double>(FLT_MAX)));
+	}
+
+} // anonymouse namespace
+
+namespace umrt
+{
+
+/**
+ * create from alembic curves
+ */
+UMCurvePtr UMCurve::create_from_abc_curve(umabc::UMAbcCurvePtr curve, ShapeType type)
+{
+	UMCurvePtr instance(std::make_shared<UMCurve>());
+	instance->abc_curve_ = curve;
+	instance->shape_type_ = type;
+	instance->material_ = umdraw::UMMaterial::default_material();
+	instance->update_box();
+	return instance;
+}
+
+/**
+ * constructor
+ */
+UMCurve::UMCurve()
+	: shape_type_(eRibbon)
+	, default_width_(0.01)
+	, is_cubic_(false)
+{
+}
+
+/**
+ * clear all curves
+ */
+void UMCurve::clear()
+{
+	vertex_list_.clear();
+	segment_list_.clear();
+	is_cubic_ = false;
+}
+
+/**
+ * add a curve. cubic curves are converted to bezier segments.
+ */
+void UMCurve::add_curve(
+	const float* positions,
+	const float* widths,
+	bool is_constant_width,
+	int vertex_count,
+	BasisType basis,
+	unsigned int curve_index)
+{
+	if (vertex_count < 2) return;
+
+	// control points with radius
+	std::vector<float> points(vertex_count * 4);
+	for (int i = 0; i < vertex_count; ++i)
+	{
+		float width = static_cast<float>(default_width_);
+		if (widths)
+		{
+			width = is_constant_width ? widths[0] : widths[i];
+		}
+		points[i * 4 + 0] = positions[i * 3 + 0];
+		points[i * 4 + 1] = positions[i * 3 + 1];
+		points[i * 4 + 2] = positions[i * 3 + 2];
+		points[i * 4 + 3] = width * 0.5f;
+	}
+
+	if (basis == eLinear)
+	{
+		const unsigned int first = static_cast<unsigned int>(vertex_list_.size() / 4);
+		vertex_list_.insert(vertex_list_.end(), points.begin(), points.end());
+		for (int i = 0; i + 1 < vertex_count; ++i)
+		{
+			Segment segment = { first + i, curve_index };
+			segment_list_.push_back(segment);
+		}
+		return;
+	}
+
+	is_cubic_ = true;
+	const int step = (basis == eBezier) ? 3 : 1;
+	for (int i = 0; i + 3 < vertex_count; i += step)
+	{
+		const float* p0 = &points[(i + 0) * 4];
+		const float* p1 = &points[(i + 1) * 4];
+		const float* p2 = &points[(i + 2) * 4];
+		const float* p3 = &points[(i + 3) * 4];
+		float b[4][4];
+		for (int k = 0; k < 4; ++k)
+		{
+			if (basis == eBspline)
+			{
+				b[0][k] = (p0[k] + 4.0f * p1[k] + p2[k]) / 6.0f;
+				b[1][k] = (2.0f * p1[k] + p2[k]) / 3.0f;
+				b[2][k] = (p1[k] + 2.0f * p2[k]) / 3.0f;
+				b[3][k] = (p1[k] + 4.0f * p2[k] + p3[k]) / 6.0f;
+			}
+			else if (basis == eCatmullRom)
+			{
+				b[0][k] = p1[k];
+				b[1][k] = p1[k] + (p2[k] - p0[k]) / 6.0f;
+				b[2][k] = p2[k] - (p3[k] - p1[k]) / 6.0f;
+				b[3][k] = p2[k];
+			}
+			else
+			{
+				b[0][k] = p0[k];
+				b[1][k] = p1[k];
+				b[2][k] = p2[k];
+				b[3][k] = p3[k];
+			}
+		}
+		Segment segment = { static_cast<unsigned int>(vertex_list_.size() / 4), curve_index };
+		segment_list_.push_back(segment);
+		for (int n = 0; n < 4; ++n)
+		{
+			b[n][3] = std::max(b[n][3], 0.0f);
+			vertex_list_.insert(vertex_list_.end(), b[n], b[n] + 4);
+		}
+	}
+}
+
+/**
+ * read current sample and rebuild bvh
+ */
+void UMCurve::update_box()
+{
+#ifdef WITH_ALEMBIC
+	if (umabc::UMAbcCurvePtr curve = abc_curve_.lock())
+	{
+		clear();
+		Alembic::AbcGeom::P3fArraySamplePtr positions = curve->positions();
+		Alembic::AbcGeom::Int32ArraySamplePtr vertex_count = curve->vertex_count();
+		Alembic::AbcGeom::FloatArraySamplePtr widths = curve->widths();
+		if (positions && vertex_count)
+		{
+			BasisType basis = eLinear;
+			if (curve->curve_type() == Alembic::AbcGeom::kCubic)
+			{
+				switch (curve->basis_type())
+				{
+				case Alembic::AbcGeom::kBezierBasis: basis = eBezier; break;
+				case Alembic::AbcGeom::kBsplineBasis: basis = eBspline; break;
+				case Alembic::AbcGeom::kCatmullromBasis: basis = eCatmullRom; break;
+				default: break;
+				}
+			}
+			const float* position_data = reinterpret_cast<const float*>(positions->get());
+			const size_t position_count = positions->size();
+			const size_t curve_count = vertex_count->size();
+			const size_t width_count = widths ? widths->size() : 0;
+			size_t offset = 0;
+			for (size_t i = 0; i < curve_count; ++i)
+			{
+				const int count = (*vertex_count)[i];
+				if (count <= 0 || offset + count > position_count) break;
+				const float* width_data = NULL;
+				bool is_constant_width = false;
+				if (width_count == position_count)
+				{
+					width_data = widths->get() + offset;
+				}
+				else if (width_count == curve_count)
+				{
+					width_data = widths->get() + i;
+					is_constant_width = true;
+				}
+				else if (width_count == 1)
+				{
+					width_data = widths->get();
+					is_constant_width = true;
+				}
+				add_curve(
+					position_data + offset * 3,
+					width_data,
+					is_constant_width,
+					count,
+					basis,
+					static_cast<unsigned int>(i));
+				offset += count;
+			}
+		}
+	}
+#endif // WITH_ALEMBIC
+	build();
+}
+
+/**
+ * build bvh
+ */
+void UMCurve::build()
+{
+	const size_t segment_count = segment_list_.size();
+	node_list_.clear();
+	index_list_.resize(segment_count);
+	box_.init();
+	if (segment_count == 0) return;
+
+	// box min, box max, center of each segment
+	std::vector<float> bounds(segment_count * 9);
+	const int vertex_count = is_cubic_ ? 4 : 2;
+	for (size_t i = 0; i < segment_count; ++i)
+	{
+		index_list_[i] = static_cast<unsigned int>(i);
+		float* b = &bounds[i * 9];
+		for (int k = 0; k < 3; ++k)
+		{
+			b[k] = FLT_MAX;
+			b[3 + k] = -FLT_MAX;
+		}
+		// cubic bezier is in the hull of control points
+		for (int n = 0; n < vertex_count; ++n)
+		{
+			const float* p = &vertex_list_[(segment_list_[i].vertex + n) * 4];
+			for (int k = 0; k < 3; ++k)
+			{
+				b[k] = std::min(b[k], p[k] - p[3]);
+				b[3 + k] = std::max(b[3 + k], p[k] + p[3]);
+			}
+		}
+		for (int k = 0; k < 3; ++k)
+		{
+			b[6 + k] = (b[k] + b[3 + k]) * 0.5f;
+		}
+	}
+	node_list_.reserve(2 * (segment_count / max_leaf_count) + 1);
+	build_node(0, static_cast<unsigned int>(segment_count), bounds);
+
+	const Node& root = node_list_[0];
+	box_.extend(UMVec3d(root.box_min[0], root.box_min[1], root.box_min[2]));
+	box_.extend(UMVec3d(root.box_max[0], root.box_max[1], root.box_max[2]));
+}
+
+/**
+ * build a node by median split.
+ * nodes are in depth first order, so left child is next to parent.
+ */
+unsigned int UMCurve::build_node(unsigned int start, unsigned int end, const std::vector<float>& bounds)
+{
+	const unsigned int node_index = static_cast<unsigned int>(node_list_.size());
+	node_list_.push_back(Node());
+
+	UMVec3d box_min(DBL_MAX);
+	UMVec3d box_max(-DBL_MAX);
+	UMVec3d center_min(DBL_MAX);
+	UMVec3d center_max(-DBL_MAX);
+	for (unsigned int i = start; i < end; ++i)
+	{
+		const float* b = &bounds[index_list_[i] * 9];
+		for (int k = 0; k < 3; ++k)
+		{
+			box_min[k] = std::min(box_min[k], static_cast<double>(b[k]));
+			box_max[k] = std::max(box_max[k], static_cast<double>(b[3 + k]));
+			center_min[k] = std::min(center_min[k], static_cast<double>(b[6 + k]));
+			center_max[k] = std::max(center_max[k], static_cast<double>(b[6 + k]));
+		}
+	}
+	{
+		Node& node = node_list_[node_index];
+		for (int k = 0; k < 3; ++k)
+		{
+			node.box_min[k] = float_floor(box_min[k]);
+			node.box_max[k] = float_ceil(box_max[k]);
+		}
+	}
+
+	if ((end - start) <= max_leaf_count)
+	{
+		Node& node = node_list_[node_index];
+		node.offset = start;
+		node.count = static_cast<unsigned short>(end - start);
+		node.axis = 0;
+		return node_index;
+	}
+
+	const UMVec3d extent = center_max - center_min;
+	int axis = 0;
+	if (extent.y > extent.x) axis = 1;
+	if (extent.z > extent[axis]) axis = 2;
+
+	const unsigned int middle = (start + end) / 2;
+	std::nth_element(
+		index_list_.begin() + start,
+		index_list_.begin() + middle,
+		index_list_.begin() + end,
+		SegmentAxisLess(bounds, axis));
+
+	build_node(start, middle, bounds);
+	const unsigned int right = build_node(middle, end, bounds);
+
+	Node& node = node_list_[node_index];
+	node.offset = right;
+	node.count = 0;
+	node.axis = static_cast<unsigned short>(axis);
+	return node_index;
+}
+
+/**
+ * traverse bvh.
+ * linear segments of a leaf, or pieces of a cubic segment, are intersected 4 at once.
+ */
+bool UMCurve::traverse(const UMRay& ray, bool is_any_hit, Hit& hit) const
+{
+	if (node_list_.empty()) return false;
+
+	const RayFrame frame(ray);
+	const float min_z = to_ray_space(ray.tmin(), frame.length);
+	const bool is_tube = (shape_type_ == eTube);
+	const UMVec3d& origin = ray.origin();
+	const UMVec3d inv_dir(1.0 / ray.direction().x, 1.0 / ray.direction().y, 1.0 / ray.direction().z);
+	const bool dir_is_negative[3] = { inv_dir.x < 0, inv_dir.y < 0, inv_dir.z < 0 };
+
+	bool is_hit = false;
+	Segments4 segments;
+	float s = 0.0f;
+	float z = 0.0f;
+	unsigned int branch_stack[64];
+	unsigned int branch_stack_index = 0;
+	for (unsigned int i = 0; ; )
+	{
+		const Node& node = node_list_[i];
+		if (intersect_node(node.box_min, node.box_max, origin, inv_dir, ray.tmin(), hit.distance))
+		{
+			if (node.count > 0)
+			{
+				if (!is_cubic_)
+				{
+					for (int lane = 0; lane < 4; ++lane)
+					{
+						if (lane >= node.count)
+						{
+							segments.disable(lane);
+							continue;
+						}
+						const Segment& segment = segment_list_[index_list_[node.offset + lane]];
+						float a[4];
+						float b[4];
+						frame.transform(&vertex_list_[segment.vertex * 4], a);
+						frame.transform(&vertex_list_[(segment.vertex + 1) * 4], b);
+						segments.set(lane, a, b);
+					}
+					const int lane = intersect_segments4(
+						segments, is_tube, min_z, to_ray_space(hit.distance, frame.length), s, z);
+					if (lane >= 0)
+					{
+						hit.segment = index_list_[node.offset + lane];
+						hit.u = s;
+						hit.distance = z / frame.length;
+						is_hit = true;
+						if (is_any_hit) return true;
+					}
+				}
+				else
+				{
+					for (unsigned int k = node.offset, end = node.offset + node.count; k < end; ++k)
+					{
+						const Segment& segment = segment_list_[index_list_[k]];
+						float control_points[4][4];
+						for (int n = 0; n < 4; ++n)
+						{
+							frame.transform(&vertex_list_[(segment.vertex + n) * 4], control_points[n]);
+						}
+						float points[cubic_subdivision + 1][4];
+						for (int n = 0; n <= cubic_subdivision; ++n)
+						{
+							bezier_point(control_points, n / static_cast<float>(cubic_subdivision), points[n]);
+						}
+						for (int piece = 0; piece < cubic_subdivision; piece += 4)
+						{
+							for (int lane = 0; lane < 4; ++lane)
+							{
+								segments.set(lane, points[piece + lane], points[piece + lane + 1]);
+							}
+							const int lane = intersect_segments4(
+								segments, is_tube, min_z, to_ray_space(hit.distance, frame.length), s, z);
+							if (lane >= 0)
+							{
+								hit.segment = index_list_[k];
+								hit.u = (piece + lane + s) / static_cast<double>(cubic_subdivision);
+								hit.distance = z / frame.length;
+								is_hit = true;
+								if (is_any_hit) return true;
+							}
+						}
+					}
+				}
+				if (branch_stack_index == 0) break;
+				i = branch_stack[--branch_stack_index];
+			}
+			else
+			{
+				// nearer child first
+				if (dir_is_negative[node.axis])
+				{
+					branch_stack[branch_stack_index++] = i + 1;
+					i = node.offset;
+				}
+				else
+				{
+					branch_stack[branch_stack_index++] = node.offset;
+					++i;
+				}
+			}
+		}
+		else
+		{
+			if (branch_stack_index == 0) break;
+			i = branch_stack[--branch_stack_index];
+		}
+	}
+	return is_hit;
+}
+
+/**
+ * evaluate center of a segment in world space
+ */
+UMVec3d UMCurve::evaluate(const Segment& segment, double u) const
+{
+	if (!is_cubic_)
+	{
+		const float* a = &vertex_list_[segment.vertex * 4];
+		const float* b = &vertex_list_[(segment.vertex + 1) * 4];
+		return UMVec3d(a[0], a[1], a[2]) * (1.0 - u) + UMVec3d(b[0], b[1], b[2]) * u;
+	}
+	float control_points[4][4];
+	for (int n = 0; n < 4; ++n)
+	{
+		std::copy(&vertex_list_[(segment.vertex + n) * 4], &vertex_list_[(segment.vertex + n) * 4] + 4, control_points[n]);
+	}
+	float p[4];
+	bezier_point(control_points, static_cast<float>(u), p);
+	return UMVec3d(p[0], p[1], p[2]);
+}
+
+/**
+ * ray intersection
+ */
+bool UMCurve::intersects(const UMRay& ray, UMShaderParameter& parameter) const
+{
+	Hit hit = { 0, 0.0, ray.tmax() };
+	if (!traverse(ray, false, hit)) return false;
+
+	const Segment& segment = segment_list_[hit.segment];
+	const UMVec3d& dir = ray.direction();
+	const UMVec3d p = ray.origin() + dir * hit.distance;
+	const UMVec3d facing = (-dir).normalized();
+	parameter.distance = hit.distance;
+	parameter.intersect_point = p;
+	parameter.normal = facing;
+	if (shape_type_ == eTube)
+	{
+		const UMVec3d normal = p - evaluate(segment, hit.u);
+		if (normal.length_sq() > 0.0)
+		{
+			parameter.normal = normal.normalized();
+		}
+	}
+	parameter.face_normal = parameter.normal;
+	parameter.uvw = UMVec3d(1.0, 0.0, 0.0);
+	parameter.uv = UMVec2d(hit.u, 0.0);
+	parameter.face_index = static_cast<int>(segment.curve);
+	parameter.primitive = this;
+	parameter.material = material_;
+	if (material_)
+	{
+		parameter.color = material_->diffuse().xyz();
+		parameter.emissive = material_->emissive().xyz() * material_->emissive_factor();
+	}
+	else
+	{
+		parameter.emissive = UMVec3d(0);
+	}
+	return true;
+}
+
+/**
+ * ray intersection
+ */
+bool UMCurve::intersects(const UMRay& ray) const
+{
+	Hit hit = { 0, 0.0, ray.tmax() };
+	return traverse(ray, true, hit);
+}
+
+} // umrt
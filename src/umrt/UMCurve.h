@@ -0,0 +1,201 @@
+/**
+ * @file UMCurve.h
+ * ray traced curves
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "UMMacro.h"
+#include "UMVector.h"
+#include "UMMathTypes.h"
+#include "UMBox.h"
+#include "UMPrimitive.h"
+#include "UMRay.h"
+#include "UMShaderParameter.h"
+
+namespace umabc
+{
+	class UMAbcCurve;
+	typedef std::shared_ptr<UMAbcCurve> UMAbcCurvePtr;
+	typedef std::weak_ptr<UMAbcCurve> UMAbcCurveWeakPtr;
+} // umabc
+
+namespace umrt
+{
+
+class UMCurve;
+typedef std::shared_ptr<UMCurve> UMCurvePtr;
+typedef std::vector<UMCurvePtr> UMCurveList;
+
+/**
+ * ray traced curves.
+ * all curves are one primitive which has its own bvh over curve segments,
+ * so a long strand is bounded by many small boxes instead of one large box.
+ * cubic segments are stored as bezier and flattened at intersection.
+ */
+class UMCurve : public UMPrimitive
+{
+	DISALLOW_COPY_AND_ASSIGN(UMCurve);
+public:
+	/**
+	 * shape of a curve
+	 */
+	enum ShapeType {
+		eRibbon, ///< flat ribbon facing the ray
+		eTube,
+	};
+
+	/**
+	 * basis of control points
+	 */
+	enum BasisType {
+		eLinear,
+		eBezier,
+		eBspline,
+		eCatmullRom,
+	};
+
+	/**
+	 * create from alembic curves
+	 * @param [in] curve alembic curves
+	 * @param [in] type shape of a curve
+	 */
+	static UMCurvePtr create_from_abc_curve(umabc::UMAbcCurvePtr curve, ShapeType type);
+
+	UMCurve();
+
+	~UMCurve() {}
+
+	/**
+	 * ray intersection
+	 * @param [in] ray a ray
+	 * @param [in,out] parameter shading parameters
+	 */
+	virtual bool intersects(const UMRay& ray, UMShaderParameter& parameter) const;
+
+	/**
+	 * ray intersection
+	 * @param [in] ray a ray
+	 */
+	virtual bool intersects(const UMRay& ray) const;
+
+	/**
+	 * get box
+	 */
+	virtual const umbase::UMBox& box() const { return box_; }
+
+	/**
+	 * read current sample and rebuild bvh
+	 */
+	virtual void update_box();
+
+	/**
+	 * get shape type
+	 */
+	ShapeType shape_type() const { return shape_type_; }
+
+	/**
+	 * set shape type
+	 */
+	void set_shape_type(ShapeType type) { shape_type_ = type; }
+
+	/**
+	 * get width of curves without widths
+	 */
+	double default_width() const { return default_width_; }
+
+	/**
+	 * set width of curves without widths
+	 */
+	void set_default_width(double width) { default_width_ = width; }
+
+	/**
+	 * get number of segments
+	 */
+	size_t segment_count() const { return segment_list_.size(); }
+
+	/**
+	 * get material
+	 */
+	umdraw::UMMaterialPtr material() const { return material_; }
+
+	/**
+	 * set material
+	 */
+	void set_material(umdraw::UMMaterialPtr material) { material_ = material; }
+
+private:
+	/**
+	 * bvh node. 32 bytes.
+	 */
+	struct Node
+	{
+		float box_min[3];
+		float box_max[3];
+		/// leaf: first index of index_list_, branch: index of right child
+		unsigned int offset;
+		/// leaf: number of segments, branch: 0
+		unsigned short count;
+		unsigned short axis;
+	};
+	typedef std::vector<Node> NodeList;
+
+	/**
+	 * curve segment
+	 */
+	struct Segment
+	{
+		/// first vertex. linear: 2 vertices, cubic: 4 bezier vertices
+		unsigned int vertex;
+		unsigned int curve;
+	};
+	typedef std::vector<Segment> SegmentList;
+
+	/**
+	 * nearest hit
+	 */
+	struct Hit
+	{
+		unsigned int segment;
+		/// parameter on the segment
+		double u;
+		double distance;
+	};
+
+	void clear();
+	void add_curve(
+		const float* positions,
+		const float* widths,
+		bool is_constant_width,
+		int vertex_count,
+		BasisType basis,
+		unsigned int curve_index);
+	void build();
+	unsigned int build_node(unsigned int start, unsigned int end, const std::vector<float>& bounds);
+	bool traverse(const UMRay& ray, bool is_any_hit, Hit& hit) const;
+	UMVec3d evaluate(const Segment& segment, double u) const;
+
+	umabc::UMAbcCurveWeakPtr abc_curve_;
+	ShapeType shape_type_;
+	double default_width_;
+	umdraw::UMMaterialPtr material_;
+
+	bool is_cubic_;
+	/// x, y, z, radius
+	std::vector<float> vertex_list_;
+	SegmentList segment_list_;
+
+	NodeList node_list_;
+	std::vector<unsigned int> index_list_;
+	umbase::UMBox box_;
+};
+
+} // umrt
@@ -0,0 +1,245 @@
+/**
+ * @file UMDenoiser.cpp
+ * edge-avoiding a-trous wavelet denoiser
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMDenoiser.h"
+#include "UMFrameBuffer.h"
+#include "UMImage.h"
+#include "UMVector.h"
+
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#ifndef WITH_EMSCRIPTEN
+	#include <xmmintrin.h>
+	#define UM_DENOISER_SSE
+#endif
+
+namespace
+{
+	using namespace umrt;
+
+	typedef std::vector<float> FloatBuffer;
+
+	// B3 spline
+	const float kernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+	const float albedo_epsilon = 0.001f;
+
+	/**
+	 * feature buffers as float
+	 */
+	struct FeatureBuffer
+	{
+		// rgb_ (4 floats per pixel)
+		FloatBuffer albedo;
+		// xyz_ (4 floats per pixel)
+		FloatBuffer normal;
+		// 1 float per pixel
+		FloatBuffer depth;
+	};
+
+	/**
+	 * one a-trous pass
+	 * @param [out] dst filtered irradiance
+	 * @param [in] src irradiance
+	 */
+	void filter_pass(
+		FloatBuffer& dst,
+		const FloatBuffer& src,
+		const FeatureBuffer& feature,
+		int width,
+		int height,
+		int step,
+		float inv_sigma_color_sq,
+		float inv_sigma_normal_sq,
+		float inv_sigma_depth_sq)
+	{
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int y = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				const int p = y * width + x;
+				const float* np = &feature.normal[p * 4];
+				const float dp = feature.depth[p];
+				const float inv_dp = 1.0f / std::max(dp, FLT_EPSILON);
+#ifdef UM_DENOISER_SSE
+				const __m128 cp = _mm_loadu_ps(&src[p * 4]);
+				__m128 sum = _mm_setzero_ps();
+#else
+				const float* cp = &src[p * 4];
+				float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+#endif
+				float weight_sum = 0.0f;
+				for (int j = -2; j <= 2; ++j)
+				{
+					const int qy = std::min(std::max(y + j * step, 0), height - 1);
+					for (int i = -2; i <= 2; ++i)
+					{
+						const int qx = std::min(std::max(x + i * step, 0), width - 1);
+						const int q = qy * width + qx;
+
+						// color
+#ifdef UM_DENOISER_SSE
+						const __m128 cq = _mm_loadu_ps(&src[q * 4]);
+						const __m128 cd = _mm_sub_ps(cq, cp);
+						float cd2[4];
+						_mm_storeu_ps(cd2, _mm_mul_ps(cd, cd));
+						const float color_dist = cd2[0] + cd2[1] + cd2[2];
+#else
+						const float* cq = &src[q * 4];
+						const float color_dist =
+							(cq[0] - cp[0]) * (cq[0] - cp[0]) +
+							(cq[1] - cp[1]) * (cq[1] - cp[1]) +
+							(cq[2] - cp[2]) * (cq[2] - cp[2]);
+#endif
+						// normal
+						const float* nq = &feature.normal[q * 4];
+						const float normal_dist =
+							(nq[0] - np[0]) * (nq[0] - np[0]) +
+							(nq[1] - np[1]) * (nq[1] - np[1]) +
+							(nq[2] - np[2]) * (nq[2] - np[2]);
+						// relative depth
+						const float dd = (feature.depth[q] - dp) * inv_dp;
+						const float depth_dist = dd * dd;
+
+						const float weight = kernel[j + 2] * kernel[i + 2] *
+							std::exp(-color_dist * inv_sigma_color_sq
+								- normal_dist * inv_sigma_normal_sq
+								- depth_dist * inv_sigma_depth_sq);
+#ifdef UM_DENOISER_SSE
+						sum = _mm_add_ps(sum, _mm_mul_ps(cq, _mm_set1_ps(weight)));
+#else
+						sum[0] += cq[0] * weight;
+						sum[1] += cq[1] * weight;
+						sum[2] += cq[2] * weight;
+#endif
+						weight_sum += weight;
+					}
+				}
+				const float inv_weight_sum = weight_sum > 0.0f ? 1.0f / weight_sum : 0.0f;
+#ifdef UM_DENOISER_SSE
+				_mm_storeu_ps(&dst[p * 4], _mm_mul_ps(sum, _mm_set1_ps(inv_weight_sum)));
+#else
+				dst[p * 4 + 0] = sum[0] * inv_weight_sum;
+				dst[p * 4 + 1] = sum[1] * inv_weight_sum;
+				dst[p * 4 + 2] = sum[2] * inv_weight_sum;
+				dst[p * 4 + 3] = 0.0f;
+#endif
+			}
+		}
+	}
+
+} // anonymouse namespace
+
+namespace umrt
+{
+
+/**
+ * denoise image in place
+ */
+bool UMDenoiser::denoise(UMImagePtr image, const UMFrameBuffer& frame_buffer) const
+{
+	if (!image) return false;
+	return denoise(image, frame_buffer, UMVec4i(0, 0, image->width(), image->height()));
+}
+
+/**
+ * denoise a rectangle of image in place
+ */
+bool UMDenoiser::denoise(UMImagePtr image, const UMFrameBuffer& frame_buffer, const UMVec4i& rect) const
+{
+	if (!image) return false;
+	if (!image->is_valid()) return false;
+	const int image_width = image->width();
+	const int image_height = image->height();
+	if (frame_buffer.width() != image_width || frame_buffer.height() != image_height) return false;
+	if (rect.x < 0 || rect.y < 0 || rect.x + rect.z > image_width || rect.y + rect.w > image_height) return false;
+	UMFrameLayerPtr albedo = frame_buffer.layer(UMFrameBuffer::eLayerAlbedo);
+	UMFrameLayerPtr normal = frame_buffer.layer(UMFrameBuffer::eLayerNormal);
+	UMFrameLayerPtr depth = frame_buffer.layer(UMFrameBuffer::eLayerDepth);
+	if (!albedo || !normal || !depth) return false;
+	if (iteration_count_ <= 0) return true;
+
+	// buffers are local to the rectangle, so taps are clamped to it
+	const int width = rect.z;
+	const int height = rect.w;
+	const int pixel_count = width * height;
+	if (pixel_count <= 0) return true;
+
+	// demodulate albedo. filter irradiance only to keep texture detail.
+	FeatureBuffer feature;
+	feature.albedo.resize(pixel_count * 4);
+	feature.normal.resize(pixel_count * 4);
+	feature.depth.resize(pixel_count);
+	FloatBuffer src(pixel_count * 4);
+	FloatBuffer dst(pixel_count * 4);
+
+	const UMImage::ImageBuffer& color_list = image->list();
+	const UMFrameLayer& albedo_layer = *albedo;
+	const UMFrameLayer& normal_layer = *normal;
+	const UMFrameLayer& depth_layer = *depth;
+#pragma omp parallel for schedule(static)
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			const int i = y * width + x;
+			const int image_x = rect.x + x;
+			const int image_y = rect.y + y;
+			const float* albedo_pixel = albedo_layer.float_pixel(image_x, image_y);
+			const float* normal_pixel = normal_layer.float_pixel(image_x, image_y);
+			const UMVec4d& color = color_list[image_y * image_width + image_x];
+			for (int k = 0; k < 3; ++k)
+			{
+				const float a = std::max(albedo_pixel[k], albedo_epsilon);
+				feature.albedo[i * 4 + k] = a;
+				feature.normal[i * 4 + k] = normal_pixel[k];
+				src[i * 4 + k] = static_cast<float>(color[k]) / a;
+			}
+			feature.depth[i] = depth_layer.float_pixel(image_x, image_y)[0];
+		}
+	}
+
+	const float inv_sigma_normal_sq = static_cast<float>(1.0 / (sigma_normal_ * sigma_normal_));
+	const float inv_sigma_depth_sq = static_cast<float>(1.0 / (sigma_depth_ * sigma_depth_));
+	double sigma_color = sigma_color_;
+	for (int i = 0; i < iteration_count_; ++i)
+	{
+		const float inv_sigma_color_sq = static_cast<float>(1.0 / (sigma_color * sigma_color));
+		filter_pass(dst, src, feature, width, height, 1 << i,
+			inv_sigma_color_sq,
+			inv_sigma_normal_sq,
+			inv_sigma_depth_sq);
+		src.swap(dst);
+		// finer color edges on wider steps
+		sigma_color *= 0.5;
+	}
+
+	// remodulate
+	UMImage::ImageBuffer& dst_list = image->mutable_list();
+#pragma omp parallel for schedule(static)
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			const int i = y * width + x;
+			UMVec4d& color = dst_list[(rect.y + y) * image_width + rect.x + x];
+			color.x = src[i * 4 + 0] * feature.albedo[i * 4 + 0];
+			color.y = src[i * 4 + 1] * feature.albedo[i * 4 + 1];
+			color.z = src[i * 4 + 2] * feature.albedo[i * 4 + 2];
+		}
+	}
+	return true;
+}
+
+} // umrt
@@ -0,0 +1,108 @@
+/**
+ * @file UMDenoiser.h
+ * edge-avoiding a-trous wavelet denoiser
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include "UMMacro.h"
+#include "UMImageTypes.h"
+#include "UMMathTypes.h"
+
+namespace umrt
+{
+
+class UMDenoiser;
+typedef std::shared_ptr<UMDenoiser> UMDenoiserPtr;
+
+class UMFrameBuffer;
+
+/**
+ * edge-avoiding a-trous wavelet denoiser.
+ * guided by first hit albedo, normal and depth.
+ */
+class UMDenoiser
+{
+	DISALLOW_COPY_AND_ASSIGN(UMDenoiser);
+public:
+	UMDenoiser()
+		: iteration_count_(5)
+		, sigma_color_(0.6)
+		, sigma_normal_(0.1)
+		, sigma_depth_(0.05)
+	{}
+
+	~UMDenoiser() {}
+
+	/**
+	 * denoise image in place
+	 * @param [in,out] image noisy image
+	 * @param [in] frame_buffer framebuffer which has albedo, normal and depth layers
+	 * @retval success or failed
+	 */
+	bool denoise(UMImagePtr image, const UMFrameBuffer& frame_buffer) const;
+
+	/**
+	 * denoise a rectangle of image in place.
+	 * pixels out of the rectangle are neither read nor written.
+	 * @param [in,out] image noisy image
+	 * @param [in] frame_buffer framebuffer which has albedo, normal and depth layers
+	 * @param [in] rect x, y, width, height
+	 * @retval success or failed
+	 */
+	bool denoise(UMImagePtr image, const UMFrameBuffer& frame_buffer, const UMVec4i& rect) const;
+
+	/**
+	 * get iteration count
+	 */
+	int iteration_count() const { return iteration_count_; }
+
+	/**
+	 * set iteration count
+	 */
+	void set_iteration_count(int count) { iteration_count_ = count; }
+
+	/**
+	 * get color sigma
+	 */
+	double sigma_color() const { return sigma_color_; }
+
+	/**
+	 * set color sigma
+	 */
+	void set_sigma_color(double sigma) { sigma_color_ = sigma; }
+
+	/**
+	 * get normal sigma
+	 */
+	double sigma_normal() const { return sigma_normal_; }
+
+	/**
+	 * set normal sigma
+	 */
+	void set_sigma_normal(double sigma) { sigma_normal_ = sigma; }
+
+	/**
+	 * get relative depth sigma
+	 */
+	double sigma_depth() const { return sigma_depth_; }
+
+	/**
+	 * set relative depth sigma
+	 */
+	void set_sigma_depth(double sigma) { sigma_depth_ = sigma; }
+
+private:
+	int iteration_count_;
+	double sigma_color_;
+	double sigma_normal_;
+	double sigma_depth_;
+};
+
+} // umrt
@@ -0,0 +1,490 @@
+/**
+ * @file UMFrameBuffer.cpp
+ * framebuffer with arbitrary output layers
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMFrameBuffer.h"
+#include "UMShaderParameter.h"
+#include "UMPrimitive.h"
+#include "UMImage.h"
+
+#include <algorithm>
+#include <istream>
+#include <ostream>
+
+namespace
+{
+	using namespace umrt;
+
+	const char* layer_names[] = {
+		"beauty",
+		"depth",
+		"normal",
+		"albedo",
+		"primitive_id",
+		"material_id",
+		"sample_count",
+		"variance",
+	};
+
+	const UMFrameLayer::PixelType layer_pixel_types[] = {
+		UMFrameLayer::ePixelFloat3,
+		UMFrameLayer::ePixelFloat1,
+		UMFrameLayer::ePixelFloat3,
+		UMFrameLayer::ePixelFloat3,
+		UMFrameLayer::ePixelUInt1,
+		UMFrameLayer::ePixelUInt1,
+		UMFrameLayer::ePixelUInt1,
+		UMFrameLayer::ePixelFloat2,
+	};
+
+	int channel_count_of(UMFrameLayer::PixelType pixel_type)
+	{
+		switch (pixel_type)
+		{
+		case UMFrameLayer::ePixelFloat1: return 1;
+		case UMFrameLayer::ePixelFloat2: return 2;
+		case UMFrameLayer::ePixelFloat3: return 3;
+		case UMFrameLayer::ePixelFloat4: return 4;
+		case UMFrameLayer::ePixelUInt1: return 1;
+		}
+		return 0;
+	}
+
+	float luminance(const UMVec3d& color)
+	{
+		return static_cast<float>(0.2126 * color.x + 0.7152 * color.y + 0.0722 * color.z);
+	}
+
+} // anonymouse namespace
+
+namespace umrt
+{
+
+/**
+ * constructor
+ */
+UMFrameLayer::UMFrameLayer(const std::string& name, PixelType pixel_type)
+	: name_(name)
+	, pixel_type_(pixel_type)
+	, channel_count_(channel_count_of(pixel_type))
+	, width_(0)
+	, height_(0)
+	, tile_count_x_(0)
+	, tile_count_y_(0)
+{}
+
+/**
+ * init layer
+ */
+bool UMFrameLayer::init(int width, int height)
+{
+	if (width < 0 || height < 0) return false;
+	width_ = width;
+	height_ = height;
+	tile_count_x_ = (width + tile_mask) >> tile_shift;
+	tile_count_y_ = (height + tile_mask) >> tile_shift;
+	// padded to whole tiles
+	const size_t pixel_count = 
+		static_cast<size_t>(tile_count_x_ * tile_count_y_) << (tile_shift * 2);
+	if (is_uint())
+	{
+		float_buffer_.clear();
+		uint_buffer_.assign(pixel_count, 0);
+	}
+	else
+	{
+		uint_buffer_.clear();
+		float_buffer_.assign(pixel_count * channel_count_, 0.0f);
+	}
+	return true;
+}
+
+/**
+ * clear layer to zero
+ */
+void UMFrameLayer::clear()
+{
+	std::fill(float_buffer_.begin(), float_buffer_.end(), 0.0f);
+	std::fill(uint_buffer_.begin(), uint_buffer_.end(), 0);
+}
+
+/**
+ * write raw pixels
+ */
+bool UMFrameLayer::write(std::ostream& stream) const
+{
+	if (!float_buffer_.empty())
+	{
+		stream.write(reinterpret_cast<const char*>(&float_buffer_[0]), float_buffer_.size() * sizeof(float));
+	}
+	if (!uint_buffer_.empty())
+	{
+		stream.write(reinterpret_cast<const char*>(&uint_buffer_[0]), uint_buffer_.size() * sizeof(unsigned int));
+	}
+	return stream.good();
+}
+
+/**
+ * read raw pixels
+ */
+bool UMFrameLayer::read(std::istream& stream)
+{
+	if (!float_buffer_.empty())
+	{
+		stream.read(reinterpret_cast<char*>(&float_buffer_[0]), float_buffer_.size() * sizeof(float));
+	}
+	if (!uint_buffer_.empty())
+	{
+		stream.read(reinterpret_cast<char*>(&uint_buffer_[0]), uint_buffer_.size() * sizeof(unsigned int));
+	}
+	return stream.good();
+}
+
+/**
+ * constructor
+ */
+UMFrameBuffer::UMFrameBuffer()
+	: width_(0)
+	, height_(0)
+{
+	for (int i = 0; i < eLayerTypeMax; ++i)
+	{
+		is_enabled_[i] = false;
+	}
+	is_enabled_[eLayerBeauty] = true;
+	is_enabled_[eLayerSampleCount] = true;
+}
+
+/**
+ * get layer name
+ */
+const char* UMFrameBuffer::layer_name(LayerType type)
+{
+	if (type < 0 || type >= eLayerTypeMax) return "";
+	return layer_names[type];
+}
+
+/**
+ * get pixel type of a layer
+ */
+UMFrameLayer::PixelType UMFrameBuffer::layer_pixel_type(LayerType type)
+{
+	if (type < 0 || type >= eLayerTypeMax) return UMFrameLayer::ePixelFloat4;
+	return layer_pixel_types[type];
+}
+
+/**
+ * init enabled layers
+ */
+bool UMFrameBuffer::init(int width, int height)
+{
+	if (width <= 0 || height <= 0) return false;
+	width_ = width;
+	height_ = height;
+	for (int i = 0; i < eLayerTypeMax; ++i)
+	{
+		if (!is_enabled_[i])
+		{
+			layers_[i] = UMFrameLayerPtr();
+			continue;
+		}
+		LayerType type = static_cast<LayerType>(i);
+		if (!layers_[i])
+		{
+			layers_[i] = std::make_shared<UMFrameLayer>(layer_name(type), layer_pixel_type(type));
+		}
+		layers_[i]->init(width, height);
+	}
+	return true;
+}
+
+/**
+ * clear enabled layers to zero
+ */
+void UMFrameBuffer::clear()
+{
+	for (int i = 0; i < eLayerTypeMax; ++i)
+	{
+		if (layers_[i])
+		{
+			layers_[i]->clear();
+		}
+	}
+}
+
+/**
+ * is layer enabled
+ */
+bool UMFrameBuffer::is_layer_enabled(LayerType type) const
+{
+	if (type < 0 || type >= eLayerTypeMax) return false;
+	return is_enabled_[type];
+}
+
+/**
+ * set layer enabled
+ */
+void UMFrameBuffer::set_layer_enabled(LayerType type, bool enabled)
+{
+	if (type < 0 || type >= eLayerTypeMax) return;
+	if (type == eLayerBeauty || type == eLayerSampleCount) return;
+	is_enabled_[type] = enabled;
+}
+
+/**
+ * get layer
+ */
+UMFrameLayerPtr UMFrameBuffer::layer(LayerType type) const
+{
+	if (type < 0 || type >= eLayerTypeMax) return UMFrameLayerPtr();
+	return layers_[type];
+}
+
+/**
+ * find enabled layer by name
+ */
+UMFrameLayerPtr UMFrameBuffer::find_layer(const std::string& name) const
+{
+	for (int i = 0; i < eLayerTypeMax; ++i)
+	{
+		if (layers_[i] && layers_[i]->name() == name)
+		{
+			return layers_[i];
+		}
+	}
+	return UMFrameLayerPtr();
+}
+
+/**
+ * get enabled layers
+ */
+UMFrameLayerList UMFrameBuffer::enabled_layers() const
+{
+	UMFrameLayerList layers;
+	for (int i = 0; i < eLayerTypeMax; ++i)
+	{
+		if (layers_[i])
+		{
+			layers.push_back(layers_[i]);
+		}
+	}
+	return layers;
+}
+
+/**
+ * add a sample to all enabled layers
+ */
+void UMFrameBuffer::add_sample(int x, int y, const UMVec3d& color, const UMShaderParameter& first_hit)
+{
+	if (!layers_[eLayerBeauty] || !layers_[eLayerSampleCount]) return;
+
+	unsigned int& count = layers_[eLayerSampleCount]->uint_pixel(x, y);
+	++count;
+	const float inv_count = 1.0f / count;
+
+	float* beauty = layers_[eLayerBeauty]->float_pixel(x, y);
+	beauty[0] += static_cast<float>(color.x);
+	beauty[1] += static_cast<float>(color.y);
+	beauty[2] += static_cast<float>(color.z);
+
+	if (UMFrameLayer* layer = layers_[eLayerDepth].get())
+	{
+		float* depth = layer->float_pixel(x, y);
+		depth[0] += (static_cast<float>(first_hit.distance) - depth[0]) * inv_count;
+	}
+	if (UMFrameLayer* layer = layers_[eLayerNormal].get())
+	{
+		float* normal = layer->float_pixel(x, y);
+		for (int i = 0; i < 3; ++i)
+		{
+			normal[i] += (static_cast<float>(first_hit.normal[i]) - normal[i]) * inv_count;
+		}
+	}
+	if (UMFrameLayer* layer = layers_[eLayerAlbedo].get())
+	{
+		float* albedo = layer->float_pixel(x, y);
+		for (int i = 0; i < 3; ++i)
+		{
+			albedo[i] += (static_cast<float>(first_hit.color[i]) - albedo[i]) * inv_count;
+		}
+	}
+	// ids are not averaged. keep the first sample.
+	if (count == 1)
+	{
+		if (UMFrameLayer* layer = layers_[eLayerPrimitiveID].get())
+		{
+			layer->uint_pixel(x, y) = first_hit.primitive ? first_hit.primitive->id() : 0;
+		}
+		if (UMFrameLayer* layer = layers_[eLayerMaterialID].get())
+		{
+			layer->uint_pixel(x, y) = first_hit.material ? first_hit.material->id() : 0;
+		}
+	}
+	// welford
+	if (UMFrameLayer* layer = layers_[eLayerVariance].get())
+	{
+		float* variance = layer->float_pixel(x, y);
+		const float lum = luminance(color);
+		const float delta = lum - variance[0];
+		variance[0] += delta * inv_count;
+		variance[1] += delta * (lum - variance[0]);
+	}
+}
+
+/**
+ * get sample count of a pixel
+ */
+unsigned int UMFrameBuffer::sample_count(int x, int y) const
+{
+	if (!layers_[eLayerSampleCount]) return 0;
+	return layers_[eLayerSampleCount]->uint_pixel(x, y);
+}
+
+/**
+ * get averaged beauty of a pixel
+ */
+UMVec4d UMFrameBuffer::beauty(int x, int y) const
+{
+	const unsigned int count = sample_count(x, y);
+	if (count == 0) return UMVec4d(0);
+	const float* beauty = layers_[eLayerBeauty]->float_pixel(x, y);
+	const double inv_count = 1.0 / count;
+	return UMVec4d(
+		beauty[0] * inv_count,
+		beauty[1] * inv_count,
+		beauty[2] * inv_count,
+		1.0);
+}
+
+/**
+ * get total buffer size in bytes
+ */
+size_t UMFrameBuffer::byte_size() const
+{
+	size_t size = 0;
+	for (int i = 0; i < eLayerTypeMax; ++i)
+	{
+		if (layers_[i])
+		{
+			size += layers_[i]->byte_size();
+		}
+	}
+	return size;
+}
+
+/**
+ * resolve a layer to an image
+ */
+bool UMFrameBuffer::resolve(LayerType type, UMImagePtr image) const
+{
+	return resolve(type, image, UMVec4i(0, 0, width_, height_));
+}
+
+/**
+ * resolve a rectangle of a layer to an image
+ */
+bool UMFrameBuffer::resolve(LayerType type, UMImagePtr image, const UMVec4i& rect) const
+{
+	if (!image) return false;
+	UMFrameLayerPtr src = layer(type);
+	if (!src) return false;
+	if (image->width() != width_ || image->height() != height_ || !image->is_valid())
+	{
+		image->init(width_, height_);
+	}
+	const int x0 = std::max(rect.x, 0);
+	const int y0 = std::max(rect.y, 0);
+	const int x1 = std::min(rect.x + rect.z, width_);
+	const int y1 = std::min(rect.y + rect.w, height_);
+	UMImage::ImageBuffer& dst = image->mutable_list();
+#pragma omp parallel for schedule(static)
+	for (int y = y0; y < y1; ++y)
+	{
+		for (int x = x0; x < x1; ++x)
+		{
+			const int i = y * width_ + x;
+			switch (type)
+			{
+			case eLayerBeauty:
+				dst[i] = beauty(x, y);
+				break;
+			case eLayerVariance:
+				{
+					const unsigned int count = sample_count(x, y);
+					const double variance = count > 1 ? src->float_pixel(x, y)[1] / (count - 1.0) : 0.0;
+					dst[i] = UMVec4d(variance, variance, variance, 1.0);
+				}
+				break;
+			default:
+				if (src->is_uint())
+				{
+					const double value = src->uint_pixel(x, y);
+					dst[i] = UMVec4d(value, value, value, 1.0);
+				}
+				else
+				{
+					const float* value = src->float_pixel(x, y);
+					if (src->channel_count() == 1)
+					{
+						dst[i] = UMVec4d(value[0], value[0], value[0], 1.0);
+					}
+					else
+					{
+						dst[i] = UMVec4d(value[0], value[1], value[2], 1.0);
+					}
+				}
+				break;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * write size, enabled layers and pixels
+ */
+bool UMFrameBuffer::write(std::ostream& stream) const
+{
+	int header[3] = { width_, height_, 0 };
+	for (int i = 0; i < eLayerTypeMax; ++i)
+	{
+		if (layers_[i]) header[2] |= (1 << i);
+	}
+	stream.write(reinterpret_cast<const char*>(header), sizeof(header));
+	for (int i = 0; i < eLayerTypeMax; ++i)
+	{
+		if (layers_[i] && !layers_[i]->write(stream)) return false;
+	}
+	return stream.good();
+}
+
+/**
+ * read size, enabled layers and pixels
+ */
+bool UMFrameBuffer::read(std::istream& stream)
+{
+	int header[3] = { 0, 0, 0 };
+	stream.read(reinterpret_cast<char*>(header), sizeof(header));
+	if (!stream.good()) return false;
+	const int layer_mask = header[2];
+	if (layer_mask >> eLayerTypeMax) return false;
+	if (!(layer_mask & (1 << eLayerBeauty)) || !(layer_mask & (1 << eLayerSampleCount))) return false;
+	for (int i = 0; i < eLayerTypeMax; ++i)
+	{
+		set_layer_enabled(static_cast<LayerType>(i), (layer_mask & (1 << i)) != 0);
+	}
+	if (!init(header[0], header[1])) return false;
+	for (int i = 0; i < eLayerTypeMax; ++i)
+	{
+		if (layers_[i] && !layers_[i]->read(stream)) return false;
+	}
+	return true;
+}
+
+} // umrt
@@ -0,0 +1,310 @@
+/**
+ * @file UMFrameBuffer.h
+ * framebuffer with arbitrary output layers
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <iosfwd>
+#include "UMMacro.h"
+#include "UMMathTypes.h"
+#include "UMVector.h"
+#include "UMImageTypes.h"
+
+namespace umrt
+{
+
+class UMFrameLayer;
+typedef std::shared_ptr<UMFrameLayer> UMFrameLayerPtr;
+typedef std::vector<UMFrameLayerPtr> UMFrameLayerList;
+
+class UMFrameBuffer;
+typedef std::shared_ptr<UMFrameBuffer> UMFrameBufferPtr;
+
+class UMShaderParameter;
+
+/**
+ * a layer of framebuffer.
+ * pixels are stored as float32 or uint32 in 8x8 tiles.
+ */
+class UMFrameLayer
+{
+	DISALLOW_COPY_AND_ASSIGN(UMFrameLayer);
+public:
+	/**
+	 * pixel types
+	 */
+	enum PixelType {
+		ePixelFloat1,
+		ePixelFloat2,
+		ePixelFloat3,
+		ePixelFloat4,
+		ePixelUInt1,
+	};
+
+	UMFrameLayer(const std::string& name, PixelType pixel_type);
+
+	~UMFrameLayer() {}
+
+	/**
+	 * init layer
+	 */
+	bool init(int width, int height);
+
+	/**
+	 * clear layer to zero
+	 */
+	void clear();
+
+	/**
+	 * get name
+	 */
+	const std::string& name() const { return name_; }
+
+	/**
+	 * get pixel type
+	 */
+	PixelType pixel_type() const { return pixel_type_; }
+
+	/**
+	 * get channel count per pixel
+	 */
+	int channel_count() const { return channel_count_; }
+
+	/**
+	 * is uint layer
+	 */
+	bool is_uint() const { return pixel_type_ == ePixelUInt1; }
+
+	/**
+	 * get width
+	 */
+	int width() const { return width_; }
+
+	/**
+	 * get height
+	 */
+	int height() const { return height_; }
+
+	/**
+	 * get tile size
+	 */
+	static int tile_size() { return 1 << tile_shift; }
+
+	/**
+	 * get tiled pixel index
+	 */
+	int pixel_index(int x, int y) const
+	{
+		const int tile = (y >> tile_shift) * tile_count_x_ + (x >> tile_shift);
+		return (tile << (tile_shift * 2)) + ((y & tile_mask) << tile_shift) + (x & tile_mask);
+	}
+
+	/**
+	 * get float pixel
+	 */
+	float* float_pixel(int x, int y) { return &float_buffer_[pixel_index(x, y) * channel_count_]; }
+
+	/**
+	 * get float pixel
+	 */
+	const float* float_pixel(int x, int y) const { return &float_buffer_[pixel_index(x, y) * channel_count_]; }
+
+	/**
+	 * get uint pixel
+	 */
+	unsigned int& uint_pixel(int x, int y) { return uint_buffer_[pixel_index(x, y)]; }
+
+	/**
+	 * get uint pixel
+	 */
+	unsigned int uint_pixel(int x, int y) const { return uint_buffer_[pixel_index(x, y)]; }
+
+	/**
+	 * get buffer size in bytes
+	 */
+	size_t byte_size() const 
+	{
+		return float_buffer_.size() * sizeof(float) + uint_buffer_.size() * sizeof(unsigned int);
+	}
+
+	/**
+	 * write raw pixels to a binary stream
+	 */
+	bool write(std::ostream& stream) const;
+
+	/**
+	 * read raw pixels from a binary stream
+	 * @note layer must be initialized with the written size
+	 */
+	bool read(std::istream& stream);
+
+private:
+	static const int tile_shift = 3;
+	static const int tile_mask = (1 << tile_shift) - 1;
+
+	std::string name_;
+	PixelType pixel_type_;
+	int channel_count_;
+	int width_;
+	int height_;
+	int tile_count_x_;
+	int tile_count_y_;
+	std::vector<float> float_buffer_;
+	std::vector<unsigned int> uint_buffer_;
+};
+
+/**
+ * framebuffer with arbitrary output layers.
+ * renderers write all enabled layers by a sample at once,
+ * and layers are converted to UMImage only on output.
+ */
+class UMFrameBuffer
+{
+	DISALLOW_COPY_AND_ASSIGN(UMFrameBuffer);
+public:
+	/**
+	 * layer types
+	 */
+	enum LayerType {
+		eLayerBeauty, ///< float3 sum of radiance
+		eLayerDepth, ///< float1 average of first hit distance
+		eLayerNormal, ///< float3 average of first hit normal
+		eLayerAlbedo, ///< float3 average of first hit color
+		eLayerPrimitiveID, ///< uint1 first hit primitive id
+		eLayerMaterialID, ///< uint1 first hit material id
+		eLayerSampleCount, ///< uint1 sample count
+		eLayerVariance, ///< float2 luminance mean and M2
+		eLayerTypeMax
+	};
+
+	UMFrameBuffer();
+
+	~UMFrameBuffer() {}
+
+	/**
+	 * get layer name
+	 */
+	static const char* layer_name(LayerType type);
+
+	/**
+	 * get pixel type of a layer
+	 */
+	static UMFrameLayer::PixelType layer_pixel_type(LayerType type);
+
+	/**
+	 * init enabled layers
+	 */
+	bool init(int width, int height);
+
+	/**
+	 * clear enabled layers to zero
+	 */
+	void clear();
+
+	/**
+	 * get width
+	 */
+	int width() const { return width_; }
+
+	/**
+	 * get height
+	 */
+	int height() const { return height_; }
+
+	/**
+	 * is layer enabled
+	 */
+	bool is_layer_enabled(LayerType type) const;
+
+	/**
+	 * set layer enabled.
+	 * beauty and sample count are always enabled.
+	 * @note call init after changing layers
+	 */
+	void set_layer_enabled(LayerType type, bool enabled);
+
+	/**
+	 * get layer
+	 * @retval layer or empty pointer when disabled
+	 */
+	UMFrameLayerPtr layer(LayerType type) const;
+
+	/**
+	 * find enabled layer by name
+	 */
+	UMFrameLayerPtr find_layer(const std::string& name) const;
+
+	/**
+	 * get enabled layers
+	 */
+	UMFrameLayerList enabled_layers() const;
+
+	/**
+	 * add a sample to all enabled layers
+	 * @param [in] x pixel x
+	 * @param [in] y pixel y
+	 * @param [in] color radiance of the sample
+	 * @param [in] first_hit shader parameter of first hit
+	 */
+	void add_sample(int x, int y, const UMVec3d& color, const UMShaderParameter& first_hit);
+
+	/**
+	 * get sample count of a pixel
+	 */
+	unsigned int sample_count(int x, int y) const;
+
+	/**
+	 * get averaged beauty of a pixel
+	 */
+	UMVec4d beauty(int x, int y) const;
+
+	/**
+	 * get total buffer size in bytes
+	 */
+	size_t byte_size() const;
+
+	/**
+	 * resolve a layer to an image
+	 * @param [in] type layer type
+	 * @param [out] image destination. resized if need.
+	 * @retval success or failed
+	 */
+	bool resolve(LayerType type, UMImagePtr image) const;
+
+	/**
+	 * resolve a rectangle of a layer to an image
+	 * @param [in] type layer type
+	 * @param [out] image destination. resized if need.
+	 * @param [in] rect target rectangle (x, y, width, height)
+	 * @retval success or failed
+	 */
+	bool resolve(LayerType type, UMImagePtr image, const UMVec4i& rect) const;
+
+	/**
+	 * write size, enabled layers and pixels to a binary stream
+	 */
+	bool write(std::ostream& stream) const;
+
+	/**
+	 * read size, enabled layers and pixels from a binary stream.
+	 * enabled layers are replaced by the read ones.
+	 */
+	bool read(std::istream& stream);
+
+private:
+	int width_;
+	int height_;
+	bool is_enabled_[eLayerTypeMax];
+	UMFrameLayerPtr layers_[eLayerTypeMax];
+};
+
+} // umrt
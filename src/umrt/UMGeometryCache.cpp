@@ -0,0 +1,190 @@
+/**
+ * @file UMGeometryCache.cpp
+ * bounded cache of tessellated geometry
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMGeometryCache.h"
+
+#include <algorithm>
+
+namespace umrt
+{
+
+/**
+ * create instance
+ */
+UMGeometryCachePtr UMGeometryCache::create()
+{
+	return std::make_shared<UMGeometryCache>();
+}
+
+/**
+ * constructor
+ */
+UMGeometryCache::UMGeometryCache()
+	: capacity_(0)
+	, insert_count_(0)
+	, evict_count_(0)
+{
+}
+
+/**
+ * set capacity
+ */
+void UMGeometryCache::set_capacity(size_t capacity)
+{
+	capacity_ = capacity;
+	for (int i = 0; i < shard_count; ++i)
+	{
+		Shard& shard = shard_[i];
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		shard.capacity = capacity > 0 ? std::max<size_t>(capacity / shard_count, 1) : 0;
+		evict(shard);
+	}
+}
+
+/**
+ * get bytes of resident geometry
+ */
+size_t UMGeometryCache::resident_size()
+{
+	size_t size = 0;
+	for (int i = 0; i < shard_count; ++i)
+	{
+		std::lock_guard<std::mutex> lock(shard_[i].mutex);
+		size += shard_[i].resident_size;
+	}
+	return size;
+}
+
+/**
+ * remove an entry
+ */
+void UMGeometryCache::erase(Shard& shard, EntryMap::iterator it)
+{
+	const unsigned int owner = static_cast<unsigned int>(it->first >> 32);
+	OwnerKeyMap::iterator ot = shard.owner_key_map.find(owner);
+	if (ot != shard.owner_key_map.end())
+	{
+		OwnerKeyList& key_list = ot->second;
+		key_list.erase(std::remove(key_list.begin(), key_list.end(), it->first), key_list.end());
+		if (key_list.empty())
+		{
+			shard.owner_key_map.erase(ot);
+		}
+	}
+	shard.clock_list.erase(it->second.clock);
+	shard.resident_size -= it->second.size;
+	shard.entry_map.erase(it);
+}
+
+/**
+ * drop geometry over capacity by clock order.
+ * referenced geometry gets a second chance, and newest one is kept even if it is over capacity.
+ */
+void UMGeometryCache::evict(Shard& shard)
+{
+	if (shard.capacity == 0) return;
+	while (shard.resident_size > shard.capacity && shard.clock_list.size() > 1)
+	{
+		EntryMap::iterator it = shard.entry_map.find(shard.clock_list.back());
+		if (it == shard.entry_map.end())
+		{
+			shard.clock_list.pop_back();
+			continue;
+		}
+		if (it->second.is_referenced)
+		{
+			it->second.is_referenced = false;
+			shard.clock_list.splice(shard.clock_list.begin(), shard.clock_list, it->second.clock);
+			continue;
+		}
+		erase(shard, it);
+		++evict_count_;
+	}
+}
+
+/**
+ * find geometry.
+ * only marks the entry, the order of entries is changed by evict.
+ */
+UMCachedGeometryPtr UMGeometryCache::find(Key key)
+{
+	Shard& shard = shard_of(static_cast<unsigned int>(key >> 32));
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	EntryMap::iterator it = shard.entry_map.find(key);
+	if (it == shard.entry_map.end()) return UMCachedGeometryPtr();
+	it->second.is_referenced = true;
+	return it->second.geometry;
+}
+
+/**
+ * insert geometry
+ */
+UMCachedGeometryPtr UMGeometryCache::insert(Key key, UMCachedGeometryPtr geometry)
+{
+	if (!geometry) return geometry;
+	const unsigned int owner = static_cast<unsigned int>(key >> 32);
+	Shard& shard = shard_of(owner);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	EntryMap::iterator it = shard.entry_map.find(key);
+	if (it != shard.entry_map.end())
+	{
+		it->second.is_referenced = true;
+		return it->second.geometry;
+	}
+	shard.clock_list.push_front(key);
+	Entry& entry = shard.entry_map[key];
+	entry.geometry = geometry;
+	entry.size = geometry->memory_size();
+	entry.is_referenced = false;
+	entry.clock = shard.clock_list.begin();
+	shard.owner_key_map[owner].push_back(key);
+	shard.resident_size += entry.size;
+	++insert_count_;
+	evict(shard);
+	return geometry;
+}
+
+/**
+ * remove all geometry of an owner
+ */
+void UMGeometryCache::remove_owner(unsigned int owner)
+{
+	Shard& shard = shard_of(owner);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	OwnerKeyMap::iterator ot = shard.owner_key_map.find(owner);
+	if (ot == shard.owner_key_map.end()) return;
+	const OwnerKeyList key_list = ot->second;
+	for (OwnerKeyList::const_iterator kt = key_list.begin(); kt != key_list.end(); ++kt)
+	{
+		EntryMap::iterator it = shard.entry_map.find(*kt);
+		if (it != shard.entry_map.end())
+		{
+			erase(shard, it);
+		}
+	}
+}
+
+/**
+ * remove all geometry
+ */
+void UMGeometryCache::clear()
+{
+	for (int i = 0; i < shard_count; ++i)
+	{
+		Shard& shard = shard_[i];
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		shard.entry_map.clear();
+		shard.owner_key_map.clear();
+		shard.clock_list.clear();
+		shard.resident_size = 0;
+	}
+}
+
+} // umrt
@@ -0,0 +1,173 @@
+/**
+ * @file UMGeometryCache.h
+ * bounded cache of tessellated geometry
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+
+#include "UMMacro.h"
+
+namespace umrt
+{
+
+class UMGeometryCache;
+typedef std::shared_ptr<UMGeometryCache> UMGeometryCachePtr;
+
+/**
+ * geometry which can be stored in UMGeometryCache
+ */
+class UMCachedGeometry
+{
+public:
+	virtual ~UMCachedGeometry() {}
+
+	/**
+	 * get bytes of this geometry
+	 */
+	virtual size_t memory_size() const = 0;
+};
+typedef std::shared_ptr<const UMCachedGeometry> UMCachedGeometryPtr;
+
+/**
+ * bounded cache of tessellated geometry.
+ * geometry is dropped by clock (second chance) order over capacity, and tessellated again on demand.
+ * geometry in use by a ray stays valid while it is referenced.
+ * entries are split into shards by owner, so threads which find different owners do not wait each other.
+ * upper 32 bits of a key is the owner id (a patch), lower 32 bits are defined by the owner.
+ */
+class UMGeometryCache
+{
+	DISALLOW_COPY_AND_ASSIGN(UMGeometryCache);
+public:
+	typedef unsigned long long Key;
+
+	/**
+	 * create instance
+	 */
+	static UMGeometryCachePtr create();
+
+	UMGeometryCache();
+
+	~UMGeometryCache() {}
+
+	/**
+	 * get capacity in bytes. 0 is unbounded.
+	 */
+	size_t capacity() const { return capacity_; }
+
+	/**
+	 * set capacity in bytes
+	 * @param [in] capacity bytes of resident geometry. 0 is unbounded.
+	 */
+	void set_capacity(size_t capacity);
+
+	/**
+	 * get bytes of resident geometry
+	 */
+	size_t resident_size();
+
+	/**
+	 * get number of inserted geometry
+	 */
+	size_t insert_count() const { return insert_count_; }
+
+	/**
+	 * get number of dropped geometry
+	 */
+	size_t evict_count() const { return evict_count_; }
+
+	/**
+	 * find geometry
+	 * @param [in] key key
+	 * @retval geometry or none
+	 */
+	UMCachedGeometryPtr find(Key key);
+
+	/**
+	 * insert geometry.
+	 * if other thread inserted the same key first, that one is returned.
+	 * @param [in] key key
+	 * @param [in] geometry geometry
+	 * @retval cached geometry
+	 */
+	UMCachedGeometryPtr insert(Key key, UMCachedGeometryPtr geometry);
+
+	/**
+	 * remove all geometry of an owner
+	 * @param [in] owner owner id. upper 32 bits of keys.
+	 */
+	void remove_owner(unsigned int owner);
+
+	/**
+	 * remove all geometry
+	 */
+	void clear();
+
+	/**
+	 * make a key
+	 * @param [in] owner owner id
+	 * @param [in] value owner defined value
+	 */
+	static Key key(unsigned int owner, unsigned int value)
+	{
+		return (static_cast<Key>(owner) << 32) | value;
+	}
+
+private:
+	typedef std::list<Key> KeyList;
+	typedef std::vector<Key> OwnerKeyList;
+
+	/**
+	 * a geometry entry
+	 */
+	struct Entry
+	{
+		UMCachedGeometryPtr geometry;
+		size_t size;
+		/// found since the clock hand passed
+		bool is_referenced;
+		KeyList::iterator clock;
+	};
+	typedef std::unordered_map<Key, Entry> EntryMap;
+	typedef std::unordered_map<unsigned int, OwnerKeyList> OwnerKeyMap;
+
+	enum { shard_count = 16 };
+
+	/**
+	 * a part of entries which has its own lock
+	 */
+	struct Shard
+	{
+		Shard() : capacity(0), resident_size(0) {}
+		EntryMap entry_map;
+		OwnerKeyMap owner_key_map;
+		/// newest first. the hand is at the back.
+		KeyList clock_list;
+		size_t capacity;
+		size_t resident_size;
+		std::mutex mutex;
+	};
+
+	Shard& shard_of(unsigned int owner) { return shard_[(owner * 0x9e3779b1u) & (shard_count - 1)]; }
+	void evict(Shard& shard);
+	void erase(Shard& shard, EntryMap::iterator it);
+
+	size_t capacity_;
+	std::atomic<size_t> insert_count_;
+	std::atomic<size_t> evict_count_;
+	Shard shard_[shard_count];
+};
+
+} // umrt
@@ -0,0 +1,343 @@
+/**
+ * @file UMIrradianceCache.cpp
+ * irradiance cache
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMIrradianceCache.h"
+
+#include <cmath>
+#include <cfloat>
+#include <limits>
+#include <algorithm>
+
+namespace
+{
+	using namespace umrt;
+
+	// hemisphere of a record. columns are about pi times rows.
+	const int default_sample_rows = 8;
+	const int default_sample_columns = 24;
+
+	// octree depth limit
+	const int max_octree_depth = 20;
+
+	// record radius relative to diagonal of the scene
+	const double min_radius_ratio = 0.0005;
+	const double max_radius_ratio = 0.1;
+
+	/**
+	 * create orthonormal basis around w
+	 */
+	void create_basis(const UMVec3d& w, UMVec3d& u, UMVec3d& v)
+	{
+		if (fabs(w.x) > FLT_EPSILON) {
+			u = UMVec3d(0, 1, 0).cross(w).normalized();
+		} else {
+			u = UMVec3d(1, 0, 0).cross(w).normalized();
+		}
+		v = w.cross(u);
+	}
+
+	/**
+	 * child index of p in a node
+	 */
+	int child_index(const UMVec3d& p, const UMVec3d& center)
+	{
+		return (p.x > center.x ? 1 : 0) | (p.y > center.y ? 2 : 0) | (p.z > center.z ? 4 : 0);
+	}
+
+	/**
+	 * center of a child
+	 */
+	UMVec3d child_center(const UMVec3d& center, double half_size, int index)
+	{
+		const double quarter = half_size * 0.5;
+		return UMVec3d(
+			center.x + ((index & 1) ? quarter : -quarter),
+			center.y + ((index & 2) ? quarter : -quarter),
+			center.z + ((index & 4) ? quarter : -quarter));
+	}
+
+} // anonymouse namespace
+
+namespace umrt
+{
+
+/**
+ * create instance
+ */
+UMIrradianceCachePtr UMIrradianceCache::create()
+{
+	return std::make_shared<UMIrradianceCache>();
+}
+
+/**
+ * constructor
+ */
+UMIrradianceCache::UMIrradianceCache()
+	: accuracy_(0.2)
+	, min_radius_(0)
+	, max_radius_(std::numeric_limits<double>::max())
+	, sample_rows_(default_sample_rows)
+	, sample_columns_(default_sample_columns)
+	, half_size_(0)
+	, record_count_(0)
+{
+}
+
+/**
+ * init empty cache
+ */
+void UMIrradianceCache::init(const UMBox& box, double accuracy)
+{
+	clear();
+	std::lock_guard<std::mutex> lock(mutex_);
+	accuracy_ = std::max(accuracy, 0.01);
+	center_ = box.center();
+	const UMVec3d size = box.size();
+	const double max_size = std::max(size.x, std::max(size.y, size.z));
+	// root is a cube slightly larger than the scene
+	half_size_ = std::max(max_size * 0.5 * 1.01, static_cast<double>(FLT_EPSILON));
+	const double diagonal = std::max(size.length(), static_cast<double>(FLT_EPSILON));
+	min_radius_ = diagonal * min_radius_ratio;
+	max_radius_ = diagonal * max_radius_ratio;
+}
+
+/**
+ * remove all records
+ */
+void UMIrradianceCache::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (int i = 0; i < 8; ++i) {
+		root_.children[i].store(NULL);
+	}
+	root_.head.store(NULL);
+	node_list_.clear();
+	entry_list_.clear();
+	record_list_.clear();
+	record_count_ = 0;
+}
+
+/**
+ * get direction of a hemisphere sample
+ */
+UMVec3d UMIrradianceCache::sample_direction(
+	const UMVec3d& normal,
+	int row,
+	int column,
+	const UMVec2d& random_value) const
+{
+	UMVec3d u, v;
+	create_basis(normal, u, v);
+	const double sin_theta = sqrt((row + random_value.x) / sample_rows_);
+	const double cos_theta = sqrt(std::max(0.0, 1.0 - sin_theta * sin_theta));
+	const double phi = 2.0 * M_PI * (column + random_value.y) / sample_columns_;
+	return (u * (cos(phi) * sin_theta) + v * (sin(phi) * sin_theta) + normal * cos_theta).normalized();
+}
+
+/**
+ * interpolate irradiance from records
+ */
+bool UMIrradianceCache::lookup(const UMVec3d& position, const UMVec3d& normal, UMVec3d& irradiance) const
+{
+	const double inv_accuracy = 1.0 / accuracy_;
+	UMVec3d sum(0);
+	double weight_sum = 0.0;
+
+	// records are stored in all nodes they overlap, so the path to the leaf is enough.
+	const Node* node = &root_;
+	UMVec3d center(center_);
+	double half_size = half_size_;
+	while (node)
+	{
+		for (const Entry* entry = node->head.load(std::memory_order_acquire); entry; entry = entry->next)
+		{
+			const UMIrradianceRecord& record = *entry->record;
+			const UMVec3d d = position - record.position;
+			const double error =
+				d.length() / record.radius +
+				sqrt(std::max(0.0, 1.0 - normal.dot(record.normal)));
+			if (error * inv_accuracy >= 1.0) continue;
+			// record in front of the position
+			if (d.dot(normal + record.normal) * 0.5 < -0.05 * record.radius) continue;
+
+			const double weight = 1.0 / std::max(error, 1.0e-6);
+			const UMVec3d axis = record.normal.cross(normal);
+			UMVec3d value;
+			for (int c = 0; c < 3; ++c)
+			{
+				value[c] = std::max(0.0,
+					record.irradiance[c] +
+					axis.dot(record.rotation_gradient[c]) +
+					d.dot(record.translation_gradient[c]));
+			}
+			sum += value * weight;
+			weight_sum += weight;
+		}
+		const int index = child_index(position, center);
+		center = child_center(center, half_size, index);
+		half_size *= 0.5;
+		node = node->children[index].load(std::memory_order_acquire);
+	}
+	if (weight_sum <= 0.0) return false;
+	irradiance = sum / weight_sum;
+	return true;
+}
+
+/**
+ * add a record from hemisphere samples
+ */
+UMVec3d UMIrradianceCache::add(
+	const UMVec3d& position,
+	const UMVec3d& normal,
+	const UMIrradianceSampleList& sample_list)
+{
+	const int rows = sample_rows_;
+	const int columns = sample_columns_;
+	if (static_cast<int>(sample_list.size()) != rows * columns) return UMVec3d(0);
+
+	UMIrradianceRecord record;
+	record.position = position;
+	record.normal = normal;
+
+	UMVec3d u, v;
+	create_basis(normal, u, v);
+
+	// irradiance and harmonic mean distance
+	double inv_distance_sum = 0.0;
+	for (int i = 0, size = rows * columns; i < size; ++i)
+	{
+		record.irradiance += sample_list[i].radiance;
+		inv_distance_sum += 1.0 / sample_list[i].distance;
+	}
+	record.irradiance *= M_PI / (rows * columns);
+	double radius = max_radius_;
+	if (inv_distance_sum > 0.0)
+	{
+		radius = (rows * columns) / inv_distance_sum;
+	}
+
+	// rotational gradient
+	for (int k = 0; k < columns; ++k)
+	{
+		const double phi = 2.0 * M_PI * (k + 0.5) / columns;
+		const UMVec3d vk = v * cos(phi) - u * sin(phi);
+		UMVec3d sum(0);
+		for (int j = 0; j < rows; ++j)
+		{
+			const double sin_theta = sqrt((j + 0.5) / rows);
+			const double tan_theta = sin_theta / sqrt(1.0 - sin_theta * sin_theta);
+			sum += sample_list[j * columns + k].radiance * tan_theta;
+		}
+		for (int c = 0; c < 3; ++c)
+		{
+			record.rotation_gradient[c] += vk * (sum[c] * M_PI / (rows * columns));
+		}
+	}
+
+	// translational gradient
+	for (int k = 0; k < columns; ++k)
+	{
+		const double phi = 2.0 * M_PI * k / columns;
+		const UMVec3d uk = u * cos(phi) + v * sin(phi);
+		const UMVec3d vk = v * cos(phi) - u * sin(phi);
+		const int prev_k = (k + columns - 1) % columns;
+
+		// across rows
+		UMVec3d sum_u(0);
+		for (int j = 1; j < rows; ++j)
+		{
+			const UMIrradianceSample& s = sample_list[j * columns + k];
+			const UMIrradianceSample& prev = sample_list[(j - 1) * columns + k];
+			const double sin_theta = sqrt(static_cast<double>(j) / rows);
+			const double cos_theta_sq = 1.0 - static_cast<double>(j) / rows;
+			const double coefficient = sin_theta * cos_theta_sq / std::min(s.distance, prev.distance);
+			sum_u += (s.radiance - prev.radiance) * coefficient;
+		}
+		// across columns
+		UMVec3d sum_v(0);
+		for (int j = 0; j < rows; ++j)
+		{
+			const UMIrradianceSample& s = sample_list[j * columns + k];
+			const UMIrradianceSample& prev = sample_list[j * columns + prev_k];
+			const double coefficient =
+				(sqrt((j + 1.0) / rows) - sqrt(static_cast<double>(j) / rows)) /
+				std::min(s.distance, prev.distance);
+			sum_v += (s.radiance - prev.radiance) * coefficient;
+		}
+		for (int c = 0; c < 3; ++c)
+		{
+			record.translation_gradient[c] += uk * (sum_u[c] * 2.0 * M_PI / columns) + vk * sum_v[c];
+		}
+	}
+
+	// small radius near corners makes too many records.
+	// gradient is reduced instead.
+	if (radius < min_radius_)
+	{
+		const double scale = radius / min_radius_;
+		for (int c = 0; c < 3; ++c)
+		{
+			record.translation_gradient[c] *= scale;
+		}
+	}
+	record.radius = std::min(std::max(radius, min_radius_), max_radius_);
+
+	// records are valid in accuracy * radius
+	const double extent = accuracy_ * record.radius;
+	const UMBox record_box(position - UMVec3d(extent), position + UMVec3d(extent));
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	record_list_.push_back(record);
+	insert(&root_, center_, half_size_, &record_list_.back(), record_box, 0);
+	++record_count_;
+	return record.irradiance;
+}
+
+/**
+ * insert a record to nodes which overlap the record box
+ */
+void UMIrradianceCache::insert(
+	Node* node,
+	const UMVec3d& center,
+	double half_size,
+	const UMIrradianceRecord* record,
+	const UMBox& record_box,
+	int depth)
+{
+	// stop at the node which is about the record size
+	const UMVec3d record_size = record_box.size();
+	if (depth >= max_octree_depth || half_size * 2.0 < std::max(record_size.x, std::max(record_size.y, record_size.z)))
+	{
+		entry_list_.emplace_back();
+		Entry* entry = &entry_list_.back();
+		entry->record = record;
+		entry->next = node->head.load(std::memory_order_relaxed);
+		node->head.store(entry, std::memory_order_release);
+		return;
+	}
+	const UMVec3d& min = record_box.minimum();
+	const UMVec3d& max = record_box.maximum();
+	for (int i = 0; i < 8; ++i)
+	{
+		if ((i & 1) ? (max.x <= center.x) : (min.x > center.x)) continue;
+		if ((i & 2) ? (max.y <= center.y) : (min.y > center.y)) continue;
+		if ((i & 4) ? (max.z <= center.z) : (min.z > center.z)) continue;
+		Node* child = node->children[i].load(std::memory_order_relaxed);
+		if (!child)
+		{
+			node_list_.emplace_back();
+			child = &node_list_.back();
+			node->children[i].store(child, std::memory_order_release);
+		}
+		insert(child, child_center(center, half_size, i), half_size * 0.5, record, record_box, depth + 1);
+	}
+}
+
+} // umrt
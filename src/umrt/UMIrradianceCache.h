@@ -0,0 +1,190 @@
+/**
+ * @file UMIrradianceCache.h
+ * irradiance cache
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <mutex>
+
+#include "UMMacro.h"
+#include "UMMathTypes.h"
+#include "UMVector.h"
+#include "UMBox.h"
+
+namespace umrt
+{
+
+class UMIrradianceCache;
+typedef std::shared_ptr<UMIrradianceCache> UMIrradianceCachePtr;
+
+/**
+ * an irradiance record with gradients
+ */
+class UMIrradianceRecord
+{
+public:
+	UMIrradianceRecord() : radius(0) {}
+
+	UMVec3d position;
+	UMVec3d normal;
+	UMVec3d irradiance;
+	/// harmonic mean distance to surrounding surfaces
+	double radius;
+	/// gradients of r, g and b
+	UMVec3d rotation_gradient[3];
+	UMVec3d translation_gradient[3];
+};
+
+/**
+ * a hemisphere sample for a new record
+ */
+class UMIrradianceSample
+{
+public:
+	UMIrradianceSample() : distance(0) {}
+
+	UMVec3d radiance;
+	/// distance to hit point. max of double for no hit.
+	double distance;
+};
+typedef std::vector<UMIrradianceSample> UMIrradianceSampleList;
+
+/**
+ * irradiance cache.
+ * records are added lazily to an octree and interpolated by their gradients
+ * (Ward and Heckbert, "Irradiance Gradients").
+ * lookup does not lock, so threads share the cache while other threads add records.
+ */
+class UMIrradianceCache
+{
+	DISALLOW_COPY_AND_ASSIGN(UMIrradianceCache);
+public:
+	/**
+	 * create instance
+	 */
+	static UMIrradianceCachePtr create();
+
+	UMIrradianceCache();
+
+	~UMIrradianceCache() {}
+
+	/**
+	 * init empty cache
+	 * @param [in] box box of the scene
+	 * @param [in] accuracy smaller value makes more records (0.1 to 0.5)
+	 */
+	void init(const UMBox& box, double accuracy);
+
+	/**
+	 * get accuracy
+	 */
+	double accuracy() const { return accuracy_; }
+
+	/**
+	 * get hemisphere rows of a new record
+	 */
+	int sample_rows() const { return sample_rows_; }
+
+	/**
+	 * get hemisphere columns of a new record
+	 */
+	int sample_columns() const { return sample_columns_; }
+
+	/**
+	 * get number of records
+	 */
+	size_t record_count() const { return record_count_; }
+
+	/**
+	 * get direction of a hemisphere sample. cosine weighted and stratified.
+	 * @param [in] normal normal of the record
+	 * @param [in] row row in sample_rows
+	 * @param [in] column column in sample_columns
+	 * @param [in] random_value jitter in the stratum
+	 */
+	UMVec3d sample_direction(
+		const UMVec3d& normal,
+		int row,
+		int column,
+		const UMVec2d& random_value) const;
+
+	/**
+	 * interpolate irradiance from records
+	 * @param [in] position position
+	 * @param [in] normal normal
+	 * @param [out] irradiance interpolated irradiance
+	 * @retval false no valid record
+	 */
+	bool lookup(const UMVec3d& position, const UMVec3d& normal, UMVec3d& irradiance) const;
+
+	/**
+	 * add a record from hemisphere samples
+	 * @param [in] position position
+	 * @param [in] normal normal
+	 * @param [in] sample_list samples of sample_direction. row major.
+	 * @retval irradiance of the record
+	 */
+	UMVec3d add(
+		const UMVec3d& position,
+		const UMVec3d& normal,
+		const UMIrradianceSampleList& sample_list);
+
+	/**
+	 * remove all records
+	 */
+	void clear();
+
+private:
+	/**
+	 * an entry of a node. entries of a node are linked list.
+	 */
+	struct Entry
+	{
+		Entry() : record(NULL), next(NULL) {}
+		const UMIrradianceRecord* record;
+		Entry* next;
+	};
+
+	/**
+	 * octree node.
+	 * children and entries are only added, and published after initialized.
+	 */
+	struct Node
+	{
+		Node() : head(NULL) {
+			for (int i = 0; i < 8; ++i) { children[i] = NULL; }
+		}
+		std::atomic<Node*> children[8];
+		std::atomic<Entry*> head;
+	};
+
+	void insert(Node* node, const UMVec3d& center, double half_size, const UMIrradianceRecord* record, const UMBox& record_box, int depth);
+
+	double accuracy_;
+	double min_radius_;
+	double max_radius_;
+	int sample_rows_;
+	int sample_columns_;
+	UMVec3d center_;
+	double half_size_;
+	Node root_;
+	// deque keeps address of elements while adding
+	std::deque<Node> node_list_;
+	std::deque<Entry> entry_list_;
+	std::deque<UMIrradianceRecord> record_list_;
+	std::atomic<size_t> record_count_;
+	/// for adding records
+	std::mutex mutex_;
+};
+
+} // umrt
@@ -0,0 +1,600 @@
+/**
+ * @file UMLightSampler.cpp
+ * many-light sampler
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMLightSampler.h"
+#include "UMAreaLight.h"
+#include "UMTriangle.h"
+#include "UMShaderParameter.h"
+#include "UMBox.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace
+{
+	using namespace umrt;
+	using namespace umdraw;
+
+	const double one_minus_epsilon = 1.0 - DBL_EPSILON;
+
+	double luminance(const UMVec3d& color)
+	{
+		return 0.2126 * color.x + 0.7152 * color.y + 0.0722 * color.z;
+	}
+
+	/**
+	 * an area light or an emissive triangle
+	 */
+	struct LightEntry
+	{
+		LightEntry() : area(0), power(0) {}
+		UMLightPtr light;
+		UMTrianglePtr triangle;
+		UMVec3d v0;
+		UMVec3d edge1;
+		UMVec3d edge2;
+		UMVec3d normal;
+		UMVec3d emissive;
+		double area;
+		double power;
+		umbase::UMBox box;
+	};
+	typedef std::vector<LightEntry> LightEntryList;
+
+	/**
+	 * light bvh node
+	 */
+	struct LightNode
+	{
+		LightNode() : power(0), left(-1), right(-1), parent(-1), light(-1) {}
+		umbase::UMBox box;
+		double power;
+		int left;
+		int right;
+		int parent;
+		// light index if leaf, otherwise -1
+		int light;
+	};
+	typedef std::vector<LightNode> LightNodeList;
+
+	/**
+	 * importance of a light node seen from point
+	 */
+	double importance(const LightNode& node, const UMVec3d& point)
+	{
+		const double distance_sq = (node.box.center() - point).length_sq();
+		const double radius_sq = node.box.size().length_sq() * 0.25;
+		return node.power / std::max(distance_sq, std::max(radius_sq, static_cast<double>(FLT_EPSILON)));
+	}
+
+	/**
+	 * probability of going left at branch node
+	 */
+	double left_probability(const LightNodeList& nodes, const LightNode& node, const UMVec3d& point)
+	{
+		const double left = importance(nodes[node.left], point);
+		const double right = importance(nodes[node.right], point);
+		if (left + right <= 0.0) return 0.5;
+		return left / (left + right);
+	}
+
+	/**
+	 * light comparator
+	 */
+	struct light_before_less {
+		light_before_less(const LightEntryList& lights_, int axis_)
+			: lights(lights_),
+			axis(axis_)
+		{}
+		const LightEntryList& lights;
+		int axis;
+		bool operator() (int a, int b) const {
+			return lights[a].box.center()[axis] < lights[b].box.center()[axis];
+		}
+	};
+
+	/**
+	 * build light bvh recursively
+	 * @retval created node index
+	 */
+	int build_light_node(
+		LightNodeList& nodes,
+		std::vector<int>& leaf_of_light,
+		const LightEntryList& lights,
+		std::vector<int>& indices,
+		int start,
+		int end,
+		int parent)
+	{
+		const int node_index = static_cast<int>(nodes.size());
+		nodes.push_back(LightNode());
+		nodes[node_index].parent = parent;
+
+		if (end - start == 1)
+		{
+			const int light = indices[start];
+			nodes[node_index].light = light;
+			nodes[node_index].box = lights[light].box;
+			nodes[node_index].power = lights[light].power;
+			leaf_of_light[light] = node_index;
+			return node_index;
+		}
+
+		umbase::UMBox box_centroid;
+		for (int i = start; i < end; ++i)
+		{
+			box_centroid.extend(lights[indices[i]].box.center());
+		}
+		const UMVec3d size = box_centroid.size();
+		int axis = 2;
+		if (size.x > size.y && size.x > size.z) {
+			axis = 0;
+		} else if (size.y > size.z) {
+			axis = 1;
+		}
+
+		// split equal counts
+		const int middle = (start + end) / 2;
+		std::nth_element(
+			indices.begin() + start,
+			indices.begin() + middle,
+			indices.begin() + end,
+			light_before_less(lights, axis));
+
+		const int left = build_light_node(nodes, leaf_of_light, lights, indices, start, middle, node_index);
+		const int right = build_light_node(nodes, leaf_of_light, lights, indices, middle, end, node_index);
+
+		LightNode& node = nodes[node_index];
+		node.left = left;
+		node.right = right;
+		node.box.init();
+		node.box.extend(nodes[left].box);
+		node.box.extend(nodes[right].box);
+		node.power = nodes[left].power + nodes[right].power;
+		return node_index;
+	}
+
+} // anonymouse namespace
+
+namespace umrt
+{
+
+/**
+ * UMLightSampler implementation class
+ */
+class UMLightSampler::Impl
+{
+public:
+	Impl() : total_power_(0) {}
+	~Impl() {}
+
+	void clear()
+	{
+		lights_.clear();
+		nodes_.clear();
+		leaf_of_light_.clear();
+		alias_probability_.clear();
+		alias_index_.clear();
+		primitive_to_light_.clear();
+		total_power_ = 0;
+	}
+
+	bool build(const UMLightList& light_list, const UMPrimitiveList& primitive_list);
+
+	bool pick(const UMVec3d& point, double random_value, SamplingType type, int& light_index, double& pdf) const;
+
+	double pick_pdf(const UMVec3d& point, int light_index, SamplingType type) const;
+
+	double pdf(int light_index, const UMVec3d& point, const UMVec3d& light_point, SamplingType type) const;
+
+	bool sample(int light_index, const UMShaderParameter& parameter, const UMVec2d& random_value, UMLightSample& sample) const;
+
+	int light_count() const { return static_cast<int>(lights_.size()); }
+
+	int light_index(const UMPrimitive* primitive) const
+	{
+		std::unordered_map<const UMPrimitive*, int>::const_iterator it = primitive_to_light_.find(primitive);
+		if (it != primitive_to_light_.end())
+		{
+			return it->second;
+		}
+		return -1;
+	}
+
+private:
+	void build_alias_table();
+
+	LightEntryList lights_;
+	LightNodeList nodes_;
+	std::vector<int> leaf_of_light_;
+	std::vector<double> alias_probability_;
+	std::vector<int> alias_index_;
+	std::unordered_map<const UMPrimitive*, int> primitive_to_light_;
+	double total_power_;
+};
+
+/**
+ * build light bvh and alias table
+ */
+bool UMLightSampler::Impl::build(const UMLightList& light_list, const UMPrimitiveList& primitive_list)
+{
+	clear();
+
+	// area lights
+	UMLightList::const_iterator it = light_list.begin();
+	for (; it != light_list.end(); ++it)
+	{
+		if (UMAreaLightPtr area_light = std::dynamic_pointer_cast<UMAreaLight>(*it))
+		{
+			LightEntry entry;
+			entry.light = area_light;
+			entry.v0 = area_light->position();
+			entry.edge1 = area_light->edge1();
+			entry.edge2 = area_light->edge2();
+			entry.normal = area_light->normal();
+			entry.emissive = area_light->color();
+			entry.area = area_light->area();
+			entry.power = luminance(entry.emissive) * entry.area * M_PI;
+			entry.box.init();
+			entry.box.extend(entry.v0);
+			entry.box.extend(entry.v0 + entry.edge1);
+			entry.box.extend(entry.v0 + entry.edge2);
+			entry.box.extend(entry.v0 + entry.edge1 + entry.edge2);
+			if (entry.power > 0.0)
+			{
+				lights_.push_back(entry);
+			}
+		}
+	}
+
+	// emissive triangles
+	UMPrimitiveList::const_iterator pt = primitive_list.begin();
+	for (; pt != primitive_list.end(); ++pt)
+	{
+		UMTrianglePtr triangle = std::dynamic_pointer_cast<UMTriangle>(*pt);
+		if (!triangle) continue;
+		const UMVec3d emissive = triangle->emissive();
+		if (luminance(emissive) <= 0.0) continue;
+
+		UMVec3d v0, v1, v2;
+		if (!triangle->vertices(v0, v1, v2)) continue;
+
+		LightEntry entry;
+		entry.triangle = triangle;
+		entry.v0 = v0;
+		entry.edge1 = v1 - v0;
+		entry.edge2 = v2 - v0;
+		entry.normal = entry.edge1.cross(entry.edge2);
+		entry.area = entry.normal.length() * 0.5;
+		entry.normal = entry.normal.normalized();
+		entry.emissive = emissive;
+		entry.power = luminance(emissive) * entry.area * M_PI;
+		entry.box = triangle->box();
+		if (entry.power > 0.0)
+		{
+			primitive_to_light_[triangle.get()] = static_cast<int>(lights_.size());
+			lights_.push_back(entry);
+		}
+	}
+
+	if (lights_.empty()) return false;
+
+	for (size_t i = 0, size = lights_.size(); i < size; ++i)
+	{
+		total_power_ += lights_[i].power;
+	}
+
+	// light bvh
+	const int count = light_count();
+	std::vector<int> indices(count);
+	for (int i = 0; i < count; ++i)
+	{
+		indices[i] = i;
+	}
+	nodes_.reserve(2 * count - 1);
+	leaf_of_light_.resize(count, -1);
+	build_light_node(nodes_, leaf_of_light_, lights_, indices, 0, count, -1);
+
+	// fallback
+	build_alias_table();
+	return true;
+}
+
+/**
+ * build alias table (Vose's method)
+ */
+void UMLightSampler::Impl::build_alias_table()
+{
+	const int count = light_count();
+	alias_probability_.resize(count);
+	alias_index_.resize(count);
+
+	std::vector<double> scaled(count);
+	std::vector<int> small;
+	std::vector<int> large;
+	for (int i = 0; i < count; ++i)
+	{
+		scaled[i] = lights_[i].power * count / total_power_;
+		if (scaled[i] < 1.0) {
+			small.push_back(i);
+		} else {
+			large.push_back(i);
+		}
+	}
+	while (!small.empty() && !large.empty())
+	{
+		const int s = small.back();
+		small.pop_back();
+		const int l = large.back();
+		large.pop_back();
+		alias_probability_[s] = scaled[s];
+		alias_index_[s] = l;
+		scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+		if (scaled[l] < 1.0) {
+			small.push_back(l);
+		} else {
+			large.push_back(l);
+		}
+	}
+	for (size_t i = 0; i < large.size(); ++i)
+	{
+		alias_probability_[large[i]] = 1.0;
+		alias_index_[large[i]] = large[i];
+	}
+	for (size_t i = 0; i < small.size(); ++i)
+	{
+		alias_probability_[small[i]] = 1.0;
+		alias_index_[small[i]] = small[i];
+	}
+}
+
+/**
+ * pick a light
+ */
+bool UMLightSampler::Impl::pick(
+	const UMVec3d& point,
+	double random_value,
+	SamplingType type,
+	int& light_index,
+	double& pdf) const
+{
+	if (lights_.empty()) return false;
+
+	double u = std::min(random_value, one_minus_epsilon);
+	if (type == ePowerTable)
+	{
+		const int count = light_count();
+		const double scaled = u * count;
+		const int index = std::min(static_cast<int>(scaled), count - 1);
+		const double fraction = scaled - index;
+		light_index = (fraction < alias_probability_[index]) ? index : alias_index_[index];
+		pdf = lights_[light_index].power / total_power_;
+		return pdf > 0.0;
+	}
+
+	// traverse light bvh stochastically
+	pdf = 1.0;
+	int node_index = 0;
+	while (nodes_[node_index].light < 0)
+	{
+		const LightNode& node = nodes_[node_index];
+		const double p = left_probability(nodes_, node, point);
+		if (u < p)
+		{
+			u = std::min(u / p, one_minus_epsilon);
+			pdf *= p;
+			node_index = node.left;
+		}
+		else
+		{
+			u = std::min((u - p) / (1.0 - p), one_minus_epsilon);
+			pdf *= 1.0 - p;
+			node_index = node.right;
+		}
+	}
+	light_index = nodes_[node_index].light;
+	return pdf > 0.0;
+}
+
+/**
+ * get probability of picking a light
+ */
+double UMLightSampler::Impl::pick_pdf(const UMVec3d& point, int light_index, SamplingType type) const
+{
+	if (light_index < 0 || light_index >= light_count()) return 0.0;
+	if (type == ePowerTable)
+	{
+		return lights_[light_index].power / total_power_;
+	}
+
+	double pdf = 1.0;
+	int child = leaf_of_light_[light_index];
+	int parent = nodes_[child].parent;
+	for (; parent >= 0; child = parent, parent = nodes_[parent].parent)
+	{
+		const LightNode& node = nodes_[parent];
+		const double p = left_probability(nodes_, node, point);
+		pdf *= (node.left == child) ? p : (1.0 - p);
+	}
+	return pdf;
+}
+
+/**
+ * get solid angle pdf of picking a light and sampling a point on it
+ */
+double UMLightSampler::Impl::pdf(
+	int light_index,
+	const UMVec3d& point,
+	const UMVec3d& light_point,
+	SamplingType type) const
+{
+	if (light_index < 0 || light_index >= light_count()) return 0.0;
+	const LightEntry& entry = lights_[light_index];
+	const UMVec3d direction = point - light_point;
+	const double distance_sq = direction.length_sq();
+	if (distance_sq < FLT_EPSILON) return 0.0;
+	const double cos_theta_out = entry.normal.dot(direction) / sqrt(distance_sq);
+	if (cos_theta_out <= 0.0) return 0.0;
+	const double area_pdf = 1.0 / entry.area;
+	return pick_pdf(point, light_index, type) * area_pdf * distance_sq / cos_theta_out;
+}
+
+/**
+ * sample a point on a light
+ */
+bool UMLightSampler::Impl::sample(
+	int light_index,
+	const UMShaderParameter& parameter,
+	const UMVec2d& random_value,
+	UMLightSample& sample) const
+{
+	if (light_index < 0 || light_index >= light_count()) return false;
+	const LightEntry& entry = lights_[light_index];
+	if (entry.light)
+	{
+		if (!UMAreaLight::sample(
+			sample.intensity,
+			sample.point,
+			sample.direction,
+			entry.light,
+			parameter,
+			random_value))
+		{
+			return false;
+		}
+		const double distance_sq = sample.direction.length_sq();
+		const double cos_theta_out = entry.normal.dot(-sample.direction) / sqrt(distance_sq);
+		if (cos_theta_out <= 0.0) return false;
+		sample.pdf = distance_sq / (cos_theta_out * entry.area);
+		sample.is_intersectable = false;
+		return true;
+	}
+
+	// uniform sampling on triangle
+	const double su = sqrt(random_value.x);
+	const double b1 = su * (1.0 - random_value.y);
+	const double b2 = su * random_value.y;
+	const UMVec3d sample_point(entry.v0 + entry.edge1 * b1 + entry.edge2 * b2);
+	const UMVec3d direction = sample_point - parameter.intersect_point;
+	const double distance_sq = direction.length_sq();
+	if (distance_sq < FLT_EPSILON) return false;
+
+	const double direction_length_inv = 1.0 / sqrt(distance_sq);
+	const double cos_theta_in = std::max( parameter.normal.dot(direction) * direction_length_inv, 0.0 );
+	const double cos_theta_out = std::max( entry.normal.dot(-direction) * direction_length_inv, 0.0 );
+	if (cos_theta_out <= 0.0) return false;
+	const double factor = cos_theta_in * cos_theta_out / distance_sq;
+	sample.intensity = entry.emissive * factor * entry.area;
+	sample.point = sample_point;
+	sample.direction = direction;
+	sample.pdf = distance_sq / (cos_theta_out * entry.area);
+	sample.is_intersectable = true;
+	return true;
+}
+
+/**
+ * constructor
+ */
+UMLightSampler::UMLightSampler()
+	: impl_(new UMLightSampler::Impl())
+{}
+
+/**
+ * destructor
+ */
+UMLightSampler::~UMLightSampler()
+{}
+
+/**
+ * create
+ */
+UMLightSamplerPtr UMLightSampler::create()
+{
+	return UMLightSamplerPtr(new UMLightSampler());
+}
+
+/**
+ * build light bvh and alias table
+ */
+bool UMLightSampler::build(const UMLightList& light_list, const UMPrimitiveList& primitive_list)
+{
+	return impl_->build(light_list, primitive_list);
+}
+
+/**
+ * clear all lights
+ */
+void UMLightSampler::clear()
+{
+	impl_->clear();
+}
+
+/**
+ * get light count
+ */
+int UMLightSampler::light_count() const
+{
+	return impl_->light_count();
+}
+
+/**
+ * pick a light
+ */
+bool UMLightSampler::pick(
+	const UMVec3d& point,
+	double random_value,
+	SamplingType type,
+	int& light_index,
+	double& pdf) const
+{
+	return impl_->pick(point, random_value, type, light_index, pdf);
+}
+
+/**
+ * get probability of picking a light
+ */
+double UMLightSampler::pick_pdf(const UMVec3d& point, int light_index, SamplingType type) const
+{
+	return impl_->pick_pdf(point, light_index, type);
+}
+
+/**
+ * get solid angle pdf of picking a light and sampling a point on it
+ */
+double UMLightSampler::pdf(
+	int light_index,
+	const UMVec3d& point,
+	const UMVec3d& light_point,
+	SamplingType type) const
+{
+	return impl_->pdf(light_index, point, light_point, type);
+}
+
+/**
+ * sample a point on a light
+ */
+bool UMLightSampler::sample(
+	int light_index,
+	const UMShaderParameter& parameter,
+	const UMVec2d& random_value,
+	UMLightSample& sample) const
+{
+	return impl_->sample(light_index, parameter, random_value, sample);
+}
+
+/**
+ * get light index of an emissive primitive
+ */
+int UMLightSampler::light_index(const UMPrimitive* primitive) const
+{
+	return impl_->light_index(primitive);
+}
+
+} // umrt
@@ -0,0 +1,172 @@
+/**
+ * @file UMLightSampler.h
+ * many-light sampler
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "UMMacro.h"
+#include "UMMathTypes.h"
+#include "UMVector.h"
+#include "UMLight.h"
+#include "UMPrimitive.h"
+
+namespace umrt
+{
+
+class UMLightSampler;
+typedef std::shared_ptr<UMLightSampler> UMLightSamplerPtr;
+
+class UMShaderParameter;
+
+/**
+ * a sampled point on a light
+ */
+class UMLightSample
+{
+public:
+	UMLightSample() : pdf(0), is_intersectable(false) {}
+	~UMLightSample() {}
+
+	/**
+	 * light intensity divided by area pdf
+	 */
+	UMVec3d intensity;
+
+	/**
+	 * sampled point on the light
+	 */
+	UMVec3d point;
+
+	/**
+	 * direction from shading point to sampled point (not normalized)
+	 */
+	UMVec3d direction;
+
+	/**
+	 * solid angle pdf of the sampled point
+	 */
+	double pdf;
+
+	/**
+	 * the light is a geometry which bsdf rays can hit
+	 */
+	bool is_intersectable;
+};
+
+/**
+ * many-light sampler.
+ * collects area lights and emissive triangles,
+ * then picks a light by power (and distance when using light bvh).
+ */
+class UMLightSampler
+{
+	DISALLOW_COPY_AND_ASSIGN(UMLightSampler);
+public:
+	/**
+	 * sampling types
+	 */
+	enum SamplingType {
+		eLightBvh, ///< power / distance importance by light bvh
+		ePowerTable, ///< power only by alias table
+	};
+
+	/**
+	 * create
+	 */
+	static UMLightSamplerPtr create();
+
+	~UMLightSampler();
+
+	/**
+	 * build light bvh and alias table
+	 * @param [in] light_list scene lights. area lights are used.
+	 * @param [in] primitive_list primitives. emissive triangles are used.
+	 * @retval success or failed
+	 */
+	bool build(const umdraw::UMLightList& light_list, const UMPrimitiveList& primitive_list);
+
+	/**
+	 * clear all lights
+	 */
+	void clear();
+
+	/**
+	 * get light count
+	 */
+	int light_count() const;
+
+	/**
+	 * pick a light
+	 * @param [in] point shading point
+	 * @param [in] random_value random value [0, 1)
+	 * @param [in] type sampling type
+	 * @param [out] light_index picked light index
+	 * @param [out] pdf probability of picking the light
+	 * @retval success or failed
+	 */
+	bool pick(
+		const UMVec3d& point,
+		double random_value,
+		SamplingType type,
+		int& light_index,
+		double& pdf) const;
+
+	/**
+	 * get probability of picking a light
+	 * @param [in] point shading point
+	 * @param [in] light_index light index
+	 * @param [in] type sampling type
+	 */
+	double pick_pdf(const UMVec3d& point, int light_index, SamplingType type) const;
+
+	/**
+	 * get solid angle pdf of picking a light and sampling a point on it
+	 * @param [in] light_index light index
+	 * @param [in] point shading point
+	 * @param [in] light_point point on the light
+	 * @param [in] type sampling type
+	 */
+	double pdf(
+		int light_index,
+		const UMVec3d& point,
+		const UMVec3d& light_point,
+		SamplingType type) const;
+
+	/**
+	 * sample a point on a light
+	 * @param [in] light_index light index
+	 * @param [in] parameter shader parameter on shading point
+	 * @param [in] random_value random value
+	 * @param [out] sample sampled result
+	 * @retval success or failed
+	 */
+	bool sample(
+		int light_index,
+		const UMShaderParameter& parameter,
+		const UMVec2d& random_value,
+		UMLightSample& sample) const;
+
+	/**
+	 * get light index of an emissive primitive
+	 * @retval light index or -1
+	 */
+	int light_index(const UMPrimitive* primitive) const;
+
+private:
+	UMLightSampler();
+
+	class Impl;
+	typedef std::unique_ptr<Impl> ImplPtr;
+	ImplPtr impl_;
+};
+
+} // umrt
@@ -0,0 +1,991 @@
+/**
+ * @file UMNurbsPatch.cpp
+ * ray traced nurbs patch
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMNurbsPatch.h"
+
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <algorithm>
+
+#include "UMMaterial.h"
+
+#ifdef WITH_ALEMBIC
+	#include "UMAbcNurbsPatch.h"
+#endif
+
+#ifndef WITH_EMSCRIPTEN
+	#include <xmmintrin.h>
+	#define UM_NURBS_PATCH_SSE
+#endif
+
+namespace
+{
+	using namespace umrt;
+
+	/// triangles of a bvh leaf. one triangle block.
+	const unsigned int max_leaf_count = 4;
+
+	/// max order of basis functions
+	const int max_order = 16;
+
+	/// max depth of splitting a knot span
+	const int max_span_depth = 6;
+
+	/// max segments of tessellation in each direction
+	const size_t max_grid_size = 1024;
+
+	/**
+	 * 4 triangles in structure of arrays.
+	 * v0, v1 - v0, v2 - v0 of each triangle.
+	 */
+	struct TriangleBlock
+	{
+		float v0[3][4];
+		float e1[3][4];
+		float e2[3][4];
+	};
+
+	/**
+	 * tessellated patch
+	 */
+	class Tessellation : public UMCachedGeometry
+	{
+	public:
+		/**
+		 * bvh node. 32 bytes.
+		 */
+		struct Node
+		{
+			float box_min[3];
+			float box_max[3];
+			/// leaf: index of block_list, branch: index of right child
+			unsigned int offset;
+			/// leaf: number of triangles, branch: 0
+			unsigned short count;
+			unsigned short axis;
+		};
+
+		/// x, y, z
+		std::vector<float> position_list;
+		/// x, y, z
+		std::vector<float> normal_list;
+		/// u, v in [0, 1]
+		std::vector<float> parameter_list;
+		/// 3 indices of each triangle. triangle i is lane (i % 4) of block (i / 4).
+		std::vector<unsigned int> index_list;
+		std::vector<TriangleBlock> block_list;
+		std::vector<Node> node_list;
+
+		virtual size_t memory_size() const
+		{
+			return sizeof(Tessellation)
+				+ position_list.size() * sizeof(float)
+				+ normal_list.size() * sizeof(float)
+				+ parameter_list.size() * sizeof(float)
+				+ index_list.size() * sizeof(unsigned int)
+				+ block_list.size() * sizeof(TriangleBlock)
+				+ node_list.size() * sizeof(Node);
+		}
+
+		UMVec3d position(unsigned int index) const
+		{
+			const float* p = &position_list[index * 3];
+			return UMVec3d(p[0], p[1], p[2]);
+		}
+
+		UMVec3d normal(unsigned int index) const
+		{
+			const float* n = &normal_list[index * 3];
+			return UMVec3d(n[0], n[1], n[2]);
+		}
+
+		UMVec2d parameter(unsigned int index) const
+		{
+			const float* p = &parameter_list[index * 2];
+			return UMVec2d(p[0], p[1]);
+		}
+	};
+	typedef std::shared_ptr<const Tessellation> TessellationPtr;
+
+	/**
+	 * slab test of a node box
+	 */
+	bool intersect_node(
+		const float* box_min,
+		const float* box_max,
+		const UMVec3d& origin,
+		const UMVec3d& inv_dir,
+		double tmin,
+		double tmax)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			double t0 = (box_min[i] - origin[i]) * inv_dir[i];
+			double t1 = (box_max[i] - origin[i]) * inv_dir[i];
+			if (t0 > t1) std::swap(t0, t1);
+			tmin = t0 > tmin ? t0 : tmin;
+			tmax = t1 < tmax ? t1 : tmax;
+			if (tmin > tmax) return false;
+		}
+		return true;
+	}
+
+	/**
+	 * float which is not greater than value
+	 */
+	float float_floor(double value)
+	{
+		const float f = static_cast<float>(value);
+		return f > value ? std::nextafter(f, -FLT_MAX) : f;
+	}
+
+	/**
+	 * float which is not less than value
+	 */
+	float float_ceil(double value)
+	{
+		const float f = static_cast<float>(value);
+		return f < value ? std::nextafter(f, FLT_MAX) : f;
+	}
+
+	/**
+	 * compare triangle centers on an axis
+	 */
+	class TriangleAxisLess
+	{
+	public:
+		TriangleAxisLess(const std::vector<float>& center_list, int axis)
+			: center_list_(center_list), axis_(axis) {}
+
+		bool operator()(unsigned int a, unsigned int b) const
+		{
+			return center_list_[a * 3 + axis_] < center_list_[b * 3 + axis_];
+		}
+
+	private:
+		const std::vector<float>& center_list_;
+		int axis_;
+	};
+
+	/**
+	 * build a node by median split.
+	 * nodes are in depth first order, so left child is next to parent.
+	 * triangles of a leaf are packed to one block.
+	 */
+	unsigned int build_node(
+		Tessellation& t,
+		std::vector<unsigned int>& order,
+		const std::vector<unsigned int>& grid_index_list,
+		const std::vector<float>& center_list,
+		unsigned int start,
+		unsigned int end)
+	{
+		const unsigned int node_index = static_cast<unsigned int>(t.node_list.size());
+		t.node_list.push_back(Tessellation::Node());
+
+		UMVec3d box_min(DBL_MAX);
+		UMVec3d box_max(-DBL_MAX);
+		UMVec3d center_min(DBL_MAX);
+		UMVec3d center_max(-DBL_MAX);
+		for (unsigned int i = start; i < end; ++i)
+		{
+			const unsigned int* index = &grid_index_list[order[i] * 3];
+			for (int v = 0; v < 3; ++v)
+			{
+				const float* p = &t.position_list[index[v] * 3];
+				for (int k = 0; k < 3; ++k)
+				{
+					box_min[k] = std::min(box_min[k], static_cast<double>(p[k]));
+					box_max[k] = std::max(box_max[k], static_cast<double>(p[k]));
+				}
+			}
+			for (int k = 0; k < 3; ++k)
+			{
+				center_min[k] = std::min(center_min[k], static_cast<double>(center_list[order[i] * 3 + k]));
+				center_max[k] = std::max(center_max[k], static_cast<double>(center_list[order[i] * 3 + k]));
+			}
+		}
+		{
+			Tessellation::Node& node = t.node_list[node_index];
+			for (int k = 0; k < 3; ++k)
+			{
+				node.box_min[k] = float_floor(box_min[k]);
+				node.box_max[k] = float_ceil(box_max[k]);
+			}
+		}
+
+		if ((end - start) <= max_leaf_count)
+		{
+			const unsigned int block_index = static_cast<unsigned int>(t.block_list.size());
+			t.block_list.push_back(TriangleBlock());
+			TriangleBlock& block = t.block_list.back();
+			std::memset(&block, 0, sizeof(TriangleBlock));
+			for (unsigned int lane = 0; lane < max_leaf_count; ++lane)
+			{
+				// unused lanes are never read, but indices are kept aligned to blocks
+				const unsigned int triangle = order[std::min(start + lane, end - 1)];
+				const unsigned int* index = &grid_index_list[triangle * 3];
+				t.index_list.insert(t.index_list.end(), index, index + 3);
+				const float* p0 = &t.position_list[index[0] * 3];
+				const float* p1 = &t.position_list[index[1] * 3];
+				const float* p2 = &t.position_list[index[2] * 3];
+				for (int k = 0; k < 3; ++k)
+				{
+					block.v0[k][lane] = p0[k];
+					block.e1[k][lane] = p1[k] - p0[k];
+					block.e2[k][lane] = p2[k] - p0[k];
+				}
+			}
+			Tessellation::Node& node = t.node_list[node_index];
+			node.offset = block_index;
+			node.count = static_cast<unsigned short>(end - start);
+			node.axis = 0;
+			return node_index;
+		}
+
+		const UMVec3d extent = center_max - center_min;
+		int axis = 0;
+		if (extent.y > extent.x) axis = 1;
+		if (extent.z > extent[axis]) axis = 2;
+
+		const unsigned int middle = (start + end) / 2;
+		std::nth_element(
+			order.begin() + start,
+			order.begin() + middle,
+			order.begin() + end,
+			TriangleAxisLess(center_list, axis));
+
+		build_node(t, order, grid_index_list, center_list, start, middle);
+		const unsigned int right = build_node(t, order, grid_index_list, center_list, middle, end);
+
+		Tessellation::Node& node = t.node_list[node_index];
+		node.offset = right;
+		node.count = 0;
+		node.axis = static_cast<unsigned short>(axis);
+		return node_index;
+	}
+
+	/**
+	 * intersect 4 triangles of a block. both sides are hit.
+	 * @retval nearest lane or -1
+	 */
+	int intersect_block(
+		const TriangleBlock& block,
+		unsigned int count,
+		const float* o,
+		const float* d,
+		float tmin,
+		float tmax,
+		float& distance,
+		float& u,
+		float& v)
+	{
+		float tt[4];
+		float uu[4];
+		float vv[4];
+		int valid[4];
+#ifdef UM_NURBS_PATCH_SSE
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 dx = _mm_set1_ps(d[0]);
+		const __m128 dy = _mm_set1_ps(d[1]);
+		const __m128 dz = _mm_set1_ps(d[2]);
+		const __m128 e1x = _mm_loadu_ps(block.e1[0]);
+		const __m128 e1y = _mm_loadu_ps(block.e1[1]);
+		const __m128 e1z = _mm_loadu_ps(block.e1[2]);
+		const __m128 e2x = _mm_loadu_ps(block.e2[0]);
+		const __m128 e2y = _mm_loadu_ps(block.e2[1]);
+		const __m128 e2z = _mm_loadu_ps(block.e2[2]);
+		// p = d x e2
+		const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+		const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+		const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+		const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+		const __m128 inv_det = _mm_div_ps(one, det);
+		// s = o - v0
+		const __m128 sx = _mm_sub_ps(_mm_set1_ps(o[0]), _mm_loadu_ps(block.v0[0]));
+		const __m128 sy = _mm_sub_ps(_mm_set1_ps(o[1]), _mm_loadu_ps(block.v0[1]));
+		const __m128 sz = _mm_sub_ps(_mm_set1_ps(o[2]), _mm_loadu_ps(block.v0[2]));
+		const __m128 b1 = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv_det);
+		// q = s x e1
+		const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+		const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+		const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+		const __m128 b2 = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv_det);
+		const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+		__m128 mask = _mm_cmpneq_ps(det, zero);
+		mask = _mm_and_ps(mask, _mm_cmpge_ps(b1, zero));
+		mask = _mm_and_ps(mask, _mm_cmpge_ps(b2, zero));
+		mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(b1, b2), one));
+		mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, _mm_set1_ps(tmin)));
+		mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(tmax)));
+		const int bits = _mm_movemask_ps(mask);
+		if (bits == 0) return -1;
+		_mm_storeu_ps(tt, t);
+		_mm_storeu_ps(uu, b1);
+		_mm_storeu_ps(vv, b2);
+		for (int lane = 0; lane < 4; ++lane)
+		{
+			valid[lane] = (bits >> lane) & 1;
+		}
+#else
+		for (int lane = 0; lane < 4; ++lane)
+		{
+			const float e1x = block.e1[0][lane], e1y = block.e1[1][lane], e1z = block.e1[2][lane];
+			const float e2x = block.e2[0][lane], e2y = block.e2[1][lane], e2z = block.e2[2][lane];
+			const float px = d[1] * e2z - d[2] * e2y;
+			const float py = d[2] * e2x - d[0] * e2z;
+			const float pz = d[0] * e2y - d[1] * e2x;
+			const float det = e1x * px + e1y * py + e1z * pz;
+			valid[lane] = 0;
+			if (det == 0.0f) continue;
+			const float inv_det = 1.0f / det;
+			const float sx = o[0] - block.v0[0][lane];
+			const float sy = o[1] - block.v0[1][lane];
+			const float sz = o[2] - block.v0[2][lane];
+			uu[lane] = (sx * px + sy * py + sz * pz) * inv_det;
+			const float qx = sy * e1z - sz * e1y;
+			const float qy = sz * e1x - sx * e1z;
+			const float qz = sx * e1y - sy * e1x;
+			vv[lane] = (d[0] * qx + d[1] * qy + d[2] * qz) * inv_det;
+			tt[lane] = (e2x * qx + e2y * qy + e2z * qz) * inv_det;
+			valid[lane] = uu[lane] >= 0.0f && vv[lane] >= 0.0f && (uu[lane] + vv[lane]) <= 1.0f
+				&& tt[lane] > tmin && tt[lane] < tmax;
+		}
+#endif // UM_NURBS_PATCH_SSE
+		int hit_lane = -1;
+		for (int lane = 0; lane < static_cast<int>(count); ++lane)
+		{
+			if (!valid[lane]) continue;
+			if (hit_lane < 0 || tt[lane] < tt[hit_lane])
+			{
+				hit_lane = lane;
+			}
+		}
+		if (hit_lane >= 0)
+		{
+			distance = tt[hit_lane];
+			u = uu[hit_lane];
+			v = vv[hit_lane];
+		}
+		return hit_lane;
+	}
+
+	/**
+	 * a ray hit to a tessellation
+	 */
+	struct Hit
+	{
+		unsigned int triangle;
+		float u;
+		float v;
+		float distance;
+	};
+
+	/**
+	 * traverse bvh of a tessellation
+	 */
+	bool traverse(const Tessellation& t, const UMRay& ray, bool is_any_hit, Hit& hit)
+	{
+		if (t.node_list.empty()) return false;
+
+		const UMVec3d& origin = ray.origin();
+		const UMVec3d inv_dir(1.0 / ray.direction().x, 1.0 / ray.direction().y, 1.0 / ray.direction().z);
+		const bool dir_is_negative[3] = { inv_dir.x < 0, inv_dir.y < 0, inv_dir.z < 0 };
+		const float o[3] = {
+			static_cast<float>(origin.x),
+			static_cast<float>(origin.y),
+			static_cast<float>(origin.z) };
+		const float d[3] = {
+			static_cast<float>(ray.direction().x),
+			static_cast<float>(ray.direction().y),
+			static_cast<float>(ray.direction().z) };
+		const float tmin = static_cast<float>(ray.tmin());
+
+		bool is_hit = false;
+		float distance = 0.0f;
+		float u = 0.0f;
+		float v = 0.0f;
+		unsigned int branch_stack[64];
+		unsigned int branch_stack_index = 0;
+		for (unsigned int i = 0; ; )
+		{
+			const Tessellation::Node& node = t.node_list[i];
+			if (intersect_node(node.box_min, node.box_max, origin, inv_dir, ray.tmin(), hit.distance))
+			{
+				if (node.count > 0)
+				{
+					const int lane = intersect_block(
+						t.block_list[node.offset], node.count, o, d, tmin, hit.distance, distance, u, v);
+					if (lane >= 0)
+					{
+						hit.triangle = node.offset * max_leaf_count + lane;
+						hit.u = u;
+						hit.v = v;
+						hit.distance = distance;
+						is_hit = true;
+						if (is_any_hit) return true;
+					}
+					if (branch_stack_index == 0) break;
+					i = branch_stack[--branch_stack_index];
+				}
+				else
+				{
+					// nearer child first
+					if (dir_is_negative[node.axis])
+					{
+						branch_stack[branch_stack_index++] = i + 1;
+						i = node.offset;
+					}
+					else
+					{
+						branch_stack[branch_stack_index++] = node.offset;
+						++i;
+					}
+				}
+			}
+			else
+			{
+				if (branch_stack_index == 0) break;
+				i = branch_stack[--branch_stack_index];
+			}
+		}
+		return is_hit;
+	}
+
+	/**
+	 * find knot span which has t. knot[span] <= t < knot[span + 1]
+	 */
+	int find_span(const std::vector<double>& knot, int size, int order, double t)
+	{
+		if (t >= knot[size]) return size - 1;
+		if (t <= knot[order - 1]) return order - 1;
+		int low = order - 1;
+		int high = size;
+		while (high - low > 1)
+		{
+			const int middle = (low + high) / 2;
+			if (t < knot[middle]) high = middle;
+			else low = middle;
+		}
+		return low;
+	}
+
+	/**
+	 * non zero basis functions at t. N[0] is for control point (span - order + 1).
+	 */
+	void basis_functions(const std::vector<double>& knot, int span, int order, double t, double* N)
+	{
+		double left[max_order];
+		double right[max_order];
+		N[0] = 1.0;
+		for (int j = 1; j < order; ++j)
+		{
+			left[j] = t - knot[span + 1 - j];
+			right[j] = knot[span + j] - t;
+			double saved = 0.0;
+			for (int r = 0; r < j; ++r)
+			{
+				const double denominator = right[r + 1] + left[j - r];
+				const double temp = denominator != 0.0 ? N[r] / denominator : 0.0;
+				N[r] = saved + right[r + 1] * temp;
+				saved = left[j - r] * temp;
+			}
+			N[j] = saved;
+		}
+	}
+
+	/**
+	 * hash of values
+	 */
+	unsigned long long hash_values(unsigned long long hash, const void* data, size_t size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
+} // anonymouse namespace
+
+namespace umrt
+{
+
+/**
+ * create from alembic nurbs patch
+ */
+UMNurbsPatchPtr UMNurbsPatch::create_from_abc_nurbs_patch(umabc::UMAbcNurbsPatchPtr patch, UMGeometryCachePtr cache)
+{
+	if (!patch || !cache) return UMNurbsPatchPtr();
+	UMNurbsPatchPtr instance(std::make_shared<UMNurbsPatch>());
+	instance->abc_patch_ = patch;
+	instance->cache_ = cache;
+	instance->material_ = umdraw::UMMaterial::default_material();
+	instance->update_box();
+	return instance;
+}
+
+/**
+ * create
+ */
+UMNurbsPatchPtr UMNurbsPatch::create(UMGeometryCachePtr cache)
+{
+	if (!cache) return UMNurbsPatchPtr();
+	UMNurbsPatchPtr instance(std::make_shared<UMNurbsPatch>());
+	instance->cache_ = cache;
+	instance->material_ = umdraw::UMMaterial::default_material();
+	return instance;
+}
+
+/**
+ * constructor
+ */
+UMNurbsPatch::UMNurbsPatch()
+	: revision_(0)
+	, digest_(0)
+	, flatness_(0.001)
+	, u_size_(0)
+	, v_size_(0)
+	, u_order_(0)
+	, v_order_(0)
+{
+}
+
+/**
+ * set flatness
+ */
+void UMNurbsPatch::set_flatness(double flatness)
+{
+	if (flatness <= 0.0 || flatness == flatness_) return;
+	flatness_ = flatness;
+	next_revision();
+}
+
+/**
+ * set control points and knots
+ */
+void UMNurbsPatch::set_surface(
+	const float* positions,
+	const float* weights,
+	const float* u_knot,
+	const float* v_knot,
+	int u_size,
+	int v_size,
+	int u_order,
+	int v_order)
+{
+	control_point_list_.clear();
+	u_knot_list_.clear();
+	v_knot_list_.clear();
+	u_size_ = v_size_ = u_order_ = v_order_ = 0;
+	box_.init();
+	if (!positions || !u_knot || !v_knot
+		|| u_order < 2 || v_order < 2
+		|| u_order > max_order || v_order > max_order
+		|| u_size < u_order || v_size < v_order)
+	{
+		update_revision();
+		return;
+	}
+	u_size_ = u_size;
+	v_size_ = v_size;
+	u_order_ = u_order;
+	v_order_ = v_order;
+	u_knot_list_.assign(u_knot, u_knot + u_size + u_order);
+	v_knot_list_.assign(v_knot, v_knot + v_size + v_order);
+	const int count = u_size * v_size;
+	control_point_list_.resize(count);
+	for (int i = 0; i < count; ++i)
+	{
+		const float* p = &positions[i * 3];
+		const double w = weights ? weights[i] : 1.0;
+		control_point_list_[i] = UMVec4d(p[0] * w, p[1] * w, p[2] * w, w);
+		// surface is in the hull of control points
+		box_.extend(UMVec3d(p[0], p[1], p[2]));
+	}
+	update_revision();
+}
+
+/**
+ * cached tessellation is stale when control points or knots are changed
+ */
+void UMNurbsPatch::update_revision()
+{
+	unsigned long long digest = 14695981039346656037ULL;
+	const int size[4] = { u_size_, v_size_, u_order_, v_order_ };
+	digest = hash_values(digest, size, sizeof(size));
+	if (!control_point_list_.empty())
+	{
+		digest = hash_values(digest, &control_point_list_[0], control_point_list_.size() * sizeof(UMVec4d));
+		digest = hash_values(digest, &u_knot_list_[0], u_knot_list_.size() * sizeof(double));
+		digest = hash_values(digest, &v_knot_list_[0], v_knot_list_.size() * sizeof(double));
+	}
+	if (digest != digest_)
+	{
+		digest_ = digest;
+		next_revision();
+	}
+}
+
+/**
+ * change revision and drop tessellation of old revisions
+ */
+void UMNurbsPatch::next_revision()
+{
+	++revision_;
+	if (cache_) cache_->remove_owner(id());
+}
+
+/**
+ * read current sample and update box
+ */
+void UMNurbsPatch::update_box()
+{
+#ifdef WITH_ALEMBIC
+	if (umabc::UMAbcNurbsPatchPtr patch = abc_patch_.lock())
+	{
+		Alembic::AbcGeom::P3fArraySamplePtr positions = patch->positions();
+		Alembic::AbcGeom::FloatArraySamplePtr weights = patch->position_weights();
+		Alembic::AbcGeom::FloatArraySamplePtr u_knot = patch->u_knot();
+		Alembic::AbcGeom::FloatArraySamplePtr v_knot = patch->v_knot();
+		const int u_size = static_cast<int>(patch->u_size());
+		const int v_size = static_cast<int>(patch->v_size());
+		const int u_order = patch->u_order();
+		const int v_order = patch->v_order();
+		const size_t count = static_cast<size_t>(u_size) * v_size;
+		if (positions && u_knot && v_knot
+			&& positions->size() == count
+			&& u_knot->size() == static_cast<size_t>(u_size + u_order)
+			&& v_knot->size() == static_cast<size_t>(v_size + v_order))
+		{
+			set_surface(
+				reinterpret_cast<const float*>(positions->get()),
+				(weights && weights->size() == count) ? weights->get() : NULL,
+				u_knot->get(),
+				v_knot->get(),
+				u_size,
+				v_size,
+				u_order,
+				v_order);
+		}
+		else
+		{
+			set_surface(NULL, NULL, NULL, NULL, 0, 0, 0, 0);
+		}
+	}
+#endif // WITH_ALEMBIC
+}
+
+/**
+ * evaluate a point on the surface
+ */
+UMVec3d UMNurbsPatch::evaluate(double u, double v) const
+{
+	if (control_point_list_.empty()) return UMVec3d(0);
+	double nu[max_order];
+	double nv[max_order];
+	const int u_span = find_span(u_knot_list_, u_size_, u_order_, u);
+	const int v_span = find_span(v_knot_list_, v_size_, v_order_, v);
+	basis_functions(u_knot_list_, u_span, u_order_, u, nu);
+	basis_functions(v_knot_list_, v_span, v_order_, v, nv);
+	UMVec4d p(0);
+	for (int j = 0; j < v_order_; ++j)
+	{
+		const int row = (v_span - v_order_ + 1 + j) * u_size_;
+		UMVec4d q(0);
+		for (int i = 0; i < u_order_; ++i)
+		{
+			q += control_point_list_[row + u_span - u_order_ + 1 + i] * nu[i];
+		}
+		p += q * nv[j];
+	}
+	if (p.w == 0.0) return UMVec3d(0);
+	return p.xyz() * (1.0 / p.w);
+}
+
+/**
+ * max distance from the surface to chords between a and b,
+ * along each sample of the other direction
+ */
+double UMNurbsPatch::chord_error(bool is_u, double a, double b, const ParameterList& samples) const
+{
+	double error = 0.0;
+	for (ParameterList::const_iterator it = samples.begin(); it != samples.end(); ++it)
+	{
+		const UMVec3d pa = is_u ? evaluate(a, *it) : evaluate(*it, a);
+		const UMVec3d pb = is_u ? evaluate(b, *it) : evaluate(*it, b);
+		for (int k = 1; k < 4; ++k)
+		{
+			const double s = k * 0.25;
+			const double t = a + (b - a) * s;
+			const UMVec3d p = is_u ? evaluate(t, *it) : evaluate(*it, t);
+			error = std::max(error, (p - (pa * (1.0 - s) + pb * s)).length());
+		}
+	}
+	return error;
+}
+
+/**
+ * split parameter domain of a direction until chords are flat.
+ * each knot span is split by halves. the other direction is sampled at its spans.
+ * @param [in] is_u u or v
+ * @param [out] dst ascending parameters of tessellation
+ */
+void UMNurbsPatch::partition(bool is_u, ParameterList& dst) const
+{
+	const ParameterList& knot = is_u ? u_knot_list_ : v_knot_list_;
+	const int size = is_u ? u_size_ : v_size_;
+	const int order = is_u ? u_order_ : v_order_;
+	const ParameterList& other_knot = is_u ? v_knot_list_ : u_knot_list_;
+	const int other_size = is_u ? v_size_ : u_size_;
+	const int other_order = is_u ? v_order_ : u_order_;
+
+	// samples of the other direction. span boundaries and middles, at most 17.
+	ParameterList samples;
+	{
+		ParameterList breaks;
+		for (int i = other_order - 1; i <= other_size; ++i)
+		{
+			if (breaks.empty() || other_knot[i] > breaks.back())
+			{
+				breaks.push_back(other_knot[i]);
+			}
+		}
+		const size_t stride = breaks.size() / 8 + 1;
+		for (size_t i = 0; i < breaks.size(); i += stride)
+		{
+			samples.push_back(breaks[i]);
+			const size_t next = std::min(i + stride, breaks.size() - 1);
+			if (next > i)
+			{
+				samples.push_back((breaks[i] + breaks[next]) * 0.5);
+			}
+		}
+		samples.push_back(breaks.back());
+	}
+
+	const double tolerance = std::max(flatness_ * (box_.maximum() - box_.minimum()).length(), DBL_EPSILON);
+	dst.clear();
+	dst.push_back(knot[order - 1]);
+	for (int i = order - 1; i < size; ++i)
+	{
+		const double a = knot[i];
+		const double b = knot[i + 1];
+		if (b <= a) continue;
+
+		// depth first, left half first
+		std::vector< std::pair<double, int> > stack;
+		stack.push_back(std::make_pair(b, 0));
+		double start = a;
+		while (!stack.empty())
+		{
+			const double end = stack.back().first;
+			const int depth = stack.back().second;
+			if (depth < max_span_depth
+				&& dst.size() < max_grid_size
+				&& chord_error(is_u, start, end, samples) > tolerance)
+			{
+				stack.back().second = depth + 1;
+				stack.push_back(std::make_pair((start + end) * 0.5, depth + 1));
+				continue;
+			}
+			dst.push_back(end);
+			start = end;
+			stack.pop_back();
+		}
+	}
+}
+
+/**
+ * tessellate patch to a grid of flat cells
+ */
+UMCachedGeometryPtr UMNurbsPatch::tessellate() const
+{
+	std::shared_ptr<Tessellation> t(std::make_shared<Tessellation>());
+	if (control_point_list_.empty()) return t;
+
+	ParameterList u_list;
+	ParameterList v_list;
+	partition(true, u_list);
+	partition(false, v_list);
+	const int nu = static_cast<int>(u_list.size());
+	const int nv = static_cast<int>(v_list.size());
+	if (nu < 2 || nv < 2) return t;
+
+	const double u_start = u_list.front();
+	const double v_start = v_list.front();
+	const double u_scale = 1.0 / (u_list.back() - u_start);
+	const double v_scale = 1.0 / (v_list.back() - v_start);
+	t->position_list.resize(nu * nv * 3);
+	t->normal_list.resize(nu * nv * 3, 0.0f);
+	t->parameter_list.resize(nu * nv * 2);
+	for (int j = 0; j < nv; ++j)
+	{
+		for (int i = 0; i < nu; ++i)
+		{
+			const int index = j * nu + i;
+			const UMVec3d p = evaluate(u_list[i], v_list[j]);
+			t->position_list[index * 3 + 0] = static_cast<float>(p.x);
+			t->position_list[index * 3 + 1] = static_cast<float>(p.y);
+			t->position_list[index * 3 + 2] = static_cast<float>(p.z);
+			t->parameter_list[index * 2 + 0] = static_cast<float>((u_list[i] - u_start) * u_scale);
+			t->parameter_list[index * 2 + 1] = static_cast<float>((v_list[j] - v_start) * v_scale);
+		}
+	}
+
+	// 2 triangles of each cell
+	const int triangle_count = (nu - 1) * (nv - 1) * 2;
+	std::vector<unsigned int> grid_index_list(triangle_count * 3);
+	std::vector<float> center_list(triangle_count * 3);
+	std::vector<UMVec3d> normal_sum(nu * nv, UMVec3d(0));
+	for (int j = 0; j < nv - 1; ++j)
+	{
+		for (int i = 0; i < nu - 1; ++i)
+		{
+			const unsigned int a = j * nu + i;
+			const unsigned int b = a + 1;
+			const unsigned int c = a + nu + 1;
+			const unsigned int d = a + nu;
+			const unsigned int cell[2][3] = { { a, b, c }, { a, c, d } };
+			for (int n = 0; n < 2; ++n)
+			{
+				const int triangle = ((j * (nu - 1) + i) * 2 + n);
+				const UMVec3d p0 = t->position(cell[n][0]);
+				const UMVec3d p1 = t->position(cell[n][1]);
+				const UMVec3d p2 = t->position(cell[n][2]);
+				const UMVec3d normal = (p1 - p0).cross(p2 - p0);
+				const UMVec3d center = (p0 + p1 + p2) * (1.0 / 3.0);
+				for (int k = 0; k < 3; ++k)
+				{
+					grid_index_list[triangle * 3 + k] = cell[n][k];
+					center_list[triangle * 3 + k] = static_cast<float>(center[k]);
+					normal_sum[cell[n][k]] += normal;
+				}
+			}
+		}
+	}
+	for (int i = 0; i < nu * nv; ++i)
+	{
+		const UMVec3d n = normal_sum[i].length_sq() > 0.0 ? normal_sum[i].normalized() : UMVec3d(0);
+		t->normal_list[i * 3 + 0] = static_cast<float>(n.x);
+		t->normal_list[i * 3 + 1] = static_cast<float>(n.y);
+		t->normal_list[i * 3 + 2] = static_cast<float>(n.z);
+	}
+
+	std::vector<unsigned int> order(triangle_count);
+	for (int i = 0; i < triangle_count; ++i)
+	{
+		order[i] = static_cast<unsigned int>(i);
+	}
+	t->node_list.reserve(2 * (triangle_count / max_leaf_count) + 1);
+	t->block_list.reserve(triangle_count / max_leaf_count + 1);
+	t->index_list.reserve((triangle_count / max_leaf_count + 1) * max_leaf_count * 3);
+	build_node(*t, order, grid_index_list, center_list, 0, static_cast<unsigned int>(triangle_count));
+	return t;
+}
+
+/**
+ * get tessellation from cache, or tessellate.
+ * rays which reach the patch while it is tessellated wait for the result.
+ */
+UMCachedGeometryPtr UMNurbsPatch::tessellation() const
+{
+	if (!cache_) return tessellate();
+	const UMGeometryCache::Key key = UMGeometryCache::key(id(), revision_);
+	if (UMCachedGeometryPtr geometry = cache_->find(key))
+	{
+		return geometry;
+	}
+	std::lock_guard<std::mutex> lock(tessellation_mutex_);
+	if (UMCachedGeometryPtr geometry = cache_->find(key))
+	{
+		return geometry;
+	}
+	return cache_->insert(key, tessellate());
+}
+
+/**
+ * get number of triangles of current tessellation
+ */
+size_t UMNurbsPatch::triangle_count() const
+{
+	TessellationPtr t = std::static_pointer_cast<const Tessellation>(tessellation());
+	if (!t || t->node_list.empty()) return 0;
+	size_t count = 0;
+	for (std::vector<Tessellation::Node>::const_iterator it = t->node_list.begin(); it != t->node_list.end(); ++it)
+	{
+		count += it->count;
+	}
+	return count;
+}
+
+/**
+ * ray intersection
+ */
+bool UMNurbsPatch::intersects(const UMRay& ray, UMShaderParameter& parameter) const
+{
+	if (control_point_list_.empty()) return false;
+	TessellationPtr t = std::static_pointer_cast<const Tessellation>(tessellation());
+	if (!t) return false;
+	Hit hit = { 0, 0.0f, 0.0f, static_cast<float>(std::min(ray.tmax(), static_cast<double>(FLT_MAX))) };
+	if (!traverse(*t, ray, false, hit)) return false;
+
+	const unsigned int* index = &t->index_list[hit.triangle * 3];
+	const double w = 1.0 - hit.u - hit.v;
+	const UMVec3d p0 = t->position(index[0]);
+	const UMVec3d p1 = t->position(index[1]);
+	const UMVec3d p2 = t->position(index[2]);
+	UMVec3d face_normal = (p1 - p0).cross(p2 - p0).normalized();
+	UMVec3d normal = t->normal(index[0]) * w + t->normal(index[1]) * hit.u + t->normal(index[2]) * hit.v;
+	normal = normal.length_sq() > 0.0 ? normal.normalized() : face_normal;
+	// both sides are front
+	if (face_normal.dot(ray.direction()) > 0.0)
+	{
+		face_normal = -face_normal;
+		normal = -normal;
+	}
+	parameter.distance = hit.distance;
+	parameter.intersect_point = ray.origin() + ray.direction() * parameter.distance;
+	parameter.normal = normal;
+	parameter.face_normal = face_normal;
+	parameter.uvw = UMVec3d(w, hit.u, hit.v);
+	parameter.uv = t->parameter(index[0]) * w + t->parameter(index[1]) * hit.u + t->parameter(index[2]) * hit.v;
+	parameter.face_index = static_cast<int>(hit.triangle);
+	parameter.primitive = this;
+	parameter.material = material_;
+	if (material_)
+	{
+		parameter.color = material_->diffuse().xyz();
+		parameter.emissive = material_->emissive().xyz() * material_->emissive_factor();
+	}
+	else
+	{
+		parameter.emissive = UMVec3d(0);
+	}
+	return true;
+}
+
+/**
+ * ray intersection
+ */
+bool UMNurbsPatch::intersects(const UMRay& ray) const
+{
+	if (control_point_list_.empty()) return false;
+	TessellationPtr t = std::static_pointer_cast<const Tessellation>(tessellation());
+	if (!t) return false;
+	Hit hit = { 0, 0.0f, 0.0f, static_cast<float>(std::min(ray.tmax(), static_cast<double>(FLT_MAX))) };
+	return traverse(*t, ray, true, hit);
+}
+
+} // umrt
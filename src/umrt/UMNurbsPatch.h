@@ -0,0 +1,173 @@
+/**
+ * @file UMNurbsPatch.h
+ * ray traced nurbs patch
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <mutex>
+
+#include "UMMacro.h"
+#include "UMVector.h"
+#include "UMMathTypes.h"
+#include "UMBox.h"
+#include "UMPrimitive.h"
+#include "UMRay.h"
+#include "UMShaderParameter.h"
+#include "UMGeometryCache.h"
+
+namespace umabc
+{
+	class UMAbcNurbsPatch;
+	typedef std::shared_ptr<UMAbcNurbsPatch> UMAbcNurbsPatchPtr;
+	typedef std::weak_ptr<UMAbcNurbsPatch> UMAbcNurbsPatchWeakPtr;
+} // umabc
+
+namespace umrt
+{
+
+class UMNurbsPatch;
+typedef std::shared_ptr<UMNurbsPatch> UMNurbsPatchPtr;
+typedef std::vector<UMNurbsPatchPtr> UMNurbsPatchList;
+
+/**
+ * ray traced nurbs patch.
+ * only the box of control points is in the scene bvh.
+ * the first ray which reaches the box tessellates the patch,
+ * by splitting each knot span until the surface is flat within a tolerance.
+ * other rays which reach the patch meanwhile wait for it.
+ * triangles are packed by 4 in leaves of its own bvh, and kept in a geometry cache
+ * while control points and knots are unchanged.
+ * trim curves are ignored.
+ */
+class UMNurbsPatch : public UMPrimitive
+{
+	DISALLOW_COPY_AND_ASSIGN(UMNurbsPatch);
+public:
+	/**
+	 * create from alembic nurbs patch
+	 * @param [in] patch alembic nurbs patch
+	 * @param [in] cache cache of tessellated geometry
+	 */
+	static UMNurbsPatchPtr create_from_abc_nurbs_patch(umabc::UMAbcNurbsPatchPtr patch, UMGeometryCachePtr cache);
+
+	/**
+	 * create
+	 * @param [in] cache cache of tessellated geometry
+	 */
+	static UMNurbsPatchPtr create(UMGeometryCachePtr cache);
+
+	UMNurbsPatch();
+
+	~UMNurbsPatch() {}
+
+	/**
+	 * ray intersection
+	 * @param [in] ray a ray
+	 * @param [in,out] parameter shading parameters
+	 */
+	virtual bool intersects(const UMRay& ray, UMShaderParameter& parameter) const;
+
+	/**
+	 * ray intersection
+	 * @param [in] ray a ray
+	 */
+	virtual bool intersects(const UMRay& ray) const;
+
+	/**
+	 * get box
+	 */
+	virtual const umbase::UMBox& box() const { return box_; }
+
+	/**
+	 * read current sample and update box
+	 */
+	virtual void update_box();
+
+	/**
+	 * set control points and knots
+	 * @param [in] positions x, y, z of u_size * v_size control points. u varies fastest.
+	 * @param [in] weights weights of control points. NULL is not rational.
+	 * @param [in] u_knot u_size + u_order knots
+	 * @param [in] v_knot v_size + v_order knots
+	 */
+	void set_surface(
+		const float* positions,
+		const float* weights,
+		const float* u_knot,
+		const float* v_knot,
+		int u_size,
+		int v_size,
+		int u_order,
+		int v_order);
+
+	/**
+	 * evaluate a point on the surface
+	 * @param [in] u u parameter in knot range
+	 * @param [in] v v parameter in knot range
+	 */
+	UMVec3d evaluate(double u, double v) const;
+
+	/**
+	 * get flatness. max distance from surface to triangles, relative to the box diagonal.
+	 */
+	double flatness() const { return flatness_; }
+
+	/**
+	 * set flatness
+	 */
+	void set_flatness(double flatness);
+
+	/**
+	 * get number of triangles of current tessellation
+	 */
+	size_t triangle_count() const;
+
+	/**
+	 * get material
+	 */
+	umdraw::UMMaterialPtr material() const { return material_; }
+
+	/**
+	 * set material
+	 */
+	void set_material(umdraw::UMMaterialPtr material) { material_ = material; }
+
+private:
+	typedef std::vector<double> ParameterList;
+
+	UMCachedGeometryPtr tessellation() const;
+	UMCachedGeometryPtr tessellate() const;
+	void partition(bool is_u, ParameterList& dst) const;
+	double chord_error(bool is_u, double a, double b, const ParameterList& samples) const;
+	void update_revision();
+	void next_revision();
+
+	unsigned int revision_;
+	unsigned long long digest_;
+	umabc::UMAbcNurbsPatchWeakPtr abc_patch_;
+	UMGeometryCachePtr cache_;
+	umdraw::UMMaterialPtr material_;
+	double flatness_;
+
+	/// homogeneous control points. x * w, y * w, z * w, w
+	std::vector<UMVec4d> control_point_list_;
+	ParameterList u_knot_list_;
+	ParameterList v_knot_list_;
+	int u_size_;
+	int v_size_;
+	int u_order_;
+	int v_order_;
+	umbase::UMBox box_;
+	/// one thread tessellates a patch at once
+	mutable std::mutex tessellation_mutex_;
+};
+
+} // umrt
@@ -16,6 +16,11 @@
 #include "UMScene.h"
 #include "UMSceneAccess.h"
 #include "UMAreaLight.h"
+#include "UMLightSampler.h"
+#include "UMFrameBuffer.h"
+#include "UMBucket.h"
+#include "UMCheckpoint.h"
+#include "UMTime.h"
 
 #include <limits>
 #include <algorithm>
@@ -30,18 +35,58 @@ namespace
 	using namespace umdraw;
 
 	const int minimum_path_depth = 2;
+
+	// pixel size of the first interactive pass. halved at every pass until 1.
+	const int interactive_start_scale = 8;
+	// rows rendered between time checks of interactive render
+	const int interactive_band_height = 8;
+	// blocks in a row traced by a task of interactive render
+	const int interactive_chunk_width = 64;
 	
+	// xor128 state per thread
+	unsigned int xor128_x = 123456789;
+	unsigned int xor128_y = 362436069;
+	unsigned int xor128_z = 521288629;
+	unsigned int xor128_w = 88675123;
+#pragma omp threadprivate(xor128_x, xor128_y, xor128_z, xor128_w)
+
+	// ray counter of current thread. set at the start of each bucket.
+	UMRenderStatistics::ThreadCounter* ray_counter = NULL;
+#pragma omp threadprivate(ray_counter)
+
 	unsigned int xor128()
 	{
-		static unsigned int x = 123456789;
-		static unsigned int y = 362436069;
-		static unsigned int z = 521288629;
-		static unsigned int w = 88675123;
+		unsigned int& x = xor128_x;
+		unsigned int& y = xor128_y;
+		unsigned int& z = xor128_z;
+		unsigned int& w = xor128_w;
 		unsigned int t = x ^ (x << 11);
 		x = y; y = z; z = w;
 		return w = w ^ (w >> 19) ^ t ^ (t >> 8);
 	}
 
+	unsigned int hash32(unsigned int x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352d;
+		x ^= x >> 15;
+		x *= 0x846ca68b;
+		x ^= x >> 16;
+		return x;
+	}
+
+	/**
+	 * seed xor128 of current thread.
+	 * buckets are seeded by position, so the result does not depend on threads or tiles.
+	 */
+	void seed_xor128(unsigned int seed)
+	{
+		xor128_x = hash32(seed ^ 123456789);
+		xor128_y = hash32(xor128_x ^ 362436069);
+		xor128_z = hash32(xor128_y ^ 521288629);
+		xor128_w = hash32(xor128_z ^ 88675123) | 1;
+	}
+
 	double xor128d()
 	{
 		return xor128() / 4294967296.0;
@@ -56,21 +101,208 @@ namespace
 		return src;
 	}
 
-	UMVec3d hemisphere(const UMVec3d& normal)
+	/**
+	 * create orthonormal basis around w
+	 */
+	void create_basis(const UMVec3d& w, UMVec3d& u, UMVec3d& v)
 	{
-		UMVec3d u, v, w;
-		w = normal;
 		if (fabs(w.x) > FLT_EPSILON) {
 			u = UMVec3d(0, 1, 0).cross(w).normalized();
 		} else {
 			u = UMVec3d(1, 0, 0).cross(w).normalized();
 		}
 		v = w.cross(u);
-		const double r1 = 2 * M_PI * xor128d();
-		const double r2 = xor128d();
-		const double r2s = sqrt(r2);
-		UMVec3d dir = (u * cos(r1) * r2s + v * sin(r1) * r2s + w * sqrt(1.0 - r2)).normalized();
-		return dir;
+	}
+
+	/**
+	 * direction around axis by cos theta and phi
+	 */
+	UMVec3d around(const UMVec3d& axis, double cos_theta, double phi)
+	{
+		UMVec3d u, v;
+		create_basis(axis, u, v);
+		const double sin_theta = sqrt(std::max(0.0, 1.0 - cos_theta * cos_theta));
+		return (u * cos(phi) * sin_theta + v * sin(phi) * sin_theta + axis * cos_theta).normalized();
+	}
+
+	/**
+	 * power heuristic (beta = 2)
+	 */
+	double power_heuristic(double pdf, double other_pdf)
+	{
+		const double a = pdf * pdf;
+		const double b = other_pdf * other_pdf;
+		if (a + b <= 0.0) return 0.0;
+		return a / (a + b);
+	}
+
+	double luminance(const UMVec3d& color)
+	{
+		return 0.2126 * color.x + 0.7152 * color.y + 0.0722 * color.z;
+	}
+
+	/**
+	 * lambert diffuse + normalized phong specular lobe from UMMaterial
+	 */
+	class UMBsdf
+	{
+	public:
+		/**
+		 * @param [in] parameter shader parameter on hit point
+		 * @param [in] wo direction to viewer
+		 */
+		UMBsdf(const UMShaderParameter& parameter, const UMVec3d& wo)
+			: normal_(parameter.normal)
+			, diffuse_(parameter.color)
+			, specular_(0)
+			, shininess_(0)
+			, specular_probability_(0)
+		{
+			if (UMMaterialPtr material = parameter.material)
+			{
+				if (material->shininess() > 0.0 && material->reflection_factor() > 0.0)
+				{
+					specular_ = material->specular().xyz() * material->reflection_factor();
+					shininess_ = material->shininess();
+					// keep energy
+					const double max_specular = std::max(specular_.x, std::max(specular_.y, specular_.z));
+					diffuse_ *= std::max(0.0, 1.0 - max_specular);
+				}
+			}
+			reflect_ = (normal_ * (2.0 * normal_.dot(wo)) - wo).normalized();
+			const double diffuse_weight = luminance(diffuse_);
+			const double specular_weight = luminance(specular_);
+			if (diffuse_weight + specular_weight > 0.0)
+			{
+				specular_probability_ = specular_weight / (diffuse_weight + specular_weight);
+			}
+		}
+
+		/**
+		 * evaluate bsdf
+		 * @param [in] wi direction to light
+		 */
+		UMVec3d eval(const UMVec3d& wi) const
+		{
+			if (normal_.dot(wi) <= 0.0) return UMVec3d(0);
+			UMVec3d f = diffuse_ * M_PI_INV;
+			if (specular_probability_ > 0.0)
+			{
+				const double cos_alpha = reflect_.dot(wi);
+				if (cos_alpha > 0.0)
+				{
+					f += specular_ * ((shininess_ + 2.0) * 0.5 * M_PI_INV * pow(cos_alpha, shininess_));
+				}
+			}
+			return f;
+		}
+
+		/**
+		 * get solid angle pdf of sampling wi
+		 */
+		double pdf(const UMVec3d& wi) const
+		{
+			const double cos_theta = normal_.dot(wi);
+			if (cos_theta <= 0.0) return 0.0;
+			double pdf = (1.0 - specular_probability_) * cos_theta * M_PI_INV;
+			if (specular_probability_ > 0.0)
+			{
+				const double cos_alpha = reflect_.dot(wi);
+				if (cos_alpha > 0.0)
+				{
+					pdf += specular_probability_ * (shininess_ + 1.0) * 0.5 * M_PI_INV * pow(cos_alpha, shininess_);
+				}
+			}
+			return pdf;
+		}
+
+		/**
+		 * sample direction
+		 * @param [in] lobe_value random value to select lobe
+		 * @param [in] random_value random value to sample direction
+		 * @param [out] wi sampled direction
+		 */
+		bool sample(double lobe_value, const UMVec2d& random_value, UMVec3d& wi) const
+		{
+			const double phi = 2 * M_PI * random_value.x;
+			if (lobe_value < specular_probability_)
+			{
+				const double cos_alpha = pow(random_value.y, 1.0 / (shininess_ + 1.0));
+				wi = around(reflect_, cos_alpha, phi);
+			}
+			else
+			{
+				// cosine weighted hemisphere
+				wi = around(normal_, sqrt(1.0 - random_value.y), phi);
+			}
+			return normal_.dot(wi) > 0.0;
+		}
+
+		/**
+		 * get diffuse reflectance
+		 */
+		const UMVec3d& diffuse() const { return diffuse_; }
+
+		/**
+		 * has specular lobe
+		 */
+		bool has_specular() const { return specular_probability_ > 0.0; }
+
+		/**
+		 * evaluate specular lobe only
+		 */
+		UMVec3d eval_specular(const UMVec3d& wi) const
+		{
+			if (normal_.dot(wi) <= 0.0) return UMVec3d(0);
+			const double cos_alpha = reflect_.dot(wi);
+			if (cos_alpha <= 0.0) return UMVec3d(0);
+			return specular_ * ((shininess_ + 2.0) * 0.5 * M_PI_INV * pow(cos_alpha, shininess_));
+		}
+
+		/**
+		 * get solid angle pdf of sample_specular
+		 */
+		double specular_pdf(const UMVec3d& wi) const
+		{
+			if (normal_.dot(wi) <= 0.0) return 0.0;
+			const double cos_alpha = reflect_.dot(wi);
+			if (cos_alpha <= 0.0) return 0.0;
+			return (shininess_ + 1.0) * 0.5 * M_PI_INV * pow(cos_alpha, shininess_);
+		}
+
+		/**
+		 * sample direction of specular lobe
+		 */
+		bool sample_specular(const UMVec2d& random_value, UMVec3d& wi) const
+		{
+			const double cos_alpha = pow(random_value.y, 1.0 / (shininess_ + 1.0));
+			wi = around(reflect_, cos_alpha, 2 * M_PI * random_value.x);
+			return normal_.dot(wi) > 0.0;
+		}
+
+	private:
+		UMVec3d normal_;
+		UMVec3d reflect_;
+		UMVec3d diffuse_;
+		UMVec3d specular_;
+		double shininess_;
+		double specular_probability_;
+	};
+
+	/**
+	 * set rendering settings of a checkpoint
+	 */
+	void set_checkpoint_settings(UMCheckpoint& checkpoint, int width, int height, const UMRenderParameter& parameter)
+	{
+		checkpoint.width = width;
+		checkpoint.height = height;
+		checkpoint.sample_count = parameter.sample_count();
+		checkpoint.super_sampling_count = parameter.super_sampling_count();
+		checkpoint.light_sample_count = parameter.light_sample_count();
+		checkpoint.light_sampling_type = parameter.light_sampling_type();
+		checkpoint.bucket_order = parameter.bucket_order();
+		checkpoint.bucket_size = parameter.bucket_size();
+		checkpoint.crop_window = parameter.crop_window();
 	}
 
 }
@@ -142,7 +374,12 @@ UMPathTracer::UMPathTracer() :
 	current_sample_count_(0),
 	current_subpixel_x_(0),
 	current_subpixel_y_(0),
-	max_sample_count_(0)
+	max_sample_count_(0),
+	interactive_scale_(interactive_start_scale),
+	interactive_row_(0),
+	interactive_pass_(0),
+	light_sample_count_(1),
+	light_sampling_type_(UMLightSampler::eLightBvh)
 	//sample_event_(std::make_shared<UMEvent>(eEventTypeRenderProgressSample))
 {
 	//mutable_event_list().push_back(sample_event_);
@@ -154,25 +391,81 @@ UMPathTracer::UMPathTracer() :
 UMVec3d UMPathTracer::trace(const UMRay& ray, UMSceneAccessPtr scene_access, UMShaderParameter& parameter)
 {
 	umdraw::UMScenePtr scene = scene_access->scene();
+	if (ray_counter)
+	{
+		if (parameter.bsdf_pdf <= 0.0)
+		{
+			++ray_counter->primary_ray_count;
+		}
+		else
+		{
+			++ray_counter->indirect_ray_count;
+		}
+	}
 	UMIntersection intersection;
-	if (!UMIntersection::intersect(ray, scene_access, parameter, intersection)){
+	UMShaderParameter hit_parameter;
+	if (!UMIntersection::intersect(ray, scene_access, hit_parameter, intersection)){
+		if (parameter.bsdf_pdf <= 0.0)
+		{
+			parameter.color = scene->background_color();
+			parameter.normal = UMVec3d(0);
+			parameter.distance = 0.0;
+			parameter.primitive = NULL;
+			parameter.material = umdraw::UMMaterialPtr();
+		}
 		return scene->background_color();
 	}
+	return shade(ray, scene_access, intersection, parameter);
+}
 
-	UMVec3d normal = intersection.closest_parameter.normal;
-	if (normal.dot(ray.direction()) >= 0.0)
+/**
+ * shade a hit point
+ */
+UMVec3d UMPathTracer::shade(
+	const UMRay& ray, 
+	UMSceneAccessPtr scene_access, 
+	UMIntersection& intersection, 
+	UMShaderParameter& parameter)
+{
+	UMShaderParameter& closest = intersection.closest_parameter;
+	if (closest.normal.dot(ray.direction()) >= 0.0)
 	{
-		normal = -normal;
+		closest.normal = -closest.normal;
+	}
+
+	// write back first hit for output layers
+	if (parameter.bsdf_pdf <= 0.0)
+	{
+		parameter.color = closest.color;
+		parameter.normal = closest.normal;
+		parameter.distance = closest.distance;
+		parameter.primitive = closest.primitive;
+		parameter.material = closest.material;
 	}
 	
-	UMVec3d point_color(intersection.closest_parameter.color);
+	UMVec3d point_color(closest.color);
 	double russian_roulette_probability = std::max(point_color.x, std::max(point_color.y, point_color.z));
 	
 	if (parameter.depth < 16) {
 		russian_roulette_probability *= pow(0.5, 16 - parameter.depth);
 	}
 
-	UMVec3d color = intersection.closest_parameter.emissive;
+	// emission. weighted against light sampling when the emitter was reachable by it.
+	UMVec3d color = closest.emissive;
+	if (parameter.bsdf_pdf > 0.0)
+	{
+		UMLightSamplerPtr light_sampler = scene_access->light_sampler();
+		const int light_index = light_sampler ? light_sampler->light_index(closest.primitive) : -1;
+		if (light_index >= 0 && light_sample_count_ > 0)
+		{
+			const double light_pdf = light_sampler->pdf(
+				light_index, 
+				ray.origin(), 
+				closest.intersect_point, 
+				light_sampling_type_);
+			color *= power_heuristic(parameter.bsdf_pdf, light_sample_count_ * light_pdf);
+		}
+	}
 
 	if (parameter.depth < (parameter.max_depth - minimum_path_depth)) {
 		if (xor128d() >= russian_roulette_probability)
@@ -184,10 +477,17 @@ UMVec3d UMPathTracer::trace(const UMRay& ray, UMSceneAccessPtr scene_access, UMS
 	}
 	--parameter.depth;
 
-	// diffuse direct
+	// direct
 	color += illuminate_direct(ray, scene_access, intersection, parameter);
-	// diffuse indirect
-	color += illuminate_indirect(ray, scene_access, intersection, parameter) / russian_roulette_probability;
+	// indirect. secondary bounces use irradiance cache if enabled.
+	if (irradiance_cache_ && parameter.bsdf_pdf > 0.0 && !parameter.is_irradiance_gather)
+	{
+		color += illuminate_cached(ray, scene_access, intersection, parameter) / russian_roulette_probability;
+	}
+	else
+	{
+		color += illuminate_indirect(ray, scene_access, intersection, parameter) / russian_roulette_probability;
+	}
 
 	return color;
 }
@@ -201,28 +501,47 @@ UMVec3d UMPathTracer::illuminate_direct(
 	const UMIntersection& intersection,
 	UMShaderParameter& parameter)
 {
-	umdraw::UMScenePtr scene = scene_access->scene();
 	UMVec3d color(0);
-	UMMaterialPtr mat = intersection.closest_parameter.material;
+	UMLightSamplerPtr light_sampler = scene_access->light_sampler();
+	if (!light_sampler || light_sampler->light_count() == 0) return color;
+	if (light_sample_count_ <= 0) return color;
+
+	const UMShaderParameter& closest = intersection.closest_parameter;
+	const UMVec3d& p(closest.intersect_point);
+	const double inv_light_sample_count = 1.0 / light_sample_count_;
+	const UMBsdf bsdf(closest, -ray.direction());
 
-	UMLightList::const_iterator it = scene->light_list().begin();
-	for (; it != scene->light_list().end(); ++it)
+	// pick lights by importance instead of looping over all lights
+	for (int i = 0; i < light_sample_count_; ++i)
 	{
-		UMLightPtr light = *it;
-		UMVec3d intensity;
-		UMVec3d sample_point;
-		UMVec3d direction;
+		int light_index = -1;
+		double pick_pdf = 0.0;
+		if (!light_sampler->pick(p, xor128d(), light_sampling_type_, light_index, pick_pdf))
+		{
+			continue;
+		}
+		UMLightSample sample;
 		UMVec2d random_value(xor128d(), xor128d());
-		if (UMAreaLight::sample(intensity, sample_point, direction, light, intersection.closest_parameter, random_value))
+		if (!light_sampler->sample(light_index, closest, random_value, sample)) continue;
+		if (sample.pdf <= 0.0) continue;
+
+		const UMVec3d wi = sample.direction.normalized();
+		const UMVec3d f = bsdf.eval(wi);
+		if (f.x <= 0.0 && f.y <= 0.0 && f.z <= 0.0) continue;
+
+		const double distance = (sample.point - p).length();
+		UMRay shadow_ray(p, wi);
+		shadow_ray.set_tmax( distance * (1.0 - FLT_EPSILON) );
+		if (ray_counter) ++ray_counter->shadow_ray_count;
+		if (UMIntersection::intersect(shadow_ray, scene_access)) continue;
+
+		// area lights can not be hit by bsdf rays
+		double weight = 1.0;
+		if (sample.is_intersectable)
 		{
-			UMVec3d p(intersection.closest_parameter.intersect_point);
-			UMRay shadow_ray(p, direction.normalized());
-			shadow_ray.set_tmax( (sample_point - p).length() );
-			if (!UMIntersection::intersect(shadow_ray, scene_access))
-			{
-				color += (intersection.closest_parameter.color * M_PI_INV).multiply(intensity);
-			}
+			weight = power_heuristic(light_sample_count_ * pick_pdf * sample.pdf, bsdf.pdf(wi));
 		}
+		color += f.multiply(sample.intensity) * (weight * inv_light_sample_count / pick_pdf);
 	}
 	return color;
 }
@@ -236,17 +555,143 @@ UMVec3d UMPathTracer::illuminate_indirect(
 	const UMIntersection& intersection,
 	UMShaderParameter& parameter)
 {
-	UMVec3d color;
-	UMMaterialPtr mat = intersection.closest_parameter.material;
+	const UMShaderParameter& closest = intersection.closest_parameter;
+	const UMBsdf bsdf(closest, -ray.direction());
+
+	UMVec3d wi;
+	const double lobe_value = xor128d();
+	const UMVec2d random_value(xor128d(), xor128d());
+	if (!bsdf.sample(lobe_value, random_value, wi)) return UMVec3d(0);
+
+	const double pdf = bsdf.pdf(wi);
+	if (pdf <= 0.0) return UMVec3d(0);
+	const UMVec3d f = bsdf.eval(wi);
+	const double cos_theta = closest.normal.dot(wi);
 
-	UMVec3d dir = hemisphere(parameter.normal);
-	UMRay next_ray(intersection.closest_parameter.intersect_point, dir);
+	UMRay next_ray(closest.intersect_point, wi);
+	parameter.bsdf_pdf = pdf;
 	UMVec3d traced_color = trace(next_ray, scene_access, parameter);
 	// importance sampling
-	color = traced_color.multiply(intersection.closest_parameter.color);
+	return traced_color.multiply(f) * (cos_theta / pdf);
+}
+
+/**
+ * indirect lighting by irradiance cache.
+ * diffuse is interpolated from records, specular is traced.
+ */
+UMVec3d UMPathTracer::illuminate_cached(
+	const UMRay& ray, 
+	UMSceneAccessPtr scene_access, 
+	const UMIntersection& intersection,
+	UMShaderParameter& parameter)
+{
+	const UMShaderParameter& closest = intersection.closest_parameter;
+	const UMBsdf bsdf(closest, -ray.direction());
+	UMVec3d color(0);
+
+	const UMVec3d& diffuse = bsdf.diffuse();
+	if (diffuse.x > 0.0 || diffuse.y > 0.0 || diffuse.z > 0.0)
+	{
+		UMVec3d irradiance;
+		if (!irradiance_cache_->lookup(closest.intersect_point, closest.normal, irradiance))
+		{
+			irradiance = gather_irradiance(scene_access, intersection, parameter);
+		}
+		color += diffuse.multiply(irradiance) * M_PI_INV;
+	}
+
+	if (bsdf.has_specular())
+	{
+		UMVec3d wi;
+		const UMVec2d random_value(xor128d(), xor128d());
+		if (bsdf.sample_specular(random_value, wi))
+		{
+			const double pdf = bsdf.specular_pdf(wi);
+			if (pdf > 0.0)
+			{
+				const UMVec3d f = bsdf.eval_specular(wi);
+				const double cos_theta = closest.normal.dot(wi);
+				UMRay next_ray(closest.intersect_point, wi);
+				// emission is weighted by the pdf which light sampling used
+				parameter.bsdf_pdf = bsdf.pdf(wi);
+				UMVec3d traced_color = trace(next_ray, scene_access, parameter);
+				color += traced_color.multiply(f) * (cos_theta / pdf);
+			}
+		}
+	}
 	return color;
 }
 
+/**
+ * gather irradiance by stratified hemisphere rays and add a record
+ */
+UMVec3d UMPathTracer::gather_irradiance(
+	UMSceneAccessPtr scene_access, 
+	const UMIntersection& intersection,
+	const UMShaderParameter& parameter)
+{
+	const UMShaderParameter& closest = intersection.closest_parameter;
+	const UMVec3d& p = closest.intersect_point;
+	const UMVec3d& n = closest.normal;
+	const int rows = irradiance_cache_->sample_rows();
+	const int columns = irradiance_cache_->sample_columns();
+	const UMVec3d background = scene_access->scene()->background_color();
+
+	UMIrradianceSampleList sample_list(rows * columns);
+	for (int j = 0; j < rows; ++j)
+	{
+		for (int k = 0; k < columns; ++k)
+		{
+			UMIrradianceSample& sample = sample_list[j * columns + k];
+			const UMVec3d wi = irradiance_cache_->sample_direction(n, j, k, UMVec2d(xor128d(), xor128d()));
+			const double cos_theta = n.dot(wi);
+			sample.distance = std::numeric_limits<double>::max();
+			sample.radiance = background;
+			if (cos_theta <= 0.0) continue;
+
+			UMRay gather_ray(p, wi);
+			if (ray_counter) ++ray_counter->indirect_ray_count;
+			UMIntersection gather_intersection;
+			UMShaderParameter hit_parameter;
+			if (!UMIntersection::intersect(gather_ray, scene_access, hit_parameter, gather_intersection)) continue;
+
+			UMShaderParameter gather_parameter;
+			// directions are cosine weighted, so records do not depend on the view direction.
+			// emission at gather hits is weighted against light sampling by this pdf.
+			gather_parameter.bsdf_pdf = cos_theta * M_PI_INV;
+			gather_parameter.depth = parameter.depth;
+			gather_parameter.max_depth = parameter.max_depth;
+			gather_parameter.is_irradiance_gather = true;
+			sample.distance = std::max(gather_intersection.closest_distance, static_cast<double>(FLT_EPSILON));
+			sample.radiance = shade(gather_ray, scene_access, gather_intersection, gather_parameter);
+		}
+	}
+	return irradiance_cache_->add(p, n, sample_list);
+}
+
+/**
+ * prepare irradiance cache for a new render
+ */
+void UMPathTracer::prepare_irradiance_cache(UMSceneAccessPtr scene_access, const UMRenderParameter& parameter)
+{
+	const UMPrimitiveList& primitive_list = scene_access->render_primitive_list();
+	if (!parameter.is_irradiance_cache_enabled() || primitive_list.empty())
+	{
+		irradiance_cache_.reset();
+		return;
+	}
+	UMBox box;
+	for (UMPrimitiveList::const_iterator it = primitive_list.begin(); it != primitive_list.end(); ++it)
+	{
+		box.extend((*it)->box());
+	}
+	if (!irradiance_cache_)
+	{
+		irradiance_cache_ = UMIrradianceCache::create();
+	}
+	irradiance_cache_->init(box, parameter.irradiance_cache_accuracy());
+}
+
 /**
  * render
  */
@@ -256,33 +701,63 @@ bool UMPathTracer::render(UMSceneAccessPtr scene_access, UMRenderParameter& para
 	if (!scene) return false;
 	if (width_ == 0 || height_ == 0) return false;
 	if (!scene->camera()) return false;
+	UMRenderStatistics& statistics = parameter.statistics();
+	statistics.reset();
+	statistics.set_bvh_build_seconds(scene_access->bvh_build_seconds());
+	const double setup_start_seconds = umbase::UMTime::current_seconds();
+	if (!scene_access->update_camera_sampler()) return false;
 
 	const int sample_count = parameter.sample_count();
-	//std::random_device random_device;
-	//std::vector<unsigned int> seed(2 * height_);
-	//std::generate(seed.begin(), seed.end(), std::ref(random_device));
+	light_sample_count_ = parameter.light_sample_count();
+	light_sampling_type_ = parameter.light_sampling_type();
+	prepare_irradiance_cache(scene_access, parameter);
+	UMFrameBuffer& frame_buffer = parameter.frame_buffer();
+	frame_buffer.init(width_, height_);
+	UMBucketList buckets;
+	parameter.create_buckets(buckets, width_, height_);
+	const int bucket_count = static_cast<int>(buckets.size());
+	statistics.add_setup_seconds(umbase::UMTime::current_seconds() - setup_start_seconds);
 
-	for (int y = 0; y < height_; ++y)
+	statistics.begin_pass();
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i < bucket_count; ++i)
 	{
-		//std::mt19937 mt(std::seed_seq(seed.begin() + 2 * y, seed.begin() +  2 * (y + 1)));
-
-		for (int x = 0; x < width_; ++x)
+		const UMBucket& bucket = buckets[i];
+		const double bucket_start_seconds = umbase::UMTime::current_seconds();
+		ray_counter = &statistics.current_thread_counter();
+		seed_xor128(bucket.y * width_ + bucket.x);
+		for (int y = bucket.y; y < (bucket.y + bucket.height); ++y)
 		{
-			const int pos = width_ * y + x;
-			for (int s = 0; s < sample_count; ++s)
+			for (int x = bucket.x; x < (bucket.x + bucket.width); ++x)
 			{
-				UMVec2d sample_point(xor128d(),  xor128d());
-				sample_point.x += x;
-				sample_point.y += y;
-				UMRay ray;
-				scene_access->generate_ray(ray, sample_point);
-				UMShaderParameter shader_parameter;
-				UMVec3d color = trace(ray, scene_access, shader_parameter);
-				parameter.output_image()->mutable_list()[pos] += UMVec4d(color, 1.0);
+				for (int s = 0; s < sample_count; ++s)
+				{
+					UMVec2d sample_point(xor128d(),  xor128d());
+					sample_point.x += x;
+					sample_point.y += y;
+					UMRay ray;
+					scene_access->camera_sampler().generate_ray(ray, sample_point, UMVec2d(xor128d(), xor128d()));
+					UMShaderParameter shader_parameter;
+					UMVec3d color = trace(ray, scene_access, shader_parameter);
+					frame_buffer.add_sample(x, y, color, shader_parameter);
+				}
 			}
 		}
+		ray_counter->busy_seconds += umbase::UMTime::current_seconds() - bucket_start_seconds;
+		ray_counter = NULL;
 	}
-	
+	statistics.end_pass();
+
+	const double resolve_start_seconds = umbase::UMTime::current_seconds();
+	frame_buffer.resolve(
+		UMFrameBuffer::eLayerBeauty, 
+		parameter.output_image(), 
+		parameter.render_rect(width_, height_));
+	if (parameter.is_denoise_enabled())
+	{
+		parameter.denoise(parameter.render_rect(width_, height_));
+	}
+	statistics.add_resolve_seconds(umbase::UMTime::current_seconds() - resolve_start_seconds);
 	return true;
 }
 
@@ -295,6 +770,7 @@ bool UMPathTracer::progress_render(UMSceneAccessPtr scene_access, UMRenderParame
 	if (!scene) return false;
 	if (width_ == 0 || height_ == 0) return false;
 	if (!scene->camera()) return false;
+	if (!scene_access->update_camera_sampler()) return false;
 	
 	const UMVec2i super_sampling = parameter.super_sampling_count();
 	
@@ -311,11 +787,24 @@ bool UMPathTracer::progress_render(UMSceneAccessPtr scene_access, UMRenderParame
 	if (current_sample_count_ == 0 &&
 		current_subpixel_x_ == 0 &&
 		current_subpixel_y_ == 0) {
-		// init temporary image
+		// init framebuffer
+		const double setup_start_seconds = umbase::UMTime::current_seconds();
+		parameter.statistics().reset();
+		parameter.statistics().set_bvh_build_seconds(scene_access->bvh_build_seconds());
 		current_subpixel_x_ = 0;
 		current_subpixel_y_ = 0;
-		temporary_image_.init(width_, height_);
+		parameter.frame_buffer().init(width_, height_);
+		parameter.create_buckets(buckets_, width_, height_);
 		max_sample_count_ = parameter.sample_count() / (super_sampling.x * super_sampling.y);
+		light_sample_count_ = parameter.light_sample_count();
+		light_sampling_type_ = parameter.light_sampling_type();
+		prepare_irradiance_cache(scene_access, parameter);
+		parameter.statistics().add_setup_seconds(umbase::UMTime::current_seconds() - setup_start_seconds);
+	}
+	else if (parameter.is_irradiance_cache_enabled() && !irradiance_cache_)
+	{
+		// resumed from a checkpoint
+		prepare_irradiance_cache(scene_access, parameter);
 	}
 	
 	bool is_end_subpixel = 
@@ -339,56 +828,293 @@ bool UMPathTracer::progress_render(UMSceneAccessPtr scene_access, UMRenderParame
 			++current_subpixel_x_;
 		}
 	}
-	const double inv_current_sample_count = 1.0 / current_sample_count_;
-	const double inv_current_subpixel_sample_count 
-		= 1.0 / (current_subpixel_x_ + 1)
-		* 1.0 / (current_subpixel_y_ + 1);
 	const double inv_super_sampling_x = 1.0 / (double)super_sampling.x;
 	const double inv_super_sampling_y = 1.0 / (double)super_sampling.y;
+	UMFrameBuffer& frame_buffer = parameter.frame_buffer();
 	
-	//std::random_device random_device;
-	//std::vector<unsigned int> seed(2 * height_);
-	//std::generate(seed.begin(), seed.end(), std::ref(random_device));
+	const int bucket_count = static_cast<int>(buckets_.size());
+	const unsigned int pass = 
+		(current_sample_count_ * super_sampling.y + current_subpixel_y_) * super_sampling.x + current_subpixel_x_;
+	UMImage::ImageBuffer& out_buffer = parameter.output_image()->mutable_list();
+	UMRenderStatistics& statistics = parameter.statistics();
+
+	statistics.begin_pass();
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i < bucket_count; ++i)
+	{
+		const UMBucket& bucket = buckets_[i];
+		const double bucket_start_seconds = umbase::UMTime::current_seconds();
+		ray_counter = &statistics.current_thread_counter();
+		seed_xor128(hash32(pass) ^ (bucket.y * width_ + bucket.x));
+		for (int y = bucket.y; y < (bucket.y + bucket.height); ++y)
+		{
+			for (int x = bucket.x; x < (bucket.x + bucket.width); ++x)
+			{
+				// sample point
+				UMVec2d sample_point(x, y);
+				sample_point.x += current_subpixel_x_ * inv_super_sampling_x;
+				sample_point.y += current_subpixel_y_ * inv_super_sampling_y;
+				// generate camera ray
+				UMRay ray;
+				scene_access->camera_sampler().generate_ray(ray, sample_point, UMVec2d(xor128d(), xor128d()));
+				// trace
+				UMShaderParameter shader_param;
+				UMVec3d color = trace(ray, scene_access, shader_param);
+				// output
+				frame_buffer.add_sample(x, y, color, shader_param);
 
-//#pragma omp parallel for schedule(dynamic, 1) num_threads(8)
-	for (int y = 0; y < height_; ++y)
+				if (is_end_subpixel)
+				{
+					out_buffer[width_ * y + x] = map_one(frame_buffer.beauty(x, y));
+				}
+			}
+		}
+		ray_counter->busy_seconds += umbase::UMTime::current_seconds() - bucket_start_seconds;
+		ray_counter = NULL;
+	}
+	statistics.end_pass();
+
+	// denoise every completed pass. accumulation stays in framebuffer.
+	if (is_end_subpixel && parameter.is_denoise_enabled())
 	{
-		//std::mt19937 mt(std::seed_seq(seed.begin() + 2 * y, seed.begin() +  2 * (y + 1)));
-		for (int x = 0; x < width_; ++x)
+		const double resolve_start_seconds = umbase::UMTime::current_seconds();
+		parameter.denoise(parameter.render_rect(width_, height_));
+		statistics.add_resolve_seconds(umbase::UMTime::current_seconds() - resolve_start_seconds);
+	}
+
+	// checkpoint at intervals and at the last pass.
+	// the last pass is the last subpixel of the last sample, next call returns false.
+	if (parameter.checkpoint_interval() > 0 && !parameter.checkpoint_path().empty())
+	{
+		const bool is_last_pass =
+			current_sample_count_ == max_sample_count_ &&
+			current_subpixel_x_ == (super_sampling.x-1) &&
+			current_subpixel_y_ == (super_sampling.y-1);
+		if (is_last_pass || (pass % parameter.checkpoint_interval()) == 0)
 		{
-			// target pixel
-			const int pos = width_ * y + x;
-			UMVec4d& current_color = temporary_image_.mutable_list()[pos];
-			UMVec4d& out_color = parameter.output_image()->mutable_list()[pos];
-			
+			save_checkpoint(parameter.checkpoint_path(), parameter);
+		}
+	}
+
+	//umbase::UMAny sample_count(current_sample_count_);
+	//sample_event_->set_parameter(sample_count);
+	//sample_event_->notify();
+
+	return true;
+}
+
+/**
+ * save progressive rendering state
+ */
+bool UMPathTracer::save_checkpoint(const umstring& path, const UMRenderParameter& parameter) const
+{
+	if (width_ == 0 || height_ == 0) return false;
+	UMCheckpoint checkpoint;
+	set_checkpoint_settings(checkpoint, width_, height_, parameter);
+	checkpoint.light_sample_count = light_sample_count_;
+	checkpoint.light_sampling_type = light_sampling_type_;
+	checkpoint.current_sample_count = current_sample_count_;
+	checkpoint.current_subpixel_x = current_subpixel_x_;
+	checkpoint.current_subpixel_y = current_subpixel_y_;
+	return UMCheckpoint::save(path, checkpoint, parameter.frame_buffer());
+}
+
+/**
+ * resume progressive rendering
+ */
+bool UMPathTracer::resume(const umstring& path, UMRenderParameter& parameter)
+{
+	if (width_ == 0 || height_ == 0) return false;
+
+	// passes and buckets must be same as before. only sample count may be raised.
+	UMCheckpoint current;
+	set_checkpoint_settings(current, width_, height_, parameter);
+	UMCheckpoint checkpoint;
+	if (!UMCheckpoint::load(path, current, checkpoint, parameter.frame_buffer())) return false;
+
+	current_sample_count_ = checkpoint.current_sample_count;
+	current_subpixel_x_ = checkpoint.current_subpixel_x;
+	current_subpixel_y_ = checkpoint.current_subpixel_y;
+	const UMVec2i super_sampling = parameter.super_sampling_count();
+	max_sample_count_ = parameter.sample_count() / (super_sampling.x * super_sampling.y);
+	light_sample_count_ = parameter.light_sample_count();
+	light_sampling_type_ = parameter.light_sampling_type();
+	parameter.create_buckets(buckets_, width_, height_);
+
+	// restore output image from accumulation
+	UMImagePtr image = parameter.output_image();
+	if (image->width() != width_ || image->height() != height_ || !image->is_valid())
+	{
+		image->init(width_, height_);
+	}
+	const UMFrameBuffer& frame_buffer = parameter.frame_buffer();
+	UMImage::ImageBuffer& out_buffer = image->mutable_list();
+	for (size_t i = 0, size = buckets_.size(); i < size; ++i)
+	{
+		const UMBucket& bucket = buckets_[i];
+		for (int y = bucket.y; y < (bucket.y + bucket.height); ++y)
+		{
+			for (int x = bucket.x; x < (bucket.x + bucket.width); ++x)
+			{
+				out_buffer[width_ * y + x] = map_one(frame_buffer.beauty(x, y));
+			}
+		}
+	}
+	if (parameter.is_denoise_enabled())
+	{
+		parameter.denoise(parameter.render_rect(width_, height_));
+	}
+	return true;
+}
+
+/**
+ * restart interactive render
+ */
+void UMPathTracer::restart()
+{
+	interactive_scale_ = interactive_start_scale;
+	interactive_row_ = 0;
+	interactive_pass_ = 0;
+}
+
+/**
+ * interactive render
+ */
+bool UMPathTracer::interactive_render(UMSceneAccessPtr scene_access, UMRenderParameter& parameter, double time_slice)
+{
+	umdraw::UMScenePtr scene = scene_access->scene();
+	if (!scene) return false;
+	if (width_ == 0 || height_ == 0) return false;
+	if (!scene->camera()) return false;
+
+	// end
+	if (interactive_scale_ == 1 && interactive_pass_ >= parameter.sample_count()) return false;
+
+	// start
+	if (interactive_scale_ == interactive_start_scale && interactive_row_ == 0)
+	{
+		const double setup_start_seconds = umbase::UMTime::current_seconds();
+		parameter.statistics().reset();
+		parameter.statistics().set_bvh_build_seconds(scene_access->bvh_build_seconds());
+		if (!scene_access->update_camera_sampler()) return false;
+		parameter.frame_buffer().init(width_, height_);
+		UMImagePtr image = parameter.output_image();
+		if (image->width() != width_ || image->height() != height_ || !image->is_valid())
+		{
+			image->init(width_, height_);
+		}
+		parameter.clear_display_image();
+		light_sample_count_ = parameter.light_sample_count();
+		light_sampling_type_ = parameter.light_sampling_type();
+		prepare_irradiance_cache(scene_access, parameter);
+		parameter.statistics().add_setup_seconds(umbase::UMTime::current_seconds() - setup_start_seconds);
+	}
+
+	// render bands until the time slice expires.
+	// at least one band is rendered, so a slow scene still progresses.
+	const double start_seconds = umbase::UMTime::current_seconds();
+	do
+	{
+		const int band_height = std::min(
+			std::max(interactive_scale_, interactive_band_height), 
+			height_ - interactive_row_);
+		render_interactive_band(scene_access, parameter, interactive_row_, band_height);
+		interactive_row_ += band_height;
+		if (interactive_row_ < height_) continue;
+
+		// next pass
+		interactive_row_ = 0;
+		if (interactive_scale_ > 1)
+		{
+			interactive_scale_ /= 2;
+		}
+		else
+		{
+			++interactive_pass_;
+			// bands of the next pass overwrite output image, so denoise into display image
+			if (parameter.is_denoise_enabled())
+			{
+				const double resolve_start_seconds = umbase::UMTime::current_seconds();
+				parameter.denoise_display(parameter.render_rect(width_, height_));
+				parameter.statistics().add_resolve_seconds(umbase::UMTime::current_seconds() - resolve_start_seconds);
+			}
+			if (interactive_pass_ >= parameter.sample_count()) break;
+		}
+	} while ((umbase::UMTime::current_seconds() - start_seconds) < time_slice);
+	return true;
+}
+
+/**
+ * render a band of rows for interactive render.
+ * low resolution pass traces one ray per block and fills the block.
+ * full resolution pass accumulates samples to framebuffer.
+ * a task is a chunk of blocks in a row, so timing and seeding are once per chunk.
+ */
+void UMPathTracer::render_interactive_band(
+	UMSceneAccessPtr scene_access,
+	UMRenderParameter& parameter,
+	int band_y,
+	int band_height)
+{
+	const int scale = interactive_scale_;
+	const int block_x_count = (width_ + scale - 1) / scale;
+	const int block_y_count = (band_height + scale - 1) / scale;
+	const int chunk_x_count = (block_x_count + interactive_chunk_width - 1) / interactive_chunk_width;
+	const int chunk_count = chunk_x_count * block_y_count;
+	const int band_end = band_y + band_height;
+	const unsigned int pass = hash32(interactive_pass_ * interactive_start_scale * 2 + scale);
+	UMFrameBuffer& frame_buffer = parameter.frame_buffer();
+	UMImage::ImageBuffer& out_buffer = parameter.output_image()->mutable_list();
+	UMRenderStatistics& statistics = parameter.statistics();
+
+	statistics.begin_pass();
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i < chunk_count; ++i)
+	{
+		const double chunk_start_seconds = umbase::UMTime::current_seconds();
+		ray_counter = &statistics.current_thread_counter();
+		const int y = band_y + (i / chunk_x_count) * scale;
+		const int block_height = std::min(scale, band_end - y);
+		const int first_block = (i % chunk_x_count) * interactive_chunk_width;
+		const int last_block = std::min(first_block + interactive_chunk_width, block_x_count);
+		seed_xor128(pass ^ (y * width_ + first_block * scale));
+		for (int k = first_block; k < last_block; ++k)
+		{
+			const int x = k * scale;
+			const int block_width = std::min(scale, width_ - x);
+
 			// sample point
-			UMVec2d sample_point(x, y);
-			sample_point.x += current_subpixel_x_ * inv_super_sampling_x;
-			sample_point.y += current_subpixel_y_ * inv_super_sampling_y;
+			UMVec2d sample_point(
+				x + xor128d() * block_width, 
+				y + xor128d() * block_height);
 			// generate camera ray
 			UMRay ray;
-			scene_access->generate_ray(ray, sample_point);
+			scene_access->camera_sampler().generate_ray(ray, sample_point, UMVec2d(xor128d(), xor128d()));
 			// trace
 			UMShaderParameter shader_param;
 			UMVec3d color = trace(ray, scene_access, shader_param);
 			// output
-			current_color += UMVec4d(color, 1.0);
-
-			if (is_end_subpixel)
+			if (scale == 1)
+			{
+				frame_buffer.add_sample(x, y, color, shader_param);
+				out_buffer[width_ * y + x] = map_one(frame_buffer.beauty(x, y));
+			}
+			else
 			{
-				out_color = map_one(current_color 
-					* inv_current_sample_count
-					* inv_super_sampling_x
-					* inv_super_sampling_y);
+				const UMVec4d mapped = map_one(UMVec4d(color.x, color.y, color.z, 1.0));
+				for (int by = y; by < (y + block_height); ++by)
+				{
+					for (int bx = x; bx < (x + block_width); ++bx)
+					{
+						out_buffer[width_ * by + bx] = mapped;
+					}
+				}
 			}
 		}
+		ray_counter->busy_seconds += umbase::UMTime::current_seconds() - chunk_start_seconds;
+		ray_counter = NULL;
 	}
-
-	//umbase::UMAny sample_count(current_sample_count_);
-	//sample_event_->set_parameter(sample_count);
-	//sample_event_->notify();
-
-	return true;
+	statistics.end_pass();
 }
 
 } // umrt
@@ -20,6 +20,9 @@
 #include "UMShaderParameter.h"
 //#include "UMSceneAccess.h"
 #include "UMImage.h"
+#include "UMLightSampler.h"
+#include "UMBucket.h"
+#include "UMIrradianceCache.h"
 //#include "UMEvent.h"
 
 namespace umrt
@@ -77,7 +80,68 @@ public:
 	 */
 	virtual bool progress_render(UMSceneAccessPtr scene_access, UMRenderParameter& parameter);
 
+	/**
+	 * save progressive rendering state to a checkpoint file
+	 * @param [in] path checkpoint file path
+	 * @param [in] parameter parameters for rendering
+	 * @retval success or failed
+	 */
+	virtual bool save_checkpoint(const umstring& path, const UMRenderParameter& parameter) const;
+
+	/**
+	 * resume progressive rendering from a checkpoint file.
+	 * fails when parameters differ from the checkpoint except a raised sample count.
+	 * @param [in] path checkpoint file path
+	 * @param [in,out] parameter parameters for rendering. framebuffer is restored from the checkpoint.
+	 * @retval success or failed
+	 */
+	virtual bool resume(const umstring& path, UMRenderParameter& parameter);
+
+	/**
+	 * interactive render
+	 * @param [in] scene_access target scene access
+	 * @param [in,out] parameter parameters for rendering
+	 * @param [in] time_slice seconds for this call
+	 * @retval true output image is updated. denoised passes are written to display image.
+	 * @retval false render finished or failed
+	 */
+	virtual bool interactive_render(UMSceneAccessPtr scene_access, UMRenderParameter& parameter, double time_slice);
+
+	/**
+	 * restart interactive render from the lowest resolution
+	 */
+	virtual void restart();
+
+	/**
+	 * get current pixel size of interactive render. 1 is full resolution.
+	 */
+	int interactive_scale() const { return interactive_scale_; }
+
+	/**
+	 * get accumulated samples of interactive render at full resolution
+	 */
+	int interactive_pass() const { return interactive_pass_; }
+
+	/**
+	 * get irradiance cache. empty unless enabled by UMRenderParameter.
+	 */
+	UMIrradianceCachePtr irradiance_cache() const { return irradiance_cache_; }
+
 private:
+	/**
+	 * render a band of rows for interactive render
+	 */
+	void render_interactive_band(
+		UMSceneAccessPtr scene_access,
+		UMRenderParameter& parameter,
+		int band_y,
+		int band_height);
+
+	/**
+	 * prepare irradiance cache for a new render
+	 */
+	void prepare_irradiance_cache(UMSceneAccessPtr scene_access, const UMRenderParameter& parameter);
+
 	/**
 	 * trace
 	 */
@@ -86,6 +150,15 @@ private:
 		UMSceneAccessPtr scene_access, 
 		UMShaderParameter& parameter);
 
+	/**
+	 * shade a hit point
+	 */
+	UMVec3d shade(
+		const UMRay& ray, 
+		UMSceneAccessPtr scene_access, 
+		UMIntersection& intersection, 
+		UMShaderParameter& parameter);
+
 	/**
 	 * direct lighting
 	 */
@@ -103,6 +176,23 @@ private:
 		UMSceneAccessPtr scene_access, 
 		const UMIntersection& intersection, 
 		UMShaderParameter& parameter);
+
+	/**
+	 * indirect lighting by irradiance cache
+	 */
+	UMVec3d illuminate_cached(
+		const UMRay& ray, 
+		UMSceneAccessPtr scene_access, 
+		const UMIntersection& intersection, 
+		UMShaderParameter& parameter);
+
+	/**
+	 * gather irradiance of a new record
+	 */
+	UMVec3d gather_irradiance(
+		UMSceneAccessPtr scene_access, 
+		const UMIntersection& intersection, 
+		const UMShaderParameter& parameter);
 	
 
 	// for progress render
@@ -110,8 +200,17 @@ private:
 	int current_subpixel_x_;
 	int current_subpixel_y_;
 	int max_sample_count_;
+	// for interactive render
+	int interactive_scale_;
+	int interactive_row_;
+	int interactive_pass_;
+	// for light sampling
+	int light_sample_count_;
+	UMLightSampler::SamplingType light_sampling_type_;
 	//UMRandomSampler sampler_;
-	UMImage temporary_image_;
+	UMBucketList buckets_;
+	// for irradiance cache
+	UMIrradianceCachePtr irradiance_cache_;
 	//UMEventPtr sample_event_;
 };
 
@@ -0,0 +1,404 @@
+/**
+ * @file UMPointCloud.cpp
+ * ray traced points
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMPointCloud.h"
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#ifdef WITH_ALEMBIC
+	#include "UMAbcPoint.h"
+#endif
+
+namespace
+{
+	using namespace umrt;
+
+	const unsigned int max_leaf_count = 4;
+
+	/**
+	 * slab test of a node box
+	 */
+	bool intersect_node(
+		const float* box_min,
+		const float* box_max,
+		const UMVec3d& origin,
+		const UMVec3d& inv_dir,
+		double tmin,
+		double tmax)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			double t0 = (box_min[i] - origin[i]) * inv_dir[i];
+			double t1 = (box_max[i] - origin[i]) * inv_dir[i];
+			if (t0 > t1) std::swap(t0, t1);
+			tmin = t0 > tmin ? t0 : tmin;
+			tmax = t1 < tmax ? t1 : tmax;
+			if (tmin > tmax) return false;
+		}
+		return true;
+	}
+
+	/**
+	 * compare point positions on an axis
+	 */
+	class PointAxisLess
+	{
+	public:
+		PointAxisLess(const float* position_data, int axis)
+			: position_data_(position_data), axis_(axis) {}
+
+		bool operator()(unsigned int a, unsigned int b) const
+		{
+			return position_data_[a * 3 + axis_] < position_data_[b * 3 + axis_];
+		}
+
+	private:
+		const float* position_data_;
+		int axis_;
+	};
+
+	/**
+	 * float which is not greater than value
+	 */
+	float float_floor(double value)
+	{
+		const float f = static_cast<float>(value);
+		return f > value ? std::nextafter(f, -FLT_MAX) : f;
+	}
+
+	/**
+	 * float which is not less than value
+	 */
+	float float_ceil(double value)
+	{
+		const float f = static_cast<float>(value);
+		return f < value ? std::nextafter(f, FLT_MAX) : f;
+	}
+
+} // anonymouse namespace
+
+namespace umrt
+{
+
+/**
+ * create from alembic points
+ */
+UMPointCloudPtr UMPointCloud::create_from_abc_point(umabc::UMAbcPointPtr point, ShapeType type)
+{
+	UMPointCloudPtr cloud(std::make_shared<UMPointCloud>());
+	cloud->abc_point_ = point;
+	cloud->shape_type_ = type;
+	cloud->material_ = umdraw::UMMaterial::default_material();
+	cloud->update_box();
+	return cloud;
+}
+
+/**
+ * constructor
+ */
+UMPointCloud::UMPointCloud()
+	: shape_type_(eSphere)
+	, default_width_(0.1)
+	, position_data_(NULL)
+	, width_data_(NULL)
+	, color_data_(NULL)
+	, point_count_(0)
+	, width_count_(0)
+{
+}
+
+/**
+ * get position of a point
+ */
+UMVec3d UMPointCloud::position(unsigned int index) const
+{
+	const float* p = &position_data_[index * 3];
+	return UMVec3d(p[0], p[1], p[2]);
+}
+
+/**
+ * get radius of a point
+ */
+double UMPointCloud::radius(unsigned int index) const
+{
+	// alembic widths are diameters
+	if (width_count_ == point_count_) return width_data_[index] * 0.5;
+	if (width_count_ == 1) return width_data_[0] * 0.5;
+	return default_width_ * 0.5;
+}
+
+/**
+ * read current sample and rebuild bvh
+ */
+void UMPointCloud::update_box()
+{
+#ifdef WITH_ALEMBIC
+	if (umabc::UMAbcPointPtr point = abc_point_.lock())
+	{
+		Alembic::AbcGeom::P3fArraySamplePtr positions = point->positions();
+		Alembic::AbcGeom::FloatArraySamplePtr widths = point->widths();
+		Alembic::AbcGeom::C3fArraySamplePtr colors = point->colors();
+		position_holder_ = positions;
+		width_holder_ = widths;
+		color_holder_ = colors;
+		position_data_ = positions ? reinterpret_cast<const float*>(positions->get()) : NULL;
+		point_count_ = positions ? positions->size() : 0;
+		width_data_ = widths ? widths->get() : NULL;
+		width_count_ = widths ? widths->size() : 0;
+		// colors are used only when each point has one
+		color_data_ = (colors && colors->size() == point_count_) ? reinterpret_cast<const float*>(colors->get()) : NULL;
+	}
+#endif // WITH_ALEMBIC
+	build();
+}
+
+/**
+ * build bvh
+ */
+void UMPointCloud::build()
+{
+	node_list_.clear();
+	index_list_.resize(point_count_);
+	box_.init();
+	if (point_count_ == 0) return;
+
+	for (unsigned int i = 0; i < static_cast<unsigned int>(point_count_); ++i)
+	{
+		index_list_[i] = i;
+	}
+	node_list_.reserve(2 * (point_count_ / max_leaf_count) + 1);
+	build_node(0, static_cast<unsigned int>(point_count_));
+
+	const Node& root = node_list_[0];
+	box_.extend(UMVec3d(root.box_min[0], root.box_min[1], root.box_min[2]));
+	box_.extend(UMVec3d(root.box_max[0], root.box_max[1], root.box_max[2]));
+}
+
+/**
+ * build a node by median split.
+ * nodes are in depth first order, so left child is next to parent.
+ */
+unsigned int UMPointCloud::build_node(unsigned int start, unsigned int end)
+{
+	const unsigned int node_index = static_cast<unsigned int>(node_list_.size());
+	node_list_.push_back(Node());
+
+	UMVec3d box_min(DBL_MAX);
+	UMVec3d box_max(-DBL_MAX);
+	UMVec3d center_min(DBL_MAX);
+	UMVec3d center_max(-DBL_MAX);
+	for (unsigned int i = start; i < end; ++i)
+	{
+		const unsigned int index = index_list_[i];
+		const UMVec3d p = position(index);
+		const double r = radius(index);
+		for (int k = 0; k < 3; ++k)
+		{
+			box_min[k] = std::min(box_min[k], p[k] - r);
+			box_max[k] = std::max(box_max[k], p[k] + r);
+			center_min[k] = std::min(center_min[k], p[k]);
+			center_max[k] = std::max(center_max[k], p[k]);
+		}
+	}
+	{
+		Node& node = node_list_[node_index];
+		for (int k = 0; k < 3; ++k)
+		{
+			node.box_min[k] = float_floor(box_min[k]);
+			node.box_max[k] = float_ceil(box_max[k]);
+		}
+	}
+
+	if ((end - start) <= max_leaf_count)
+	{
+		Node& node = node_list_[node_index];
+		node.offset = start;
+		node.count = static_cast<unsigned short>(end - start);
+		node.axis = 0;
+		return node_index;
+	}
+
+	const UMVec3d extent = center_max - center_min;
+	int axis = 0;
+	if (extent.y > extent.x) axis = 1;
+	if (extent.z > extent[axis]) axis = 2;
+
+	const unsigned int middle = (start + end) / 2;
+	std::nth_element(
+		index_list_.begin() + start,
+		index_list_.begin() + middle,
+		index_list_.begin() + end,
+		PointAxisLess(position_data_, axis));
+
+	build_node(start, middle);
+	const unsigned int right = build_node(middle, end);
+
+	Node& node = node_list_[node_index];
+	node.offset = right;
+	node.count = 0;
+	node.axis = static_cast<unsigned short>(axis);
+	return node_index;
+}
+
+/**
+ * intersection of a point
+ */
+bool UMPointCloud::intersects_point(
+	const UMRay& ray,
+	unsigned int index,
+	double closest_distance,
+	double& distance) const
+{
+	const UMVec3d center = position(index);
+	const double r = radius(index);
+	const UMVec3d& origin = ray.origin();
+	const UMVec3d& dir = ray.direction();
+	const double a = dir.dot(dir);
+	// avoid self intersection of rays from the surface
+	const double epsilon = std::max(ray.tmin(), r * 1.0e-3);
+
+	if (shape_type_ == eDisk)
+	{
+		const double t = (center - origin).dot(dir) / a;
+		if (t <= epsilon || t >= closest_distance) return false;
+		const UMVec3d p = origin + dir * t;
+		if ((p - center).length_sq() > r * r) return false;
+		distance = t;
+		return true;
+	}
+
+	const UMVec3d oc = origin - center;
+	const double b = oc.dot(dir);
+	const double c = oc.dot(oc) - r * r;
+	const double discriminant = b * b - a * c;
+	if (discriminant < 0.0) return false;
+	const double root = std::sqrt(discriminant);
+	double t = (-b - root) / a;
+	if (t <= epsilon)
+	{
+		t = (-b + root) / a;
+	}
+	if (t <= epsilon || t >= closest_distance) return false;
+	distance = t;
+	return true;
+}
+
+/**
+ * traverse bvh
+ */
+bool UMPointCloud::traverse(
+	const UMRay& ray,
+	bool is_any_hit,
+	double& closest_distance,
+	unsigned int& closest_index) const
+{
+	if (node_list_.empty()) return false;
+
+	const UMVec3d& origin = ray.origin();
+	const UMVec3d inv_dir(1.0 / ray.direction().x, 1.0 / ray.direction().y, 1.0 / ray.direction().z);
+	const bool dir_is_negative[3] = { inv_dir.x < 0, inv_dir.y < 0, inv_dir.z < 0 };
+
+	bool hit = false;
+	unsigned int branch_stack[64];
+	unsigned int branch_stack_index = 0;
+	for (unsigned int i = 0; ; )
+	{
+		const Node& node = node_list_[i];
+		if (intersect_node(node.box_min, node.box_max, origin, inv_dir, ray.tmin(), closest_distance))
+		{
+			if (node.count > 0)
+			{
+				for (unsigned int k = node.offset, end = node.offset + node.count; k < end; ++k)
+				{
+					double distance = 0.0;
+					if (intersects_point(ray, index_list_[k], closest_distance, distance))
+					{
+						closest_distance = distance;
+						closest_index = index_list_[k];
+						hit = true;
+						if (is_any_hit) return true;
+					}
+				}
+				if (branch_stack_index == 0) break;
+				i = branch_stack[--branch_stack_index];
+			}
+			else
+			{
+				// nearer child first
+				if (dir_is_negative[node.axis])
+				{
+					branch_stack[branch_stack_index++] = i + 1;
+					i = node.offset;
+				}
+				else
+				{
+					branch_stack[branch_stack_index++] = node.offset;
+					++i;
+				}
+			}
+		}
+		else
+		{
+			if (branch_stack_index == 0) break;
+			i = branch_stack[--branch_stack_index];
+		}
+	}
+	return hit;
+}
+
+/**
+ * ray intersection
+ */
+bool UMPointCloud::intersects(const UMRay& ray, UMShaderParameter& parameter) const
+{
+	double distance = ray.tmax();
+	unsigned int index = 0;
+	if (!traverse(ray, false, distance, index)) return false;
+
+	const UMVec3d& dir = ray.direction();
+	const UMVec3d p = ray.origin() + dir * distance;
+	parameter.distance = distance;
+	parameter.intersect_point = p;
+	parameter.normal = (shape_type_ == eDisk) ? (-dir).normalized() : (p - position(index)).normalized();
+	parameter.face_normal = parameter.normal;
+	parameter.uvw = UMVec3d(1.0, 0.0, 0.0);
+	parameter.face_index = static_cast<int>(index);
+	parameter.primitive = this;
+	parameter.material = material_;
+	if (material_)
+	{
+		parameter.color = material_->diffuse().xyz();
+		parameter.emissive = material_->emissive().xyz() * material_->emissive_factor();
+	}
+	else
+	{
+		parameter.emissive = UMVec3d(0);
+	}
+	if (color_data_)
+	{
+		const float* c = &color_data_[index * 3];
+		parameter.color = UMVec3d(c[0], c[1], c[2]);
+	}
+	return true;
+}
+
+/**
+ * ray intersection
+ */
+bool UMPointCloud::intersects(const UMRay& ray) const
+{
+	double distance = ray.tmax();
+	unsigned int index = 0;
+	return traverse(ray, true, distance, index);
+}
+
+} // umrt
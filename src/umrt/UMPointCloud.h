@@ -0,0 +1,168 @@
+/**
+ * @file UMPointCloud.h
+ * ray traced points
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "UMMacro.h"
+#include "UMVector.h"
+#include "UMMathTypes.h"
+#include "UMBox.h"
+#include "UMPrimitive.h"
+#include "UMRay.h"
+#include "UMShaderParameter.h"
+
+namespace umabc
+{
+	class UMAbcPoint;
+	typedef std::shared_ptr<UMAbcPoint> UMAbcPointPtr;
+	typedef std::weak_ptr<UMAbcPoint> UMAbcPointWeakPtr;
+} // umabc
+
+namespace umrt
+{
+
+class UMPointCloud;
+typedef std::shared_ptr<UMPointCloud> UMPointCloudPtr;
+typedef std::vector<UMPointCloudPtr> UMPointCloudList;
+
+/**
+ * ray traced points.
+ * all points are one primitive which has its own bvh,
+ * and each point is a sphere or a disk facing the ray. no tessellation.
+ * positions and widths refer the alembic sample without copy.
+ */
+class UMPointCloud : public UMPrimitive
+{
+	DISALLOW_COPY_AND_ASSIGN(UMPointCloud);
+public:
+	/**
+	 * shape of a point
+	 */
+	enum ShapeType {
+		eSphere,
+		eDisk, ///< disk facing the ray
+	};
+
+	/**
+	 * create from alembic points
+	 * @param [in] point alembic points
+	 * @param [in] type shape of a point
+	 */
+	static UMPointCloudPtr create_from_abc_point(umabc::UMAbcPointPtr point, ShapeType type);
+
+	UMPointCloud();
+
+	~UMPointCloud() {}
+
+	/**
+	 * ray intersection
+	 * @param [in] ray a ray
+	 * @param [in,out] parameter shading parameters
+	 */
+	virtual bool intersects(const UMRay& ray, UMShaderParameter& parameter) const;
+
+	/**
+	 * ray intersection
+	 * @param [in] ray a ray
+	 */
+	virtual bool intersects(const UMRay& ray) const;
+
+	/**
+	 * get box
+	 */
+	virtual const umbase::UMBox& box() const { return box_; }
+
+	/**
+	 * read current sample and rebuild bvh
+	 */
+	virtual void update_box();
+
+	/**
+	 * get shape type
+	 */
+	ShapeType shape_type() const { return shape_type_; }
+
+	/**
+	 * set shape type
+	 */
+	void set_shape_type(ShapeType type) { shape_type_ = type; }
+
+	/**
+	 * get width of points without widths
+	 */
+	double default_width() const { return default_width_; }
+
+	/**
+	 * set width of points without widths
+	 */
+	void set_default_width(double width) { default_width_ = width; }
+
+	/**
+	 * get number of points
+	 */
+	size_t point_count() const { return point_count_; }
+
+	/**
+	 * get material
+	 */
+	umdraw::UMMaterialPtr material() const { return material_; }
+
+	/**
+	 * set material
+	 */
+	void set_material(umdraw::UMMaterialPtr material) { material_ = material; }
+
+private:
+	/**
+	 * bvh node. 32 bytes.
+	 */
+	struct Node
+	{
+		float box_min[3];
+		float box_max[3];
+		/// leaf: first index of index_list_, branch: index of right child
+		unsigned int offset;
+		/// leaf: number of points, branch: 0
+		unsigned short count;
+		unsigned short axis;
+	};
+	typedef std::vector<Node> NodeList;
+
+	UMVec3d position(unsigned int index) const;
+	double radius(unsigned int index) const;
+	void build();
+	unsigned int build_node(unsigned int start, unsigned int end);
+	bool intersects_point(const UMRay& ray, unsigned int index, double closest_distance, double& distance) const;
+	bool traverse(const UMRay& ray, bool is_any_hit, double& closest_distance, unsigned int& closest_index) const;
+
+	umabc::UMAbcPointWeakPtr abc_point_;
+	ShapeType shape_type_;
+	double default_width_;
+	umdraw::UMMaterialPtr material_;
+
+	/// keeps samples alive
+	std::shared_ptr<const void> position_holder_;
+	std::shared_ptr<const void> width_holder_;
+	std::shared_ptr<const void> color_holder_;
+	const float* position_data_;
+	const float* width_data_;
+	const float* color_data_;
+	size_t point_count_;
+	size_t width_count_;
+
+	NodeList node_list_;
+	std::vector<unsigned int> index_list_;
+	umbase::UMBox box_;
+};
+
+} // umrt
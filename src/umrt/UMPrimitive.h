@@ -12,6 +12,7 @@
 
 #include <memory>
 #include <vector>
+#include <atomic>
 
 #include "UMMacro.h"
 #include "UMMathTypes.h"
@@ -35,8 +36,17 @@ class UMPrimitive
 	DISALLOW_COPY_AND_ASSIGN(UMPrimitive);
 
 public:
-	UMPrimitive() {}
+	UMPrimitive() {
+		// primitives are created by tessellation threads too
+		static std::atomic<unsigned int> counter(0);
+		id_ = ++counter;
+	}
 	~UMPrimitive() {}
+
+	/**
+	 * get id
+	 */
+	unsigned int id() const { return id_; }
 	
 	/**
 	 * ray intersection
@@ -60,6 +70,9 @@ public:
 	 * update AABB
 	 */
 	virtual void update_box() = 0;
+
+private:
+	unsigned int id_;
 };
 
 } // umrt
@@ -9,6 +9,7 @@
  */
 #include "UMRT.h"
 #include <string>
+#include <cstring>
 #include <assert.h>
 
 #include "UMStringUtil.h"
@@ -23,6 +24,20 @@
 #include "UMRenderParameter.h"
 #include "UMBvh.h"
 #include "UMRenderer.h"
+#include "UMScene.h"
+#include "UMCamera.h"
+
+namespace
+{
+	// samples per pixel of interactive render at full resolution
+	const int interactive_sample_count = 1024;
+
+	bool is_same_matrix(const umbase::UMMat44d& a, const umbase::UMMat44d& b)
+	{
+		return memcmp(a.m, b.m, sizeof(a.m)) == 0;
+	}
+
+} // anonymouse namespace
 
 namespace umrt
 {
@@ -98,11 +113,124 @@ UMImagePtr UMRT::render()
 }
 
 /**
- * subdiv test
+ * start interactive render
+ */
+bool UMRT::start_interactive_render(int width, int height)
+{
+	if (!scene_access_) return false;
+	if (width <= 0 || height <= 0) return false;
+	umdraw::UMScenePtr scene = scene_access_->scene();
+	if (!scene || !scene->camera()) return false;
+
+	UMRendererPtr renderer = UMRenderer::create(UMRenderer::ePathTracer);
+	if (!renderer) return false;
+	renderer->set_width(width);
+	renderer->set_height(height);
+	if (!renderer->init()) return false;
+	interactive_renderer_ = renderer;
+	interactive_parameter_ = std::make_shared<UMRenderParameter>(width, height);
+	interactive_parameter_->set_sample_count(interactive_sample_count);
+	is_transform_changed();
+	restart_interactive_render(true);
+	return true;
+}
+
+/**
+ * stop interactive render
+ */
+void UMRT::stop_interactive_render()
+{
+	interactive_renderer_ = UMRendererPtr();
+	interactive_parameter_ = UMRenderParameterPtr();
+	interactive_transform_list_.clear();
+}
+
+/**
+ * interactive render for a time slice
+ */
+bool UMRT::interactive_render(double time_slice)
+{
+	if (!interactive_renderer_) return false;
+	umdraw::UMScenePtr scene = scene_access_->scene();
+	if (!scene || !scene->camera()) return false;
+
+	if (is_transform_changed())
+	{
+		restart_interactive_render(true);
+	}
+	else if (!is_same_matrix(interactive_view_projection_, scene->camera()->view_projection_matrix()))
+	{
+		restart_interactive_render(false);
+	}
+	return interactive_renderer_->interactive_render(scene_access_, *interactive_parameter_, time_slice);
+}
+
+/**
+ * restart interactive render
+ */
+void UMRT::restart_interactive_render(bool is_geometry_changed)
+{
+	if (!interactive_renderer_) return;
+	if (is_geometry_changed)
+	{
+		// same bvh object is rebuilt, so primitives referencing it stay valid
+		scene_access_->update_bvh();
+	}
+	if (umdraw::UMScenePtr scene = scene_access_->scene())
+	{
+		if (scene->camera())
+		{
+			interactive_view_projection_ = scene->camera()->view_projection_matrix();
+		}
+	}
+	interactive_renderer_->restart();
+}
+
+/**
+ * get image of interactive render
+ */
+UMImagePtr UMRT::interactive_image()
+{
+	if (!interactive_parameter_) return UMImagePtr();
+	return interactive_parameter_->display_image();
+}
+
+/**
+ * compare global transforms of meshes with previous call
  */
-bool UMRT::subdiv_test()
+bool UMRT::is_transform_changed()
 {
-	return scene_access_->subdivide(48, 2);
+	umdraw::UMScenePtr scene = scene_access_->scene();
+	if (!scene) return false;
+	std::vector<UMMat44d> transform_list;
+	const umdraw::UMMeshGroupList& group_list = scene->mesh_group_list();
+	for (size_t i = 0, size = group_list.size(); i < size; ++i)
+	{
+		const umdraw::UMMeshList& mesh_list = group_list.at(i)->mesh_list();
+		for (size_t k = 0, ksize = mesh_list.size(); k < ksize; ++k)
+		{
+			transform_list.push_back(mesh_list.at(k)->global_transform());
+		}
+	}
+	bool is_changed = (transform_list.size() != interactive_transform_list_.size());
+	for (size_t i = 0, size = transform_list.size(); !is_changed && i < size; ++i)
+	{
+		is_changed = !is_same_matrix(transform_list[i], interactive_transform_list_[i]);
+	}
+	interactive_transform_list_.swap(transform_list);
+	return is_changed;
+}
+
+/**
+ * subdivide meshes by their size on screen
+ */
+bool UMRT::subdivide_adaptive(unsigned int max_level, size_t triangle_budget)
+{
+	if (!scene_access_->subdivide_adaptive(max_level, triangle_budget))
+	{
+		return false;
+	}
+	return scene_access_->update_bvh();
 }
 
 
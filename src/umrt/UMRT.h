@@ -11,8 +11,10 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 #include "UMMacro.h"
 #include "UMVector.h"
+#include "UMMatrix.h"
 #include "UMMathTypes.h"
 
 namespace umabc
@@ -39,6 +41,12 @@ namespace umrt
 class UMSceneAccess;
 typedef std::shared_ptr<UMSceneAccess> UMSceneAccessPtr;
 
+class UMRenderer;
+typedef std::shared_ptr<UMRenderer> UMRendererPtr;
+
+class UMRenderParameter;
+typedef std::shared_ptr<UMRenderParameter> UMRenderParameterPtr;
+
 class UMRT;
 typedef std::shared_ptr<UMRT> UMRTPtr;
 
@@ -73,9 +81,50 @@ public:
 	umimage::UMImagePtr render();
 
 	/**
-	 * subdiv test
+	 * start interactive render.
+	 * bvh is kept alive between restarts.
+	 * @param [in] width image width
+	 * @param [in] height image height
+	 */
+	bool start_interactive_render(int width, int height);
+
+	/**
+	 * stop interactive render
+	 */
+	void stop_interactive_render();
+
+	/**
+	 * is interactive render started
+	 */
+	bool is_interactive_rendering() const { return !!interactive_renderer_; }
+
+	/**
+	 * interactive render for a time slice.
+	 * restarts from the lowest resolution when the camera or node transforms are changed.
+	 * @param [in] time_slice seconds for this call
+	 * @retval true image is updated
+	 * @retval false render finished or not started
 	 */
-	bool subdiv_test();
+	bool interactive_render(double time_slice);
+
+	/**
+	 * restart interactive render
+	 * @param [in] is_geometry_changed update bvh before restart
+	 */
+	void restart_interactive_render(bool is_geometry_changed);
+
+	/**
+	 * get image of interactive render.
+	 * denoised image of the last full pass when denoise is enabled.
+	 */
+	umimage::UMImagePtr interactive_image();
+
+	/**
+	 * subdivide meshes by their size on screen, and rebuild bvh
+	 * @param [in] max_level max subdivision level
+	 * @param [in] triangle_budget max triangles of the scene. 0 is unbounded.
+	 */
+	bool subdivide_adaptive(unsigned int max_level, size_t triangle_budget);
 
 	/**
 	 * get scene access
@@ -83,7 +132,14 @@ public:
 	UMSceneAccessPtr scene_access() { return scene_access_; }
 
 private:
+	bool is_transform_changed();
+
 	UMSceneAccessPtr scene_access_;
+	// for interactive render
+	UMRendererPtr interactive_renderer_;
+	UMRenderParameterPtr interactive_parameter_;
+	UMMat44d interactive_view_projection_;
+	std::vector<UMMat44d> interactive_transform_list_;
 };
 
 } // umrt
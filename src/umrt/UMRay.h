@@ -28,7 +28,8 @@ public:
 		origin_(0),
 		direction_(0),
 		tmin_(FLT_EPSILON),
-		tmax_(FLT_MAX)
+		tmax_(FLT_MAX),
+		has_differentials_(false)
 	{}
 	
 	/**
@@ -39,7 +40,8 @@ public:
 		origin_(origin),
 		direction_(direction),
 		tmin_(FLT_EPSILON),
-		tmax_(FLT_MAX) {}
+		tmax_(FLT_MAX),
+		has_differentials_(false) {}
 
 	~UMRay() {}
 
@@ -85,11 +87,66 @@ public:
 	 */
 	void set_tmax(double tmax) { tmax_ = tmax; }
 
+	/**
+	 * ray has differentials or not
+	 */
+	bool has_differentials() const { return has_differentials_; }
+
+	/**
+	 * get origin difference of neighbor pixel ray in x
+	 */
+	const UMVec3d& origin_dx() const { return origin_dx_; }
+	
+	/**
+	 * get origin difference of neighbor pixel ray in y
+	 */
+	const UMVec3d& origin_dy() const { return origin_dy_; }
+
+	/**
+	 * get direction difference of neighbor pixel ray in x
+	 */
+	const UMVec3d& direction_dx() const { return direction_dx_; }
+	
+	/**
+	 * get direction difference of neighbor pixel ray in y
+	 */
+	const UMVec3d& direction_dy() const { return direction_dy_; }
+
+	/**
+	 * set differentials
+	 * @param [in] origin_dx origin difference in x
+	 * @param [in] origin_dy origin difference in y
+	 * @param [in] direction_dx direction difference in x
+	 * @param [in] direction_dy direction difference in y
+	 */
+	void set_differentials(
+		const UMVec3d& origin_dx,
+		const UMVec3d& origin_dy,
+		const UMVec3d& direction_dx,
+		const UMVec3d& direction_dy)
+	{
+		origin_dx_ = origin_dx;
+		origin_dy_ = origin_dy;
+		direction_dx_ = direction_dx;
+		direction_dy_ = direction_dy;
+		has_differentials_ = true;
+	}
+
+	/**
+	 * clear differentials
+	 */
+	void clear_differentials() { has_differentials_ = false; }
+
 private:
 	UMVec3d origin_;
 	UMVec3d direction_;
 	double tmin_;
 	double tmax_;
+	bool has_differentials_;
+	UMVec3d origin_dx_;
+	UMVec3d origin_dy_;
+	UMVec3d direction_dx_;
+	UMVec3d direction_dy_;
 };
 
 } // umrt
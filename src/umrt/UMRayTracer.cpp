@@ -10,11 +10,15 @@
  */
 #include "UMRayTracer.h"
 #include "UMRenderParameter.h"
+#include "UMRenderStatistics.h"
+#include "UMFrameBuffer.h"
+#include "UMBucket.h"
 #include "UMShaderParameter.h"
 #include "UMRay.h"
 #include "UMScene.h"
 #include "UMVector.h"
 #include "UMStringUtil.h"
+#include "UMTime.h"
 
 #include <limits>
 #include <algorithm>
@@ -30,17 +34,47 @@ namespace
 	using namespace umrt;
 	using namespace umdraw;
 	
+	/// counters of the rendering thread. NULL outside of render passes.
+	UMRenderStatistics::ThreadCounter* ray_counter = NULL;
+
+	unsigned int xor128_x = 123456789;
+	unsigned int xor128_y = 362436069;
+	unsigned int xor128_z = 521288629;
+	unsigned int xor128_w = 88675123;
+
 	unsigned int xor128()
 	{
-		static unsigned int x = 123456789;
-		static unsigned int y = 362436069;
-		static unsigned int z = 521288629;
-		static unsigned int w = 88675123;
+		unsigned int& x = xor128_x;
+		unsigned int& y = xor128_y;
+		unsigned int& z = xor128_z;
+		unsigned int& w = xor128_w;
 		unsigned int t = x ^ (x << 11);
 		x = y; y = z; z = w;
 		return w = w ^ (w >> 19) ^ t ^ (t >> 8);
 	}
 
+	unsigned int hash32(unsigned int x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352d;
+		x ^= x >> 15;
+		x *= 0x846ca68b;
+		x ^= x >> 16;
+		return x;
+	}
+
+	/**
+	 * seed xor128.
+	 * buckets are seeded by position, so tiles rendered apart match a whole frame.
+	 */
+	void seed_xor128(unsigned int seed)
+	{
+		xor128_x = hash32(seed ^ 123456789);
+		xor128_y = hash32(xor128_x ^ 362436069);
+		xor128_z = hash32(xor128_y ^ 521288629);
+		xor128_w = hash32(xor128_z ^ 88675123) | 1;
+	}
+
 	double xor128d()
 	{
 		return xor128() / 4294967296.0;
@@ -119,6 +153,7 @@ namespace
 
 			// shadow ray
 			UMRay shadow_ray(parameter.intersect_point + parameter.normal * 0.00001, L);
+			if (ray_counter) ++ray_counter->shadow_ray_count;
 			UMIntersection intersection;
 			UMShaderParameter shadow_parameter;
 			if (!intersect(shadow_ray, scene_access, shadow_parameter, intersection))
@@ -134,6 +169,7 @@ namespace
 			refrect_parameter.bounce = parameter.bounce;
 			UMVec3d refrection_dir = reflect(ray, normal).normalized();
 			UMRay reflection_ray(parameter.intersect_point + normal * 0.00001, refrection_dir);
+			if (ray_counter) ++ray_counter->indirect_ray_count;
 			UMVec3d color = trace(reflection_ray, scene_access, refrect_parameter);
 			//UMVec3d nl = parameter.normal.dot(refrection_dir);
 			radiance += color;
@@ -152,12 +188,24 @@ namespace
 		//if (parameter.bounce == 1)
 		{
 			if (!intersect(ray, scene_access, parameter, intersection)){
+				parameter.color = scene->background_color();
+				parameter.normal = UMVec3d(0);
+				parameter.distance = 0.0;
+				parameter.primitive = NULL;
+				parameter.material = UMMaterialPtr();
 				return scene->background_color();
 			}
 		}
 
 		if (intersection.closest_primitive)
 		{
+			// write back first hit for output layers
+			const UMShaderParameter& closest = intersection.closest_parameter;
+			parameter.color = closest.color;
+			parameter.normal = closest.normal;
+			parameter.distance = closest.distance;
+			parameter.primitive = closest.primitive;
+			parameter.material = closest.material;
 			return shade(intersection.closest_primitive, ray, scene_access, intersection.closest_parameter);
 		}
 		return scene->background_color();
@@ -301,8 +349,7 @@ class UMRayTracer::Impl
 {
 public:
 	Impl(int width, int height) 
-		:  current_x_(0)
-		, current_y_(0)
+		:  current_bucket_(0)
 		, width_(width)
 		, height_(height)
 #ifdef WITH_OSL
@@ -342,8 +389,7 @@ public:
 
 	bool init() 
 	{
-		current_x_ = 0;
-		current_y_ = 0;
+		current_bucket_ = 0;
 		return true;
 	}
 
@@ -355,8 +401,8 @@ public:
 private:
 	OSL::RendererServices* render_service_;
 	// for progress render
-	int current_x_;
-	int current_y_;
+	int current_bucket_;
+	UMBucketList buckets_;
 	int width_;
 	int height_;
 };
@@ -400,6 +446,11 @@ bool UMRayTracer::Impl::render(UMSceneAccessPtr scene_access, UMRenderParameter&
 	if (!scene) return false;
 	if (width_ == 0 || height_ == 0) return false;
 	if (!scene->camera()) return false;
+	UMRenderStatistics& statistics = parameter.statistics();
+	statistics.reset();
+	statistics.set_bvh_build_seconds(scene_access->bvh_build_seconds());
+	const double setup_start_seconds = umbase::UMTime::current_seconds();
+	if (!scene_access->update_camera_sampler()) return false;
 	
 	//OSL::ErrorHandler error_handler;
 	//OSL::TextureSystem* texture_system = render_service()->texturesys();
@@ -438,45 +489,62 @@ bool UMRayTracer::Impl::render(UMSceneAccessPtr scene_access, UMRenderParameter&
 	//shading_system = NULL;
 
 	const int sample_count = parameter.super_sampling_count().x * parameter.super_sampling_count().y;
-	const double inv_sample_count = 1.0 / sample_count;
 
-	UMImage::ImageBuffer& dst_buffer = parameter.output_image()->mutable_list();
+	UMFrameBuffer& frame_buffer = parameter.frame_buffer();
+	frame_buffer.init(width_, height_);
 	
-//#pragma omp parallel for schedule(dynamic, 1) num_threads(4)
-	for (int y = 0; y < height_; ++y)
+	UMBucketList buckets;
+	parameter.create_buckets(buckets, width_, height_);
+	statistics.add_setup_seconds(umbase::UMTime::current_seconds() - setup_start_seconds);
+	
+	statistics.begin_pass();
+	for (size_t i = 0, size = buckets.size(); i < size; ++i)
 	{
-		if (sample_count > 1)
+		const UMBucket& bucket = buckets[i];
+		const double bucket_start_seconds = umbase::UMTime::current_seconds();
+		ray_counter = &statistics.current_thread_counter();
+		seed_xor128(bucket.y * width_ + bucket.x);
+		for (int y = bucket.y; y < (bucket.y + bucket.height); ++y)
 		{
-			for (int x = 0; x < width_; ++x)
+			for (int x = bucket.x; x < (bucket.x + bucket.width); ++x)
 			{
-				const int pos = width_ * y + x;
-				for (int s = 0; s < sample_count; ++s)
+				if (sample_count > 1)
+				{
+					for (int s = 0; s < sample_count; ++s)
+					{
+						UMVec2d sample_point(xor128d(), xor128d());
+						sample_point.x += x;
+						sample_point.y += y;
+						UMRay ray;
+						scene_access->generate_ray(ray, sample_point);
+						++ray_counter->primary_ray_count;
+						UMShaderParameter shader_parameter;
+						UMVec3d color = trace(ray, scene_access, shader_parameter);
+						frame_buffer.add_sample(x, y, color, shader_parameter);
+					}
+				}
+				else
 				{
-					UMVec2d sample_point(xor128d(), xor128d());
-					sample_point.x += x;
-					sample_point.y += y;
 					UMRay ray;
-					scene_access->generate_ray(ray, sample_point);
+					scene_access->generate_ray(ray, UMVec2d(x, y));
+					++ray_counter->primary_ray_count;
 					UMShaderParameter shader_parameter;
 					UMVec3d color = trace(ray, scene_access, shader_parameter);
-					dst_buffer[pos] += UMVec4d(color, 1.0);
+					frame_buffer.add_sample(x, y, color, shader_parameter);
 				}
-				dst_buffer[pos] *= inv_sample_count;
-			}
-		}
-		else
-		{
-			for (int x = 0; x < width_; ++x)
-			{
-				const int pos = width_ * y + x;
-				UMRay ray;
-				scene_access->generate_ray(ray, UMVec2d(x, y));
-				UMShaderParameter shader_parameter;
-				UMVec3d color = trace(ray, scene_access, shader_parameter);
-				dst_buffer[pos] = UMVec4d(color, 1.0);
 			}
 		}
+		ray_counter->busy_seconds += umbase::UMTime::current_seconds() - bucket_start_seconds;
+		ray_counter = NULL;
 	}
+	statistics.end_pass();
+
+	const double resolve_start_seconds = umbase::UMTime::current_seconds();
+	frame_buffer.resolve(
+		UMFrameBuffer::eLayerBeauty, 
+		parameter.output_image(), 
+		parameter.render_rect(width_, height_));
+	statistics.add_resolve_seconds(umbase::UMTime::current_seconds() - resolve_start_seconds);
 	return true;
 }
 
@@ -486,34 +554,60 @@ bool UMRayTracer::Impl::progress_render(UMSceneAccessPtr scene_access, UMRenderP
 	if (!scene) return false;
 	if (width_ == 0 || height_ == 0) return false;
 	if (!scene->camera()) return false;
+	if (!scene_access->update_camera_sampler()) return false;
 	
-	const int ystep = 10;
+	const int bucket_step = 4;
 	
 	const int sample_count = parameter.super_sampling_count().x * parameter.super_sampling_count().y;
-	const double inv_sample_count = 1.0 / sample_count;
 	
-	for (int& y = current_y_, rows = (y + ystep); y < rows; ++y)
+	UMFrameBuffer& frame_buffer = parameter.frame_buffer();
+	UMRenderStatistics& statistics = parameter.statistics();
+	if (current_bucket_ == 0)
+	{
+		const double setup_start_seconds = umbase::UMTime::current_seconds();
+		statistics.reset();
+		statistics.set_bvh_build_seconds(scene_access->bvh_build_seconds());
+		frame_buffer.init(width_, height_);
+		parameter.create_buckets(buckets_, width_, height_);
+		statistics.add_setup_seconds(umbase::UMTime::current_seconds() - setup_start_seconds);
+	}
+	
+	// end
+	if (current_bucket_ >= static_cast<int>(buckets_.size())) { return false; }
+
+	statistics.begin_pass();
+	for (int& i = current_bucket_, last = (i + bucket_step); i < last; ++i)
 	{
-		// end
-		if (y == height_) { return false; }
+		if (i >= static_cast<int>(buckets_.size())) { break; }
 		
-		for (int x = 0; x < width_; ++x)
+		const UMBucket& bucket = buckets_[i];
+		const double bucket_start_seconds = umbase::UMTime::current_seconds();
+		ray_counter = &statistics.current_thread_counter();
+		seed_xor128(bucket.y * width_ + bucket.x);
+		for (int y = bucket.y; y < (bucket.y + bucket.height); ++y)
 		{
-			const int pos = width_ * y + x;
-			for (int s = 0; s < sample_count; ++s)
+			for (int x = bucket.x; x < (bucket.x + bucket.width); ++x)
 			{
-				UMVec2d sample_point(xor128d(), xor128d());
-				sample_point.x += x;
-				sample_point.y += y;
-				UMRay ray;
-				scene_access->generate_ray(ray, sample_point);
-				UMShaderParameter shader_parameter;
-				UMVec3d color = trace(ray, scene_access, shader_parameter);
-				parameter.output_image()->mutable_list()[pos] += UMVec4d(color, 1.0);
+				const int pos = width_ * y + x;
+				for (int s = 0; s < sample_count; ++s)
+				{
+					UMVec2d sample_point(xor128d(), xor128d());
+					sample_point.x += x;
+					sample_point.y += y;
+					UMRay ray;
+					scene_access->generate_ray(ray, sample_point);
+					++ray_counter->primary_ray_count;
+					UMShaderParameter shader_parameter;
+					UMVec3d color = trace(ray, scene_access, shader_parameter);
+					frame_buffer.add_sample(x, y, color, shader_parameter);
+				}
+				parameter.output_image()->mutable_list()[pos] = frame_buffer.beauty(x, y);
 			}
-			parameter.output_image()->mutable_list()[pos] *= inv_sample_count;
 		}
+		ray_counter->busy_seconds += umbase::UMTime::current_seconds() - bucket_start_seconds;
+		ray_counter = NULL;
 	}
+	statistics.end_pass();
 	
 	return true;
 }
@@ -0,0 +1,785 @@
+/**
+ * @file UMRenderFarm.cpp
+ * distributed tile rendering
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMRenderFarm.h"
+#include "UMRenderParameter.h"
+#include "UMRenderStatistics.h"
+#include "UMFrameBuffer.h"
+#include "UMSceneAccess.h"
+#include "UMSocket.h"
+#include "UMBucket.h"
+#include "UMImage.h"
+#include "UMTime.h"
+
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace
+{
+	using namespace umrt;
+
+	// "UMRF"
+	const unsigned int message_magic = 0x46524d55;
+
+	enum MessageType {
+		eMessageTileRequest = 1,
+		eMessageTileResult = 2,
+		eMessageFinish = 3,
+		eMessageHello = 4,
+	};
+
+	// messages are sent in host byte order. all hosts are expected to be little endian.
+	struct MessageHeader
+	{
+		unsigned int magic;
+		unsigned int type;
+		unsigned int size;
+	};
+
+	/// first message of a worker
+	struct WorkerHello
+	{
+		int frame;
+	};
+
+	/// frame of the coordinator. workers of other frames are finished at once.
+	struct FinishMessage
+	{
+		int frame;
+	};
+
+	struct TileRequest
+	{
+		int frame;
+		int renderer_type;
+		int width;
+		int height;
+		int sample_count;
+		int super_sampling_x;
+		int super_sampling_y;
+		int light_sample_count;
+		int light_sampling_type;
+		int bucket_size;
+		int is_denoise_enabled;
+		int is_irradiance_cache_enabled;
+		double irradiance_cache_accuracy;
+		int tile_index;
+		int x;
+		int y;
+		int tile_width;
+		int tile_height;
+	};
+
+	struct TileResult
+	{
+		int tile_index;
+		int x;
+		int y;
+		int tile_width;
+		int tile_height;
+	};
+
+	bool send_message(UMSocketPtr socket, MessageType type, const void* data, unsigned int size)
+	{
+		MessageHeader header;
+		header.magic = message_magic;
+		header.type = type;
+		header.size = size;
+		if (!socket->send_all(&header, sizeof(header))) return false;
+		if (size > 0 && !socket->send_all(data, size)) return false;
+		return true;
+	}
+
+	bool receive_header(UMSocketPtr socket, MessageHeader& header, int milliseconds = -1)
+	{
+		if (!socket->receive_all(&header, sizeof(header), milliseconds)) return false;
+		return header.magic == message_magic;
+	}
+
+	// layers sent with each tile, so the coordinator denoises a whole frame once
+	const UMFrameBuffer::LayerType feature_layers[] = {
+		UMFrameBuffer::eLayerAlbedo,
+		UMFrameBuffer::eLayerNormal,
+		UMFrameBuffer::eLayerDepth,
+	};
+	const int feature_layer_count = sizeof(feature_layers) / sizeof(feature_layers[0]);
+
+	/**
+	 * float count of a pixel in a tile result
+	 */
+	int tile_pixel_float_count(const UMFrameBuffer* frame_buffer)
+	{
+		int count = 3;
+		if (!frame_buffer) return count;
+		for (int i = 0; i < feature_layer_count; ++i)
+		{
+			UMFrameLayerPtr layer = frame_buffer->layer(feature_layers[i]);
+			if (layer) count += layer->channel_count();
+		}
+		return count;
+	}
+
+	/**
+	 * milliseconds until deadline. negative for no deadline.
+	 */
+	int remaining_milliseconds(double deadline)
+	{
+		if (deadline <= 0.0) return -1;
+		return std::max(static_cast<int>((deadline - umbase::UMTime::current_seconds()) * 1000.0), 0);
+	}
+
+} // anonymouse namespace
+
+namespace umrt
+{
+
+/**
+ * coordinator implementation
+ */
+class UMRenderCoordinator::Impl
+{
+	DISALLOW_COPY_AND_ASSIGN(Impl);
+public:
+	Impl()
+		: tile_size_(64)
+		, tile_timeout_(0)
+		, connect_timeout_(60)
+		, frame_(0)
+		, reassigned_tile_count_(0)
+		, worker_count_(0)
+		, active_worker_count_(0)
+		, done_count_(0)
+		, is_finished_(false)
+		, is_failed_(false)
+		, frame_buffer_(NULL)
+	{}
+
+	~Impl() {}
+
+	bool listen(const std::string& address)
+	{
+		listener_ = UMSocket::listen(address);
+		return listener_ ? true : false;
+	}
+
+	bool render(
+		UMRenderer::RendererType type,
+		int width,
+		int height,
+		UMRenderParameter& parameter);
+
+	int tile_size_;
+	int tile_timeout_;
+	int connect_timeout_;
+	int frame_;
+	int reassigned_tile_count_;
+	int worker_count_;
+
+private:
+	void serve_worker(UMSocketPtr socket);
+	bool render_tile(UMSocketPtr socket, int tile_index);
+
+	UMSocketPtr listener_;
+	TileRequest job_;
+	UMBucketList tiles_;
+	UMImagePtr image_;
+
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	std::deque<int> queue_;
+	int active_worker_count_;
+	int done_count_;
+	bool is_finished_;
+	/// no worker was connected for connect timeout before tiles were done
+	bool is_failed_;
+	/// feature layers for denoising. NULL when denoise is disabled.
+	UMFrameBuffer* frame_buffer_;
+	/// workers accepted after tiles were done. served in the next frame.
+	std::vector<UMSocketPtr> pending_socket_list_;
+};
+
+/**
+ * render a frame by workers
+ */
+bool UMRenderCoordinator::Impl::render(
+	UMRenderer::RendererType type,
+	int width,
+	int height,
+	UMRenderParameter& parameter)
+{
+	if (!listener_) return false;
+	if (width <= 0 || height <= 0) return false;
+
+	// tiles are aligned to buckets, so workers sample same as a local render
+	const int bucket_size = std::max(parameter.bucket_size(), 1);
+	const int tile_size = ((std::max(tile_size_, 1) + bucket_size - 1) / bucket_size) * bucket_size;
+	UMBucketOrder::create_buckets(
+		tiles_,
+		parameter.render_rect(width, height),
+		tile_size,
+		UMBucketOrder::eOrderHilbert);
+	if (tiles_.empty()) return false;
+
+	job_.frame = frame_;
+	job_.renderer_type = type;
+	job_.width = width;
+	job_.height = height;
+	job_.sample_count = parameter.sample_count();
+	job_.super_sampling_x = parameter.super_sampling_count().x;
+	job_.super_sampling_y = parameter.super_sampling_count().y;
+	job_.light_sample_count = parameter.light_sample_count();
+	job_.light_sampling_type = parameter.light_sampling_type();
+	job_.bucket_size = bucket_size;
+	// workers send feature layers, and the coordinator denoises the whole frame
+	job_.is_denoise_enabled = parameter.is_denoise_enabled() ? 1 : 0;
+	job_.is_irradiance_cache_enabled = parameter.is_irradiance_cache_enabled() ? 1 : 0;
+	job_.irradiance_cache_accuracy = parameter.irradiance_cache_accuracy();
+
+	// rays are counted by workers, only denoise is measured here
+	parameter.statistics().reset();
+	image_ = parameter.output_image();
+	if (image_->width() != width || image_->height() != height || !image_->is_valid())
+	{
+		image_->init(width, height);
+	}
+	frame_buffer_ = NULL;
+	if (parameter.is_denoise_enabled())
+	{
+		frame_buffer_ = &parameter.frame_buffer();
+		for (int i = 0; i < feature_layer_count; ++i)
+		{
+			frame_buffer_->set_layer_enabled(feature_layers[i], true);
+		}
+		if (!frame_buffer_->init(width, height)) return false;
+	}
+
+	queue_.clear();
+	for (int i = 0, size = static_cast<int>(tiles_.size()); i < size; ++i)
+	{
+		queue_.push_back(i);
+	}
+	active_worker_count_ = 0;
+	done_count_ = 0;
+	is_finished_ = false;
+	is_failed_ = false;
+	reassigned_tile_count_ = 0;
+	worker_count_ = 0;
+
+	// accept workers until all tiles are returned.
+	// tiles of lost workers stay queued for workers connecting later.
+	std::vector<std::thread> threads;
+	for (size_t i = 0, size = pending_socket_list_.size(); i < size; ++i)
+	{
+		UMSocketPtr socket = pending_socket_list_[i];
+		++active_worker_count_;
+		threads.push_back(std::thread([this, socket] { serve_worker(socket); }));
+	}
+	pending_socket_list_.clear();
+	double idle_start_seconds = umbase::UMTime::current_seconds();
+	for (;;)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (is_finished_) break;
+			const double current_seconds = umbase::UMTime::current_seconds();
+			if (active_worker_count_ > 0)
+			{
+				idle_start_seconds = current_seconds;
+			}
+			else if (connect_timeout_ > 0 && current_seconds - idle_start_seconds > connect_timeout_)
+			{
+				is_failed_ = true;
+				is_finished_ = true;
+				condition_.notify_all();
+				break;
+			}
+		}
+		if (!listener_->wait_readable(100)) continue;
+		UMSocketPtr socket = listener_->accept();
+		if (!socket) continue;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (is_finished_)
+			{
+				pending_socket_list_.push_back(socket);
+				break;
+			}
+			++active_worker_count_;
+		}
+		threads.push_back(std::thread([this, socket] { serve_worker(socket); }));
+	}
+	for (size_t i = 0, size = threads.size(); i < size; ++i)
+	{
+		threads[i].join();
+	}
+	image_ = UMImagePtr();
+	if (is_failed_) return false;
+	if (frame_buffer_)
+	{
+		frame_buffer_ = NULL;
+		const double resolve_start_seconds = umbase::UMTime::current_seconds();
+		if (!parameter.denoise(parameter.render_rect(width, height))) return false;
+		parameter.statistics().add_resolve_seconds(umbase::UMTime::current_seconds() - resolve_start_seconds);
+	}
+	return true;
+}
+
+/**
+ * hand tiles to a worker until finished or lost
+ */
+void UMRenderCoordinator::Impl::serve_worker(UMSocketPtr socket)
+{
+	FinishMessage finish;
+	finish.frame = job_.frame;
+
+	// workers of other frames are told the current frame and finished
+	const double deadline = tile_timeout_ > 0 ? umbase::UMTime::current_seconds() + tile_timeout_ : 0.0;
+	MessageHeader header;
+	WorkerHello hello;
+	if (!receive_header(socket, header, remaining_milliseconds(deadline)) ||
+		header.type != eMessageHello ||
+		header.size != sizeof(hello) ||
+		!socket->receive_all(&hello, sizeof(hello), remaining_milliseconds(deadline)) ||
+		hello.frame != job_.frame)
+	{
+		send_message(socket, eMessageFinish, &finish, sizeof(finish));
+		socket->close();
+		std::lock_guard<std::mutex> lock(mutex_);
+		--active_worker_count_;
+		condition_.notify_all();
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		++worker_count_;
+	}
+
+	for (;;)
+	{
+		int tile_index = -1;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			while (queue_.empty() && !is_finished_)
+			{
+				condition_.wait(lock);
+			}
+			if (is_finished_) break;
+			tile_index = queue_.front();
+			queue_.pop_front();
+		}
+
+		if (!render_tile(socket, tile_index))
+		{
+			// worker lost. hand the tile to others or to workers connecting later.
+			std::lock_guard<std::mutex> lock(mutex_);
+			queue_.push_front(tile_index);
+			++reassigned_tile_count_;
+			--active_worker_count_;
+			condition_.notify_all();
+			socket->close();
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		++done_count_;
+		if (done_count_ == static_cast<int>(tiles_.size()))
+		{
+			is_finished_ = true;
+			condition_.notify_all();
+		}
+	}
+	send_message(socket, eMessageFinish, &finish, sizeof(finish));
+	socket->close();
+}
+
+/**
+ * send a tile request and receive the result
+ */
+bool UMRenderCoordinator::Impl::render_tile(UMSocketPtr socket, int tile_index)
+{
+	const UMBucket& tile = tiles_[tile_index];
+	TileRequest request = job_;
+	request.tile_index = tile_index;
+	request.x = tile.x;
+	request.y = tile.y;
+	request.tile_width = tile.width;
+	request.tile_height = tile.height;
+	if (!send_message(socket, eMessageTileRequest, &request, sizeof(request))) return false;
+
+	// timeout covers rendering and receiving the whole tile
+	const double deadline = tile_timeout_ > 0 ? umbase::UMTime::current_seconds() + tile_timeout_ : 0.0;
+	MessageHeader header;
+	if (!receive_header(socket, header, remaining_milliseconds(deadline))) return false;
+	if (header.type != eMessageTileResult) return false;
+
+	TileResult result;
+	if (header.size < sizeof(result)) return false;
+	if (!socket->receive_all(&result, sizeof(result), remaining_milliseconds(deadline))) return false;
+	if (result.tile_index != tile_index ||
+		result.x != tile.x || result.y != tile.y ||
+		result.tile_width != tile.width || result.tile_height != tile.height)
+	{
+		return false;
+	}
+	// color, then feature layers in order
+	const size_t pixel_count = static_cast<size_t>(tile.width) * tile.height;
+	const size_t float_count = pixel_count * tile_pixel_float_count(frame_buffer_);
+	if (header.size != sizeof(result) + float_count * sizeof(float)) return false;
+	std::vector<float> pixels(float_count);
+	if (!socket->receive_all(&pixels[0], float_count * sizeof(float), remaining_milliseconds(deadline))) return false;
+
+	// tiles do not overlap
+	UMImage::ImageBuffer& dst = image_->mutable_list();
+	const int width = image_->width();
+	for (int y = 0; y < tile.height; ++y)
+	{
+		for (int x = 0; x < tile.width; ++x)
+		{
+			const float* src = &pixels[(y * tile.width + x) * 3];
+			dst[(tile.y + y) * width + tile.x + x] = UMVec4d(src[0], src[1], src[2], 1.0);
+		}
+	}
+	if (!frame_buffer_) return true;
+	const float* src = &pixels[pixel_count * 3];
+	for (int i = 0; i < feature_layer_count; ++i)
+	{
+		UMFrameLayerPtr layer = frame_buffer_->layer(feature_layers[i]);
+		if (!layer) continue;
+		const int channel_count = layer->channel_count();
+		for (int y = 0; y < tile.height; ++y)
+		{
+			for (int x = 0; x < tile.width; ++x, src += channel_count)
+			{
+				std::copy(src, src + channel_count, layer->float_pixel(tile.x + x, tile.y + y));
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * constructor
+ */
+UMRenderCoordinator::UMRenderCoordinator()
+	: impl_(new UMRenderCoordinator::Impl())
+{}
+
+/**
+ * destructor
+ */
+UMRenderCoordinator::~UMRenderCoordinator()
+{}
+
+/**
+ * listen for workers
+ */
+bool UMRenderCoordinator::listen(const std::string& address)
+{
+	return impl_->listen(address);
+}
+
+/**
+ * render a frame by workers
+ */
+bool UMRenderCoordinator::render(
+	UMRenderer::RendererType type,
+	int width,
+	int height,
+	UMRenderParameter& parameter)
+{
+	return impl_->render(type, width, height, parameter);
+}
+
+/**
+ * get tile size
+ */
+int UMRenderCoordinator::tile_size() const
+{
+	return impl_->tile_size_;
+}
+
+/**
+ * set tile size
+ */
+void UMRenderCoordinator::set_tile_size(int size)
+{
+	impl_->tile_size_ = size;
+}
+
+/**
+ * get tile timeout
+ */
+int UMRenderCoordinator::tile_timeout() const
+{
+	return impl_->tile_timeout_;
+}
+
+/**
+ * set tile timeout
+ */
+void UMRenderCoordinator::set_tile_timeout(int seconds)
+{
+	impl_->tile_timeout_ = seconds;
+}
+
+/**
+ * get connect timeout
+ */
+int UMRenderCoordinator::connect_timeout() const
+{
+	return impl_->connect_timeout_;
+}
+
+/**
+ * set connect timeout
+ */
+void UMRenderCoordinator::set_connect_timeout(int seconds)
+{
+	impl_->connect_timeout_ = seconds;
+}
+
+/**
+ * get frame
+ */
+int UMRenderCoordinator::frame() const
+{
+	return impl_->frame_;
+}
+
+/**
+ * set frame
+ */
+void UMRenderCoordinator::set_frame(int frame)
+{
+	impl_->frame_ = frame;
+}
+
+/**
+ * get reassigned tile count
+ */
+int UMRenderCoordinator::reassigned_tile_count() const
+{
+	return impl_->reassigned_tile_count_;
+}
+
+/**
+ * get worker count
+ */
+int UMRenderCoordinator::worker_count() const
+{
+	return impl_->worker_count_;
+}
+
+/**
+ * worker implementation
+ */
+class UMRenderWorker::Impl
+{
+	DISALLOW_COPY_AND_ASSIGN(Impl);
+public:
+	explicit Impl(UMSceneAccessPtr scene_access)
+		: rendered_tile_count_(0)
+		, frame_(0)
+		, coordinator_frame_(0)
+		, scene_access_(scene_access)
+	{}
+
+	~Impl() {}
+
+	bool run(const std::string& address);
+
+	int rendered_tile_count_;
+	int frame_;
+	int coordinator_frame_;
+
+private:
+	bool render_tile(UMSocketPtr socket, const TileRequest& request);
+
+	UMSceneAccessPtr scene_access_;
+};
+
+/**
+ * render tiles until finished
+ */
+bool UMRenderWorker::Impl::run(const std::string& address)
+{
+	if (!scene_access_) return false;
+	UMSocketPtr socket = UMSocket::connect(address);
+	if (!socket) return false;
+
+	WorkerHello hello;
+	hello.frame = frame_;
+	if (!send_message(socket, eMessageHello, &hello, sizeof(hello))) return false;
+
+	for (;;)
+	{
+		MessageHeader header;
+		if (!receive_header(socket, header)) return false;
+		if (header.type == eMessageFinish)
+		{
+			FinishMessage finish;
+			if (header.size != sizeof(finish)) return false;
+			if (!socket->receive_all(&finish, sizeof(finish))) return false;
+			coordinator_frame_ = finish.frame;
+			return true;
+		}
+		if (header.type != eMessageTileRequest || header.size != sizeof(TileRequest)) return false;
+		TileRequest request;
+		if (!socket->receive_all(&request, sizeof(request))) return false;
+		if (request.frame != frame_) return false;
+		if (!render_tile(socket, request)) return false;
+		++rendered_tile_count_;
+	}
+}
+
+/**
+ * render a tile and send back
+ */
+bool UMRenderWorker::Impl::render_tile(UMSocketPtr socket, const TileRequest& request)
+{
+	if (request.tile_width <= 0 || request.tile_height <= 0) return false;
+	if (request.x < 0 || request.y < 0 ||
+		request.x + request.tile_width > request.width ||
+		request.y + request.tile_height > request.height)
+	{
+		return false;
+	}
+
+	UMRenderParameter parameter(request.width, request.height);
+	parameter.set_sample_count(request.sample_count);
+	parameter.set_super_sampling_count(UMVec2i(request.super_sampling_x, request.super_sampling_y));
+	parameter.set_light_sample_count(request.light_sample_count);
+	parameter.set_light_sampling_type(static_cast<UMLightSampler::SamplingType>(request.light_sampling_type));
+	parameter.set_bucket_size(request.bucket_size);
+	// denoised once by the coordinator. tiles send feature layers instead.
+	parameter.set_denoise_enabled(false);
+	const bool is_feature_enabled = request.is_denoise_enabled != 0;
+	for (int i = 0; is_feature_enabled && i < feature_layer_count; ++i)
+	{
+		parameter.set_layer_enabled(feature_layers[i], true);
+	}
+	parameter.set_irradiance_cache_enabled(request.is_irradiance_cache_enabled != 0);
+	parameter.set_irradiance_cache_accuracy(request.irradiance_cache_accuracy);
+	parameter.set_crop_window(UMVec4i(request.x, request.y, request.tile_width, request.tile_height));
+
+	UMRendererPtr renderer = UMRenderer::create(static_cast<UMRenderer::RendererType>(request.renderer_type));
+	if (!renderer) return false;
+	renderer->set_width(request.width);
+	renderer->set_height(request.height);
+	renderer->init();
+	renderer->render(scene_access_, parameter);
+
+	TileResult result;
+	result.tile_index = request.tile_index;
+	result.x = request.x;
+	result.y = request.y;
+	result.tile_width = request.tile_width;
+	result.tile_height = request.tile_height;
+
+	const UMFrameBuffer* frame_buffer = is_feature_enabled ? &parameter.frame_buffer() : NULL;
+	const size_t pixel_count = static_cast<size_t>(request.tile_width) * request.tile_height;
+	const size_t float_count = pixel_count * tile_pixel_float_count(frame_buffer);
+	std::vector<float> pixels(float_count);
+	const UMImage::ImageBuffer& src = parameter.output_image()->list();
+	for (int y = 0; y < request.tile_height; ++y)
+	{
+		for (int x = 0; x < request.tile_width; ++x)
+		{
+			const UMVec4d& color = src[(request.y + y) * request.width + request.x + x];
+			float* dst = &pixels[(y * request.tile_width + x) * 3];
+			dst[0] = static_cast<float>(color.x);
+			dst[1] = static_cast<float>(color.y);
+			dst[2] = static_cast<float>(color.z);
+		}
+	}
+	float* dst = &pixels[pixel_count * 3];
+	for (int i = 0; frame_buffer && i < feature_layer_count; ++i)
+	{
+		UMFrameLayerPtr layer = frame_buffer->layer(feature_layers[i]);
+		if (!layer) continue;
+		const int channel_count = layer->channel_count();
+		for (int y = 0; y < request.tile_height; ++y)
+		{
+			for (int x = 0; x < request.tile_width; ++x, dst += channel_count)
+			{
+				const float* src = layer->float_pixel(request.x + x, request.y + y);
+				std::copy(src, src + channel_count, dst);
+			}
+		}
+	}
+
+	const unsigned int size = static_cast<unsigned int>(sizeof(result) + float_count * sizeof(float));
+	MessageHeader header;
+	header.magic = message_magic;
+	header.type = eMessageTileResult;
+	header.size = size;
+	if (!socket->send_all(&header, sizeof(header))) return false;
+	if (!socket->send_all(&result, sizeof(result))) return false;
+	return socket->send_all(&pixels[0], float_count * sizeof(float));
+}
+
+/**
+ * constructor
+ */
+UMRenderWorker::UMRenderWorker(UMSceneAccessPtr scene_access)
+	: impl_(new UMRenderWorker::Impl(scene_access))
+{}
+
+/**
+ * destructor
+ */
+UMRenderWorker::~UMRenderWorker()
+{}
+
+/**
+ * connect to coordinator and render tiles until finished
+ */
+bool UMRenderWorker::run(const std::string& address)
+{
+	return impl_->run(address);
+}
+
+/**
+ * get rendered tile count
+ */
+int UMRenderWorker::rendered_tile_count() const
+{
+	return impl_->rendered_tile_count_;
+}
+
+/**
+ * get frame
+ */
+int UMRenderWorker::frame() const
+{
+	return impl_->frame_;
+}
+
+/**
+ * set frame
+ */
+void UMRenderWorker::set_frame(int frame)
+{
+	impl_->frame_ = frame;
+}
+
+/**
+ * get frame of the coordinator
+ */
+int UMRenderWorker::coordinator_frame() const
+{
+	return impl_->coordinator_frame_;
+}
+
+} // umrt
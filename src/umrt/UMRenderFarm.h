@@ -0,0 +1,178 @@
+/**
+ * @file UMRenderFarm.h
+ * distributed tile rendering
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include "UMMacro.h"
+#include "UMRenderer.h"
+
+namespace umrt
+{
+
+class UMRenderCoordinator;
+typedef std::shared_ptr<UMRenderCoordinator> UMRenderCoordinatorPtr;
+
+class UMRenderWorker;
+typedef std::shared_ptr<UMRenderWorker> UMRenderWorkerPtr;
+
+class UMSceneAccess;
+typedef std::shared_ptr<UMSceneAccess> UMSceneAccessPtr;
+
+class UMRenderParameter;
+
+/**
+ * render farm coordinator.
+ * splits a frame into tiles and hands them to connected workers.
+ * tiles of lost workers are handed to other workers or to workers connecting later.
+ * denoise is applied once to the whole frame with feature layers sent by workers.
+ * a sequence is rendered by calling render for each frame with the same coordinator.
+ */
+class UMRenderCoordinator
+{
+	DISALLOW_COPY_AND_ASSIGN(UMRenderCoordinator);
+public:
+	UMRenderCoordinator();
+
+	~UMRenderCoordinator();
+
+	/**
+	 * listen for workers
+	 * @param [in] address "host:port" or "unix:/path"
+	 * @retval success or failed
+	 */
+	bool listen(const std::string& address);
+
+	/**
+	 * render a frame by workers. blocks until all tiles are returned.
+	 * fails when no worker is connected for connect timeout before tiles are done.
+	 * @param [in] type renderer type which workers use
+	 * @param [in] width frame width
+	 * @param [in] height frame height
+	 * @param [in,out] parameter parameters for rendering. result is written to output image.
+	 * @retval success or failed
+	 */
+	bool render(
+		UMRenderer::RendererType type,
+		int width,
+		int height,
+		UMRenderParameter& parameter);
+
+	/**
+	 * get tile size
+	 */
+	int tile_size() const;
+
+	/**
+	 * set tile size. rounded up to bucket size.
+	 */
+	void set_tile_size(int size);
+
+	/**
+	 * get tile timeout in seconds (0 waits forever)
+	 */
+	int tile_timeout() const;
+
+	/**
+	 * set tile timeout in seconds (0 waits forever).
+	 * a worker exceeding timeout is treated as lost.
+	 */
+	void set_tile_timeout(int seconds);
+
+	/**
+	 * get connect timeout in seconds (0 waits forever)
+	 */
+	int connect_timeout() const;
+
+	/**
+	 * set connect timeout in seconds (0 waits forever).
+	 * render fails when no worker is connected for timeout.
+	 */
+	void set_connect_timeout(int seconds);
+
+	/**
+	 * get frame to render
+	 */
+	int frame() const;
+
+	/**
+	 * set frame to render.
+	 * only workers of the same frame are given tiles.
+	 */
+	void set_frame(int frame);
+
+	/**
+	 * get count of tiles reassigned from lost workers in last render
+	 */
+	int reassigned_tile_count() const;
+
+	/**
+	 * get count of workers connected in last render
+	 */
+	int worker_count() const;
+
+private:
+	class Impl;
+	typedef std::unique_ptr<Impl> ImplPtr;
+	ImplPtr impl_;
+};
+
+/**
+ * render farm worker.
+ * renders tiles requested by coordinator with a loaded scene.
+ * @note scene size must be same as the frame size of the coordinator.
+ * @note scene must be updated to the frame of the worker before run.
+ */
+class UMRenderWorker
+{
+	DISALLOW_COPY_AND_ASSIGN(UMRenderWorker);
+public:
+	explicit UMRenderWorker(UMSceneAccessPtr scene_access);
+
+	~UMRenderWorker();
+
+	/**
+	 * connect to coordinator and render tiles until finished.
+	 * finished at once when the coordinator renders other frame.
+	 * @param [in] address "host:port" or "unix:/path"
+	 * @retval true finished by coordinator. see coordinator_frame.
+	 * @retval false connection failed or lost
+	 */
+	bool run(const std::string& address);
+
+	/**
+	 * get rendered tile count
+	 */
+	int rendered_tile_count() const;
+
+	/**
+	 * get frame of the scene
+	 */
+	int frame() const;
+
+	/**
+	 * set frame of the scene
+	 */
+	void set_frame(int frame);
+
+	/**
+	 * get frame which the coordinator rendered when last run finished.
+	 * same as frame when the frame is done.
+	 */
+	int coordinator_frame() const;
+
+private:
+	class Impl;
+	typedef std::unique_ptr<Impl> ImplPtr;
+	ImplPtr impl_;
+};
+
+} // umrt
@@ -11,9 +11,15 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
 #include "UMMacro.h"
 #include "UMImage.h"
 #include "UMVector.h"
+#include "UMLightSampler.h"
+#include "UMDenoiser.h"
+#include "UMFrameBuffer.h"
+#include "UMBucket.h"
+#include "UMRenderStatistics.h"
 
 namespace umrt
 {
@@ -28,12 +34,28 @@ public:
 	UMRenderParameter() 
 		: super_sampling_count_(2, 2)
 		, sample_count_(20)
+		, light_sample_count_(1)
+		, light_sampling_type_(UMLightSampler::eLightBvh)
+		, is_denoise_enabled_(false)
+		, is_irradiance_cache_enabled_(false)
+		, irradiance_cache_accuracy_(0.2)
+		, bucket_order_(UMBucketOrder::eOrderHilbert)
+		, bucket_size_(32)
+		, checkpoint_interval_(0)
 		, output_image_(std::make_shared<UMImage>())
 	{}
 
 	UMRenderParameter(int width, int height)
 		: super_sampling_count_(2, 2)
 		, sample_count_(20)
+		, light_sample_count_(1)
+		, light_sampling_type_(UMLightSampler::eLightBvh)
+		, is_denoise_enabled_(false)
+		, is_irradiance_cache_enabled_(false)
+		, irradiance_cache_accuracy_(0.2)
+		, bucket_order_(UMBucketOrder::eOrderHilbert)
+		, bucket_size_(32)
+		, checkpoint_interval_(0)
 		, output_image_(std::make_shared<UMImage>())
 	{
 		if (UMImagePtr image = output_image())
@@ -49,16 +71,250 @@ public:
 	 */
 	UMImagePtr output_image() { return output_image_; } 
 
+	/**
+	 * get image to display while rendering.
+	 * denoised image of the last pass if exists, otherwise output image.
+	 */
+	UMImagePtr display_image() { return display_image_ ? display_image_ : output_image_; }
+
+	/**
+	 * discard denoised display image
+	 */
+	void clear_display_image() { display_image_ = UMImagePtr(); }
+
 	/** 
 	 * get sample count par pixel
 	 */
 	int sample_count() const { return sample_count_; }
 
+	/** 
+	 * set sample count par pixel
+	 */
+	void set_sample_count(int count) { sample_count_ = count; }
+
 	/**
 	 * get super sampling
 	 */
 	UMVec2i super_sampling_count() const { return super_sampling_count_; }
 
+	/**
+	 * set super sampling
+	 */
+	void set_super_sampling_count(const UMVec2i& count) { super_sampling_count_ = count; }
+
+	/**
+	 * get light sample count per shading point
+	 */
+	int light_sample_count() const { return light_sample_count_; }
+
+	/**
+	 * set light sample count per shading point
+	 */
+	void set_light_sample_count(int count) { light_sample_count_ = count; }
+
+	/**
+	 * get light sampling type
+	 */
+	UMLightSampler::SamplingType light_sampling_type() const { return light_sampling_type_; }
+
+	/**
+	 * set light sampling type
+	 */
+	void set_light_sampling_type(UMLightSampler::SamplingType type) { light_sampling_type_ = type; }
+
+	/**
+	 * is denoise enabled
+	 */
+	bool is_denoise_enabled() const { return is_denoise_enabled_; }
+
+	/**
+	 * set denoise enabled.
+	 * enables albedo, normal and depth layers for the denoiser.
+	 */
+	void set_denoise_enabled(bool enabled) 
+	{
+		is_denoise_enabled_ = enabled;
+		if (enabled)
+		{
+			frame_buffer_.set_layer_enabled(UMFrameBuffer::eLayerAlbedo, true);
+			frame_buffer_.set_layer_enabled(UMFrameBuffer::eLayerNormal, true);
+			frame_buffer_.set_layer_enabled(UMFrameBuffer::eLayerDepth, true);
+		}
+	}
+
+	/**
+	 * is irradiance cache enabled
+	 */
+	bool is_irradiance_cache_enabled() const { return is_irradiance_cache_enabled_; }
+
+	/**
+	 * set irradiance cache enabled.
+	 * indirect diffuse at secondary bounces is interpolated from the cache.
+	 */
+	void set_irradiance_cache_enabled(bool enabled) { is_irradiance_cache_enabled_ = enabled; }
+
+	/**
+	 * get irradiance cache accuracy
+	 */
+	double irradiance_cache_accuracy() const { return irradiance_cache_accuracy_; }
+
+	/**
+	 * set irradiance cache accuracy. smaller value makes more records.
+	 */
+	void set_irradiance_cache_accuracy(double accuracy) { irradiance_cache_accuracy_ = accuracy; }
+
+	/**
+	 * get denoiser
+	 */
+	UMDenoiser& denoiser() { return denoiser_; }
+
+	/**
+	 * get framebuffer
+	 */
+	UMFrameBuffer& frame_buffer() { return frame_buffer_; }
+
+	/**
+	 * get framebuffer
+	 */
+	const UMFrameBuffer& frame_buffer() const { return frame_buffer_; }
+
+	/**
+	 * is output layer enabled
+	 */
+	bool is_layer_enabled(UMFrameBuffer::LayerType type) const { return frame_buffer_.is_layer_enabled(type); }
+
+	/**
+	 * set output layer enabled
+	 */
+	void set_layer_enabled(UMFrameBuffer::LayerType type, bool enabled) { frame_buffer_.set_layer_enabled(type, enabled); }
+
+	/**
+	 * init framebuffer
+	 */
+	bool init_frame_buffer(int width, int height) { return frame_buffer_.init(width, height); }
+
+	/**
+	 * create image of an output layer
+	 * @retval image or empty pointer when the layer is disabled
+	 */
+	UMImagePtr create_layer_image(UMFrameBuffer::LayerType type) const
+	{
+		UMImagePtr image(std::make_shared<UMImage>());
+		if (frame_buffer_.resolve(type, image))
+		{
+			return image;
+		}
+		return UMImagePtr();
+	}
+
+	/**
+	 * denoise output image by albedo, normal and depth layers
+	 * @param [in] rect x, y, width, height of rendered pixels. see render_rect.
+	 * @retval success or failed
+	 */
+	bool denoise(const UMVec4i& rect) 
+	{
+		return denoiser_.denoise(output_image_, frame_buffer_, rect);
+	}
+
+	/**
+	 * denoise a copy of output image into display image.
+	 * output image keeps accumulated samples for following passes.
+	 * @param [in] rect x, y, width, height of rendered pixels. see render_rect.
+	 * @retval success or failed
+	 */
+	bool denoise_display(const UMVec4i& rect)
+	{
+		if (!display_image_)
+		{
+			display_image_ = std::make_shared<UMImage>();
+		}
+		if (display_image_->width() != output_image_->width() || 
+			display_image_->height() != output_image_->height())
+		{
+			display_image_->init(output_image_->width(), output_image_->height());
+		}
+		display_image_->mutable_list() = output_image_->list();
+		return denoiser_.denoise(display_image_, frame_buffer_, rect);
+	}
+
+	/**
+	 * get bucket order
+	 */
+	UMBucketOrder::OrderType bucket_order() const { return bucket_order_; }
+
+	/**
+	 * set bucket order
+	 */
+	void set_bucket_order(UMBucketOrder::OrderType order) { bucket_order_ = order; }
+
+	/**
+	 * get bucket size
+	 */
+	int bucket_size() const { return bucket_size_; }
+
+	/**
+	 * set bucket size
+	 */
+	void set_bucket_size(int size) { bucket_size_ = size; }
+
+	/**
+	 * get crop window (x, y, width, height)
+	 */
+	const UMVec4i& crop_window() const { return crop_window_; }
+
+	/**
+	 * set crop window (x, y, width, height).
+	 * only the window is rendered. zero size window renders full image.
+	 */
+	void set_crop_window(const UMVec4i& window) { crop_window_ = window; }
+
+	/**
+	 * has crop window
+	 */
+	bool has_crop_window() const { return crop_window_.z > 0 && crop_window_.w > 0; }
+
+	/**
+	 * get rendering rectangle (x, y, width, height) clipped by crop window
+	 */
+	UMVec4i render_rect(int width, int height) const
+	{
+		if (!has_crop_window()) return UMVec4i(0, 0, width, height);
+		const int x0 = std::max(crop_window_.x, 0);
+		const int y0 = std::max(crop_window_.y, 0);
+		const int x1 = std::min(crop_window_.x + crop_window_.z, width);
+		const int y1 = std::min(crop_window_.y + crop_window_.w, height);
+		return UMVec4i(x0, y0, std::max(x1 - x0, 0), std::max(y1 - y0, 0));
+	}
+
+	/**
+	 * create ordered buckets in rendering rectangle
+	 */
+	bool create_buckets(UMBucketList& buckets, int width, int height) const
+	{
+		return UMBucketOrder::create_buckets(buckets, render_rect(width, height), bucket_size_, bucket_order_);
+	}
+
+	/**
+	 * get checkpoint file path
+	 */
+	const umstring& checkpoint_path() const { return checkpoint_path_; }
+
+	/**
+	 * set checkpoint file path
+	 */
+	void set_checkpoint_path(const umstring& path) { checkpoint_path_ = path; }
+
+	/**
+	 * get passes between checkpoints of progressive rendering
+	 */
+	int checkpoint_interval() const { return checkpoint_interval_; }
+
+	/**
+	 * set passes between checkpoints of progressive rendering. 0 disables checkpoints.
+	 */
+	void set_checkpoint_interval(int passes) { checkpoint_interval_ = passes; }
+
 	/**
 	 * get osl file path(test)
 	 */
@@ -69,12 +325,36 @@ public:
 	 */ 
 	void set_osl_filepath(const umstring& path) { osl_filepath_ = path; }
 	
+	/**
+	 * get rendering statistics
+	 */
+	UMRenderStatistics& statistics() { return statistics_; }
+
+	/**
+	 * get rendering statistics
+	 */
+	const UMRenderStatistics& statistics() const { return statistics_; }
+
 private:
 	UMImagePtr output_image_;
+	UMImagePtr display_image_;
 	//UMImagePtr temporary_image_;
 	int sample_count_;
+	int light_sample_count_;
+	UMLightSampler::SamplingType light_sampling_type_;
+	bool is_denoise_enabled_;
+	bool is_irradiance_cache_enabled_;
+	double irradiance_cache_accuracy_;
+	UMDenoiser denoiser_;
+	UMFrameBuffer frame_buffer_;
+	UMBucketOrder::OrderType bucket_order_;
+	int bucket_size_;
+	UMVec4i crop_window_;
+	umstring checkpoint_path_;
+	int checkpoint_interval_;
 	UMVec2i super_sampling_count_;
 	umstring osl_filepath_;
+	UMRenderStatistics statistics_;
 };
 
 } // umrt
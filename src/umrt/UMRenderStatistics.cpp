@@ -0,0 +1,214 @@
+/**
+ * @file UMRenderStatistics.cpp
+ * rendering statistics
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMRenderStatistics.h"
+
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+
+#ifdef _OPENMP
+	#include <omp.h>
+#endif
+
+#include "UMTime.h"
+
+namespace
+{
+	const size_t cache_line_size = 64;
+
+	/// counter size rounded up to cache lines, so that threads never share a line
+	const size_t counter_stride =
+		((sizeof(umrt::UMRenderStatistics::ThreadCounter) + cache_line_size - 1) / cache_line_size) * cache_line_size;
+
+	int max_thread_count()
+	{
+#ifdef _OPENMP
+		return std::max(1, omp_get_max_threads());
+#else
+		return 1;
+#endif
+	}
+
+	int current_thread()
+	{
+#ifdef _OPENMP
+		return omp_get_thread_num();
+#else
+		return 0;
+#endif
+	}
+
+} // anonymouse namespace
+
+namespace umrt
+{
+
+/**
+ * constructor
+ */
+UMRenderStatistics::UMRenderStatistics()
+	: counter_offset_(0)
+	, thread_count_(0)
+	, pass_start_seconds_(0)
+	, pass_count_(0)
+	, shading_seconds_(0)
+	, bvh_build_seconds_(0)
+	, setup_seconds_(0)
+	, resolve_seconds_(0)
+{
+	reset();
+}
+
+/**
+ * clear all statistics
+ */
+void UMRenderStatistics::reset()
+{
+	const int thread_count = max_thread_count();
+	counter_buffer_.assign(thread_count * counter_stride + cache_line_size, 0);
+	const size_t address = reinterpret_cast<size_t>(&counter_buffer_[0]);
+	counter_offset_ = (cache_line_size - address % cache_line_size) % cache_line_size;
+	thread_count_ = thread_count;
+	for (int i = 0; i < thread_count; ++i)
+	{
+		new (&counter_buffer_[counter_offset_ + i * counter_stride]) ThreadCounter();
+	}
+	pass_busy_seconds_.assign(thread_count, 0.0);
+	pass_start_seconds_ = 0;
+	pass_count_ = 0;
+	shading_seconds_ = 0;
+	bvh_build_seconds_ = 0;
+	setup_seconds_ = 0;
+	resolve_seconds_ = 0;
+}
+
+/**
+ * get counters of a thread
+ */
+UMRenderStatistics::ThreadCounter& UMRenderStatistics::counter_at(int thread)
+{
+	return *reinterpret_cast<ThreadCounter*>(&counter_buffer_[counter_offset_ + thread * counter_stride]);
+}
+
+/**
+ * get counters of a thread
+ */
+const UMRenderStatistics::ThreadCounter& UMRenderStatistics::counter_at(int thread) const
+{
+	return *reinterpret_cast<const ThreadCounter*>(&counter_buffer_[counter_offset_ + thread * counter_stride]);
+}
+
+/**
+ * get counters of a thread
+ */
+const UMRenderStatistics::ThreadCounter& UMRenderStatistics::thread_counter(int thread) const
+{
+	if (thread < 0 || thread >= thread_count_)
+	{
+		throw std::out_of_range("UMRenderStatistics::thread_counter");
+	}
+	return counter_at(thread);
+}
+
+/**
+ * get counters of the calling thread
+ */
+UMRenderStatistics::ThreadCounter& UMRenderStatistics::current_thread_counter()
+{
+	const int thread = std::min(current_thread(), thread_count() - 1);
+	return counter_at(thread);
+}
+
+/**
+ * start a render pass
+ */
+void UMRenderStatistics::begin_pass()
+{
+	for (int i = 0, size = thread_count(); i < size; ++i)
+	{
+		pass_busy_seconds_[i] = counter_at(i).busy_seconds;
+	}
+	pass_start_seconds_ = umbase::UMTime::current_seconds();
+}
+
+/**
+ * end a render pass
+ */
+void UMRenderStatistics::end_pass()
+{
+	const double pass_seconds = umbase::UMTime::current_seconds() - pass_start_seconds_;
+	for (int i = 0, size = thread_count(); i < size; ++i)
+	{
+		ThreadCounter& counter = counter_at(i);
+		const double busy = counter.busy_seconds - pass_busy_seconds_[i];
+		counter.idle_seconds += std::max(0.0, pass_seconds - busy);
+	}
+	shading_seconds_ += pass_seconds;
+	++pass_count_;
+}
+
+/**
+ * get number of camera rays
+ */
+unsigned long long UMRenderStatistics::primary_ray_count() const
+{
+	unsigned long long count = 0;
+	for (int i = 0, size = thread_count(); i < size; ++i)
+	{
+		count += counter_at(i).primary_ray_count;
+	}
+	return count;
+}
+
+/**
+ * get number of shadow rays
+ */
+unsigned long long UMRenderStatistics::shadow_ray_count() const
+{
+	unsigned long long count = 0;
+	for (int i = 0, size = thread_count(); i < size; ++i)
+	{
+		count += counter_at(i).shadow_ray_count;
+	}
+	return count;
+}
+
+/**
+ * get number of secondary rays
+ */
+unsigned long long UMRenderStatistics::indirect_ray_count() const
+{
+	unsigned long long count = 0;
+	for (int i = 0, size = thread_count(); i < size; ++i)
+	{
+		count += counter_at(i).indirect_ray_count;
+	}
+	return count;
+}
+
+/**
+ * get number of all rays
+ */
+unsigned long long UMRenderStatistics::ray_count() const
+{
+	return primary_ray_count() + shadow_ray_count() + indirect_ray_count();
+}
+
+/**
+ * get rays per second
+ */
+double UMRenderStatistics::rays_per_second() const
+{
+	if (shading_seconds_ <= 0.0) return 0.0;
+	return ray_count() / shading_seconds_;
+}
+
+} // umrt
@@ -0,0 +1,168 @@
+/**
+ * @file UMRenderStatistics.h
+ * rendering statistics
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <vector>
+#include "UMMacro.h"
+
+namespace umrt
+{
+
+/**
+ * rendering statistics.
+ * ray counts are kept per thread, so threads count rays without locks.
+ * progressive render updates this at every pass.
+ */
+class UMRenderStatistics
+{
+	DISALLOW_COPY_AND_ASSIGN(UMRenderStatistics);
+public:
+	/**
+	 * counters of a thread
+	 */
+	class ThreadCounter
+	{
+	public:
+		ThreadCounter()
+			: primary_ray_count(0)
+			, shadow_ray_count(0)
+			, indirect_ray_count(0)
+			, busy_seconds(0)
+			, idle_seconds(0)
+		{}
+
+		unsigned long long primary_ray_count;
+		unsigned long long shadow_ray_count;
+		unsigned long long indirect_ray_count;
+		/// seconds working in render passes
+		double busy_seconds;
+		/// seconds waiting for other threads in render passes
+		double idle_seconds;
+	};
+
+	UMRenderStatistics();
+
+	~UMRenderStatistics() {}
+
+	/**
+	 * clear all statistics and prepare counters for threads
+	 */
+	void reset();
+
+	/**
+	 * get number of thread counters
+	 */
+	int thread_count() const { return thread_count_; }
+
+	/**
+	 * get counters of a thread
+	 */
+	const ThreadCounter& thread_counter(int thread) const;
+
+	/**
+	 * get counters of the calling thread
+	 */
+	ThreadCounter& current_thread_counter();
+
+	/**
+	 * start a render pass
+	 */
+	void begin_pass();
+
+	/**
+	 * end a render pass.
+	 * idle time of threads is the pass time which is not busy.
+	 */
+	void end_pass();
+
+	/**
+	 * get number of render passes
+	 */
+	int pass_count() const { return pass_count_; }
+
+	/**
+	 * get number of camera rays
+	 */
+	unsigned long long primary_ray_count() const;
+
+	/**
+	 * get number of shadow rays
+	 */
+	unsigned long long shadow_ray_count() const;
+
+	/**
+	 * get number of secondary rays
+	 */
+	unsigned long long indirect_ray_count() const;
+
+	/**
+	 * get number of all rays
+	 */
+	unsigned long long ray_count() const;
+
+	/**
+	 * get rays per second in render passes
+	 */
+	double rays_per_second() const;
+
+	/**
+	 * get seconds of tracing and shading passes
+	 */
+	double shading_seconds() const { return shading_seconds_; }
+
+	/**
+	 * get seconds of bvh build
+	 */
+	double bvh_build_seconds() const { return bvh_build_seconds_; }
+
+	/**
+	 * set seconds of bvh build
+	 */
+	void set_bvh_build_seconds(double seconds) { bvh_build_seconds_ = seconds; }
+
+	/**
+	 * get seconds to prepare camera and framebuffer
+	 */
+	double setup_seconds() const { return setup_seconds_; }
+
+	/**
+	 * add seconds to prepare camera and framebuffer
+	 */
+	void add_setup_seconds(double seconds) { setup_seconds_ += seconds; }
+
+	/**
+	 * get seconds of resolve and denoise
+	 */
+	double resolve_seconds() const { return resolve_seconds_; }
+
+	/**
+	 * add seconds of resolve and denoise
+	 */
+	void add_resolve_seconds(double seconds) { resolve_seconds_ += seconds; }
+
+private:
+	ThreadCounter& counter_at(int thread);
+	const ThreadCounter& counter_at(int thread) const;
+
+	/// counters of threads placed at cache line boundaries
+	std::vector<char> counter_buffer_;
+	size_t counter_offset_;
+	int thread_count_;
+	std::vector<double> pass_busy_seconds_;
+	double pass_start_seconds_;
+	int pass_count_;
+	double shading_seconds_;
+	double bvh_build_seconds_;
+	double setup_seconds_;
+	double resolve_seconds_;
+};
+
+} // umrt
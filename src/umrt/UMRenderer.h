@@ -84,7 +84,43 @@ public:
 	 * @retval true still render
 	 * @retval false render finished or failed
 	 */
-	virtual bool progress_render(UMSceneAccessPtr scene, UMRenderParameter& parameter){ return false; }
+	virtual bool progress_render(UMSceneAccessPtr, UMRenderParameter&){ return false; }
+
+	/**
+	 * save progressive rendering state to a checkpoint file
+	 * @param [in] path checkpoint file path
+	 * @param [in] parameter parameters for rendering
+	 * @retval success or failed
+	 */
+	virtual bool save_checkpoint(const umstring&, const UMRenderParameter&) const { return false; }
+
+	/**
+	 * resume progressive rendering from a checkpoint file.
+	 * following progress_render calls continue where the checkpoint was saved.
+	 * fails when parameters differ from the checkpoint except a raised sample count.
+	 * @param [in] path checkpoint file path
+	 * @param [in,out] parameter parameters for rendering. framebuffer is restored from the checkpoint.
+	 * @retval success or failed
+	 */
+	virtual bool resume(const umstring&, UMRenderParameter&) { return false; }
+
+	/**
+	 * interactive render.
+	 * renders until time slice expires and returns, next call continues from there.
+	 * starts from 1/8 resolution, refines resolution up to full,
+	 * then accumulates samples at full resolution.
+	 * @param [in] scene target scene
+	 * @param [in,out] parameter parameters for rendering
+	 * @param [in] time_slice seconds for this call
+	 * @retval true output image is updated
+	 * @retval false render finished or failed
+	 */
+	virtual bool interactive_render(UMSceneAccessPtr, UMRenderParameter&, double) { return false; }
+
+	/**
+	 * restart interactive render from the lowest resolution
+	 */
+	virtual void restart() {}
 
 	/**
 	 * OpenShadingLanguage render service
@@ -9,6 +9,10 @@
  */
 #include "UMSceneAccess.h"
 #include <string>
+#include <map>
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
 #include <assert.h>
 #include "UMMesh.h"
 #include "UMMeshGroup.h"
@@ -21,11 +25,21 @@
 #include "UMTriangle.h"
 #include "UMBvh.h"
 #include "UMSubdivision.h"
+#include "UMLightSampler.h"
+#include "UMPointCloud.h"
+#include "UMCurve.h"
+#include "UMNurbsPatch.h"
+#include "UMSubdivisionPatch.h"
+#include "UMTime.h"
+#include "UMStringUtil.h"
 
 #ifdef WITH_ALEMBIC
 	#include "UMAbcScene.h"
 	#include "UMAbcObject.h"
 	#include "UMAbcMesh.h"
+	#include "UMAbcPoint.h"
+	#include "UMAbcCurve.h"
+	#include "UMAbcNurbsPatch.h"
 	#include "UMAbcIO.h"
 #endif //WITH_ALEMBIC
 
@@ -35,9 +49,71 @@ namespace
 	using namespace umdraw;
 	using namespace umrt;
 
+	/// bytes of resident tessellation unless set by geometry_cache()->set_capacity
+	const size_t default_geometry_cache_size = 256 * 1024 * 1024;
+
+	/**
+	 * get mip-mapped texture of a material. mip levels are built at first use.
+	 * texture of a material image is found by image id, texture of an image file by path.
+	 */
+	UMTexturePtr find_or_create_texture(UMTextureLibrary& texture_library, UMMaterialPtr material)
+	{
+		if (!material) return UMTexturePtr();
+		if (!material->texture_list().empty())
+		{
+			umimage::UMImagePtr image = material->texture_list()[0];
+			if (!image) return UMTexturePtr();
+
+			UMTextureMap::iterator it = texture_library.image_texture_map.find(image->id());
+			if (it != texture_library.image_texture_map.end())
+			{
+				return it->second;
+			}
+			UMTexturePtr texture = UMTexture::create(image);
+			if (texture)
+			{
+				texture_library.image_texture_map[image->id()] = texture;
+			}
+			return texture;
+		}
+		// image is not loaded. e.g. scenes loaded without gl.
+		if (material->texture_path_list().empty()) return UMTexturePtr();
+		const umstring& path = material->texture_path_list()[0];
+		UMTexturePathMap::iterator it = texture_library.path_texture_map.find(path);
+		if (it != texture_library.path_texture_map.end())
+		{
+			return it->second;
+		}
+		UMTexturePtr texture = UMTexture::create(path, texture_library.image_loader);
+		if (texture)
+		{
+			texture_library.path_texture_map[path] = texture;
+		}
+		return texture;
+	}
+
+	/**
+	 * remove material textures which have mip-mapped texture
+	 */
+	void release_texture_images(const UMTextureLibrary& texture_library, const UMMaterialList& material_list)
+	{
+		const UMTextureMap& texture_map = texture_library.image_texture_map;
+		for (UMMaterialList::const_iterator it = material_list.begin(); it != material_list.end(); ++it)
+		{
+			UMMaterialPtr material = *it;
+			if (material->texture_list().empty()) continue;
+			umimage::UMImagePtr image = material->texture_list()[0];
+			if (image && texture_map.find(image->id()) != texture_map.end())
+			{
+				material->mutable_texture_list().clear();
+			}
+		}
+	}
+
 	void create_triangle_and_vertex(
 		UMPrimitiveList& primitive_list, 
 		UMVertexParameterList& vertex_parameter_list,
+		UMTextureLibrary& texture_library,
 		UMMeshPtr mesh)
 	{
 		const size_t vertex_count = mesh->vertex_list().size();
@@ -58,6 +134,7 @@ namespace
 			{
 				UMVec3i face(i * 3 + 0, i * 3 + 1, i * 3 + 2);
 				UMTrianglePtr triangle(UMTriangle::create(mesh, face, i));
+				triangle->set_texture(find_or_create_texture(texture_library, mesh->material_from_face_index(i)));
 				primitive_list.at(start_index + i) = triangle;
 
 				for (int k = 0; k < 3; ++k)
@@ -76,6 +153,7 @@ namespace
 			{
 				const UMVec3i& face = mesh->face_list().at(i);
 				UMTrianglePtr triangle(UMTriangle::create(mesh, face, i));
+				triangle->set_texture(find_or_create_texture(texture_library, mesh->material_from_face_index(i)));
 				primitive_list.at(start_index + i) = triangle;
 
 				for (int k = 0; k < 3; ++k)
@@ -92,6 +170,7 @@ namespace
 	void create_triangle_and_vertex_from_abc_mesh(
 		UMPrimitiveList& primitive_list, 
 		UMVertexParameterList& vertex_parameter_list,
+		UMTextureLibrary& texture_library,
 		UMAbcMeshPtr mesh)
 	{
 		const size_t vertex_count = mesh->vertex()->size();
@@ -113,6 +192,7 @@ namespace
 				const UMVec3i face(i * 3 + 0, i * 3 + 2, i * 3 + 1);
 				const UMVec3i iface(face.x, face.y, face.z);
 				UMTrianglePtr triangle(UMTriangle::create_from_abc_mesh(mesh, iface, i));
+				triangle->set_texture(find_or_create_texture(texture_library, mesh->material_from_face_index(i)));
 				primitive_list.at(start_index + i) = triangle;
 
 				for (int k = 0; k < 3; ++k)
@@ -132,6 +212,7 @@ namespace
 				const UMVec3ui& face = mesh->triangle_index().at(i);
 				const UMVec3i iface(face.x, face.z, face.y);
 				UMTrianglePtr triangle(UMTriangle::create_from_abc_mesh(mesh, iface, i));
+				triangle->set_texture(find_or_create_texture(texture_library, mesh->material_from_face_index(i)));
 				primitive_list.at(start_index + i) = triangle;
 
 				for (int k = 0; k < 3; ++k)
@@ -148,16 +229,36 @@ namespace
 		umabc::UMAbcMeshList& dst_abc_mesh_list, 
 		UMPrimitiveList& primitive_list, 
 		UMVertexParameterList& vertex_parameter_list,
+		UMTextureLibrary& texture_library,
+		UMGeometryCachePtr geometry_cache,
 		UMAbcObjectPtr object)
 	{
 		if (UMAbcMeshPtr mesh = std::dynamic_pointer_cast<UMAbcMesh>(object))
 		{
 			//if (umdraw::UMMeshPtr draw_mesh = umabc::UMAbcIO::convert_abc_mesh_to_mesh(mesh))
 			{
-				create_triangle_and_vertex_from_abc_mesh(primitive_list, vertex_parameter_list, mesh);
+				create_triangle_and_vertex_from_abc_mesh(primitive_list, vertex_parameter_list, texture_library, mesh);
 				dst_abc_mesh_list.push_back(mesh);
 			}
 		}
+		else if (UMAbcPointPtr point = std::dynamic_pointer_cast<UMAbcPoint>(object))
+		{
+			// points are not tessellated. one primitive has all points.
+			primitive_list.push_back(UMPointCloud::create_from_abc_point(point, UMPointCloud::eSphere));
+		}
+		else if (UMAbcCurvePtr curve = std::dynamic_pointer_cast<UMAbcCurve>(object))
+		{
+			// curves are not tessellated. one primitive has all curves.
+			primitive_list.push_back(UMCurve::create_from_abc_curve(curve, UMCurve::eRibbon));
+		}
+		else if (UMAbcNurbsPatchPtr patch = std::dynamic_pointer_cast<UMAbcNurbsPatch>(object))
+		{
+			// patches are tessellated when a ray reaches them
+			if (UMNurbsPatchPtr nurbs_patch = UMNurbsPatch::create_from_abc_nurbs_patch(patch, geometry_cache))
+			{
+				primitive_list.push_back(nurbs_patch);
+			}
+		}
 		UMAbcObjectList::const_iterator it = object->children().begin();
 		for (; it != object->children().end(); ++it)
 		{
@@ -165,6 +266,8 @@ namespace
 				dst_abc_mesh_list,
 				primitive_list, 
 				vertex_parameter_list,
+				texture_library,
+				geometry_cache,
 				*it);
 		}
 	}
@@ -174,6 +277,96 @@ namespace
 	{
 		return false;
 	}
+
+	/**
+	 * pixels of unit length at unit distance from camera
+	 */
+	double screen_pixel_scale(umdraw::UMScenePtr scene, umdraw::UMCameraPtr camera)
+	{
+		return scene->height() / (2.0 * tan(umbase::um_to_radian(camera->fov_y() * 0.5)));
+	}
+
+	/**
+	 * average length of edges of a mesh
+	 */
+	double average_edge_length(UMMeshPtr mesh)
+	{
+		const UMMesh::Vec3dList& vertex_list = mesh->vertex_list();
+		const UMMesh::Vec3iList& face_list = mesh->face_list();
+		if (face_list.empty()) return 0.0;
+		double length = 0.0;
+		for (UMMesh::Vec3iList::const_iterator it = face_list.begin(); it != face_list.end(); ++it)
+		{
+			const UMVec3d& v0 = vertex_list.at(it->x);
+			const UMVec3d& v1 = vertex_list.at(it->y);
+			const UMVec3d& v2 = vertex_list.at(it->z);
+			length += (v1 - v0).length() + (v2 - v1).length() + (v0 - v2).length();
+		}
+		return length / (face_list.size() * 3);
+	}
+
+	/**
+	 * distance from a point to a box. 0 is inside.
+	 */
+	double box_distance(const umbase::UMBox& box, const UMVec3d& p)
+	{
+		UMVec3d d(0);
+		for (int i = 0; i < 3; ++i)
+		{
+			if (p[i] < box.minimum()[i]) d[i] = box.minimum()[i] - p[i];
+			else if (p[i] > box.maximum()[i]) d[i] = p[i] - box.maximum()[i];
+		}
+		return d.length();
+	}
+
+	/**
+	 * whether a box is behind camera
+	 */
+	bool is_behind(const umbase::UMBox& box, const UMVec3d& position, const UMVec3d& direction)
+	{
+		for (int i = 0; i < 8; ++i)
+		{
+			const UMVec3d corner(
+				box[(i >> 0) & 1].x,
+				box[(i >> 1) & 1].y,
+				box[(i >> 2) & 1].z);
+			if ((corner - position).dot(direction) > 0.0) return false;
+		}
+		return true;
+	}
+
+	/**
+	 * same vertices or not
+	 */
+	bool is_same_vertex_list(const UMMesh::Vec3dList& a, const UMMesh::Vec3dList& b)
+	{
+		if (a.size() != b.size()) return false;
+		for (size_t i = 0, size = a.size(); i < size; ++i)
+		{
+			if (a[i].x != b[i].x || a[i].y != b[i].y || a[i].z != b[i].z) return false;
+		}
+		return true;
+	}
+
+	/**
+	 * a mesh to be subdivided adaptively
+	 */
+	struct UMAdaptiveMesh
+	{
+		/// mesh in the scene. base mesh or its subdivided mesh.
+		UMMeshPtr mesh;
+		/// mesh before subdivision
+		UMMeshPtr base_mesh;
+		/// subdivision of base mesh
+		UMSubdivisionPtr subdivision;
+		/// average edge length on screen at level 0
+		double pixels;
+		unsigned int level;
+
+		/// triangles at current level
+		size_t refined_count() const { return subdivision->triangle_count(level); }
+	};
+	typedef std::vector<UMAdaptiveMesh> UMAdaptiveMeshList;
 }
 
 namespace umrt
@@ -184,8 +377,13 @@ namespace umrt
  * constructor
  */
 UMSceneAccess::UMSceneAccess()
+	: bvh_build_seconds_(0)
 {
 	bvh_ = UMBvh::create();
+	light_sampler_ = UMLightSampler::create();
+	geometry_cache_ = UMGeometryCache::create();
+	geometry_cache_->set_capacity(default_geometry_cache_size);
+	tessellation_setting_ = std::make_shared<UMTessellationSetting>();
 }
 
 /**
@@ -196,6 +394,9 @@ bool UMSceneAccess::init()
 	mutable_render_primitive_list().clear();
 	mutable_vertex_parameter_list().clear();
 	mutable_primitive_list().clear();
+	texture_library_.image_texture_map.clear();
+	texture_library_.path_texture_map.clear();
+	subdivided_mesh_map_.clear();
 	return true;
 }
 
@@ -221,6 +422,7 @@ void UMSceneAccess::add_scene(umdraw::UMScenePtr scene)
 			create_triangle_and_vertex(
 				mutable_primitive_list(), 
 				mutable_vertex_parameter_list(),
+				texture_library_,
 				mesh);
 		}
 	}
@@ -240,6 +442,8 @@ void UMSceneAccess::add_abc_scene(umabc::UMAbcScenePtr scene)
 			abc_mesh_list_,
 			mutable_primitive_list(), 
 			mutable_vertex_parameter_list(),
+			texture_library_,
+			geometry_cache_,
 			root);
 	}
 	abc_scene_ = scene;
@@ -247,6 +451,31 @@ void UMSceneAccess::add_abc_scene(umabc::UMAbcScenePtr scene)
 #endif
 }
 
+/**
+ * release source images of textures
+ */
+void UMSceneAccess::release_texture_images()
+{
+	if (scene_)
+	{
+		const UMMeshGroupList& group_list = scene_->mesh_group_list();
+		for (UMMeshGroupList::const_iterator it = group_list.begin(); it != group_list.end(); ++it)
+		{
+			const UMMeshList& mesh_list = (*it)->mesh_list();
+			for (UMMeshList::const_iterator mt = mesh_list.begin(); mt != mesh_list.end(); ++mt)
+			{
+				::release_texture_images(texture_library_, (*mt)->material_list());
+			}
+		}
+	}
+#ifdef WITH_ALEMBIC
+	for (umabc::UMAbcMeshList::const_iterator it = abc_mesh_list_.begin(); it != abc_mesh_list_.end(); ++it)
+	{
+		::release_texture_images(texture_library_, (*it)->material_list());
+	}
+#endif
+}
+
 /**
  * subdivide mesh
  */
@@ -254,30 +483,305 @@ bool UMSceneAccess::subdivide(unsigned int id, unsigned int level)
 {
 	if (id == 0) return false;
 	if (level == 0) return false;
+	if (!scene_) return false;
 
-	if (scene_)
+	// mesh in the scene and its base mesh. id of a base mesh finds its subdivided mesh.
+	UMMeshPtr mesh;
+	UMMeshPtr base_mesh;
+	SubdividedMeshMap::iterator st = subdivided_mesh_map_.find(id);
+	if (st != subdivided_mesh_map_.end())
+	{
+		base_mesh = st->second.base_mesh;
+		mesh = st->second.divided_mesh ? st->second.divided_mesh : base_mesh;
+	}
+	else
 	{
-		umdraw::UMMeshGroupList::iterator it = scene_->mutable_mesh_group_list().begin();
-		for (; it != scene_->mutable_mesh_group_list().end(); ++it)
+		umdraw::UMMeshGroupList::const_iterator it = scene_->mesh_group_list().begin();
+		for (; it != scene_->mesh_group_list().end() && !mesh; ++it)
 		{
-			umdraw::UMMeshGroupPtr group = *it;
-			umdraw::UMMeshList::iterator mt = group->mutable_mesh_list().begin();
-			for (; mt != group->mutable_mesh_list().end(); ++mt)
+			const umdraw::UMMeshList& mesh_list = (*it)->mesh_list();
+			umdraw::UMMeshList::const_iterator mt = mesh_list.begin();
+			for (; mt != mesh_list.end(); ++mt)
 			{
-				umdraw::UMMeshPtr mesh = *mt;
-				if (mesh->id() == id)
+				if ((*mt)->id() == id)
 				{
-					UMSubdivision subdiv(mesh);
-					if (umdraw::UMMeshPtr divided_mesh = subdiv.subdivided_mesh(level))
-					{
-						(*mt) = divided_mesh;
-						return true;
-					}
+					mesh = base_mesh = *mt;
+					break;
 				}
 			}
 		}
+		for (st = subdivided_mesh_map_.begin(); st != subdivided_mesh_map_.end(); ++st)
+		{
+			if (mesh && st->second.divided_mesh == mesh)
+			{
+				base_mesh = st->second.base_mesh;
+			}
+		}
 	}
-	return false;
+	if (!mesh) return false;
+
+	SubdividedMesh& subdivided = subdivided_mesh_map_[base_mesh->id()];
+	if (subdivided.divided_mesh && subdivided.level == level) return true;
+	UMMeshPtr divided_mesh = subdivide_base_mesh(subdivided, base_mesh, level);
+	if (!divided_mesh) return false;
+	replace_mesh(mesh, divided_mesh);
+	return true;
+}
+
+/**
+ * get kept subdivision of a base mesh.
+ * refinement tables of the mesh are built once and shared by all levels.
+ */
+UMSubdivisionPtr UMSceneAccess::subdivision_of(SubdividedMesh& subdivided, UMMeshPtr base_mesh)
+{
+	if (!subdivided.subdivision)
+	{
+		subdivided.base_mesh = base_mesh;
+		subdivided.subdivision = std::make_shared<UMSubdivision>(base_mesh);
+	}
+	return subdivided.subdivision;
+}
+
+/**
+ * subdivide a base mesh by its kept subdivision
+ */
+UMMeshPtr UMSceneAccess::subdivide_base_mesh(SubdividedMesh& subdivided, UMMeshPtr base_mesh, unsigned int level)
+{
+	UMMeshPtr divided_mesh = subdivision_of(subdivided, base_mesh)->subdivided_mesh(level);
+	if (!divided_mesh) return divided_mesh;
+	divided_mesh->set_name(base_mesh->name());
+	subdivided.divided_mesh = divided_mesh;
+	subdivided.level = level;
+	subdivided.refined_vertex_list = base_mesh->vertex_list();
+	return divided_mesh;
+}
+
+/**
+ * subdivide mesh on demand
+ */
+bool UMSceneAccess::subdivide_on_demand(unsigned int id, unsigned int max_level)
+{
+	if (id == 0) return false;
+	return replace_with_patches(id, max_level);
+}
+
+/**
+ * subdivide all meshes on demand
+ */
+bool UMSceneAccess::subdivide_on_demand(unsigned int max_level)
+{
+	return replace_with_patches(0, max_level);
+}
+
+/**
+ * replace triangles of a mesh with patches.
+ * patches of earlier call are replaced by new ones, and only their tessellation is dropped.
+ * @param [in] id mesh id. 0 is all meshes.
+ */
+bool UMSceneAccess::replace_with_patches(unsigned int id, unsigned int max_level)
+{
+	bool is_replaced = false;
+	// one-rings of faces by mesh
+	std::map<unsigned int, UMSubdivisionPtr> subdivision_map;
+	UMSubdivisionRing ring;
+	UMPrimitiveList::iterator it = mutable_primitive_list().begin();
+	for (; it != mutable_primitive_list().end(); ++it)
+	{
+		UMTrianglePtr triangle = std::dynamic_pointer_cast<UMTriangle>(*it);
+		UMSubdivisionPatchPtr old_patch;
+		if (!triangle)
+		{
+			old_patch = std::dynamic_pointer_cast<UMSubdivisionPatch>(*it);
+			if (!old_patch) continue;
+			triangle = old_patch->triangle();
+		}
+		UMMeshPtr mesh = triangle->mesh();
+		if (!mesh) continue;
+		if (id != 0 && mesh->id() != id) continue;
+		UMSubdivisionPtr& subdivision = subdivision_map[mesh->id()];
+		if (!subdivision)
+		{
+			subdivision = std::make_shared<UMSubdivision>(mesh);
+		}
+		if (!subdivision->face_ring(triangle->face_index(), ring)) continue;
+		if (UMSubdivisionPatchPtr patch = UMSubdivisionPatch::create(
+			triangle, ring, geometry_cache_, tessellation_setting_, max_level))
+		{
+			if (old_patch)
+			{
+				// old tessellation of this patch is never used
+				geometry_cache_->remove_owner(old_patch->id());
+			}
+			(*it) = patch;
+			is_replaced = true;
+		}
+	}
+	return is_replaced;
+}
+
+/**
+ * subdivide meshes by their size on screen
+ */
+bool UMSceneAccess::subdivide_adaptive(unsigned int max_level, size_t triangle_budget)
+{
+	if (!scene_) return false;
+	umdraw::UMCameraPtr camera = scene_->camera();
+	if (!camera) return false;
+
+	const double pixel_scale = screen_pixel_scale(scene_, camera);
+	const UMVec3d& position = camera->position();
+	const UMVec3d direction = (camera->target() - position).normalized();
+	const double edge_pixels = std::max(tessellation_setting_->edge_pixels, DBL_EPSILON);
+
+	// only meshes of triangles are subdivided. patches are tessellated by themselves.
+	std::map<unsigned int, size_t> triangle_count_map;
+	size_t total_count = 0;
+	for (UMPrimitiveList::const_iterator it = primitive_list().begin(); it != primitive_list().end(); ++it)
+	{
+		UMTrianglePtr triangle = std::dynamic_pointer_cast<UMTriangle>(*it);
+		if (triangle && triangle->mesh())
+		{
+			++triangle_count_map[triangle->mesh()->id()];
+		}
+		++total_count;
+	}
+
+	// subdivided meshes are refined again from their base meshes
+	std::map<unsigned int, UMMeshPtr> base_mesh_map;
+	for (SubdividedMeshMap::const_iterator it = subdivided_mesh_map_.begin(); it != subdivided_mesh_map_.end(); ++it)
+	{
+		if (!it->second.divided_mesh) continue;
+		base_mesh_map[it->second.divided_mesh->id()] = it->second.base_mesh;
+	}
+
+	// level by size on screen
+	UMAdaptiveMeshList adaptive_list;
+	const UMMeshGroupList& group_list = scene_->mesh_group_list();
+	for (UMMeshGroupList::const_iterator it = group_list.begin(); it != group_list.end(); ++it)
+	{
+		const UMMeshList& mesh_list = (*it)->mesh_list();
+		for (UMMeshList::const_iterator mt = mesh_list.begin(); mt != mesh_list.end(); ++mt)
+		{
+			UMMeshPtr mesh = *mt;
+			std::map<unsigned int, size_t>::const_iterator ct = triangle_count_map.find(mesh->id());
+			if (ct == triangle_count_map.end()) continue;
+			if (mesh->face_list().size() != ct->second) continue;
+
+			UMAdaptiveMesh adaptive;
+			adaptive.mesh = mesh;
+			std::map<unsigned int, UMMeshPtr>::const_iterator bt = base_mesh_map.find(mesh->id());
+			adaptive.base_mesh = bt != base_mesh_map.end() ? bt->second : mesh;
+			// triangle counts are taken from the scheme of the subdivision
+			adaptive.subdivision = subdivision_of(subdivided_mesh_map_[adaptive.base_mesh->id()], adaptive.base_mesh);
+			adaptive.pixels = 0.0;
+			adaptive.level = 0;
+			UMMeshPtr base_mesh = adaptive.base_mesh;
+			if (!is_behind(base_mesh->box(), position, direction))
+			{
+				const double distance = std::max(box_distance(base_mesh->box(), position), DBL_EPSILON);
+				adaptive.pixels = average_edge_length(base_mesh) * pixel_scale / distance;
+			}
+			double pixels = adaptive.pixels;
+			while (adaptive.level < max_level && pixels > edge_pixels)
+			{
+				pixels *= 0.5;
+				++adaptive.level;
+			}
+			total_count += adaptive.refined_count() - ct->second;
+			adaptive_list.push_back(adaptive);
+		}
+	}
+
+	// lower the level of the smallest triangles on screen until within the budget
+	while (triangle_budget > 0 && total_count > triangle_budget)
+	{
+		UMAdaptiveMesh* smallest = NULL;
+		double smallest_pixels = DBL_MAX;
+		for (UMAdaptiveMeshList::iterator it = adaptive_list.begin(); it != adaptive_list.end(); ++it)
+		{
+			if (it->level == 0) continue;
+			const double pixels = it->pixels / (1 << it->level);
+			if (pixels < smallest_pixels)
+			{
+				smallest_pixels = pixels;
+				smallest = &(*it);
+			}
+		}
+		if (!smallest) break;
+		const size_t count = smallest->refined_count();
+		--smallest->level;
+		total_count -= count - smallest->refined_count();
+	}
+
+	// replace meshes whose level is changed
+	bool is_subdivided = false;
+	for (UMAdaptiveMeshList::const_iterator it = adaptive_list.begin(); it != adaptive_list.end(); ++it)
+	{
+		UMMeshPtr base_mesh = it->base_mesh;
+		SubdividedMeshMap::iterator st = subdivided_mesh_map_.find(base_mesh->id());
+		const unsigned int current_level = st != subdivided_mesh_map_.end() ? st->second.level : 0;
+		if (it->level == current_level) continue;
+
+		SubdividedMesh& subdivided = subdivided_mesh_map_[base_mesh->id()];
+		if (it->level == 0)
+		{
+			// subdivision is kept for later levels
+			replace_mesh(it->mesh, base_mesh);
+			subdivided.divided_mesh.reset();
+			subdivided.level = 0;
+			is_subdivided = true;
+			continue;
+		}
+		UMMeshPtr divided_mesh = subdivide_base_mesh(subdivided, base_mesh, it->level);
+		if (!divided_mesh) continue;
+		replace_mesh(it->mesh, divided_mesh);
+		is_subdivided = true;
+	}
+	return is_subdivided;
+}
+
+/**
+ * replace a mesh of the scene and its triangles
+ */
+void UMSceneAccess::replace_mesh(UMMeshPtr mesh, UMMeshPtr new_mesh)
+{
+	umdraw::UMMeshGroupList::iterator gt = scene_->mutable_mesh_group_list().begin();
+	for (; gt != scene_->mutable_mesh_group_list().end(); ++gt)
+	{
+		umdraw::UMMeshList& mesh_list = (*gt)->mutable_mesh_list();
+		std::replace(mesh_list.begin(), mesh_list.end(), mesh, new_mesh);
+	}
+
+	UMPrimitiveList& primitives = mutable_primitive_list();
+	UMPrimitiveList::iterator pt = primitives.begin();
+	for (; pt != primitives.end(); ++pt)
+	{
+		UMTrianglePtr triangle = std::dynamic_pointer_cast<UMTriangle>(*pt);
+		if (triangle && triangle->mesh() == mesh)
+		{
+			(*pt).reset();
+		}
+	}
+	primitives.erase(std::remove(primitives.begin(), primitives.end(), UMPrimitivePtr()), primitives.end());
+
+	UMVertexParameterList& vertex_parameters = mutable_vertex_parameter_list();
+	UMVertexParameterList::iterator vt = vertex_parameters.begin();
+	for (; vt != vertex_parameters.end(); ++vt)
+	{
+		if ((*vt)->mesh() == mesh)
+		{
+			(*vt).reset();
+		}
+	}
+	vertex_parameters.erase(
+		std::remove(vertex_parameters.begin(), vertex_parameters.end(), UMVertexParameterPtr()), 
+		vertex_parameters.end());
+
+	create_triangle_and_vertex(
+		mutable_primitive_list(), 
+		mutable_vertex_parameter_list(),
+		texture_library_,
+		new_mesh);
 }
 
 /** 
@@ -288,6 +792,42 @@ bool UMSceneAccess::update_bvh()
 	if (!bvh_) return false;
 	if (!scene_) return false;
 
+	const double start_seconds = umbase::UMTime::current_seconds();
+	// subdivided meshes follow their base meshes.
+	// base meshes are out of the scene, so they are deformed here.
+	SubdividedMeshMap::iterator st = subdivided_mesh_map_.begin();
+	for (; st != subdivided_mesh_map_.end(); ++st)
+	{
+		SubdividedMesh& subdivided = st->second;
+		if (!subdivided.divided_mesh) continue;
+		if (scene_->is_enable_deform())
+		{
+			subdivided.base_mesh->update();
+		}
+		// stencils are applied only when base vertices are changed
+		if (is_same_vertex_list(subdivided.base_mesh->vertex_list(), subdivided.refined_vertex_list)) continue;
+		if (subdivided.subdivision->update_subdivided_mesh(subdivided.divided_mesh, subdivided.level))
+		{
+			subdivided.refined_vertex_list = subdivided.base_mesh->vertex_list();
+			continue;
+		}
+
+		// faces of the base mesh are changed. subdivided again, or the base mesh is rendered.
+		UMMeshPtr mesh = subdivided.divided_mesh;
+		if (UMMeshPtr divided_mesh = subdivide_base_mesh(subdivided, subdivided.base_mesh, subdivided.level))
+		{
+			replace_mesh(mesh, divided_mesh);
+		}
+		else
+		{
+			fprintf(stderr, "failed to update subdivided mesh %s\n", 
+				umbase::UMStringUtil::utf16_to_utf8(subdivided.base_mesh->name()).c_str());
+			replace_mesh(mesh, subdivided.base_mesh);
+			subdivided.divided_mesh.reset();
+			subdivided.level = 0;
+		}
+	}
+
 	UMPrimitiveList::iterator it = mutable_primitive_list().begin();
 	for (; it != mutable_primitive_list().end(); ++it)
 	{
@@ -298,42 +838,37 @@ bool UMSceneAccess::update_bvh()
 	{
 		mutable_render_primitive_list().clear();
 		mutable_render_primitive_list().push_back(bvh_);
+		// area lights and emissive triangles
+		light_sampler_->build(scene_->light_list(), primitive_list());
+		bvh_build_seconds_ = umbase::UMTime::current_seconds() - start_seconds;
 		return true;
 	}
 	return false;
 }
 
 	
+/**
+ * precompute camera ray generator
+ */
+bool UMSceneAccess::update_camera_sampler()
+{
+	if (!scene_) return false;
+	if (umdraw::UMCameraPtr camera = scene_->camera())
+	{
+		// patches are tessellated for this view
+		tessellation_setting_->camera_position = camera->position();
+		tessellation_setting_->pixel_scale = screen_pixel_scale(scene_, camera);
+	}
+	return camera_sampler_.init(scene_->camera(), scene_->width(), scene_->height());
+}
+	
 /** 
  * generate a camera ray
  */
 void UMSceneAccess::generate_ray(UMRay& ray, const UMVec2d& sample_point) const
 {
-	if (!scene_) return;
-	UMCameraPtr camera = scene_->camera();
-	if (!camera) return;
-
-	const UMMat44d& view_projection = camera->view_projection_matrix();
-	UMVec3d right (view_projection.m[0][0], view_projection.m[1][0], view_projection.m[2][0]);
-	UMVec3d up (view_projection.m[0][1], view_projection.m[1][1], view_projection.m[2][1]);
-	UMVec3d direction (view_projection.m[0][2], view_projection.m[1][2], view_projection.m[2][2]);
-	
-	const double inv_yscale = tan(umbase::um_to_radian(camera->fov_y() * 0.5));
-	const double inv_xscale = camera->aspect() * inv_yscale;
-	right *= inv_xscale;
-	up *= inv_yscale;
-	const UMVec3d generate_ray_x_scale = right * camera->aspect();
-	const UMVec3d generate_ray_y_scale = up;
-	const UMVec3d generate_ray_adder = direction / inv_yscale;
-	
-	const double inverted_width = 1.0 / static_cast<double>(scene_->width());
-	const double inverted_height = 1.0 / static_cast<double>(scene_->height());
-	const double xx = sample_point.x * inverted_width * 2 - 1;
-	const double yy = sample_point.y * inverted_height * 2 - 1;
-	UMVec3d dir = generate_ray_x_scale * xx + generate_ray_y_scale * yy + generate_ray_adder;
-
-	ray.set_origin(camera->position());
-	ray.set_direction(dir.normalized());
+	if (!camera_sampler_.is_valid()) return;
+	camera_sampler_.generate_ray(ray, sample_point);
 }
 
 } // umrt
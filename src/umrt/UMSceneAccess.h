@@ -10,6 +10,8 @@
  */
 #pragma once
 
+#include <map>
+
 #include "UMMacro.h"
 #include "UMVector.h"
 #include "UMMathTypes.h"
@@ -17,6 +19,9 @@
 #include "UMScene.h"
 #include "UMPrimitive.h"
 #include "UMVertexParameter.h"
+#include "UMTexture.h"
+#include "UMCameraSampler.h"
+#include "UMGeometryCache.h"
 
 namespace umdraw
 {
@@ -52,6 +57,12 @@ typedef std::shared_ptr<UMBvh> UMBvhPtr;
 class UMSubdivision;
 typedef std::shared_ptr<UMSubdivision> UMSubdivisionPtr;
 
+class UMLightSampler;
+typedef std::shared_ptr<UMLightSampler> UMLightSamplerPtr;
+
+class UMTessellationSetting;
+typedef std::shared_ptr<UMTessellationSetting> UMTessellationSettingPtr;
+
 /**
  * accelerated scene access
  */
@@ -77,9 +88,53 @@ public:
 	void add_abc_scene(umabc::UMAbcScenePtr abc_scene);
 
 	/**
-	 * subdivide mesh
+	 * subdivide mesh.
+	 * a subdivided mesh is refined again from its base mesh,
+	 * and follows the base mesh in update_bvh. call before update_bvh.
+	 * @param [in] id mesh id. id of a base mesh or its subdivided mesh.
+	 * @param [in] level subdivision level
+	 * @retval success or failed
 	 */
 	bool subdivide(unsigned int id, unsigned int level);
+
+	/**
+	 * subdivide mesh on demand.
+	 * each face of the mesh becomes a patch which is tessellated when a ray reaches it,
+	 * to a level decided by its size on screen. call before update_bvh.
+	 * @param [in] id mesh id
+	 * @param [in] max_level max subdivision level
+	 * @retval success or failed
+	 */
+	bool subdivide_on_demand(unsigned int id, unsigned int max_level);
+
+	/**
+	 * subdivide all meshes on demand
+	 * @param [in] max_level max subdivision level
+	 * @retval any mesh replaced or not
+	 */
+	bool subdivide_on_demand(unsigned int max_level);
+
+	/**
+	 * subdivide meshes by their size on screen under current camera.
+	 * each mesh gets a level which makes its edges about edge_pixels of tessellation setting,
+	 * then levels of the smallest triangles on screen are lowered until
+	 * all triangles of the scene are within the budget. call before update_bvh.
+	 * meshes subdivided by earlier call are refined again from their base meshes.
+	 * @param [in] max_level max subdivision level
+	 * @param [in] triangle_budget max triangles of the scene. 0 is unbounded.
+	 * @retval any mesh subdivided or not
+	 */
+	bool subdivide_adaptive(unsigned int max_level, size_t triangle_budget);
+
+	/**
+	 * get cache of tessellated patches
+	 */
+	UMGeometryCachePtr geometry_cache() const { return geometry_cache_; }
+
+	/**
+	 * get screen space tessellation setting
+	 */
+	UMTessellationSettingPtr tessellation_setting() const { return tessellation_setting_; }
 	
 	/**
 	 * get primitive list
@@ -130,8 +185,46 @@ public:
 	 * update bvh
 	 */
 	bool update_bvh();
+
+	/**
+	 * get seconds of last update_bvh
+	 */
+	double bvh_build_seconds() const { return bvh_build_seconds_; }
+
+	/**
+	 * get light sampler
+	 */
+	UMLightSamplerPtr light_sampler() const { return light_sampler_; }
+
+	/**
+	 * get mip-mapped textures by image id
+	 */
+	const UMTextureMap& texture_map() const { return texture_library_.image_texture_map; }
+
+	/**
+	 * set loader of image files which materials refer by path.
+	 * set before scenes are added.
+	 */
+	void set_texture_loader(const UMTexture::ImageLoader& loader) { texture_library_.image_loader = loader; }
+
+	/**
+	 * release source images of textures prepared for rendering.
+	 * material textures are removed, so call this only for scenes which are not drawn.
+	 */
+	void release_texture_images();
 	
 	
+	/**
+	 * precompute camera ray generator from current camera.
+	 * call once per frame before generating rays.
+	 */
+	bool update_camera_sampler();
+
+	/**
+	 * get camera ray generator
+	 */
+	const UMCameraSampler& camera_sampler() const { return camera_sampler_; }
+	
 	/** 
 	 * generate a camera ray
 	 * @param [out] ray generated ray
@@ -140,6 +233,30 @@ public:
 	void generate_ray(UMRay& ray, const UMVec2d& sample_point) const;
 
 private:
+	bool replace_with_patches(unsigned int id, unsigned int max_level);
+	void replace_mesh(umdraw::UMMeshPtr mesh, umdraw::UMMeshPtr new_mesh);
+
+	/**
+	 * a mesh of the scene replaced by its subdivided mesh
+	 */
+	struct SubdividedMesh
+	{
+		SubdividedMesh() : level(0) {}
+		umdraw::UMMeshPtr base_mesh;
+		/// none at level 0
+		umdraw::UMMeshPtr divided_mesh;
+		/// kept for other levels and later frames
+		UMSubdivisionPtr subdivision;
+		unsigned int level;
+		/// base vertices which divided mesh is refined from
+		umdraw::UMMesh::Vec3dList refined_vertex_list;
+	};
+	/// by id of base mesh
+	typedef std::map<unsigned int, SubdividedMesh> SubdividedMeshMap;
+
+	UMSubdivisionPtr subdivision_of(SubdividedMesh& subdivided, umdraw::UMMeshPtr base_mesh);
+	umdraw::UMMeshPtr subdivide_base_mesh(SubdividedMesh& subdivided, umdraw::UMMeshPtr base_mesh, unsigned int level);
+
 	umdraw::UMScenePtr scene_;
 	umabc::UMAbcScenePtr abc_scene_;
 	umabc::UMAbcMeshList abc_mesh_list_;
@@ -147,7 +264,14 @@ private:
 	UMPrimitiveList render_primitive_list_;
 	UMPrimitiveList primitive_list_;
 	UMVertexParameterList vertex_parameter_list_;
+	UMTextureLibrary texture_library_;
+	UMCameraSampler camera_sampler_;
 	UMBvhPtr bvh_;
+	UMLightSamplerPtr light_sampler_;
+	UMGeometryCachePtr geometry_cache_;
+	UMTessellationSettingPtr tessellation_setting_;
+	SubdividedMeshMap subdivided_mesh_map_;
+	double bvh_build_seconds_;
 };
 
 } // umrt
@@ -16,6 +16,8 @@
 namespace umrt
 {
 
+class UMPrimitive;
+
 /**
  * shading parameters
  */
@@ -28,6 +30,9 @@ public:
 		, depth(16)
 		, max_depth(32)
 		, outline_size(1.0)
+		, primitive(NULL)
+		, bsdf_pdf(0.0)
+		, is_irradiance_gather(false)
 	{}
 	~UMShaderParameter() {}
 	
@@ -100,6 +105,21 @@ public:
 	 * outline size
 	 */
 	double outline_size;
+
+	/**
+	 * intersected primitive
+	 */
+	const UMPrimitive* primitive;
+
+	/**
+	 * bsdf pdf of the ray which reached here (0 for camera ray)
+	 */
+	double bsdf_pdf;
+
+	/**
+	 * is in a path gathering a record of irradiance cache
+	 */
+	bool is_irradiance_gather;
 };
 
 } // umrt
@@ -0,0 +1,387 @@
+/**
+ * @file UMSocket.cpp
+ * a stream socket
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMSocket.h"
+#include "UMTime.h"
+
+#include <cstring>
+#include <cstdlib>
+
+#ifdef _WIN32
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+#else
+	#include <sys/types.h>
+	#include <sys/socket.h>
+	#include <sys/select.h>
+	#include <sys/un.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
+	#include <netdb.h>
+	#include <unistd.h>
+	#include <signal.h>
+#endif
+
+namespace
+{
+#ifdef _WIN32
+	typedef SOCKET socket_handle;
+	const socket_handle invalid_socket = INVALID_SOCKET;
+
+	void close_socket(socket_handle handle) { closesocket(handle); }
+
+	bool startup()
+	{
+		static bool is_started = false;
+		if (!is_started)
+		{
+			WSADATA data;
+			is_started = (WSAStartup(MAKEWORD(2, 2), &data) == 0);
+		}
+		return is_started;
+	}
+
+	const int send_flags = 0;
+#else
+	typedef int socket_handle;
+	const socket_handle invalid_socket = -1;
+
+	void close_socket(socket_handle handle) { ::close(handle); }
+
+	bool startup()
+	{
+		// a lost peer must not kill the process
+		static bool is_started = false;
+		if (!is_started)
+		{
+			signal(SIGPIPE, SIG_IGN);
+			is_started = true;
+		}
+		return true;
+	}
+
+	#ifdef MSG_NOSIGNAL
+		const int send_flags = MSG_NOSIGNAL;
+	#else
+		const int send_flags = 0;
+	#endif
+#endif
+
+	const char unix_prefix[] = "unix:";
+
+	bool is_unix_address(const std::string& address)
+	{
+		return address.compare(0, sizeof(unix_prefix) - 1, unix_prefix) == 0;
+	}
+
+	/**
+	 * split "host:port"
+	 */
+	bool split_address(const std::string& address, std::string& host, std::string& port)
+	{
+		const std::string::size_type pos = address.rfind(':');
+		if (pos == std::string::npos)
+		{
+			// port only
+			host = "";
+			port = address;
+		}
+		else
+		{
+			host = address.substr(0, pos);
+			port = address.substr(pos + 1);
+		}
+		return !port.empty();
+	}
+
+	void set_no_delay(socket_handle handle)
+	{
+		int flag = 1;
+		setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&flag), sizeof(flag));
+	}
+
+} // anonymouse namespace
+
+namespace umrt
+{
+
+/**
+ * socket implementation
+ */
+class UMSocket::Impl
+{
+	DISALLOW_COPY_AND_ASSIGN(Impl);
+public:
+	Impl() : handle_(invalid_socket) {}
+
+	~Impl() { close(); }
+
+	void close()
+	{
+		if (handle_ != invalid_socket)
+		{
+			close_socket(handle_);
+			handle_ = invalid_socket;
+		}
+		if (!unix_path_.empty())
+		{
+#ifndef _WIN32
+			unlink(unix_path_.c_str());
+#endif
+			unix_path_.clear();
+		}
+	}
+
+	socket_handle handle_;
+	// listening unix socket path to remove
+	std::string unix_path_;
+};
+
+/**
+ * constructor
+ */
+UMSocket::UMSocket()
+	: impl_(new UMSocket::Impl())
+{}
+
+/**
+ * destructor
+ */
+UMSocket::~UMSocket()
+{}
+
+/**
+ * listen on address
+ */
+UMSocketPtr UMSocket::listen(const std::string& address)
+{
+	if (!startup()) return UMSocketPtr();
+	UMSocketPtr result(new UMSocket());
+
+	if (is_unix_address(address))
+	{
+#ifdef _WIN32
+		return UMSocketPtr();
+#else
+		const std::string path = address.substr(sizeof(unix_prefix) - 1);
+		sockaddr_un addr;
+		if (path.size() >= sizeof(addr.sun_path)) return UMSocketPtr();
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+		socket_handle handle = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (handle == invalid_socket) return UMSocketPtr();
+		unlink(path.c_str());
+		if (bind(handle, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+			::listen(handle, SOMAXCONN) != 0)
+		{
+			close_socket(handle);
+			return UMSocketPtr();
+		}
+		result->impl_->handle_ = handle;
+		result->impl_->unix_path_ = path;
+		return result;
+#endif
+	}
+
+	std::string host;
+	std::string port;
+	if (!split_address(address, host, port)) return UMSocketPtr();
+
+	addrinfo hints;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	addrinfo* info = NULL;
+	if (getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &info) != 0)
+	{
+		return UMSocketPtr();
+	}
+	socket_handle handle = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+	if (handle == invalid_socket)
+	{
+		freeaddrinfo(info);
+		return UMSocketPtr();
+	}
+	int reuse = 1;
+	setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+	if (bind(handle, info->ai_addr, static_cast<int>(info->ai_addrlen)) != 0 ||
+		::listen(handle, SOMAXCONN) != 0)
+	{
+		freeaddrinfo(info);
+		close_socket(handle);
+		return UMSocketPtr();
+	}
+	freeaddrinfo(info);
+	result->impl_->handle_ = handle;
+	return result;
+}
+
+/**
+ * connect to address
+ */
+UMSocketPtr UMSocket::connect(const std::string& address)
+{
+	if (!startup()) return UMSocketPtr();
+	UMSocketPtr result(new UMSocket());
+
+	if (is_unix_address(address))
+	{
+#ifdef _WIN32
+		return UMSocketPtr();
+#else
+		const std::string path = address.substr(sizeof(unix_prefix) - 1);
+		sockaddr_un addr;
+		if (path.size() >= sizeof(addr.sun_path)) return UMSocketPtr();
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+		socket_handle handle = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (handle == invalid_socket) return UMSocketPtr();
+		if (::connect(handle, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+		{
+			close_socket(handle);
+			return UMSocketPtr();
+		}
+		result->impl_->handle_ = handle;
+		return result;
+#endif
+	}
+
+	std::string host;
+	std::string port;
+	if (!split_address(address, host, port)) return UMSocketPtr();
+
+	addrinfo hints;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* info = NULL;
+	if (getaddrinfo(host.empty() ? "127.0.0.1" : host.c_str(), port.c_str(), &hints, &info) != 0)
+	{
+		return UMSocketPtr();
+	}
+	socket_handle handle = invalid_socket;
+	for (addrinfo* it = info; it; it = it->ai_next)
+	{
+		handle = socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+		if (handle == invalid_socket) continue;
+		if (::connect(handle, it->ai_addr, static_cast<int>(it->ai_addrlen)) == 0) break;
+		close_socket(handle);
+		handle = invalid_socket;
+	}
+	freeaddrinfo(info);
+	if (handle == invalid_socket) return UMSocketPtr();
+	set_no_delay(handle);
+	result->impl_->handle_ = handle;
+	return result;
+}
+
+/**
+ * accept a connection
+ */
+UMSocketPtr UMSocket::accept()
+{
+	if (!is_valid()) return UMSocketPtr();
+	socket_handle handle = ::accept(impl_->handle_, NULL, NULL);
+	if (handle == invalid_socket) return UMSocketPtr();
+	if (impl_->unix_path_.empty())
+	{
+		set_no_delay(handle);
+	}
+	UMSocketPtr result(new UMSocket());
+	result->impl_->handle_ = handle;
+	return result;
+}
+
+/**
+ * wait until readable
+ */
+bool UMSocket::wait_readable(int milliseconds)
+{
+	if (!is_valid()) return false;
+	fd_set read_set;
+	FD_ZERO(&read_set);
+	FD_SET(impl_->handle_, &read_set);
+	timeval timeout;
+	timeout.tv_sec = milliseconds / 1000;
+	timeout.tv_usec = (milliseconds % 1000) * 1000;
+	const int result = select(
+		static_cast<int>(impl_->handle_ + 1),
+		&read_set,
+		NULL,
+		NULL,
+		milliseconds < 0 ? NULL : &timeout);
+	return result > 0;
+}
+
+/**
+ * send all bytes
+ */
+bool UMSocket::send_all(const void* data, size_t size)
+{
+	if (!is_valid()) return false;
+	const char* src = static_cast<const char*>(data);
+	while (size > 0)
+	{
+		const int chunk = static_cast<int>(size > 0x100000 ? 0x100000 : size);
+		const int sent = static_cast<int>(send(impl_->handle_, src, chunk, send_flags));
+		if (sent <= 0) return false;
+		src += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+/**
+ * receive all bytes
+ */
+bool UMSocket::receive_all(void* data, size_t size, int milliseconds)
+{
+	if (!is_valid()) return false;
+	const double deadline = umbase::UMTime::current_seconds() + milliseconds / 1000.0;
+	char* dst = static_cast<char*>(data);
+	while (size > 0)
+	{
+		// every recv waits only until the deadline, so a stalled peer can not block
+		if (milliseconds >= 0)
+		{
+			const int rest = static_cast<int>((deadline - umbase::UMTime::current_seconds()) * 1000.0);
+			if (rest <= 0 || !wait_readable(rest)) return false;
+		}
+		const int chunk = static_cast<int>(size > 0x100000 ? 0x100000 : size);
+		const int received = static_cast<int>(recv(impl_->handle_, dst, chunk, 0));
+		if (received <= 0) return false;
+		dst += received;
+		size -= received;
+	}
+	return true;
+}
+
+/**
+ * close socket
+ */
+void UMSocket::close()
+{
+	impl_->close();
+}
+
+/**
+ * is valid
+ */
+bool UMSocket::is_valid() const
+{
+	return impl_->handle_ != invalid_socket;
+}
+
+} // umrt
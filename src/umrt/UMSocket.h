@@ -0,0 +1,89 @@
+/**
+ * @file UMSocket.h
+ * a stream socket
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include "UMMacro.h"
+
+namespace umrt
+{
+
+class UMSocket;
+typedef std::shared_ptr<UMSocket> UMSocketPtr;
+
+/**
+ * a blocking stream socket.
+ * address is "host:port" for tcp or "unix:/path/to/socket" for unix domain socket.
+ */
+class UMSocket
+{
+	DISALLOW_COPY_AND_ASSIGN(UMSocket);
+public:
+	~UMSocket();
+
+	/**
+	 * listen on address
+	 * @retval listening socket or empty pointer
+	 */
+	static UMSocketPtr listen(const std::string& address);
+
+	/**
+	 * connect to address
+	 * @retval connected socket or empty pointer
+	 */
+	static UMSocketPtr connect(const std::string& address);
+
+	/**
+	 * accept a connection
+	 * @retval connected socket or empty pointer
+	 */
+	UMSocketPtr accept();
+
+	/**
+	 * wait until readable
+	 * @param [in] milliseconds timeout. negative waits forever.
+	 * @retval readable or not
+	 */
+	bool wait_readable(int milliseconds);
+
+	/**
+	 * send all bytes
+	 * @retval success or failed
+	 */
+	bool send_all(const void* data, size_t size);
+
+	/**
+	 * receive all bytes
+	 * @param [in] milliseconds timeout of the whole receive. negative waits forever.
+	 * @retval success or failed
+	 */
+	bool receive_all(void* data, size_t size, int milliseconds = -1);
+
+	/**
+	 * close socket
+	 */
+	void close();
+
+	/**
+	 * is valid
+	 */
+	bool is_valid() const;
+
+private:
+	UMSocket();
+
+	class Impl;
+	typedef std::unique_ptr<Impl> ImplPtr;
+	ImplPtr impl_;
+};
+
+} // umrt
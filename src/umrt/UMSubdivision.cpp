@@ -10,12 +10,23 @@
 #include "UMSubdivision.h"
 
 #include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
 
 #include "UMStringUtil.h"
 #include "UMPath.h"
 #include "UMMesh.h"
+#include "UMMaterial.h"
+#include "UMMath.h"
 #include "UMSceneAccess.h"
 
+#ifndef WITH_EMSCRIPTEN
+	#include <xmmintrin.h>
+	#define UM_SUBDIVISION_SSE
+#endif
+
 #ifdef WITH_OSD
 	#define and &&
 	#define and_eq &=
@@ -38,6 +49,36 @@
 
 namespace umrt
 {
+
+namespace
+{
+	/**
+	 * copy material for a subdivided mesh.
+	 * polygon count of the material belongs to the mesh, so the base one is not shared.
+	 */
+	umdraw::UMMaterialPtr clone_material(umdraw::UMMaterialPtr src)
+	{
+		umdraw::UMMaterialPtr material = std::make_shared<umdraw::UMMaterial>();
+		material->set_name(src->name());
+		material->set_ambient(src->ambient());
+		material->set_diffuse(src->diffuse());
+		material->set_specular(src->specular());
+		material->set_emissive(src->emissive());
+		material->set_refrection(src->refrection());
+		material->set_transparent(src->transparent());
+		material->set_transparency_factor(src->transparency_factor());
+		material->set_shininess(src->shininess());
+		material->set_reflection_factor(src->reflection_factor());
+		material->set_diffuse_factor(src->diffuse_factor());
+		material->set_specular_factor(src->specular_factor());
+		material->set_emissive_factor(src->emissive_factor());
+		material->set_ambient_factor(src->ambient_factor());
+		material->mutable_texture_list() = src->texture_list();
+		material->mutable_texture_path_list() = src->texture_path_list();
+		material->set_polygon_count(src->polygon_count());
+		return material;
+	}
+} // anonymouse namespace
 	
 #ifdef WITH_OSD
 
@@ -112,11 +153,15 @@ class UMSubdivision::SudivImpl
 public:
 	SudivImpl(umdraw::UMMeshPtr mesh)
 		: mesh_(mesh)
+		, divided_mesh_(NULL)
+		, divided_level_(0)
+		, context_(NULL)
+		, controller_(NULL)
+		, vertex_buffer_(NULL)
 	{}
 
 	~SudivImpl() {
-		delete divided_mesh_;
-		divided_mesh_ = NULL;
+		release_divided_mesh();
 	}
 
 	/// create subdivided mesh
@@ -125,36 +170,44 @@ public:
 		if (!mesh_) return umdraw::UMMeshPtr();
 		if (level == 0) return umdraw::UMMeshPtr();
 
-		// find from cache
-		if (divided_mesh_)
+		// tables of a far mesh are for its own level
+		if (!divided_mesh_ || divided_level_ != level)
 		{
-			if (umdraw::UMMeshPtr result_mesh = create_result_mesh(divided_mesh_, level))
-			{
-				return result_mesh;
-			}
-		}
-
-		// initialize base mesh
-		if (!base_mesh_)
-		{
-			if (!init_base_mesh())
+			if (!create_divided_mesh(level))
 			{
 				return umdraw::UMMeshPtr();
 			}
 		}
-		
-		// get divided mesh
-		const int max_level = level;
-		OpenSubdiv::FarMeshFactory<UMSubdivVertex> mesh_factory(&(*base_mesh_), max_level);
-		divided_mesh_ = mesh_factory.Create();
-		if (divided_mesh_)
-		{
-			if (umdraw::UMMeshPtr result_mesh = create_result_mesh(divided_mesh_, level))
-			{
-				return result_mesh;
-			}
-		}
-		return umdraw::UMMeshPtr();
+		return create_result_mesh(divided_mesh_, level);
+	}
+
+	/// update subdivided mesh.
+	/// coarse vertices of a far mesh are fixed when it is created, so it is rebuilt from current vertices.
+	bool update_subdivided_mesh(umdraw::UMMeshPtr subdivided_mesh, unsigned int level)
+	{
+		if (!mesh_) return false;
+		if (!subdivided_mesh) return false;
+		if (level == 0) return false;
+
+		base_mesh_.reset();
+		if (!create_divided_mesh(level)) return false;
+		umdraw::UMMeshPtr result = create_result_mesh(divided_mesh_, level);
+		if (!result) return false;
+		if (result->face_list().size() != subdivided_mesh->face_list().size()) return false;
+		subdivided_mesh->mutable_vertex_list() = result->vertex_list();
+		subdivided_mesh->mutable_normal_list() = result->normal_list();
+		subdivided_mesh->update_box();
+		return true;
+	}
+
+	/// triangle count at level.
+	/// catmark splits a triangle to 3 quads, and a quad to 4 quads. quads are split to 2 triangles.
+	size_t triangle_count(unsigned int level) const
+	{
+		if (!mesh_) return 0;
+		const size_t face_size = mesh_->face_list().size();
+		if (level == 0) return face_size;
+		return ((face_size * 3) << (2 * (level - 1))) * 2;
 	}
 	
 private:
@@ -163,6 +216,47 @@ private:
 	typedef std::shared_ptr< OpenSubdiv::HbrMesh<UMSubdivVertex> > SubdivMeshPtr;
 	SubdivMeshPtr base_mesh_;
 	DevidedMesh* divided_mesh_;
+	unsigned int divided_level_;
+	// created with divided_mesh_ for its tables and vertex count
+	OpenSubdiv::OsdCpuComputeContext* context_;
+	OpenSubdiv::OsdCpuComputeController* controller_;
+	OpenSubdiv::OsdCpuVertexBuffer* vertex_buffer_;
+
+	// delete far mesh and its compute objects
+	void release_divided_mesh()
+	{
+		delete vertex_buffer_;
+		delete context_;
+		delete controller_;
+		delete divided_mesh_;
+		vertex_buffer_ = NULL;
+		context_ = NULL;
+		controller_ = NULL;
+		divided_mesh_ = NULL;
+		divided_level_ = 0;
+	}
+
+	// replace far mesh and its compute objects
+	bool create_divided_mesh(unsigned int level)
+	{
+		release_divided_mesh();
+		if (!base_mesh_)
+		{
+			if (!init_base_mesh())
+			{
+				base_mesh_.reset();
+				return false;
+			}
+		}
+		OpenSubdiv::FarMeshFactory<UMSubdivVertex> mesh_factory(&(*base_mesh_), level);
+		divided_mesh_ = mesh_factory.Create();
+		if (!divided_mesh_) return false;
+		divided_level_ = level;
+		context_ = OpenSubdiv::OsdCpuComputeContext::Create(reinterpret_cast<const FarMesh<OsdVertex>* >(divided_mesh_));
+		controller_ = new OpenSubdiv::OsdCpuComputeController();
+		vertex_buffer_ = OpenSubdiv::OsdCpuVertexBuffer::Create(3, divided_mesh_->GetNumVertices());
+		return true;
+	}
 
 	// int base mesh
 	bool init_base_mesh()
@@ -212,27 +306,23 @@ private:
 		umdraw::UMMeshPtr result = std::make_shared<umdraw::UMMesh>();
 		
 		const std::vector<UMSubdivVertex>& vertex = divided_mesh->GetVertices();
-		const int veretx_size = static_cast<int>(vertex.size());
 		const unsigned int* face = divided_mesh->GetPatchTables()->GetFaceVertices();
 		const int face_size = divided_mesh->GetPatchTables()->GetNumFaces();
 		// important: base vertex index changed by level!
 		const unsigned int base_vertex_index = divided_mesh->GetSubdivisionTables()->GetNumVerticesTotal(level - 1);
+		// vertices of the finest level only
+		const int veretx_size = divided_mesh->GetNumVertices() - static_cast<int>(base_vertex_index);
 		
-		OpenSubdiv::OsdCpuComputeContext* context
-			= OpenSubdiv::OsdCpuComputeContext::Create(reinterpret_cast<const FarMesh<OsdVertex>* >(divided_mesh));
-		OpenSubdiv::OsdCpuComputeController* controller
-			= new OpenSubdiv::OsdCpuComputeController();
-		OpenSubdiv::OsdCpuVertexBuffer *vertex_buffer
-			= OpenSubdiv::OsdCpuVertexBuffer::Create(3, divided_mesh->GetNumVertices());
-		vertex_buffer->UpdateData(&(vertex[0].pos[0]), 0, divided_mesh->GetNumVertices());
+		if (!context_ || !controller_ || !vertex_buffer_) return umdraw::UMMeshPtr();
+		vertex_buffer_->UpdateData(&(vertex[0].pos[0]), 0, divided_mesh->GetNumVertices());
 
 		// vertex will replace subdivided verts.
-		controller->Refine(context, divided_mesh->GetKernelBatches(), vertex_buffer);
+		controller_->Refine(context_, divided_mesh->GetKernelBatches(), vertex_buffer_);
 
 		// assing refined verts
 		result->mutable_vertex_list().resize(veretx_size);
-		float * refined_vertex = vertex_buffer->BindCpuBuffer() + (3 * base_vertex_index);
-		for (size_t i = 0; i < veretx_size; ++i)
+		float * refined_vertex = vertex_buffer_->BindCpuBuffer() + (3 * base_vertex_index);
+		for (int i = 0; i < veretx_size; ++i)
 		{
 			result->mutable_vertex_list().at(i) = UMVec3d(
 				refined_vertex[i * 3 + 0],
@@ -242,7 +332,7 @@ private:
 		// assign faces as triangle
 		const int triangle_count = face_size * 2;
 		result->mutable_face_list().resize(triangle_count);
-		for (int i = 0; i < triangle_count; ++i)
+		for (int i = 0; i < face_size; ++i)
 		{
 			unsigned int f0 = face[ i * 4 + 0 ] - base_vertex_index;
 			unsigned int f1 = face[ i * 4 + 1 ] - base_vertex_index;
@@ -254,26 +344,571 @@ private:
 
 		// TODO: calc normals by subdiv
 		result->create_normals(true);
-		result->mutable_material_list().push_back(mesh_->mutable_material_list().at(0));
-		result->mutable_material_list().at(0)->set_polygon_count(triangle_count);
+		if (!mesh_->material_list().empty())
+		{
+			result->mutable_material_list().push_back(clone_material(mesh_->material_list().at(0)));
+			result->mutable_material_list().at(0)->set_polygon_count(triangle_count);
+		}
 		result->update_box();
-
-		delete vertex_buffer;
-		delete context;
-		delete controller;
 		return result;
 	}
 };
+#endif // WITH_OSD
+
+namespace
+{
+	typedef std::vector<int> IndexList;
+	typedef std::vector<float> WeightList;
+	typedef std::vector<float> FloatList;
+	typedef std::vector<UMVec3d> BarycentricList;
+
+	/**
+	 * stencils of refined vertices in compressed rows.
+	 * a refined vertex is a weighted sum of base vertices in its row.
+	 */
+	class UMStencilTable
+	{
+	public:
+		UMStencilTable() : offset_list(1, 0) {}
+
+		/// number of rows
+		int size() const { return static_cast<int>(offset_list.size()) - 1; }
+
+		/// add a weighted base vertex to current row
+		void add(int index, float weight)
+		{
+			index_list.push_back(index);
+			weight_list.push_back(weight);
+		}
+
+		/// close current row
+		void end_row()
+		{
+			offset_list.push_back(static_cast<int>(index_list.size()));
+		}
+
+		/// row i is [offset_list[i], offset_list[i+1])
+		IndexList offset_list;
+		IndexList index_list;
+		WeightList weight_list;
+	};
+
+	/**
+	 * an edge of refining mesh
+	 */
+	struct UMRefineEdge
+	{
+		int v0;
+		int v1;
+		/// vertices opposite to the edge in first two faces
+		int opposite[2];
+		int face_count;
+	};
+	typedef std::vector<UMRefineEdge> UMRefineEdgeList;
+
+	typedef unsigned long long EdgeKey;
+
+	EdgeKey edge_key(int a, int b)
+	{
+		if (a > b) std::swap(a, b);
+		return (static_cast<EdgeKey>(a) << 32) | static_cast<unsigned int>(b);
+	}
+
+	/**
+	 * refine topology by one level of loop subdivision.
+	 * refined vertices are the coarse vertices followed by one vertex per edge,
+	 * and face i is split to faces i * 4 + 0 ... i * 4 + 3.
+	 * @param [in] face_list coarse faces
+	 * @param [in] vertex_size number of coarse vertices
+	 * @param [out] refine refined vertices by coarse vertices
+	 * @param [out] refined_face_list refined faces
+	 */
+	void refine_topology(
+		const umdraw::UMMesh::Vec3iList& face_list,
+		int vertex_size,
+		UMStencilTable& refine,
+		umdraw::UMMesh::Vec3iList& refined_face_list)
+	{
+		const int face_size = static_cast<int>(face_list.size());
+
+		// edges
+		UMRefineEdgeList edge_list;
+		edge_list.reserve(face_size * 3 / 2 + 1);
+		std::unordered_map<EdgeKey, int> edge_map;
+		edge_map.reserve(face_size * 3 / 2 + 1);
+		IndexList face_edge_list(face_size * 3);
+		for (int i = 0; i < face_size; ++i)
+		{
+			const UMVec3i& face = face_list.at(i);
+			for (int k = 0; k < 3; ++k)
+			{
+				const int a = face[k];
+				const int b = face[(k + 1) % 3];
+				const int c = face[(k + 2) % 3];
+				const EdgeKey key = edge_key(a, b);
+				std::unordered_map<EdgeKey, int>::iterator it = edge_map.find(key);
+				if (it == edge_map.end())
+				{
+					UMRefineEdge edge;
+					edge.v0 = a;
+					edge.v1 = b;
+					edge.opposite[0] = c;
+					edge.opposite[1] = -1;
+					edge.face_count = 1;
+					face_edge_list[i * 3 + k] = static_cast<int>(edge_list.size());
+					edge_map[key] = static_cast<int>(edge_list.size());
+					edge_list.push_back(edge);
+				}
+				else
+				{
+					UMRefineEdge& edge = edge_list.at(it->second);
+					if (edge.face_count == 1)
+					{
+						edge.opposite[1] = c;
+					}
+					++edge.face_count;
+					face_edge_list[i * 3 + k] = it->second;
+				}
+			}
+		}
+
+		// neighbors of vertices. edges of one or over two faces are boundary.
+		std::vector<IndexList> neighbor_list(vertex_size);
+		std::vector<IndexList> boundary_list(vertex_size);
+		for (UMRefineEdgeList::const_iterator it = edge_list.begin(); it != edge_list.end(); ++it)
+		{
+			neighbor_list[it->v0].push_back(it->v1);
+			neighbor_list[it->v1].push_back(it->v0);
+			if (it->face_count != 2)
+			{
+				boundary_list[it->v0].push_back(it->v1);
+				boundary_list[it->v1].push_back(it->v0);
+			}
+		}
+
+		refine = UMStencilTable();
+		refine.offset_list.reserve(vertex_size + edge_list.size() + 1);
+
+		// even vertices
+		for (int i = 0; i < vertex_size; ++i)
+		{
+			const IndexList& neighbor = neighbor_list[i];
+			const IndexList& boundary = boundary_list[i];
+			const int valence = static_cast<int>(neighbor.size());
+			if (boundary.empty() && valence >= 3)
+			{
+				const double c = 3.0 / 8.0 + 0.25 * cos(2.0 * M_PI / valence);
+				const double beta = (5.0 / 8.0 - c * c) / valence;
+				refine.add(i, static_cast<float>(1.0 - valence * beta));
+				for (int k = 0; k < valence; ++k)
+				{
+					refine.add(neighbor[k], static_cast<float>(beta));
+				}
+			}
+			else if (boundary.size() == 2)
+			{
+				refine.add(i, 0.75f);
+				refine.add(boundary[0], 0.125f);
+				refine.add(boundary[1], 0.125f);
+			}
+			else
+			{
+				// corner, non-manifold or isolated vertex
+				refine.add(i, 1.0f);
+			}
+			refine.end_row();
+		}
+
+		// odd vertices
+		for (UMRefineEdgeList::const_iterator it = edge_list.begin(); it != edge_list.end(); ++it)
+		{
+			if (it->face_count == 2)
+			{
+				refine.add(it->v0, 0.375f);
+				refine.add(it->v1, 0.375f);
+				refine.add(it->opposite[0], 0.125f);
+				refine.add(it->opposite[1], 0.125f);
+			}
+			else
+			{
+				refine.add(it->v0, 0.5f);
+				refine.add(it->v1, 0.5f);
+			}
+			refine.end_row();
+		}
+
+		// faces
+		refined_face_list.resize(face_size * 4);
+		for (int i = 0; i < face_size; ++i)
+		{
+			const UMVec3i& face = face_list.at(i);
+			const int ab = vertex_size + face_edge_list[i * 3 + 0];
+			const int bc = vertex_size + face_edge_list[i * 3 + 1];
+			const int ca = vertex_size + face_edge_list[i * 3 + 2];
+			refined_face_list[i * 4 + 0] = UMVec3i(face.x, ab, ca);
+			refined_face_list[i * 4 + 1] = UMVec3i(ab, face.y, bc);
+			refined_face_list[i * 4 + 2] = UMVec3i(ca, bc, face.z);
+			refined_face_list[i * 4 + 3] = UMVec3i(ab, bc, ca);
+		}
+	}
+
+#ifndef WITH_OSD
+	/**
+	 * compose stencils, so refined vertices are weighted base vertices directly
+	 * @param [in] refine refined vertices by coarse vertices
+	 * @param [in] coarse coarse vertices by base vertices
+	 * @param [in] base_vertex_size number of base vertices
+	 * @param [out] dst refined vertices by base vertices
+	 */
+	void compose_stencil(
+		const UMStencilTable& refine,
+		const UMStencilTable& coarse,
+		int base_vertex_size,
+		UMStencilTable& dst)
+	{
+		dst = UMStencilTable();
+		dst.offset_list.reserve(refine.offset_list.size());
+		std::vector<double> weight(base_vertex_size, 0.0);
+		IndexList row_of(base_vertex_size, -1);
+		IndexList used;
+		for (int i = 0, size = refine.size(); i < size; ++i)
+		{
+			for (int k = refine.offset_list[i]; k < refine.offset_list[i + 1]; ++k)
+			{
+				const int coarse_index = refine.index_list[k];
+				const double w = refine.weight_list[k];
+				for (int m = coarse.offset_list[coarse_index]; m < coarse.offset_list[coarse_index + 1]; ++m)
+				{
+					const int base_index = coarse.index_list[m];
+					if (row_of[base_index] != i)
+					{
+						row_of[base_index] = i;
+						used.push_back(base_index);
+					}
+					weight[base_index] += w * coarse.weight_list[m];
+				}
+			}
+			// ascending index for cache friendly gather
+			std::sort(used.begin(), used.end());
+			for (IndexList::const_iterator it = used.begin(); it != used.end(); ++it)
+			{
+				dst.add(*it, static_cast<float>(weight[*it]));
+				weight[*it] = 0.0;
+			}
+			used.clear();
+			dst.end_row();
+		}
+	}
+
+	/**
+	 * apply stencils to 4 float vectors
+	 * @param [in] table stencil table
+	 * @param [in] src base vectors, 4 floats each
+	 * @param [out] dst refined vectors, 4 floats each
+	 */
+	void apply_stencil(const UMStencilTable& table, const FloatList& src, FloatList& dst)
+	{
+		const int size = table.size();
+		dst.resize(size * 4);
+		const int* offset = &table.offset_list[0];
+		const int* index = table.index_list.empty() ? NULL : &table.index_list[0];
+		const float* weight = table.weight_list.empty() ? NULL : &table.weight_list[0];
+		const float* s = &src[0];
+		float* d = &dst[0];
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < size; ++i)
+		{
+#ifdef UM_SUBDIVISION_SSE
+			__m128 sum = _mm_setzero_ps();
+			for (int k = offset[i]; k < offset[i + 1]; ++k)
+			{
+				const __m128 v = _mm_loadu_ps(s + index[k] * 4);
+				sum = _mm_add_ps(sum, _mm_mul_ps(v, _mm_set1_ps(weight[k])));
+			}
+			_mm_storeu_ps(d + i * 4, sum);
 #else
+			float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (int k = offset[i]; k < offset[i + 1]; ++k)
+			{
+				const float* v = s + index[k] * 4;
+				sum[0] += v[0] * weight[k];
+				sum[1] += v[1] * weight[k];
+				sum[2] += v[2] * weight[k];
+				sum[3] += v[3] * weight[k];
+			}
+			d[i * 4 + 0] = sum[0];
+			d[i * 4 + 1] = sum[1];
+			d[i * 4 + 2] = sum[2];
+			d[i * 4 + 3] = sum[3];
+#endif // UM_SUBDIVISION_SSE
+		}
+	}
+#endif // WITH_OSD
+
+	/**
+	 * barycentric coordinates of base face at corners of refined faces in one base face.
+	 * the pattern is same for all base faces.
+	 */
+	void refine_barycentric(const BarycentricList& coarse, BarycentricList& dst)
+	{
+		const int face_size = static_cast<int>(coarse.size()) / 3;
+		dst.resize(face_size * 4 * 3);
+		for (int i = 0; i < face_size; ++i)
+		{
+			const UMVec3d& a = coarse[i * 3 + 0];
+			const UMVec3d& b = coarse[i * 3 + 1];
+			const UMVec3d& c = coarse[i * 3 + 2];
+			const UMVec3d ab = (a + b) * 0.5;
+			const UMVec3d bc = (b + c) * 0.5;
+			const UMVec3d ca = (c + a) * 0.5;
+			const UMVec3d corner[12] = { a, ab, ca, ab, b, bc, ca, bc, c, ab, bc, ca };
+			for (int k = 0; k < 12; ++k)
+			{
+				dst[i * 12 + k] = corner[k];
+			}
+		}
+	}
+
+	/**
+	 * keep faces around first faces and drop others.
+	 * vertices are renumbered in order of use.
+	 * @param [in] first_face_size number of first faces
+	 * @param [in,out] face_list faces. first faces are kept first.
+	 * @param [in,out] vertex_list vertices of faces
+	 */
+	void keep_ring(int first_face_size, umdraw::UMMesh::Vec3iList& face_list, umdraw::UMMesh::Vec3dList& vertex_list)
+	{
+		std::vector<char> is_inner(vertex_list.size(), 0);
+		for (int i = 0; i < first_face_size; ++i)
+		{
+			const UMVec3i& face = face_list[i];
+			is_inner[face.x] = is_inner[face.y] = is_inner[face.z] = 1;
+		}
+		IndexList new_index(vertex_list.size(), -1);
+		umdraw::UMMesh::Vec3dList kept_vertex_list;
+		size_t kept_face_size = 0;
+		for (size_t i = 0, size = face_list.size(); i < size; ++i)
+		{
+			const UMVec3i face = face_list[i];
+			if (!is_inner[face.x] && !is_inner[face.y] && !is_inner[face.z]) continue;
+			UMVec3i kept_face;
+			for (int k = 0; k < 3; ++k)
+			{
+				int& index = new_index[face[k]];
+				if (index < 0)
+				{
+					index = static_cast<int>(kept_vertex_list.size());
+					kept_vertex_list.push_back(vertex_list[face[k]]);
+				}
+				kept_face[k] = index;
+			}
+			face_list[kept_face_size++] = kept_face;
+		}
+		face_list.resize(kept_face_size);
+		vertex_list.swap(kept_vertex_list);
+	}
+} // anonymouse namespace
+
+#ifndef WITH_OSD
 
 /**
- * subdivision implementation
+ * subdivision implementation.
+ * loop subdivision by stencil tables from base vertices.
  */
 class UMSubdivision::SudivImpl
 {
 public:
-	SudivImpl(umdraw::UMMeshPtr mesh){}
+	SudivImpl(umdraw::UMMeshPtr mesh)
+		: mesh_(mesh)
+		, base_vertex_size_(0)
+		, base_face_size_(0)
+	{}
+
 	~SudivImpl() {}
+
+	/// create subdivided mesh
+	umdraw::UMMeshPtr create_subdivided_mesh(unsigned int level)
+	{
+		if (!mesh_) return umdraw::UMMeshPtr();
+		if (level == 0) return umdraw::UMMeshPtr();
+		if (!init_level(level)) return umdraw::UMMeshPtr();
+
+		const RefinedLevel& refined = level_list_.at(level - 1);
+		umdraw::UMMeshPtr result = std::make_shared<umdraw::UMMesh>();
+		result->mutable_face_list() = refined.face_list;
+		if (!update_result_mesh(result, refined))
+		{
+			return umdraw::UMMeshPtr();
+		}
+
+		const int children = 1 << (2 * level);
+
+		// face varying uv by base face
+		const umdraw::UMMesh::Vec2dList& base_uv_list = mesh_->uv_list();
+		if (base_uv_list.size() == static_cast<size_t>(base_face_size_ * 3))
+		{
+			const int face_size = static_cast<int>(refined.face_list.size());
+			umdraw::UMMesh::Vec2dList& uv_list = result->mutable_uv_list();
+			uv_list.resize(face_size * 3);
+			for (int i = 0; i < face_size; ++i)
+			{
+				const int base = (i / children) * 3;
+				const int pattern = (i % children) * 3;
+				for (int k = 0; k < 3; ++k)
+				{
+					const UMVec3d& uvw = refined.barycentric_list[pattern + k];
+					uv_list[i * 3 + k] = 
+						base_uv_list[base + 0] * uvw.x
+						+ base_uv_list[base + 1] * uvw.y
+						+ base_uv_list[base + 2] * uvw.z;
+				}
+			}
+		}
+
+		// refined faces keep order of base faces
+		const umdraw::UMMaterialList& material_list = mesh_->material_list();
+		for (umdraw::UMMaterialList::const_iterator it = material_list.begin(); it != material_list.end(); ++it)
+		{
+			umdraw::UMMaterialPtr material = clone_material(*it);
+			material->set_polygon_count((*it)->polygon_count() * children);
+			result->mutable_material_list().push_back(material);
+		}
+		return result;
+	}
+
+	/// update subdivided mesh
+	bool update_subdivided_mesh(umdraw::UMMeshPtr subdivided_mesh, unsigned int level)
+	{
+		if (!mesh_) return false;
+		if (!subdivided_mesh) return false;
+		if (level == 0) return false;
+		if (!init_level(level)) return false;
+
+		const RefinedLevel& refined = level_list_.at(level - 1);
+		if (subdivided_mesh->face_list().size() != refined.face_list.size()) return false;
+		return update_result_mesh(subdivided_mesh, refined);
+	}
+
+	/// triangle count at level. loop splits a triangle to 4 triangles.
+	size_t triangle_count(unsigned int level) const
+	{
+		if (!mesh_) return 0;
+		if (level > 0 && level <= level_list_.size())
+		{
+			return level_list_.at(level - 1).face_list.size();
+		}
+		return mesh_->face_list().size() << (2 * level);
+	}
+
+private:
+	/**
+	 * topology and stencils of a level
+	 */
+	struct RefinedLevel
+	{
+		/// refined vertices by base vertices
+		UMStencilTable stencil;
+		umdraw::UMMesh::Vec3iList face_list;
+		/// corners of refined faces in a base face
+		BarycentricList barycentric_list;
+	};
+	typedef std::vector<RefinedLevel> RefinedLevelList;
+
+	umdraw::UMMeshPtr mesh_;
+	int base_vertex_size_;
+	int base_face_size_;
+	RefinedLevelList level_list_;
+	FloatList src_buffer_;
+	FloatList dst_buffer_;
+
+	// build refinement tables up to the level
+	bool init_level(unsigned int level)
+	{
+		const int vertex_size = static_cast<int>(mesh_->vertex_list().size());
+		const int face_size = static_cast<int>(mesh_->face_list().size());
+		if (vertex_size == 0 || face_size == 0) return false;
+		if (vertex_size != base_vertex_size_ || face_size != base_face_size_)
+		{
+			level_list_.clear();
+			base_vertex_size_ = vertex_size;
+			base_face_size_ = face_size;
+		}
+		while (level_list_.size() < level)
+		{
+			level_list_.push_back(RefinedLevel());
+			RefinedLevel& refined = level_list_.back();
+			if (level_list_.size() == 1)
+			{
+				refine_topology(mesh_->face_list(), vertex_size, refined.stencil, refined.face_list);
+				BarycentricList base_barycentric(3);
+				base_barycentric[0] = UMVec3d(1, 0, 0);
+				base_barycentric[1] = UMVec3d(0, 1, 0);
+				base_barycentric[2] = UMVec3d(0, 0, 1);
+				refine_barycentric(base_barycentric, refined.barycentric_list);
+			}
+			else
+			{
+				const RefinedLevel& coarse = level_list_.at(level_list_.size() - 2);
+				UMStencilTable refine;
+				refine_topology(coarse.face_list, coarse.stencil.size(), refine, refined.face_list);
+				compose_stencil(refine, coarse.stencil, vertex_size, refined.stencil);
+				refine_barycentric(coarse.barycentric_list, refined.barycentric_list);
+			}
+		}
+		return true;
+	}
+
+	// apply stencils to current base vertices
+	bool update_result_mesh(umdraw::UMMeshPtr result, const RefinedLevel& refined)
+	{
+		const umdraw::UMMesh::Vec3dList& base_vertex_list = mesh_->vertex_list();
+		const int vertex_size = static_cast<int>(base_vertex_list.size());
+		if (vertex_size != base_vertex_size_) return false;
+		const int refined_size = refined.stencil.size();
+
+		src_buffer_.resize(vertex_size * 4);
+		for (int i = 0; i < vertex_size; ++i)
+		{
+			const UMVec3d& v = base_vertex_list[i];
+			src_buffer_[i * 4 + 0] = static_cast<float>(v.x);
+			src_buffer_[i * 4 + 1] = static_cast<float>(v.y);
+			src_buffer_[i * 4 + 2] = static_cast<float>(v.z);
+			src_buffer_[i * 4 + 3] = 0.0f;
+		}
+		apply_stencil(refined.stencil, src_buffer_, dst_buffer_);
+		umdraw::UMMesh::Vec3dList& vertex_list = result->mutable_vertex_list();
+		vertex_list.resize(refined_size);
+		for (int i = 0; i < refined_size; ++i)
+		{
+			vertex_list[i] = UMVec3d(dst_buffer_[i * 4 + 0], dst_buffer_[i * 4 + 1], dst_buffer_[i * 4 + 2]);
+		}
+
+		// vertex colors
+		const umdraw::UMMesh::Vec4dList& base_color_list = mesh_->vertex_color_list();
+		if (base_color_list.size() == static_cast<size_t>(vertex_size))
+		{
+			for (int i = 0; i < vertex_size; ++i)
+			{
+				// color list is rgb
+				const UMVec3d& c = base_color_list[i];
+				src_buffer_[i * 4 + 0] = static_cast<float>(c.x);
+				src_buffer_[i * 4 + 1] = static_cast<float>(c.y);
+				src_buffer_[i * 4 + 2] = static_cast<float>(c.z);
+				src_buffer_[i * 4 + 3] = 0.0f;
+			}
+			apply_stencil(refined.stencil, src_buffer_, dst_buffer_);
+			umdraw::UMMesh::Vec4dList& color_list = result->mutable_vertex_color_list();
+			color_list.resize(refined_size);
+			for (int i = 0; i < refined_size; ++i)
+			{
+				color_list[i] = UMVec3d(dst_buffer_[i * 4 + 0], dst_buffer_[i * 4 + 1], dst_buffer_[i * 4 + 2]);
+			}
+		}
+
+		result->create_normals(true);
+		result->update_box();
+		return true;
+	}
 };
 
 #endif // WITH_OSD
@@ -283,6 +918,7 @@ public:
  */
 UMSubdivision::UMSubdivision(umdraw::UMMeshPtr mesh)
 	: impl_(new UMSubdivision::SudivImpl(mesh))
+	, mesh_(mesh)
 {
 }
 
@@ -298,11 +934,147 @@ UMSubdivision::~UMSubdivision()
  */
 umdraw::UMMeshPtr UMSubdivision::subdivided_mesh(unsigned int level)
 {
-#ifdef WITH_OSD
 	return impl_->create_subdivided_mesh(level);
-#else
-	return umdraw::UMMeshPtr();
-#endif
+}
+
+/**
+ * update subdivided mesh
+ */
+bool UMSubdivision::update_subdivided_mesh(umdraw::UMMeshPtr subdivided_mesh, unsigned int level)
+{
+	return impl_->update_subdivided_mesh(subdivided_mesh, level);
+}
+
+/**
+ * get triangle count of subdivided mesh
+ */
+size_t UMSubdivision::triangle_count(unsigned int level) const
+{
+	return impl_->triangle_count(level);
+}
+
+/**
+ * get one-ring of a base face
+ */
+bool UMSubdivision::face_ring(int face_index, UMSubdivisionRing& ring)
+{
+	if (!mesh_) return false;
+	const umdraw::UMMesh::Vec3iList& face_list = mesh_->face_list();
+	const int face_size = static_cast<int>(face_list.size());
+	const int vertex_size = static_cast<int>(mesh_->vertex_list().size());
+	if (face_index < 0 || face_index >= face_size) return false;
+	if (static_cast<int>(vertex_face_list_.size()) != vertex_size)
+	{
+		vertex_face_list_.clear();
+		vertex_face_list_.resize(vertex_size);
+		for (int i = 0; i < face_size; ++i)
+		{
+			const UMVec3i& face = face_list[i];
+			for (int k = 0; k < 3; ++k)
+			{
+				if (face[k] < 0 || face[k] >= vertex_size) continue;
+				vertex_face_list_[face[k]].push_back(i);
+			}
+		}
+	}
+
+	// base face first, then faces around its vertices
+	const UMVec3i& base_face = face_list[face_index];
+	IndexList ring_face_list(1, face_index);
+	for (int k = 0; k < 3; ++k)
+	{
+		if (base_face[k] < 0 || base_face[k] >= vertex_size) return false;
+		const IndexList& faces = vertex_face_list_[base_face[k]];
+		for (IndexList::const_iterator it = faces.begin(); it != faces.end(); ++it)
+		{
+			if (std::find(ring_face_list.begin(), ring_face_list.end(), *it) == ring_face_list.end())
+			{
+				ring_face_list.push_back(*it);
+			}
+		}
+	}
+
+	ring.vertex_index_list.clear();
+	ring.face_list.resize(ring_face_list.size());
+	for (size_t i = 0, size = ring_face_list.size(); i < size; ++i)
+	{
+		const UMVec3i& face = face_list[ring_face_list[i]];
+		for (int k = 0; k < 3; ++k)
+		{
+			if (face[k] < 0 || face[k] >= vertex_size) return false;
+			IndexList::iterator it = std::find(ring.vertex_index_list.begin(), ring.vertex_index_list.end(), face[k]);
+			ring.face_list[i][k] = static_cast<int>(it - ring.vertex_index_list.begin());
+			if (it == ring.vertex_index_list.end())
+			{
+				ring.vertex_index_list.push_back(face[k]);
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * refine a base face alone.
+ * refined vertices in a face depend only on faces around the face at the level before,
+ * so other faces are dropped at each level.
+ */
+bool UMSubdivision::refine_face(
+	const UMSubdivisionRing& ring, 
+	const std::vector<UMVec3d>& ring_vertex_list, 
+	unsigned int level, 
+	std::vector<UMVec3d>& grid_vertex_list)
+{
+	if (ring.face_list.empty()) return false;
+	if (ring_vertex_list.size() != ring.vertex_index_list.size()) return false;
+
+	umdraw::UMMesh::Vec3iList face_list(ring.face_list);
+	umdraw::UMMesh::Vec3dList vertex_list(ring_vertex_list);
+	BarycentricList barycentric_list(3);
+	barycentric_list[0] = UMVec3d(1, 0, 0);
+	barycentric_list[1] = UMVec3d(0, 1, 0);
+	barycentric_list[2] = UMVec3d(0, 0, 1);
+
+	UMStencilTable refine;
+	umdraw::UMMesh::Vec3iList refined_face_list;
+	umdraw::UMMesh::Vec3dList refined_vertex_list;
+	BarycentricList refined_barycentric_list;
+	for (unsigned int i = 0; i < level; ++i)
+	{
+		refine_topology(face_list, static_cast<int>(vertex_list.size()), refine, refined_face_list);
+		const int refined_size = refine.size();
+		refined_vertex_list.resize(refined_size);
+		for (int k = 0; k < refined_size; ++k)
+		{
+			UMVec3d v(0);
+			for (int m = refine.offset_list[k]; m < refine.offset_list[k + 1]; ++m)
+			{
+				v += vertex_list[refine.index_list[m]] * refine.weight_list[m];
+			}
+			refined_vertex_list[k] = v;
+		}
+		face_list.swap(refined_face_list);
+		vertex_list.swap(refined_vertex_list);
+		// faces of the base face are first
+		keep_ring(1 << (2 * (i + 1)), face_list, vertex_list);
+		refine_barycentric(barycentric_list, refined_barycentric_list);
+		barycentric_list.swap(refined_barycentric_list);
+	}
+
+	const int n = 1 << level;
+	const int children = 1 << (2 * level);
+	grid_vertex_list.resize((n + 1) * (n + 2) / 2);
+	for (int i = 0; i < children; ++i)
+	{
+		const UMVec3i& face = face_list[i];
+		for (int k = 0; k < 3; ++k)
+		{
+			const UMVec3d& uvw = barycentric_list[i * 3 + k];
+			const int u = static_cast<int>(floor(uvw.y * n + 0.5));
+			const int v = static_cast<int>(floor(uvw.z * n + 0.5));
+			grid_vertex_list[v * (n + 1) - (v * (v - 1)) / 2 + u] = vertex_list[face[k]];
+		}
+	}
+	return true;
 }
 
 } // umrt
@@ -11,6 +11,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 #include "UMMacro.h"
 #include "UMVector.h"
 #include "UMMathTypes.h"
@@ -27,7 +28,21 @@ class UMSubdivision;
 typedef std::shared_ptr<UMSubdivision> UMSubdivisionPtr;
 
 /**
- * rays
+ * faces around the 3 vertices of a base face.
+ * loop subdivision of the face depends only on them.
+ */
+struct UMSubdivisionRing
+{
+	/// base vertex index of each local vertex
+	std::vector<int> vertex_index_list;
+	/// faces of local vertices. first face is the base face.
+	std::vector<UMVec3i> face_list;
+};
+
+/**
+ * subdivision of a triangle mesh.
+ * without OpenSubdiv, refinement stencils of the mesh topology are built once per level,
+ * and each subdivided mesh only applies them to the current vertices of the mesh.
  */
 class UMSubdivision 
 {
@@ -41,10 +56,53 @@ public:
 	 */
 	umdraw::UMMeshPtr subdivided_mesh(unsigned int level);
 
+	/**
+	 * update vertices of subdivided mesh from current vertices of base mesh.
+	 * faces of base mesh must not be changed after subdivided_mesh.
+	 * @param [in,out] subdivided_mesh mesh created by subdivided_mesh
+	 * @param [in] level subdivision level of subdivided_mesh
+	 * @retval success or failed
+	 */
+	bool update_subdivided_mesh(umdraw::UMMeshPtr subdivided_mesh, unsigned int level);
+
+	/**
+	 * get triangle count of subdivided mesh without subdividing
+	 * @param [in] level subdivision level. 0 is base mesh.
+	 */
+	size_t triangle_count(unsigned int level) const;
+
+	/**
+	 * get one-ring of a base face
+	 * @param [in] face_index base face
+	 * @param [out] ring faces around the base face
+	 * @retval success or failed
+	 */
+	bool face_ring(int face_index, UMSubdivisionRing& ring);
+
+	/**
+	 * refine a base face alone by loop subdivision of its one-ring.
+	 * same as the face of a mesh subdivided by stencils.
+	 * @param [in] ring one-ring of the face
+	 * @param [in] ring_vertex_list current positions of local vertices of the ring
+	 * @param [in] level subdivision level. edges of the face are split to n = 2^level segments.
+	 * @param [out] grid_vertex_list refined vertices on a triangle grid.
+	 * vertex (i, j) is at barycentric (1 - (i + j) / n, i / n, j / n) of the face,
+	 * and its index is j * (n + 1) - j * (j - 1) / 2 + i.
+	 * @retval success or failed
+	 */
+	static bool refine_face(
+		const UMSubdivisionRing& ring, 
+		const std::vector<UMVec3d>& ring_vertex_list, 
+		unsigned int level, 
+		std::vector<UMVec3d>& grid_vertex_list);
+
 private:
 	class SudivImpl;
 	typedef std::unique_ptr<SudivImpl> SubdivImplPtr;
 	SubdivImplPtr impl_;
+	umdraw::UMMeshPtr mesh_;
+	/// faces of each base vertex for face_ring
+	std::vector< std::vector<int> > vertex_face_list_;
 };
 
 } // umrt
@@ -0,0 +1,438 @@
+/**
+ * @file UMSubdivisionPatch.cpp
+ * a triangle patch tessellated on demand
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMSubdivisionPatch.h"
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+namespace
+{
+	using namespace umrt;
+
+	/// level 6 is 4096 triangles per patch
+	const unsigned int level_limit = 6;
+
+	/**
+	 * tessellated patch.
+	 * triangles are in a quad tree which splits a triangle into 4 triangles recursively.
+	 */
+	class Tessellation : public UMCachedGeometry
+	{
+	public:
+		/**
+		 * quad tree node
+		 */
+		struct Node
+		{
+			float box_min[3];
+			float box_max[3];
+			/// branch: first of 4 children, leaf: -(triangle index + 1)
+			int child;
+		};
+
+		/// x, y, z
+		std::vector<float> position_list;
+		/// x, y, z
+		std::vector<float> normal_list;
+		/// v, w of base triangle
+		std::vector<float> domain_list;
+		/// 3 indices of each triangle
+		std::vector<unsigned int> index_list;
+		std::vector<Node> node_list;
+
+		virtual size_t memory_size() const
+		{
+			return sizeof(Tessellation)
+				+ position_list.size() * sizeof(float)
+				+ normal_list.size() * sizeof(float)
+				+ domain_list.size() * sizeof(float)
+				+ index_list.size() * sizeof(unsigned int)
+				+ node_list.size() * sizeof(Node);
+		}
+
+		UMVec3d position(unsigned int index) const
+		{
+			const float* p = &position_list[index * 3];
+			return UMVec3d(p[0], p[1], p[2]);
+		}
+
+		UMVec3d normal(unsigned int index) const
+		{
+			const float* n = &normal_list[index * 3];
+			return UMVec3d(n[0], n[1], n[2]);
+		}
+
+		UMVec3d domain(unsigned int index) const
+		{
+			const float* d = &domain_list[index * 2];
+			return UMVec3d(1.0 - d[0] - d[1], d[0], d[1]);
+		}
+	};
+	typedef std::shared_ptr<const Tessellation> TessellationPtr;
+
+	/**
+	 * index of vertex (i, j) on a triangle grid of n segments
+	 */
+	unsigned int grid_index(int i, int j, int n)
+	{
+		return static_cast<unsigned int>(j * (n + 1) - (j * (j - 1)) / 2 + i);
+	}
+
+	/**
+	 * build a quad tree node of a sub triangle.
+	 * up triangle is (a, b), (a+h, b), (a, b+h).
+	 * down triangle is (a+h, b), (a+h, b+h), (a, b+h).
+	 */
+	void build_node(Tessellation& t, int node_index, bool is_up, int a, int b, int h, int n)
+	{
+		if (h == 1)
+		{
+			const unsigned int triangle_index = static_cast<unsigned int>(t.index_list.size() / 3);
+			unsigned int index[3];
+			if (is_up)
+			{
+				index[0] = grid_index(a, b, n);
+				index[1] = grid_index(a + 1, b, n);
+				index[2] = grid_index(a, b + 1, n);
+			}
+			else
+			{
+				index[0] = grid_index(a + 1, b, n);
+				index[1] = grid_index(a + 1, b + 1, n);
+				index[2] = grid_index(a, b + 1, n);
+			}
+			Tessellation::Node& node = t.node_list[node_index];
+			node.child = -static_cast<int>(triangle_index + 1);
+			for (int k = 0; k < 3; ++k)
+			{
+				node.box_min[k] = FLT_MAX;
+				node.box_max[k] = -FLT_MAX;
+			}
+			for (int v = 0; v < 3; ++v)
+			{
+				t.index_list.push_back(index[v]);
+				const float* p = &t.position_list[index[v] * 3];
+				for (int k = 0; k < 3; ++k)
+				{
+					node.box_min[k] = std::min(node.box_min[k], p[k]);
+					node.box_max[k] = std::max(node.box_max[k], p[k]);
+				}
+			}
+			return;
+		}
+
+		const int half = h / 2;
+		const int first = static_cast<int>(t.node_list.size());
+		t.node_list.resize(first + 4);
+		t.node_list[node_index].child = first;
+		if (is_up)
+		{
+			build_node(t, first + 0, true, a, b, half, n);
+			build_node(t, first + 1, true, a + half, b, half, n);
+			build_node(t, first + 2, true, a, b + half, half, n);
+			build_node(t, first + 3, false, a, b, half, n);
+		}
+		else
+		{
+			build_node(t, first + 0, false, a + half, b, half, n);
+			build_node(t, first + 1, false, a, b + half, half, n);
+			build_node(t, first + 2, false, a + half, b + half, half, n);
+			build_node(t, first + 3, true, a + half, b + half, half, n);
+		}
+		Tessellation::Node& node = t.node_list[node_index];
+		for (int k = 0; k < 3; ++k)
+		{
+			node.box_min[k] = FLT_MAX;
+			node.box_max[k] = -FLT_MAX;
+		}
+		for (int c = 0; c < 4; ++c)
+		{
+			const Tessellation::Node& child = t.node_list[first + c];
+			for (int k = 0; k < 3; ++k)
+			{
+				node.box_min[k] = std::min(node.box_min[k], child.box_min[k]);
+				node.box_max[k] = std::max(node.box_max[k], child.box_max[k]);
+			}
+		}
+	}
+
+	/**
+	 * slab test of a node box
+	 */
+	bool intersect_node(
+		const float* box_min,
+		const float* box_max,
+		const UMVec3d& origin,
+		const UMVec3d& inv_dir,
+		double tmin,
+		double tmax)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			double t0 = (box_min[i] - origin[i]) * inv_dir[i];
+			double t1 = (box_max[i] - origin[i]) * inv_dir[i];
+			if (t0 > t1) std::swap(t0, t1);
+			tmin = t0 > tmin ? t0 : tmin;
+			tmax = t1 < tmax ? t1 : tmax;
+			if (tmin > tmax) return false;
+		}
+		return true;
+	}
+
+	/**
+	 * traverse quad tree
+	 * @retval index of nearest triangle, or -1
+	 */
+	int traverse(const Tessellation& t, const UMRay& ray, UMShaderParameter* parameter)
+	{
+		const UMVec3d& origin = ray.origin();
+		const UMVec3d inv_dir(1.0 / ray.direction().x, 1.0 / ray.direction().y, 1.0 / ray.direction().z);
+		UMRay local_ray(ray);
+
+		int hit_triangle = -1;
+		int node_stack[4 * level_limit + 1];
+		int node_stack_index = 0;
+		node_stack[node_stack_index++] = 0;
+		while (node_stack_index > 0)
+		{
+			const Tessellation::Node& node = t.node_list[node_stack[--node_stack_index]];
+			if (!intersect_node(node.box_min, node.box_max, origin, inv_dir, local_ray.tmin(), local_ray.tmax())) continue;
+			if (node.child >= 0)
+			{
+				for (int c = 0; c < 4; ++c)
+				{
+					node_stack[node_stack_index++] = node.child + c;
+				}
+				continue;
+			}
+			const int triangle_index = -node.child - 1;
+			const unsigned int* index = &t.index_list[triangle_index * 3];
+			const UMVec3d v0 = t.position(index[0]);
+			const UMVec3d v1 = t.position(index[1]);
+			const UMVec3d v2 = t.position(index[2]);
+			if (parameter)
+			{
+				if (UMTriangle::intersects(v0, v1, v2, local_ray, *parameter))
+				{
+					hit_triangle = triangle_index;
+					local_ray.set_tmax(parameter->distance);
+				}
+			}
+			else if (UMTriangle::intersects(v0, v1, v2, local_ray))
+			{
+				return triangle_index;
+			}
+		}
+		return hit_triangle;
+	}
+
+} // anonymouse namespace
+
+namespace umrt
+{
+
+/**
+ * create
+ */
+UMSubdivisionPatchPtr UMSubdivisionPatch::create(
+	UMTrianglePtr triangle,
+	const UMSubdivisionRing& ring,
+	UMGeometryCachePtr cache,
+	UMTessellationSettingPtr setting,
+	unsigned int max_level)
+{
+	if (!triangle || !cache) return UMSubdivisionPatchPtr();
+	if (!triangle->mesh() || ring.face_list.empty()) return UMSubdivisionPatchPtr();
+	UMSubdivisionPatchPtr patch(std::make_shared<UMSubdivisionPatch>());
+	patch->triangle_ = triangle;
+	patch->ring_ = ring;
+	patch->cache_ = cache;
+	patch->setting_ = setting;
+	patch->max_level_ = std::min(max_level, level_limit);
+	patch->update_box();
+	return patch;
+}
+
+/**
+ * constructor
+ */
+UMSubdivisionPatch::UMSubdivisionPatch()
+	: revision_(0)
+	, max_level_(0)
+	, edge_length_(0)
+{
+}
+
+/**
+ * update one-ring vertices and box
+ */
+void UMSubdivisionPatch::update_box()
+{
+	box_.init();
+	if (!triangle_) return;
+	triangle_->update_box();
+	umdraw::UMMeshPtr mesh = triangle_->mesh();
+	if (!mesh) return;
+
+	UMVec3d p[3];
+	UMVec3d n[3];
+	if (!triangle_->vertices(p[0], p[1], p[2])) return;
+	const UMVec3d face_normal = (p[1] - p[0]).cross(p[2] - p[0]).normalized();
+	if (!triangle_->normals(n[0], n[1], n[2]))
+	{
+		n[0] = n[1] = n[2] = face_normal;
+	}
+	for (int i = 0; i < 3; ++i)
+	{
+		n[i] = n[i].length_sq() > 0.0 ? n[i].normalized() : face_normal;
+	}
+
+	// cached tessellation is stale when the one-ring moved
+	const umdraw::UMMesh::Vec3dList& vertex_list = mesh->vertex_list();
+	const size_t ring_vertex_size = ring_.vertex_index_list.size();
+	bool is_changed = ring_vertex_list_.size() != ring_vertex_size;
+	ring_vertex_list_.resize(ring_vertex_size);
+	for (size_t i = 0; i < ring_vertex_size; ++i)
+	{
+		const int index = ring_.vertex_index_list[i];
+		if (index < 0 || index >= static_cast<int>(vertex_list.size())) continue;
+		const UMVec3d& v = vertex_list[index];
+		if (v != ring_vertex_list_[i]) is_changed = true;
+		ring_vertex_list_[i] = v;
+		// loop surface is in the hull of the one-ring
+		box_.extend(v);
+	}
+	for (int i = 0; i < 3; ++i)
+	{
+		normal_[i] = n[i];
+	}
+	if (is_changed)
+	{
+		++revision_;
+		// tessellation of old revision is never used
+		if (cache_) cache_->remove_owner(id());
+	}
+	edge_length_ = std::max(std::max((p[1] - p[0]).length(), (p[2] - p[1]).length()), (p[0] - p[2]).length());
+}
+
+/**
+ * get subdivision level for current camera.
+ * the patch is divided until its longest edge is about edge_pixels on screen.
+ */
+unsigned int UMSubdivisionPatch::level() const
+{
+	if (!setting_ || setting_->pixel_scale <= 0.0) return max_level_;
+	const double distance = std::max((box_.center() - setting_->camera_position).length(), DBL_EPSILON);
+	double pixels = edge_length_ * setting_->pixel_scale / distance;
+	unsigned int level = 0;
+	while (level < max_level_ && pixels > setting_->edge_pixels)
+	{
+		pixels *= 0.5;
+		++level;
+	}
+	return level;
+}
+
+/**
+ * tessellate patch.
+ * normals are interpolated from base vertex normals.
+ */
+UMCachedGeometryPtr UMSubdivisionPatch::tessellate(unsigned int level) const
+{
+	std::vector<UMVec3d> grid_vertex_list;
+	if (!UMSubdivision::refine_face(ring_, ring_vertex_list_, level, grid_vertex_list)) return UMCachedGeometryPtr();
+
+	std::shared_ptr<Tessellation> t(std::make_shared<Tessellation>());
+	const int n = 1 << level;
+	const size_t vertex_count = static_cast<size_t>((n + 1) * (n + 2) / 2);
+	t->position_list.resize(vertex_count * 3);
+	t->normal_list.resize(vertex_count * 3);
+	t->domain_list.resize(vertex_count * 2);
+	for (int j = 0; j <= n; ++j)
+	{
+		for (int i = 0; i + j <= n; ++i)
+		{
+			const unsigned int index = grid_index(i, j, n);
+			const double v = i / static_cast<double>(n);
+			const double w = j / static_cast<double>(n);
+			const UMVec3d uvw(1.0 - v - w, v, w);
+			const UMVec3d& p = grid_vertex_list[index];
+			const UMVec3d normal = (normal_[0] * uvw.x + normal_[1] * uvw.y + normal_[2] * uvw.z).normalized();
+			for (int k = 0; k < 3; ++k)
+			{
+				t->position_list[index * 3 + k] = static_cast<float>(p[k]);
+				t->normal_list[index * 3 + k] = static_cast<float>(normal[k]);
+			}
+			t->domain_list[index * 2 + 0] = static_cast<float>(v);
+			t->domain_list[index * 2 + 1] = static_cast<float>(w);
+		}
+	}
+	t->index_list.reserve(static_cast<size_t>(n) * n * 3);
+	t->node_list.reserve(static_cast<size_t>((static_cast<size_t>(n) * n * 4 - 1) / 3));
+	t->node_list.resize(1);
+	build_node(*t, 0, true, 0, 0, n, n);
+	return t;
+}
+
+/**
+ * get tessellation from cache, or tessellate
+ */
+UMCachedGeometryPtr UMSubdivisionPatch::tessellation(unsigned int level) const
+{
+	const UMGeometryCache::Key key = UMGeometryCache::key(id(), ((revision_ & 0xFFFFFF) << 8) | level);
+	if (UMCachedGeometryPtr geometry = cache_->find(key))
+	{
+		return geometry;
+	}
+	return cache_->insert(key, tessellate(level));
+}
+
+/**
+ * ray intersection
+ */
+bool UMSubdivisionPatch::intersects(const UMRay& ray, UMShaderParameter& parameter) const
+{
+	if (!triangle_) return false;
+	TessellationPtr t = std::static_pointer_cast<const Tessellation>(tessellation(level()));
+	if (!t) return false;
+
+	const int triangle_index = traverse(*t, ray, &parameter);
+	if (triangle_index < 0) return false;
+
+	const unsigned int* index = &t->index_list[triangle_index * 3];
+	const UMVec3d local_uvw = parameter.uvw;
+	parameter.uvw =
+		t->domain(index[0]) * local_uvw.x +
+		t->domain(index[1]) * local_uvw.y +
+		t->domain(index[2]) * local_uvw.z;
+	triangle_->shade(ray, parameter);
+	parameter.normal = (
+		t->normal(index[0]) * local_uvw.x +
+		t->normal(index[1]) * local_uvw.y +
+		t->normal(index[2]) * local_uvw.z).normalized();
+	parameter.face_index = triangle_->face_index();
+	parameter.primitive = this;
+	return true;
+}
+
+/**
+ * ray intersection
+ */
+bool UMSubdivisionPatch::intersects(const UMRay& ray) const
+{
+	if (!triangle_) return false;
+	TessellationPtr t = std::static_pointer_cast<const Tessellation>(tessellation(level()));
+	if (!t) return false;
+	return traverse(*t, ray, NULL) >= 0;
+}
+
+} // umrt
@@ -0,0 +1,151 @@
+/**
+ * @file UMSubdivisionPatch.h
+ * a triangle patch tessellated on demand
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "UMMacro.h"
+#include "UMVector.h"
+#include "UMMathTypes.h"
+#include "UMBox.h"
+#include "UMPrimitive.h"
+#include "UMRay.h"
+#include "UMShaderParameter.h"
+#include "UMTriangle.h"
+#include "UMGeometryCache.h"
+#include "UMSubdivision.h"
+
+namespace umrt
+{
+
+class UMSubdivisionPatch;
+typedef std::shared_ptr<UMSubdivisionPatch> UMSubdivisionPatchPtr;
+
+class UMTessellationSetting;
+typedef std::shared_ptr<UMTessellationSetting> UMTessellationSettingPtr;
+
+/**
+ * screen space tessellation setting shared by patches
+ */
+class UMTessellationSetting
+{
+public:
+	UMTessellationSetting()
+		: camera_position(0)
+		, pixel_scale(0)
+		, edge_pixels(4.0)
+	{}
+
+	/**
+	 * camera position
+	 */
+	UMVec3d camera_position;
+
+	/**
+	 * pixels of unit length at unit distance from camera. 0 is not initialized.
+	 */
+	double pixel_scale;
+
+	/**
+	 * target edge length of tessellated triangles in pixels
+	 */
+	double edge_pixels;
+};
+
+/**
+ * a triangle patch tessellated on demand.
+ * the patch is loop subdivision of a base triangle refined from its one-ring,
+ * so it is same surface as the mesh subdivided by UMSubdivision.
+ * only the box of the one-ring is in the scene bvh.
+ * the first ray which reaches the box tessellates the patch to a level
+ * decided by its size on screen, then the result is kept in a geometry cache.
+ */
+class UMSubdivisionPatch : public UMPrimitive
+{
+	DISALLOW_COPY_AND_ASSIGN(UMSubdivisionPatch);
+public:
+	/**
+	 * create
+	 * @param [in] triangle base triangle
+	 * @param [in] ring one-ring of base triangle. see UMSubdivision::face_ring
+	 * @param [in] cache cache of tessellated geometry
+	 * @param [in] setting screen space tessellation setting
+	 * @param [in] max_level max subdivision level
+	 */
+	static UMSubdivisionPatchPtr create(
+		UMTrianglePtr triangle,
+		const UMSubdivisionRing& ring,
+		UMGeometryCachePtr cache,
+		UMTessellationSettingPtr setting,
+		unsigned int max_level);
+
+	UMSubdivisionPatch();
+
+	~UMSubdivisionPatch() {}
+
+	/**
+	 * ray intersection
+	 * @param [in] ray a ray
+	 * @param [in,out] parameter shading parameters
+	 */
+	virtual bool intersects(const UMRay& ray, UMShaderParameter& parameter) const;
+
+	/**
+	 * ray intersection
+	 * @param [in] ray a ray
+	 */
+	virtual bool intersects(const UMRay& ray) const;
+
+	/**
+	 * get box
+	 */
+	virtual const umbase::UMBox& box() const { return box_; }
+
+	/**
+	 * update one-ring vertices and box
+	 */
+	virtual void update_box();
+
+	/**
+	 * get base triangle
+	 */
+	UMTrianglePtr triangle() const { return triangle_; }
+
+	/**
+	 * get subdivision level for current camera
+	 */
+	unsigned int level() const;
+
+	/**
+	 * get max subdivision level
+	 */
+	unsigned int max_level() const { return max_level_; }
+
+private:
+	UMCachedGeometryPtr tessellation(unsigned int level) const;
+	UMCachedGeometryPtr tessellate(unsigned int level) const;
+
+	unsigned int revision_;
+	unsigned int max_level_;
+	UMTrianglePtr triangle_;
+	UMGeometryCachePtr cache_;
+	UMTessellationSettingPtr setting_;
+
+	UMSubdivisionRing ring_;
+	/// current vertices of the one-ring
+	std::vector<UMVec3d> ring_vertex_list_;
+	UMVec3d normal_[3];
+	double edge_length_;
+	umbase::UMBox box_;
+};
+
+} // umrt
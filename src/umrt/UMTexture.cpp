@@ -0,0 +1,438 @@
+/**
+ * @file UMTexture.cpp
+ * mip-mapped texture for rendering
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMTexture.h"
+#include "UMTextureCache.h"
+#include "UMMath.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+
+namespace
+{
+	using namespace umrt;
+
+	std::atomic<unsigned int> global_texture_id_counter(1);
+
+	/**
+	 * float to half float
+	 */
+	unsigned short float_to_half(float value)
+	{
+		unsigned int bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		const unsigned int sign = (bits >> 16) & 0x8000;
+		const int exponent = static_cast<int>((bits >> 23) & 0xff) - 127 + 15;
+		unsigned int mantissa = bits & 0x7fffff;
+		if (((bits >> 23) & 0xff) == 0xff)
+		{
+			// inf or nan
+			return static_cast<unsigned short>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+		}
+		if (exponent >= 0x1f)
+		{
+			return static_cast<unsigned short>(sign | 0x7c00);
+		}
+		if (exponent <= 0)
+		{
+			if (exponent < -10) return static_cast<unsigned short>(sign);
+			// denormal
+			mantissa |= 0x800000;
+			const int shift = 14 - exponent;
+			unsigned int half_mantissa = mantissa >> shift;
+			if ((mantissa >> (shift - 1)) & 1) ++half_mantissa;
+			return static_cast<unsigned short>(sign | half_mantissa);
+		}
+		unsigned int half = sign | (exponent << 10) | (mantissa >> 13);
+		// round to nearest
+		if (mantissa & 0x1000) ++half;
+		return static_cast<unsigned short>(half);
+	}
+
+	/**
+	 * half float to float
+	 */
+	float half_to_float(unsigned short half)
+	{
+		const unsigned int sign = (half & 0x8000) << 16;
+		const unsigned int exponent = (half >> 10) & 0x1f;
+		unsigned int mantissa = half & 0x3ff;
+		unsigned int bits;
+		if (exponent == 0)
+		{
+			if (mantissa == 0)
+			{
+				bits = sign;
+			}
+			else
+			{
+				// denormal
+				int e = -1;
+				do {
+					++e;
+					mantissa <<= 1;
+				} while ((mantissa & 0x400) == 0);
+				bits = sign | ((127 - 15 - e) << 23) | ((mantissa & 0x3ff) << 13);
+			}
+		}
+		else if (exponent == 0x1f)
+		{
+			bits = sign | 0x7f800000 | (mantissa << 13);
+		}
+		else
+		{
+			bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+		}
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	/**
+	 * bytes of a texel
+	 */
+	int texel_size(UMTexture::Format format)
+	{
+		return format == UMTexture::eFormatRGBA8 ? 4 : 8;
+	}
+
+	/**
+	 * encode a texel
+	 */
+	void encode_texel(unsigned char* dst, const UMVec4d& texel, UMTexture::Format format)
+	{
+		if (format == UMTexture::eFormatRGBA8)
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				dst[i] = static_cast<unsigned char>(umbase::um_clip(texel[i]) * 255.0 + 0.5);
+			}
+		}
+		else
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				const unsigned short half = float_to_half(static_cast<float>(texel[i]));
+				std::memcpy(dst + i * 2, &half, sizeof(half));
+			}
+		}
+	}
+
+	/**
+	 * decode a texel
+	 */
+	UMVec4d decode_texel(const unsigned char* src, UMTexture::Format format)
+	{
+		if (format == UMTexture::eFormatRGBA8)
+		{
+			const double inv = 1.0 / 255.0;
+			return UMVec4d(src[0] * inv, src[1] * inv, src[2] * inv, src[3] * inv);
+		}
+		unsigned short half[4];
+		std::memcpy(half, src, sizeof(half));
+		return UMVec4d(
+			half_to_float(half[0]),
+			half_to_float(half[1]),
+			half_to_float(half[2]),
+			half_to_float(half[3]));
+	}
+
+	/**
+	 * downsample by box filter.
+	 * each destination texel averages source texels it covers, so odd sizes lose no texels.
+	 */
+	void downsample(
+		umimage::UMImage::ImageBuffer& dst,
+		int dst_width,
+		int dst_height,
+		const umimage::UMImage::ImageBuffer& src,
+		int src_width,
+		int src_height)
+	{
+		dst.resize(dst_width * dst_height);
+		for (int y = 0; y < dst_height; ++y)
+		{
+			const int sy0 = (y * src_height) / dst_height;
+			const int sy1 = std::max(sy0 + 1, ((y + 1) * src_height) / dst_height);
+			for (int x = 0; x < dst_width; ++x)
+			{
+				const int sx0 = (x * src_width) / dst_width;
+				const int sx1 = std::max(sx0 + 1, ((x + 1) * src_width) / dst_width);
+				UMVec4d sum(0);
+				for (int sy = sy0; sy < sy1; ++sy)
+				{
+					for (int sx = sx0; sx < sx1; ++sx)
+					{
+						sum += src[sy * src_width + sx];
+					}
+				}
+				dst[y * dst_width + x] = sum * (1.0 / static_cast<double>((sy1 - sy0) * (sx1 - sx0)));
+			}
+		}
+	}
+
+} // anonymouse namespace
+
+namespace umrt
+{
+
+/**
+ * texel access of a level.
+ * keeps last tile to fetch neighbor texels without cache lookup.
+ */
+class UMTexture::TileAccess
+{
+	DISALLOW_COPY_AND_ASSIGN(TileAccess);
+public:
+	TileAccess(const UMTexture& texture, const Level& level)
+		: texture_(texture)
+		, level_(level)
+		, tile_index_(-1)
+	{}
+
+	~TileAccess() {}
+
+	/**
+	 * get a texel
+	 */
+	UMVec4d texel(int x, int y)
+	{
+		const int tx = x / tile_size;
+		const int ty = y / tile_size;
+		const int index = level_.first_tile + ty * level_.tile_count_x + tx;
+		if (index != tile_index_)
+		{
+			tile_ = UMTextureCache::instance().tile(texture_.id(), index);
+			tile_index_ = index;
+		}
+		if (!tile_) return UMVec4d(0);
+		const int tile_width = std::min<int>(tile_size, level_.width - tx * tile_size);
+		const int offset = (y - ty * tile_size) * tile_width + (x - tx * tile_size);
+		return decode_texel(&(*tile_)[offset * texel_size(texture_.format())], texture_.format());
+	}
+
+private:
+	const UMTexture& texture_;
+	const Level& level_;
+	int tile_index_;
+	UMTextureCache::TileBufferPtr tile_;
+};
+
+/**
+ * constructor
+ */
+UMTexture::UMTexture()
+	: id_(global_texture_id_counter++)
+	, image_id_(0)
+	, format_(eFormatRGBA8)
+{
+}
+
+/**
+ * destructor
+ */
+UMTexture::~UMTexture()
+{
+	UMTextureCache::instance().remove_texture(id_);
+}
+
+/**
+ * create texture of an image
+ */
+UMTexturePtr UMTexture::create(umimage::UMImagePtr image)
+{
+	if (!image) return UMTexturePtr();
+	if (!image->is_valid()) return UMTexturePtr();
+	if (image->width() <= 0 || image->height() <= 0) return UMTexturePtr();
+
+	UMTexturePtr texture(std::make_shared<UMTexture>());
+	texture->image_id_ = image->id();
+	texture->image_ = image;
+	return texture;
+}
+
+/**
+ * create texture of an image file
+ */
+UMTexturePtr UMTexture::create(const umstring& path, const ImageLoader& loader)
+{
+	if (path.empty()) return UMTexturePtr();
+
+	UMTexturePtr texture(std::make_shared<UMTexture>());
+	texture->path_ = path;
+	texture->loader_ = loader;
+	return texture;
+}
+
+/**
+ * build tiles from source at first access.
+ * other threads wait until tiles are built.
+ */
+void UMTexture::load() const
+{
+	UMTexture* self = const_cast<UMTexture*>(this);
+	std::call_once(load_flag_, [self] {
+		umimage::UMImagePtr image = self->image_;
+		if (!image && !self->path_.empty())
+		{
+			image = self->loader_ ? self->loader_(self->path_) : umimage::UMImage::load(self->path_);
+		}
+		if (image && image->is_valid() && image->width() > 0 && image->height() > 0)
+		{
+			self->build(image);
+		}
+		// decoded image is released here unless others refer it
+		self->image_ = umimage::UMImagePtr();
+		self->loader_ = ImageLoader();
+	});
+}
+
+/**
+ * build mip levels
+ */
+void UMTexture::build(umimage::UMImagePtr image)
+{
+	const umimage::UMImage::ImageBuffer& src = image->list();
+	for (size_t i = 0, size = src.size(); i < size; ++i)
+	{
+		const UMVec4d& texel = src[i];
+		if (texel.x < 0.0 || texel.y < 0.0 || texel.z < 0.0 || texel.w < 0.0 ||
+			texel.x > 1.0 || texel.y > 1.0 || texel.z > 1.0 || texel.w > 1.0)
+		{
+			format_ = eFormatRGBA16F;
+			break;
+		}
+	}
+
+	int width = image->width();
+	int height = image->height();
+	add_level(src, width, height);
+
+	// only one float level is alive at once
+	umimage::UMImage::ImageBuffer level_buffer;
+	while (width > 1 || height > 1)
+	{
+		const int level_width = std::max(1, width / 2);
+		const int level_height = std::max(1, height / 2);
+		umimage::UMImage::ImageBuffer next_buffer;
+		downsample(next_buffer, level_width, level_height,
+			level_buffer.empty() ? src : level_buffer, width, height);
+		level_buffer.swap(next_buffer);
+		width = level_width;
+		height = level_height;
+		add_level(level_buffer, width, height);
+	}
+}
+
+/**
+ * split a level into tiles and add them to cache
+ */
+void UMTexture::add_level(const umimage::UMImage::ImageBuffer& buffer, int width, int height)
+{
+	Level level;
+	level.width = width;
+	level.height = height;
+	level.tile_count_x = (width + tile_size - 1) / tile_size;
+	level.first_tile = 0;
+	if (!level_list_.empty())
+	{
+		const Level& last = level_list_.back();
+		const int last_tile_count_y = (last.height + tile_size - 1) / tile_size;
+		level.first_tile = last.first_tile + last.tile_count_x * last_tile_count_y;
+	}
+	level_list_.push_back(level);
+
+	const int bytes = texel_size(format_);
+	const int tile_count_y = (height + tile_size - 1) / tile_size;
+	UMTextureCache::TileBuffer tile;
+	for (int ty = 0; ty < tile_count_y; ++ty)
+	{
+		for (int tx = 0; tx < level.tile_count_x; ++tx)
+		{
+			// tiles on right and bottom edges are smaller
+			const int tile_width = std::min<int>(tile_size, width - tx * tile_size);
+			const int tile_height = std::min<int>(tile_size, height - ty * tile_size);
+			tile.resize(tile_width * tile_height * bytes);
+			for (int y = 0; y < tile_height; ++y)
+			{
+				const int src_y = ty * tile_size + y;
+				for (int x = 0; x < tile_width; ++x)
+				{
+					const int src_x = tx * tile_size + x;
+					encode_texel(&tile[(y * tile_width + x) * bytes], buffer[src_y * width + src_x], format_);
+				}
+			}
+			UMTextureCache::instance().add_tile(id_, level.first_tile + ty * level.tile_count_x + tx, tile);
+		}
+	}
+}
+
+/**
+ * bilinear sampling
+ */
+UMVec4d UMTexture::sample(const UMVec2d& uv, int level) const
+{
+	if (level_count() == 0) return UMVec4d(0);
+	level = std::min(std::max(level, 0), level_count() - 1);
+	const Level& l = level_list_[level];
+	const int w = l.width;
+	const int h = l.height;
+	// texel centers are at half integer
+	const double fx = umbase::um_clip(uv.x) * w - 0.5;
+	const double fy = umbase::um_clip(uv.y) * h - 0.5;
+	const double flx = std::floor(fx);
+	const double fly = std::floor(fy);
+	const double tx = fx - flx;
+	const double ty = fy - fly;
+	const int x0 = std::min(std::max(static_cast<int>(flx), 0), w - 1);
+	const int y0 = std::min(std::max(static_cast<int>(fly), 0), h - 1);
+	const int x1 = std::min(std::max(static_cast<int>(flx) + 1, 0), w - 1);
+	const int y1 = std::min(std::max(static_cast<int>(fly) + 1, 0), h - 1);
+
+	TileAccess access(*this, l);
+	const UMVec4d top = access.texel(x0, y0) * (1.0 - tx) + access.texel(x1, y0) * tx;
+	const UMVec4d bottom = access.texel(x0, y1) * (1.0 - tx) + access.texel(x1, y1) * tx;
+	return top * (1.0 - ty) + bottom * ty;
+}
+
+/**
+ * get level of detail
+ */
+double UMTexture::lod(const UMVec2d& duvdx, const UMVec2d& duvdy) const
+{
+	if (level_count() == 0) return 0.0;
+	const double w = static_cast<double>(width(0));
+	const double h = static_cast<double>(height(0));
+	const UMVec2d dx(duvdx.x * w, duvdx.y * h);
+	const UMVec2d dy(duvdy.x * w, duvdy.y * h);
+	// footprint width in texels of level 0
+	const double footprint = std::max(dx.length(), dy.length());
+	if (footprint <= 1.0) return 0.0;
+	return std::min(std::log(footprint) / std::log(2.0), static_cast<double>(level_count() - 1));
+}
+
+/**
+ * trilinear sampling
+ */
+UMVec4d UMTexture::sample(const UMVec2d& uv, const UMVec2d& duvdx, const UMVec2d& duvdy) const
+{
+	const double level = lod(duvdx, duvdy);
+	const int level0 = static_cast<int>(std::floor(level));
+	const double t = level - level0;
+	if (t <= 0.0 || level0 + 1 >= level_count())
+	{
+		return sample(uv, level0);
+	}
+	return sample(uv, level0) * (1.0 - t) + sample(uv, level0 + 1) * t;
+}
+
+} // umrt
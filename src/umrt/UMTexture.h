@@ -0,0 +1,173 @@
+/**
+ * @file UMTexture.h
+ * mip-mapped texture for rendering
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <functional>
+
+#include "UMMacro.h"
+#include "UMMathTypes.h"
+#include "UMVector.h"
+#include "UMImage.h"
+
+namespace umrt
+{
+
+class UMTexture;
+typedef std::shared_ptr<UMTexture> UMTexturePtr;
+typedef std::map<unsigned int, UMTexturePtr> UMTextureMap;
+typedef std::map<umstring, UMTexturePtr> UMTexturePathMap;
+
+/**
+ * mip-mapped texture.
+ * the pyramid is built from an image by 2x2 box filter,
+ * and stored as square tiles of 8-bit or half texels in UMTextureCache.
+ * tiles are built at first access from a source image or an image file,
+ * and the source is not referenced after that.
+ * uv is clamped to [0, 1] like nearest fetch of image.
+ */
+class UMTexture
+{
+	DISALLOW_COPY_AND_ASSIGN(UMTexture);
+public:
+	/**
+	 * texel formats
+	 */
+	enum Format {
+		eFormatRGBA8, ///< 8-bit per channel. values of image as is (sRGB for ldr images).
+		eFormatRGBA16F, ///< half float per channel. used when image has values out of [0, 1].
+	};
+
+	/// width and height of a tile in texels
+	enum { tile_size = 32 };
+
+	/**
+	 * image file loader
+	 */
+	typedef std::function<umimage::UMImagePtr (const umstring& path)> ImageLoader;
+
+	/**
+	 * create texture of an image
+	 * @param [in] image source image
+	 * @retval texture or none when image is invalid
+	 */
+	static UMTexturePtr create(umimage::UMImagePtr image);
+
+	/**
+	 * create texture of an image file. the file is loaded at first access.
+	 * @param [in] path image file path
+	 * @param [in] loader loads the file. UMImage::load if empty.
+	 * @retval texture or none when path is empty
+	 */
+	static UMTexturePtr create(const umstring& path, const ImageLoader& loader);
+
+	UMTexture();
+
+	~UMTexture();
+
+	/**
+	 * get id
+	 */
+	unsigned int id() const { return id_; }
+
+	/**
+	 * get id of source image
+	 */
+	unsigned int image_id() const { return image_id_; }
+
+	/**
+	 * get texel format
+	 */
+	Format format() const { load(); return format_; }
+
+	/**
+	 * get number of mip levels. 0 when source could not be loaded.
+	 */
+	int level_count() const { load(); return static_cast<int>(level_list_.size()); }
+
+	/**
+	 * get width of a level
+	 */
+	int width(int level) const { load(); return level_list_.at(level).width; }
+
+	/**
+	 * get height of a level
+	 */
+	int height(int level) const { load(); return level_list_.at(level).height; }
+
+	/**
+	 * bilinear sampling of a level
+	 * @param [in] uv texture coordinate
+	 * @param [in] level mip level
+	 */
+	UMVec4d sample(const UMVec2d& uv, int level) const;
+
+	/**
+	 * trilinear sampling by uv footprint
+	 * @param [in] uv texture coordinate
+	 * @param [in] duvdx uv difference of neighbor pixel in x
+	 * @param [in] duvdy uv difference of neighbor pixel in y
+	 */
+	UMVec4d sample(const UMVec2d& uv, const UMVec2d& duvdx, const UMVec2d& duvdy) const;
+
+	/**
+	 * get level of detail from uv footprint
+	 */
+	double lod(const UMVec2d& duvdx, const UMVec2d& duvdy) const;
+
+private:
+	/**
+	 * a mip level
+	 */
+	struct Level
+	{
+		int width;
+		int height;
+		int tile_count_x;
+		/// index of first tile in the texture
+		int first_tile;
+	};
+	typedef std::vector<Level> LevelList;
+
+	class TileAccess;
+
+	void load() const;
+	void build(umimage::UMImagePtr image);
+	void add_level(const umimage::UMImage::ImageBuffer& buffer, int width, int height);
+
+	unsigned int id_;
+	unsigned int image_id_;
+	Format format_;
+	LevelList level_list_;
+	/// source until tiles are built
+	umimage::UMImagePtr image_;
+	umstring path_;
+	ImageLoader loader_;
+	mutable std::once_flag load_flag_;
+};
+
+/**
+ * textures of a scene.
+ * textures of material images are found by image id, textures of image files by path.
+ */
+class UMTextureLibrary
+{
+public:
+	UMTextureMap image_texture_map;
+	UMTexturePathMap path_texture_map;
+	/// loads image files. UMImage::load if empty.
+	UMTexture::ImageLoader image_loader;
+};
+
+} // umrt
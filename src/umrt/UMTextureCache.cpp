@@ -0,0 +1,255 @@
+/**
+ * @file UMTextureCache.cpp
+ * bounded cache of texture tiles
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMTextureCache.h"
+
+#include <algorithm>
+
+namespace
+{
+	/**
+	 * seek in a file larger than 2GB
+	 */
+	bool seek_file(FILE* file, long long offset)
+	{
+#if defined(_WIN32)
+		return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+		return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+	}
+
+} // anonymouse namespace
+
+namespace umrt
+{
+
+/**
+ * constructor
+ */
+UMTextureCache::UMTextureCache()
+	: capacity_(0)
+	, miss_count_(0)
+	, is_warned_(false)
+{
+}
+
+/**
+ * destructor
+ */
+UMTextureCache::~UMTextureCache()
+{
+	for (int i = 0; i < shard_count; ++i)
+	{
+		if (shard_list_[i].backing_file)
+		{
+			fclose(shard_list_[i].backing_file);
+		}
+	}
+}
+
+/**
+ * get key of a tile
+ */
+UMTextureCache::Key UMTextureCache::key(unsigned int texture_id, int tile_index)
+{
+	return (static_cast<Key>(texture_id) << 32) | static_cast<unsigned int>(tile_index);
+}
+
+/**
+ * get shard of a tile.
+ * neighbor tiles are in different shards, so threads sampling near texels rarely wait.
+ */
+UMTextureCache::Shard& UMTextureCache::shard(unsigned int texture_id, int tile_index)
+{
+	const unsigned int hash = texture_id * 0x9e3779b1u + static_cast<unsigned int>(tile_index);
+	return shard_list_[hash & (shard_count - 1)];
+}
+
+/**
+ * set capacity
+ */
+void UMTextureCache::set_capacity(size_t capacity)
+{
+	capacity_ = capacity;
+	for (int i = 0; i < shard_count; ++i)
+	{
+		Shard& s = shard_list_[i];
+		std::lock_guard<std::mutex> lock(s.mutex);
+		s.capacity = capacity > 0 ? std::max<size_t>(capacity / shard_count, 1) : 0;
+		evict(s);
+	}
+}
+
+/**
+ * get bytes of resident tiles
+ */
+size_t UMTextureCache::resident_size()
+{
+	size_t size = 0;
+	for (int i = 0; i < shard_count; ++i)
+	{
+		std::lock_guard<std::mutex> lock(shard_list_[i].mutex);
+		size += shard_list_[i].resident_size;
+	}
+	return size;
+}
+
+/**
+ * move a tile to most recently used
+ */
+void UMTextureCache::touch(Shard& shard, Entry& entry)
+{
+	if (entry.offset < 0) return;
+	shard.lru_list.splice(shard.lru_list.begin(), shard.lru_list, entry.lru);
+}
+
+/**
+ * evict least recently used tiles over capacity
+ */
+void UMTextureCache::evict(Shard& shard)
+{
+	if (shard.capacity == 0) return;
+	while (shard.resident_size > shard.capacity && !shard.lru_list.empty())
+	{
+		EntryMap::iterator it = shard.entry_map.find(shard.lru_list.back());
+		shard.lru_list.pop_back();
+		if (it == shard.entry_map.end()) continue;
+		it->second.buffer.reset();
+		shard.resident_size -= it->second.size;
+	}
+}
+
+/**
+ * append a tile to backing file of a shard
+ * @param [out] offset position in backing file
+ */
+bool UMTextureCache::write_backing_file(Shard& shard, const TileBuffer& buffer, long long& offset)
+{
+	if (shard.is_backing_failed) return false;
+	if (!shard.backing_file)
+	{
+		// removed automatically when closed
+		shard.backing_file = tmpfile();
+	}
+	if (shard.backing_file
+		&& seek_file(shard.backing_file, shard.backing_size)
+		&& fwrite(&buffer[0], 1, buffer.size(), shard.backing_file) == buffer.size())
+	{
+		offset = shard.backing_size;
+		shard.backing_size += static_cast<long long>(buffer.size());
+		return true;
+	}
+	// tiles of this shard can not be evicted any more
+	shard.is_backing_failed = true;
+	if (!is_warned_.exchange(true))
+	{
+		fprintf(stderr, "texture cache: failed to write backing file, capacity is exceeded\n");
+	}
+	return false;
+}
+
+/**
+ * add a tile
+ */
+bool UMTextureCache::add_tile(unsigned int texture_id, int tile_index, const TileBuffer& buffer)
+{
+	if (buffer.empty()) return false;
+	Shard& s = shard(texture_id, tile_index);
+	std::lock_guard<std::mutex> lock(s.mutex);
+	const Key k = key(texture_id, tile_index);
+	if (s.entry_map.find(k) != s.entry_map.end()) return false;
+
+	Entry entry;
+	entry.buffer = std::make_shared<const TileBuffer>(buffer);
+	entry.offset = -1;
+	entry.size = buffer.size();
+
+	if (s.capacity > 0)
+	{
+		write_backing_file(s, buffer, entry.offset);
+	}
+	if (entry.offset >= 0)
+	{
+		s.lru_list.push_front(k);
+		entry.lru = s.lru_list.begin();
+	}
+	s.entry_map[k] = entry;
+	s.tile_index_map[texture_id].push_back(tile_index);
+	s.resident_size += entry.size;
+	evict(s);
+	return true;
+}
+
+/**
+ * get a tile
+ */
+UMTextureCache::TileBufferPtr UMTextureCache::tile(unsigned int texture_id, int tile_index)
+{
+	Shard& s = shard(texture_id, tile_index);
+	std::lock_guard<std::mutex> lock(s.mutex);
+	EntryMap::iterator it = s.entry_map.find(key(texture_id, tile_index));
+	if (it == s.entry_map.end()) return TileBufferPtr();
+
+	Entry& entry = it->second;
+	if (entry.buffer)
+	{
+		touch(s, entry);
+		return entry.buffer;
+	}
+
+	// evicted. load from backing file.
+	std::shared_ptr<TileBuffer> buffer(std::make_shared<TileBuffer>(entry.size));
+	if (!s.backing_file) return TileBufferPtr();
+	if (!seek_file(s.backing_file, entry.offset)) return TileBufferPtr();
+	if (fread(&(*buffer)[0], 1, entry.size, s.backing_file) != entry.size) return TileBufferPtr();
+
+	++miss_count_;
+	entry.buffer = buffer;
+	s.lru_list.push_front(it->first);
+	entry.lru = s.lru_list.begin();
+	s.resident_size += entry.size;
+	TileBufferPtr result = entry.buffer;
+	evict(s);
+	return result;
+}
+
+/**
+ * remove all tiles of a texture.
+ * space in backing file is not reused.
+ */
+void UMTextureCache::remove_texture(unsigned int texture_id)
+{
+	for (int i = 0; i < shard_count; ++i)
+	{
+		Shard& s = shard_list_[i];
+		std::lock_guard<std::mutex> lock(s.mutex);
+		TileIndexMap::iterator tt = s.tile_index_map.find(texture_id);
+		if (tt == s.tile_index_map.end()) continue;
+		const std::vector<int>& tile_index_list = tt->second;
+		for (size_t k = 0, size = tile_index_list.size(); k < size; ++k)
+		{
+			EntryMap::iterator it = s.entry_map.find(key(texture_id, tile_index_list[k]));
+			if (it == s.entry_map.end()) continue;
+			if (it->second.buffer)
+			{
+				s.resident_size -= it->second.size;
+				if (it->second.offset >= 0)
+				{
+					s.lru_list.erase(it->second.lru);
+				}
+			}
+			s.entry_map.erase(it);
+		}
+		s.tile_index_map.erase(tt);
+	}
+}
+
+} // umrt
@@ -0,0 +1,146 @@
+/**
+ * @file UMTextureCache.h
+ * bounded cache of texture tiles
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <cstdio>
+
+#include "UMMacro.h"
+
+namespace umrt
+{
+
+/**
+ * bounded cache of texture tiles.
+ * with a capacity, tiles are also written to a temporary backing file
+ * and least recently used tiles are evicted from memory, then loaded again on demand.
+ * without capacity (0), all tiles stay in memory.
+ * tiles are spread over shards which have their own lock, lru and backing file.
+ * set capacity before textures are created.
+ */
+class UMTextureCache
+{
+	DISALLOW_COPY_AND_ASSIGN(UMTextureCache);
+public:
+	typedef std::vector<unsigned char> TileBuffer;
+	typedef std::shared_ptr<const TileBuffer> TileBufferPtr;
+
+	~UMTextureCache();
+
+	static UMTextureCache& instance() {
+		static UMTextureCache instance_;
+		return instance_;
+	}
+
+	/**
+	 * get capacity in bytes. 0 is unbounded.
+	 */
+	size_t capacity() const { return capacity_; }
+
+	/**
+	 * set capacity in bytes
+	 * @param [in] capacity bytes of resident tiles. 0 is unbounded.
+	 */
+	void set_capacity(size_t capacity);
+
+	/**
+	 * get bytes of resident tiles
+	 */
+	size_t resident_size();
+
+	/**
+	 * get number of tiles loaded from backing file
+	 */
+	size_t miss_count() const { return miss_count_; }
+
+	/**
+	 * add a tile
+	 * @param [in] texture_id texture id
+	 * @param [in] tile_index tile index in the texture
+	 * @param [in] buffer tile data
+	 * @retval success or failed
+	 */
+	bool add_tile(unsigned int texture_id, int tile_index, const TileBuffer& buffer);
+
+	/**
+	 * get a tile. the tile is loaded from backing file if evicted.
+	 * returned tile stays valid while it is referenced.
+	 * @param [in] texture_id texture id
+	 * @param [in] tile_index tile index in the texture
+	 * @retval tile or none
+	 */
+	TileBufferPtr tile(unsigned int texture_id, int tile_index);
+
+	/**
+	 * remove all tiles of a texture
+	 */
+	void remove_texture(unsigned int texture_id);
+
+private:
+	UMTextureCache();
+
+	typedef unsigned long long Key;
+	typedef std::list<Key> KeyList;
+
+	/**
+	 * a tile entry
+	 */
+	struct Entry
+	{
+		TileBufferPtr buffer;
+		/// position in backing file. negative is memory only.
+		long long offset;
+		size_t size;
+		KeyList::iterator lru;
+	};
+	typedef std::unordered_map<Key, Entry> EntryMap;
+	/// tile indices of each texture
+	typedef std::unordered_map<unsigned int, std::vector<int> > TileIndexMap;
+
+	/**
+	 * a part of the cache
+	 */
+	struct Shard
+	{
+		Shard() : capacity(0), resident_size(0), backing_file(NULL), backing_size(0), is_backing_failed(false) {}
+		EntryMap entry_map;
+		TileIndexMap tile_index_map;
+		/// most recently used first
+		KeyList lru_list;
+		size_t capacity;
+		size_t resident_size;
+		FILE* backing_file;
+		long long backing_size;
+		bool is_backing_failed;
+		std::mutex mutex;
+	};
+
+	/// number of shards. a power of two.
+	enum { shard_count = 16 };
+
+	static Key key(unsigned int texture_id, int tile_index);
+	Shard& shard(unsigned int texture_id, int tile_index);
+	bool write_backing_file(Shard& shard, const TileBuffer& buffer, long long& offset);
+	static void touch(Shard& shard, Entry& entry);
+	static void evict(Shard& shard);
+
+	size_t capacity_;
+	std::atomic<size_t> miss_count_;
+	std::atomic<bool> is_warned_;
+	Shard shard_list_[shard_count];
+};
+
+} // umrt
@@ -10,11 +10,15 @@
  */
 #include "UMToonRender.h"
 #include "UMRenderParameter.h"
+#include "UMRenderStatistics.h"
+#include "UMFrameBuffer.h"
+#include "UMBucket.h"
 #include "UMShaderParameter.h"
 #include "UMRay.h"
 #include "UMScene.h"
 #include "UMVector.h"
 #include "UMStringUtil.h"
+#include "UMTime.h"
 
 #include "UMPathTracer.h"
 
@@ -28,6 +32,9 @@ namespace
 	using namespace umrt;
 	using namespace umdraw;
 	
+	/// counters of the rendering thread. NULL outside of render passes.
+	UMRenderStatistics::ThreadCounter* ray_counter = NULL;
+
 	unsigned int xor128()
 	{
 		static unsigned int x = 123456789;
@@ -151,12 +158,24 @@ namespace
 		//if (parameter.bounce == 1)
 		{
 			if (!intersect(ray, scene_access, parameter, intersection)){
+				parameter.color = scene->background_color();
+				parameter.normal = UMVec3d(0);
+				parameter.distance = 0.0;
+				parameter.primitive = NULL;
+				parameter.material = UMMaterialPtr();
 				return scene->background_color();
 			}
 		}
 
 		if (intersection.closest_primitive)
 		{
+			// write back first hit for output layers
+			const UMShaderParameter& closest = intersection.closest_parameter;
+			parameter.color = closest.color;
+			parameter.normal = closest.normal;
+			parameter.distance = closest.distance;
+			parameter.primitive = closest.primitive;
+			parameter.material = closest.material;
 			return shade(intersection.closest_primitive, ray, scene_access, intersection.closest_parameter);
 		}
 		return scene->background_color();
@@ -177,15 +196,15 @@ namespace
 		const int number_of_stencil_ray = 24;
 		std::vector<UMRay> rays;
 		rays.resize(number_of_stencil_ray);
+		UMVec2d points[number_of_stencil_ray];
 		{
 			double theta_adder = M_PI / 4.0;
 			for (int i = 0; i < 8; ++i)
 			{
 				double theta = theta_adder * i;
-				UMVec2d point(
+				points[i] = UMVec2d(
 					pixel.x + half_size * cos(theta),
 					pixel.y + half_size * sin(theta));
-				scene_access->generate_ray(rays.at(i), point);
 			}
 		}
 		{
@@ -193,12 +212,14 @@ namespace
 			for (int i = 0; i < 16; ++i)
 			{
 				double theta = theta_adder * i;
-				UMVec2d point(
+				points[8 + i] = UMVec2d(
 					pixel.x + parameter.outline_size * cos(theta),
 					pixel.y + parameter.outline_size * sin(theta));
-				scene_access->generate_ray(rays.at(8 + i), point);
 			}
 		}
+		// all stencil rays at once
+		scene_access->camera_sampler().generate_rays(&rays[0], points, number_of_stencil_ray);
+		if (ray_counter) ray_counter->primary_ray_count += number_of_stencil_ray;
 
 		int sample_material = -1;
 		if (parameter.material)
@@ -304,8 +325,7 @@ class UMToonRender::Impl
 {
 public:
 	Impl(int width, int height) 
-		:  current_x_(0)
-		, current_y_(0)
+		:  current_bucket_(0)
 		, width_(width)
 		, height_(height)
 	{}
@@ -336,8 +356,7 @@ public:
 
 	bool init() 
 	{
-		current_x_ = 0;
-		current_y_ = 0;
+		current_bucket_ = 0;
 		return true;
 	}
 
@@ -348,8 +367,8 @@ public:
 
 private:
 	// for progress render
-	int current_x_;
-	int current_y_;
+	int current_bucket_;
+	UMBucketList buckets_;
 	int width_;
 	int height_;
 };
@@ -360,12 +379,14 @@ bool UMToonRender::Impl::render(UMSceneAccessPtr scene_access, UMRenderParameter
 	if (!scene) return false;
 	if (width_ == 0 || height_ == 0) return false;
 	if (!scene->camera()) return false;
+	if (!scene_access->update_camera_sampler()) return false;
 	
 	const int sample_count = parameter.super_sampling_count().x * parameter.super_sampling_count().y;
 	const double inv_sample_count = 1.0 / sample_count;
 
 	UMImage::ImageBuffer& dst_buffer = parameter.output_image()->mutable_list();
 	
+	// statistics are reset by the first pass of path tracer
 	UMPathTracer path_tracer;
 	path_tracer.set_width(width_);
 	path_tracer.set_height(height_);
@@ -374,7 +395,13 @@ bool UMToonRender::Impl::render(UMSceneAccessPtr scene_access, UMRenderParameter
 		path_tracer.progress_render(scene_access, parameter);
 	}
 
-	for (int y = 0; y < height_; ++y)
+	// outline in the crop window
+	UMRenderStatistics& statistics = parameter.statistics();
+	const UMVec4i rect = parameter.render_rect(width_, height_);
+	const double outline_start_seconds = umbase::UMTime::current_seconds();
+	ray_counter = &statistics.current_thread_counter();
+	statistics.begin_pass();
+	for (int y = rect.y; y < (rect.y + rect.w); ++y)
 	{
 		//if (sample_count > 1)
 		//{
@@ -397,12 +424,13 @@ bool UMToonRender::Impl::render(UMSceneAccessPtr scene_access, UMRenderParameter
 		//}
 		//else
 		{
-			for (int x = 0; x < width_; ++x)
+			for (int x = rect.x; x < (rect.x + rect.z); ++x)
 			{
 				const int pos = width_ * y + x;
 				UMVec2d pixel(x, y);
 				UMRay ray;
 				scene_access->generate_ray(ray, pixel);
+				++ray_counter->primary_ray_count;
 				UMShaderParameter shader_parameter;
 				UMVec3d color = trace(ray, scene_access, shader_parameter);
 				//bool is_hit = shader_parameter.intersect_point != UMVec3d(0,0,0);
@@ -427,6 +455,9 @@ bool UMToonRender::Impl::render(UMSceneAccessPtr scene_access, UMRenderParameter
 			}
 		}
 	}
+	ray_counter->busy_seconds += umbase::UMTime::current_seconds() - outline_start_seconds;
+	ray_counter = NULL;
+	statistics.end_pass();
 	return true;
 }
 
@@ -436,34 +467,59 @@ bool UMToonRender::Impl::progress_render(UMSceneAccessPtr scene_access, UMRender
 	if (!scene) return false;
 	if (width_ == 0 || height_ == 0) return false;
 	if (!scene->camera()) return false;
+	if (!scene_access->update_camera_sampler()) return false;
 	
-	const int ystep = 10;
+	const int bucket_step = 4;
 	
 	const int sample_count = parameter.super_sampling_count().x * parameter.super_sampling_count().y;
-	const double inv_sample_count = 1.0 / sample_count;
 	
-	for (int& y = current_y_, rows = (y + ystep); y < rows; ++y)
+	UMFrameBuffer& frame_buffer = parameter.frame_buffer();
+	UMRenderStatistics& statistics = parameter.statistics();
+	if (current_bucket_ == 0)
+	{
+		const double setup_start_seconds = umbase::UMTime::current_seconds();
+		statistics.reset();
+		statistics.set_bvh_build_seconds(scene_access->bvh_build_seconds());
+		frame_buffer.init(width_, height_);
+		parameter.create_buckets(buckets_, width_, height_);
+		statistics.add_setup_seconds(umbase::UMTime::current_seconds() - setup_start_seconds);
+	}
+	
+	// end
+	if (current_bucket_ >= static_cast<int>(buckets_.size())) { return false; }
+
+	statistics.begin_pass();
+	for (int& i = current_bucket_, last = (i + bucket_step); i < last; ++i)
 	{
-		// end
-		if (y == height_) { return false; }
+		if (i >= static_cast<int>(buckets_.size())) { break; }
 		
-		for (int x = 0; x < width_; ++x)
+		const UMBucket& bucket = buckets_[i];
+		const double bucket_start_seconds = umbase::UMTime::current_seconds();
+		ray_counter = &statistics.current_thread_counter();
+		for (int y = bucket.y; y < (bucket.y + bucket.height); ++y)
 		{
-			const int pos = width_ * y + x;
-			for (int s = 0; s < sample_count; ++s)
+			for (int x = bucket.x; x < (bucket.x + bucket.width); ++x)
 			{
-				UMVec2d sample_point(xor128d(), xor128d());
-				sample_point.x += x;
-				sample_point.y += y;
-				UMRay ray;
-				scene_access->generate_ray(ray, sample_point);
-				UMShaderParameter shader_parameter;
-				UMVec3d color = trace(ray, scene_access, shader_parameter);
-				parameter.output_image()->mutable_list()[pos] += UMVec4d(color, 1.0);
+				const int pos = width_ * y + x;
+				for (int s = 0; s < sample_count; ++s)
+				{
+					UMVec2d sample_point(xor128d(), xor128d());
+					sample_point.x += x;
+					sample_point.y += y;
+					UMRay ray;
+					scene_access->generate_ray(ray, sample_point);
+					++ray_counter->primary_ray_count;
+					UMShaderParameter shader_parameter;
+					UMVec3d color = trace(ray, scene_access, shader_parameter);
+					frame_buffer.add_sample(x, y, color, shader_parameter);
+				}
+				parameter.output_image()->mutable_list()[pos] = frame_buffer.beauty(x, y);
 			}
-			parameter.output_image()->mutable_list()[pos] *= inv_sample_count;
 		}
+		ray_counter->busy_seconds += umbase::UMTime::current_seconds() - bucket_start_seconds;
+		ray_counter = NULL;
 	}
+	statistics.end_pass();
 	
 	return true;
 }
@@ -19,6 +19,107 @@
 #include <Imath/ImathLine.h>
 #include <Imath/ImathLineAlgo.h>
 
+namespace
+{
+	using namespace umrt;
+
+	/**
+	 * uv differences of neighbor pixel rays at a hit point.
+	 * ray differentials are transferred to the triangle plane, then converted to barycentric differences.
+	 */
+	bool uv_differentials(
+		const UMRay& ray,
+		const UMShaderParameter& parameter,
+		const UMVec3d& v0,
+		const UMVec3d& v1,
+		const UMVec3d& v2,
+		const UMVec2d& uv0,
+		const UMVec2d& uv1,
+		const UMVec2d& uv2,
+		UMVec2d& duvdx,
+		UMVec2d& duvdy)
+	{
+		if (!ray.has_differentials()) return false;
+		const UMVec3d e1 = v1 - v0;
+		const UMVec3d e2 = v2 - v0;
+		const UMVec3d n = e1.cross(e2);
+		const double dn = ray.direction().dot(n);
+		if (dn == 0.0) return false;
+
+		// differences of hit point on the plane
+		const double t = parameter.distance;
+		UMVec3d dpdx = ray.origin_dx() + ray.direction_dx() * t;
+		UMVec3d dpdy = ray.origin_dy() + ray.direction_dy() * t;
+		dpdx = dpdx - ray.direction() * (dpdx.dot(n) / dn);
+		dpdy = dpdy - ray.direction() * (dpdy.dot(n) / dn);
+
+		// differences of barycentric coordinate by least squares
+		const double a11 = e1.dot(e1);
+		const double a12 = e1.dot(e2);
+		const double a22 = e2.dot(e2);
+		const double det = a11 * a22 - a12 * a12;
+		if (det == 0.0) return false;
+		const double inv_det = 1.0 / det;
+		const double bx1 = (a22 * e1.dot(dpdx) - a12 * e2.dot(dpdx)) * inv_det;
+		const double bx2 = (a11 * e2.dot(dpdx) - a12 * e1.dot(dpdx)) * inv_det;
+		const double by1 = (a22 * e1.dot(dpdy) - a12 * e2.dot(dpdy)) * inv_det;
+		const double by2 = (a11 * e2.dot(dpdy) - a12 * e1.dot(dpdy)) * inv_det;
+
+		const UMVec2d duv1 = uv1 - uv0;
+		const UMVec2d duv2 = uv2 - uv0;
+		duvdx = duv1 * bx1 + duv2 * bx2;
+		duvdy = duv1 * by1 + duv2 * by2;
+		return true;
+	}
+
+	/**
+	 * sample texture color.
+	 * mip-mapped texture is filtered trilinearly by ray footprint, or bilinearly without differentials.
+	 * a texture which is not prepared by scene access is fetched by nearest.
+	 * source image of a prepared texture may be released.
+	 */
+	bool sample_texture(
+		UMTexturePtr mipmap,
+		umimage::UMImagePtr texture,
+		const UMRay& ray,
+		const UMShaderParameter& parameter,
+		const UMVec3d& v0,
+		const UMVec3d& v1,
+		const UMVec3d& v2,
+		const UMVec2d& uv0,
+		const UMVec2d& uv1,
+		const UMVec2d& uv2,
+		const UMVec2d& uv,
+		UMVec4d& color)
+	{
+		if (mipmap && mipmap->level_count() > 0 && (!texture || mipmap->image_id() == texture->id()))
+		{
+			UMVec2d duvdx;
+			UMVec2d duvdy;
+			if (uv_differentials(ray, parameter, v0, v1, v2, uv0, uv1, uv2, duvdx, duvdy))
+			{
+				color = mipmap->sample(uv, duvdx, duvdy);
+			}
+			else
+			{
+				color = mipmap->sample(uv, 0);
+			}
+			return true;
+		}
+		if (!texture) return false;
+		const int x = static_cast<int>(texture->width() * uv.x);
+		const int y = static_cast<int>(texture->height() * uv.y);
+		const int pixel = y * texture->width() + x;
+		if (pixel < static_cast<int>(texture->list().size()))
+		{
+			color = texture->list()[pixel];
+			return true;
+		}
+		return false;
+	}
+
+} // anonymouse namespace
+
 namespace umrt
 {
 	using namespace umdraw;
@@ -80,7 +181,8 @@ bool UMTriangle::intersects(
 	
 	double inv_dir = 1.0 / d;
 	double distance = t * inv_dir;
-	if (distance < FLT_EPSILON) return false;
+	if (distance < ray.tmin()) return false;
+	if (distance > ray.tmax()) return false;
 
 	// inside triangle ?
 	UMVec3d barycentric = (-ray_dir).cross(ao);
@@ -186,6 +288,7 @@ bool UMTriangle::intersects(const UMRay& ray, UMShaderParameter& parameter) cons
 		if (intersects(v0, v1, v2, ray, parameter))
 		{
 			parameter.face_index = face_index_;
+			parameter.primitive = this;
 
 			const UMVec3d& n0 = me->normal_list()[vertex_index_.x];
 			const UMVec3d& n1 = me->normal_list()[vertex_index_.y];
@@ -193,38 +296,7 @@ bool UMTriangle::intersects(const UMRay& ray, UMShaderParameter& parameter) cons
 			parameter.normal = (n0 * parameter.uvw.x + n1 * parameter.uvw.y + n2 * parameter.uvw.z).normalized();
 			parameter.face_normal = (v1-v0).cross(v2-v0).normalized();
 
-			if (UMMaterialPtr material = me->material_from_face_index(face_index_))
-			{
-				parameter.material = material;
-
-				const UMVec4d& diffuse = material->diffuse();
-				parameter.color.x = diffuse.x;
-				parameter.color.y = diffuse.y;
-				parameter.color.z = diffuse.z;
-				parameter.emissive = material->emissive().xyz() * material->emissive_factor();
-				if (!me->uv_list().empty() && !material->texture_list().empty()) {
-					// uv
-					const int base = face_index_ * 3;
-					const UMVec2d& uv0 = me->uv_list()[base + 0];
-					const UMVec2d& uv1 = me->uv_list()[base + 1];
-					const UMVec2d& uv2 = me->uv_list()[base + 2];
-					UMVec2d uv = UMVec2d(
-						uv0 * parameter.uvw.x +
-						uv1 * parameter.uvw.y +
-						uv2 * parameter.uvw.z);
-					uv.x = umbase::um_clip(uv.x);
-					uv.y = umbase::um_clip(uv.y);
-					UMImagePtr texture = material->texture_list()[0];
-					const int x = static_cast<int>(texture->width() * uv.x);
-					const int y = static_cast<int>(texture->height() * uv.y);
-					const int pixel = y * texture->width() + x;
-					const UMVec4d& pixel_color = texture->list()[pixel];
-					parameter.uv = uv;
-					parameter.color.x = pixel_color.x;
-					parameter.color.y = pixel_color.y;
-					parameter.color.z = pixel_color.z;
-				}
-			}
+			shade(ray, parameter);
 			return true;
 		}
 	}
@@ -241,6 +313,8 @@ bool UMTriangle::intersects(const UMRay& ray, UMShaderParameter& parameter) cons
 			UMVec3d(v1.x, v1.y, v1.z), 
 			UMVec3d(v2.x, v2.y, v2.z), ray, parameter))
 		{
+			parameter.face_index = face_index_;
+			parameter.primitive = this;
 			const Imath::V3f& in0 = me->normals()[vertex_index_.x];
 			const Imath::V3f& in1 = me->normals()[vertex_index_.y];
 			const Imath::V3f& in2 = me->normals()[vertex_index_.z];
@@ -249,41 +323,7 @@ bool UMTriangle::intersects(const UMRay& ray, UMShaderParameter& parameter) cons
 			const UMVec3d n2(in2.x, in2.y, in2.z);
 			parameter.normal = (n0 * parameter.uvw.x + n1 * parameter.uvw.y + n2 * parameter.uvw.z).normalized();
 			
-			if (UMMaterialPtr material = me->material_from_face_index(face_index_))
-			{
-				parameter.material = material;
-
-				const UMVec4d& diffuse = material->diffuse();
-				parameter.color.x = diffuse.x;
-				parameter.color.y = diffuse.y;
-				parameter.color.z = diffuse.z;
-				parameter.emissive = material->emissive().xyz() * material->emissive_factor();
-				if (me->uv().getVals()->get() && !material->texture_list().empty()) {
-					// uv
-					const int base = face_index_ * 3;
-					const Imath::V2f& uv0 = me->uv().getVals()->get()[base + 0];
-					const Imath::V2f& uv1 = me->uv().getVals()->get()[base + 2];
-					const Imath::V2f& uv2 = me->uv().getVals()->get()[base + 1];
-					UMVec2d uv = UMVec2d(
-						UMVec2d(uv0.x, uv0.y) * parameter.uvw.x +
-						UMVec2d(uv1.x, uv1.y) * parameter.uvw.y +
-						UMVec2d(uv2.x, uv2.y) * parameter.uvw.z);
-					uv.x = umbase::um_clip(uv.x);
-					uv.y = umbase::um_clip(1.0f - uv.y);
-					const UMImagePtr texture = material->texture_list()[0];
-					const int x = static_cast<int>(texture->width() * uv.x);
-					const int y = static_cast<int>(texture->height() * uv.y);
-					const int pixel = y * texture->width() + x;
-					if (pixel < texture->list().size())
-					{
-						const UMVec4d& pixel_color = texture->list()[pixel];
-						parameter.uv = uv;
-						parameter.color.x = pixel_color.x;
-						parameter.color.y = pixel_color.y;
-						parameter.color.z = pixel_color.z;
-					}
-				}
-			}
+			shade(ray, parameter);
 			return true;
 		}
 	}
@@ -291,6 +331,104 @@ bool UMTriangle::intersects(const UMRay& ray, UMShaderParameter& parameter) cons
 	return false;
 }
 
+/**
+ * fill material, color and texture color at parameter.uvw
+ */
+void UMTriangle::shade(const UMRay& ray, UMShaderParameter& parameter) const
+{
+	if (UMMeshPtr me = mesh())
+	{
+		// 3 points
+		const UMVec3d& v0 = me->vertex_list()[vertex_index_.x];
+		const UMVec3d& v1 = me->vertex_list()[vertex_index_.y];
+		const UMVec3d& v2 = me->vertex_list()[vertex_index_.z];
+
+		if (UMMaterialPtr material = me->material_from_face_index(face_index_))
+		{
+			parameter.material = material;
+
+			const UMVec4d& diffuse = material->diffuse();
+			parameter.color.x = diffuse.x;
+			parameter.color.y = diffuse.y;
+			parameter.color.z = diffuse.z;
+			parameter.emissive = material->emissive().xyz() * material->emissive_factor();
+			if (!me->uv_list().empty() && (texture_ || !material->texture_list().empty())) {
+				// uv
+				const int base = face_index_ * 3;
+				const UMVec2d& uv0 = me->uv_list()[base + 0];
+				const UMVec2d& uv1 = me->uv_list()[base + 1];
+				const UMVec2d& uv2 = me->uv_list()[base + 2];
+				UMVec2d uv = UMVec2d(
+					uv0 * parameter.uvw.x +
+					uv1 * parameter.uvw.y +
+					uv2 * parameter.uvw.z);
+				uv.x = umbase::um_clip(uv.x);
+				uv.y = umbase::um_clip(uv.y);
+				UMImagePtr texture = material->texture_list().empty() ? UMImagePtr() : material->texture_list()[0];
+				UMVec4d pixel_color;
+				if (sample_texture(texture_, texture, ray, parameter, v0, v1, v2, uv0, uv1, uv2, uv, pixel_color))
+				{
+					parameter.uv = uv;
+					parameter.color.x = pixel_color.x;
+					parameter.color.y = pixel_color.y;
+					parameter.color.z = pixel_color.z;
+				}
+			}
+		}
+		return;
+	}
+#ifdef WITH_ALEMBIC
+	if (umabc::UMAbcMeshPtr me = abc_mesh())
+	{
+		// 3 points
+		const Imath::V3f& v0 = me->vertex()->get()[vertex_index_.x];
+		const Imath::V3f& v1 = me->vertex()->get()[vertex_index_.y];
+		const Imath::V3f& v2 = me->vertex()->get()[vertex_index_.z];
+
+		if (UMMaterialPtr material = me->material_from_face_index(face_index_))
+		{
+			parameter.material = material;
+
+			const UMVec4d& diffuse = material->diffuse();
+			parameter.color.x = diffuse.x;
+			parameter.color.y = diffuse.y;
+			parameter.color.z = diffuse.z;
+			parameter.emissive = material->emissive().xyz() * material->emissive_factor();
+			if (me->uv().getVals()->get() && (texture_ || !material->texture_list().empty())) {
+				// uv
+				const int base = face_index_ * 3;
+				const Imath::V2f& uv0 = me->uv().getVals()->get()[base + 0];
+				const Imath::V2f& uv1 = me->uv().getVals()->get()[base + 2];
+				const Imath::V2f& uv2 = me->uv().getVals()->get()[base + 1];
+				UMVec2d uv = UMVec2d(
+					UMVec2d(uv0.x, uv0.y) * parameter.uvw.x +
+					UMVec2d(uv1.x, uv1.y) * parameter.uvw.y +
+					UMVec2d(uv2.x, uv2.y) * parameter.uvw.z);
+				uv.x = umbase::um_clip(uv.x);
+				uv.y = umbase::um_clip(1.0f - uv.y);
+				const UMImagePtr texture = material->texture_list().empty() ? UMImagePtr() : material->texture_list()[0];
+				UMVec4d pixel_color;
+				// v is flipped
+				if (sample_texture(texture_, texture, ray, parameter,
+					UMVec3d(v0.x, v0.y, v0.z),
+					UMVec3d(v1.x, v1.y, v1.z),
+					UMVec3d(v2.x, v2.y, v2.z),
+					UMVec2d(uv0.x, 1.0 - uv0.y),
+					UMVec2d(uv1.x, 1.0 - uv1.y),
+					UMVec2d(uv2.x, 1.0 - uv2.y),
+					uv, pixel_color))
+				{
+					parameter.uv = uv;
+					parameter.color.x = pixel_color.x;
+					parameter.color.y = pixel_color.y;
+					parameter.color.z = pixel_color.z;
+				}
+			}
+		}
+	}
+#endif
+}
+
 /**
  * ray triangle intersection
  */
@@ -321,6 +459,90 @@ bool UMTriangle::intersects(const UMRay& ray) const
 	return false;
 }
 
+/**
+ * get 3 vertices
+ */
+bool UMTriangle::vertices(UMVec3d& v0, UMVec3d& v1, UMVec3d& v2) const
+{
+	if (UMMeshPtr me = mesh())
+	{
+		v0 = me->vertex_list()[vertex_index_.x];
+		v1 = me->vertex_list()[vertex_index_.y];
+		v2 = me->vertex_list()[vertex_index_.z];
+		return true;
+	}
+#ifdef WITH_ALEMBIC
+	else if (umabc::UMAbcMeshPtr me = abc_mesh())
+	{
+		const Imath::V3f& iv0 = me->vertex()->get()[vertex_index_.x];
+		const Imath::V3f& iv1 = me->vertex()->get()[vertex_index_.y];
+		const Imath::V3f& iv2 = me->vertex()->get()[vertex_index_.z];
+		v0 = UMVec3d(iv0.x, iv0.y, iv0.z);
+		v1 = UMVec3d(iv1.x, iv1.y, iv1.z);
+		v2 = UMVec3d(iv2.x, iv2.y, iv2.z);
+		return true;
+	}
+#endif
+	return false;
+}
+
+/**
+ * get 3 vertex normals
+ */
+bool UMTriangle::normals(UMVec3d& n0, UMVec3d& n1, UMVec3d& n2) const
+{
+	if (UMMeshPtr me = mesh())
+	{
+		n0 = me->normal_list()[vertex_index_.x];
+		n1 = me->normal_list()[vertex_index_.y];
+		n2 = me->normal_list()[vertex_index_.z];
+		return true;
+	}
+#ifdef WITH_ALEMBIC
+	else if (umabc::UMAbcMeshPtr me = abc_mesh())
+	{
+		const Imath::V3f& in0 = me->normals()[vertex_index_.x];
+		const Imath::V3f& in1 = me->normals()[vertex_index_.y];
+		const Imath::V3f& in2 = me->normals()[vertex_index_.z];
+		n0 = UMVec3d(in0.x, in0.y, in0.z);
+		n1 = UMVec3d(in1.x, in1.y, in1.z);
+		n2 = UMVec3d(in2.x, in2.y, in2.z);
+		return true;
+	}
+#endif
+	return false;
+}
+
+/**
+ * get material of this face
+ */
+UMMaterialPtr UMTriangle::material() const
+{
+	if (UMMeshPtr me = mesh())
+	{
+		return me->material_from_face_index(face_index_);
+	}
+#ifdef WITH_ALEMBIC
+	else if (umabc::UMAbcMeshPtr me = abc_mesh())
+	{
+		return me->material_from_face_index(face_index_);
+	}
+#endif
+	return UMMaterialPtr();
+}
+
+/**
+ * get emissive color of this face
+ */
+UMVec3d UMTriangle::emissive() const
+{
+	if (UMMaterialPtr mat = material())
+	{
+		return mat->emissive().xyz() * mat->emissive_factor();
+	}
+	return UMVec3d(0);
+}
+
 /**
  * update box
  */
@@ -18,6 +18,7 @@
 #include "UMPrimitive.h"
 #include "UMRay.h"
 #include "UMShaderParameter.h"
+#include "UMTexture.h"
 
 namespace umabc
 {
@@ -128,6 +129,56 @@ public:
 	 */
 	void set_face_index(const int face_index) { face_index_ = face_index; }
 
+	/**
+	 * get 3 vertices
+	 * @param [out] v0 vertex 0
+	 * @param [out] v1 vertex 1
+	 * @param [out] v2 vertex 2
+	 * @retval success or failed
+	 */
+	bool vertices(UMVec3d& v0, UMVec3d& v1, UMVec3d& v2) const;
+
+	/**
+	 * get 3 vertex normals
+	 * @param [out] n0 normal 0
+	 * @param [out] n1 normal 1
+	 * @param [out] n2 normal 2
+	 * @retval success or failed
+	 */
+	bool normals(UMVec3d& n0, UMVec3d& n1, UMVec3d& n2) const;
+
+	/**
+	 * fill material, color and texture color of a point on this face
+	 * @param [in] ray a ray
+	 * @param [in,out] parameter shading parameters. uvw and distance are used.
+	 */
+	void shade(const UMRay& ray, UMShaderParameter& parameter) const;
+
+	/**
+	 * get mesh. none for alembic mesh.
+	 */ 
+	umdraw::UMMeshPtr mesh() const { return mesh_.lock(); }
+
+	/**
+	 * get material of this face
+	 */
+	umdraw::UMMaterialPtr material() const;
+
+	/**
+	 * get emissive color of this face
+	 */
+	UMVec3d emissive() const;
+
+	/**
+	 * get mip-mapped texture of this face
+	 */
+	UMTexturePtr texture() const { return texture_; }
+
+	/**
+	 * set mip-mapped texture of this face
+	 */
+	void set_texture(UMTexturePtr texture) { texture_ = texture; }
+
 	///**
 	// * get normal
 	// */
@@ -140,17 +191,12 @@ public:
 	//void set_normal(const UMVec3d& normal) { normal_ = normal;
 	
 private:
-	/**
-	 * get mesh
-	 */ 
-	umdraw::UMMeshPtr mesh() const { return mesh_.lock(); }
 
 	/**
 	 * get abc mesh
 	 */
 	umabc::UMAbcMeshPtr abc_mesh() const { return abc_mesh_.lock(); }
 
-	umdraw::UMMeshPtr mesh() { return mesh_.lock(); }
 	umdraw::UMMeshWeakPtr mesh_;
 	
 	umabc::UMAbcMeshPtr abc_mesh() { return abc_mesh_.lock(); }
@@ -161,6 +207,8 @@ private:
 	int face_index_;
 	UMVec3i vertex_index_;
 	//UMVec3d normal_;
+
+	UMTexturePtr texture_;
 	
 	umbase::UMBox box_;
 };
@@ -65,9 +65,12 @@ public:
 	 */
 	IndexList& mutable_triangle_index_list() { return triangle_index_list_; }
 
-private:
-	umdraw::UMMeshPtr mesh() { return mesh_.lock(); }
+	/**
+	 * get mesh
+	 */
 	umdraw::UMMeshPtr mesh() const { return mesh_.lock(); }
+
+private:
 	umdraw::UMMeshWeakPtr mesh_;
 	
 	umabc::UMAbcMeshPtr abc_mesh() { return abc_mesh_.lock(); }